@@ -27,17 +27,36 @@
 #import <QuartzCore/QuartzCore.h>
 
 /**
- Create a CGPDFDocumentRef from the PDF file at the given URL.
+ Get an unlocked CGPDFDocumentRef for the PDF file at the given URL. Documents are opened and unlocked once, and shared with every caller that opens the same file with the same password, until the file changes or memory is needed.
  
  @param url      The URL of the PDF file to load.
  @param password The password to unlock the file if necessary.
  
- @return A CGPDFDocumentRef.
+ @return A CGPDFDocumentRef, that must be released by the caller. NULL if the file could not be opened or unlocked.
  */
 CGPDFDocumentRef CGPDFDocumentCreate(NSURL *url, NSString *password);
 
 /**
- Wether or not the given password will unlock the PDF file at the given URL.
+ Open and unlock the PDF file at the given URL, without using or updating the shared documents.
+ 
+ @param url      The URL of the PDF file to load.
+ @param password The password to unlock the file if necessary.
+ 
+ @return A CGPDFDocumentRef, that must be released by the caller. NULL if the file could not be opened or unlocked.
+ */
+CGPDFDocumentRef CGPDFDocumentCreateUnshared(NSURL *url, NSString *password);
+
+/**
+ The fingerprint of a document opened with CGPDFDocumentCreate or CGPDFDocumentCreateUnshared, see PDFKDocument. It changes when the file changes. A file without a file identifier is fingerprinted from its size and both ends, rather than from all of its contents.
+ 
+ @param documentRef The document.
+ 
+ @return The fingerprint, or nil if the document was not opened by these functions.
+ */
+NSString *CGPDFDocumentGetFingerprint(CGPDFDocumentRef documentRef);
+
+/**
+ Wether or not the given password will unlock the PDF file at the given URL. Documents that are not encrypted, or that unlock with a blank password, can always be unlocked. A successful unlock is kept as a shared document, so opening the file afterwards does not unlock it again.
  
  @param url      The URL of the PDF file to check.
  @param password The password to attempt to unlock the PDF file with.
@@ -45,3 +64,17 @@ CGPDFDocumentRef CGPDFDocumentCreate(NSURL *url, NSString *password);
  @return YES if the password unlocks the document. NO otherwise.
  */
 BOOL CGPDFDocumentCanBeUnlockedWithPassword(NSURL *url, NSString *password);
+
+/**
+ Open and unlock the PDF file at the given URL in the background. The unlocked document is kept as a shared document for CGPDFDocumentCreate.
+ 
+ @param url        The URL of the PDF file to load.
+ @param password   The password to unlock the file if necessary.
+ @param completion Called on the main thread with wether or not the document was unlocked.
+ */
+void CGPDFDocumentUnlockInBackground(NSURL *url, NSString *password, void (^completion)(BOOL unlocked));
+
+/**
+ Release all the shared documents. Documents still in use by a caller stay open until they are released.
+ */
+void CGPDFDocumentRemoveSharedDocuments(void);
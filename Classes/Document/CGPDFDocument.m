@@ -24,8 +24,78 @@
 //
 
 #import "CGPDFDocument.h"
+#import "PDFKDocument.h"
+#import "PDFKResourceGovernor.h"
 
-CGPDFDocumentRef CGPDFDocumentCreate(NSURL *url, NSString *password)
+//The number of unlocked documents to keep open
+#define MAXIMUM_SHARED_DOCUMENTS 6
+
+/**
+ Unlock the document with the given password, trying a blank password first, per Apple's Quartz PDF example.
+ */
+static BOOL CGPDFDocumentUnlock(CGPDFDocumentRef docRef, NSString *password)
+{
+    //Is the document password protected?
+	if (CGPDFDocumentIsEncrypted(docRef) == FALSE || CGPDFDocumentIsUnlocked(docRef) == TRUE) {
+        return YES;
+    }
+    
+	if (CGPDFDocumentUnlockWithPassword(docRef, "") == TRUE) {
+        return YES;
+    }
+    
+    //Nope, now let's try the provided password to unlock the PDF. The full UTF-8 string is used, it is not truncated.
+	if ((password != nil) && ([password length] > 0)) {
+        const char *text = [password UTF8String];
+		if (text != NULL && CGPDFDocumentUnlockWithPassword(docRef, text) == TRUE) {
+            return YES;
+        }
+    }
+    
+    return (CGPDFDocumentIsUnlocked(docRef) == TRUE);
+}
+
+#pragma mark Fingerprints
+
+/**
+ The fingerprints of the opened documents, by document. The entry of a closed document is replaced when the next document opened has the same address.
+ */
+static NSMapTable *CGPDFDocumentFingerprints(void)
+{
+    static dispatch_once_t predicate = 0;
+    static NSMapTable *fingerprints = nil;
+    dispatch_once(&predicate, ^{
+        fingerprints = [[NSMapTable alloc] initWithKeyOptions:(NSPointerFunctionsOpaqueMemory | NSPointerFunctionsOpaquePersonality) valueOptions:NSPointerFunctionsStrongMemory capacity:0];
+    });
+    return fingerprints;
+}
+
+static void CGPDFDocumentSetFingerprint(CGPDFDocumentRef docRef, NSURL *url)
+{
+    unsigned long long fileSize = [[[NSFileManager new] attributesOfItemAtPath:url.path error:NULL] fileSize];
+    NSString *fingerprint = [PDFKDocument fingerprintForDocument:docRef fileSize:fileSize];
+    if (fingerprint == nil) {
+        fingerprint = [PDFKDocument provisionalFingerprintForFileAtURL:url fileSize:fileSize];
+    }
+    
+    NSMapTable *fingerprints = CGPDFDocumentFingerprints();
+    @synchronized(fingerprints) {
+        [fingerprints setObject:fingerprint forKey:(__bridge id)docRef];
+    }
+}
+
+NSString *CGPDFDocumentGetFingerprint(CGPDFDocumentRef documentRef)
+{
+    if (documentRef == NULL) {
+        return nil;
+    }
+    NSMapTable *fingerprints = CGPDFDocumentFingerprints();
+    @synchronized(fingerprints) {
+        return [fingerprints objectForKey:(__bridge id)documentRef];
+    }
+}
+
+CGPDFDocumentRef CGPDFDocumentCreateUnshared(NSURL *url, NSString *password)
 {
 	CGPDFDocumentRef docRef = NULL;
     
@@ -35,33 +105,15 @@ CGPDFDocumentRef CGPDFDocumentCreate(NSURL *url, NSString *password)
         
         //Did the document load?
 		if (docRef != NULL) {
-            
-            //Is the document password protected?
-			if (CGPDFDocumentIsEncrypted(docRef) == TRUE) {
-                
-				//Try a blank password first, per Apple's Quartz PDF example.
-				if (CGPDFDocumentUnlockWithPassword(docRef, "") == FALSE) {
-                    
-					//Nope, now let's try the provided password to unlock the PDF
-					if ((password != nil) && ([password length] > 0)) {
-                        
-						char text[128]; // char array buffer for the string conversion
-						[password getCString:text maxLength:126 encoding:NSUTF8StringEncoding];
-                        
-                        //If we can't unlock the document.
-						if (CGPDFDocumentUnlockWithPassword(docRef, text) == FALSE) // Log failure
-						{
-                            #ifdef DEBUG
-                            NSLog(@"CGPDFDocumentCreate: Unable to unlock [%@] with [%@]", url, password);
-                            #endif
-						}
-					}
-				}
-                //Failed to unlock the document. Cleanup.
-				if (CGPDFDocumentIsUnlocked(docRef) == FALSE) {
-					CGPDFDocumentRelease(docRef), docRef = NULL;
-				}
-			}
+            //Failed to unlock the document. Cleanup.
+			if (CGPDFDocumentUnlock(docRef, password) == NO) {
+                #ifdef DEBUG
+                NSLog(@"CGPDFDocumentCreate: Unable to unlock [%@]", url);
+                #endif
+				CGPDFDocumentRelease(docRef), docRef = NULL;
+			} else {
+                CGPDFDocumentSetFingerprint(docRef, url);
+            }
 		} else {
             #ifdef DEBUG
             
@@ -85,45 +137,175 @@ CGPDFDocumentRef CGPDFDocumentCreate(NSURL *url, NSString *password)
 	return docRef;
 }
 
-BOOL CGPDFDocumentCanBeUnlockedWithPassword(NSURL *url, NSString *password)
+#pragma mark Shared documents
+
+/**
+ The unlocked documents, shared by all the views and thumb renderers.
+ */
+@interface PDFKSharedDocuments : NSObject <PDFKResourceConsumer>
+
++ (PDFKSharedDocuments *)sharedDocuments;
+- (CGPDFDocumentRef)copyDocumentWithURL:(NSURL *)url password:(NSString *)password CF_RETURNS_RETAINED;
+- (void)removeAllDocuments;
+
+@end
+
+@implementation PDFKSharedDocuments
 {
-	BOOL unlockable = NO;
-    //Do we have a URL
-	if (url != nil) {
-		CGPDFDocumentRef thePDFDocRef = CGPDFDocumentCreateWithURL((__bridge CFURLRef)url);
+    /**
+     The open documents, keyed by the file, its size and modification date, and the password.
+     */
+    NSMutableDictionary *documents;
+    /**
+     The file sizes of the open documents.
+     */
+    NSMutableDictionary *documentSizes;
+    /**
+     The keys of the documents, least recently used first.
+     */
+    NSMutableArray *accessOrder;
+}
+
++ (PDFKSharedDocuments *)sharedDocuments
+{
+    static dispatch_once_t predicate = 0;
+    static PDFKSharedDocuments *sharedDocuments = nil;
+    dispatch_once(&predicate, ^{
+        sharedDocuments = [self new];
+    });
+    return sharedDocuments;
+}
+
+- (id)init
+{
+    if ((self = [super init])) {
+        documents = [NSMutableDictionary new];
+        documentSizes = [NSMutableDictionary new];
+        accessOrder = [NSMutableArray new];
         
-        //Do we have a document?
-		if (thePDFDocRef != NULL)
-		{
-            //Is the document locked?
-			if (CGPDFDocumentIsEncrypted(thePDFDocRef) == TRUE) {
-                
-				// Try a blank password first, per Apple's Quartz PDF example
-				if (CGPDFDocumentUnlockWithPassword(thePDFDocRef, "") == FALSE) {
-                    
-					// Nope, now let's try the provided password to unlock the PDF
-					if ((password != nil) && ([password length] > 0)) // Not blank?
-					{
-						char text[128]; // char array buffer for the string conversion
-                        
-						[password getCString:text maxLength:126 encoding:NSUTF8StringEncoding];
-                        
-						if (CGPDFDocumentUnlockWithPassword(thePDFDocRef, text) == FALSE) {
-							unlockable = YES;
-						}
-					} else {
-						unlockable = NO;
-					}
-				}
-			}
-            
-			CGPDFDocumentRelease(thePDFDocRef); // Cleanup CGPDFDocumentRef
-		}
-	} else {
+        //Can be reopened, but unlocking is slow.
+        [[PDFKResourceGovernor sharedGovernor] registerConsumer:self category:PDFKResourceCategoryDocuments priority:PDFKResourcePriorityNormal];
+    }
+    return self;
+}
+
+- (CGPDFDocumentRef)copyDocumentWithURL:(NSURL *)url password:(NSString *)password
+{
+    if (url == nil) {
+        return CGPDFDocumentCreateUnshared(url, password);
+    }
+    
+    //A changed file is a different document
+    NSDictionary *attributes = [[NSFileManager new] attributesOfItemAtPath:url.path error:NULL];
+    if (attributes == nil) {
+        return CGPDFDocumentCreateUnshared(url, password);
+    }
+    NSArray *key = @[url.path, @([attributes fileSize]), @([[attributes fileModificationDate] timeIntervalSinceReferenceDate]), (password ?: @"")];
+    
+    //Open and unlock each document once
+    @synchronized(self) {
+        CGPDFDocumentRef docRef = (__bridge CGPDFDocumentRef)documents[key];
+        if (docRef != NULL) {
+            [accessOrder removeObject:key];
+            [accessOrder addObject:key];
+            return CGPDFDocumentRetain(docRef);
+        }
+    }
+    
+    //Open outside of the lock, so documents open in parallel.
+    CGPDFDocumentRef docRef = CGPDFDocumentCreateUnshared(url, password);
+    if (docRef == NULL) {
+        return NULL;
+    }
+    
+    @synchronized(self) {
+        //Another thread opened it first, use theirs.
+        CGPDFDocumentRef sharedRef = (__bridge CGPDFDocumentRef)documents[key];
+        if (sharedRef != NULL) {
+            CGPDFDocumentRelease(docRef);
+            [accessOrder removeObject:key];
+            [accessOrder addObject:key];
+            return CGPDFDocumentRetain(sharedRef);
+        }
+        
+        documents[key] = (__bridge id)docRef;
+        documentSizes[key] = @([attributes fileSize]);
+        [accessOrder addObject:key];
+        
+        //Close the least recently used documents
+        while (accessOrder.count > MAXIMUM_SHARED_DOCUMENTS) {
+            id oldest = accessOrder.firstObject;
+            [documents removeObjectForKey:oldest];
+            [documentSizes removeObjectForKey:oldest];
+            [accessOrder removeObjectAtIndex:0];
+        }
+        return docRef;
+    }
+}
+
+- (void)removeAllDocuments
+{
+    @synchronized(self) {
+        [documents removeAllObjects];
+        [documentSizes removeAllObjects];
+        [accessOrder removeAllObjects];
+    }
+}
+
+#pragma mark PDFKResourceConsumer
+
+- (NSUInteger)resourceBytes
+{
+    //The file size is a lower bound of what an open document holds.
+    @synchronized(self) {
+        return [[documentSizes.allValues valueForKeyPath:@"@sum.self"] unsignedIntegerValue];
+    }
+}
+
+- (NSUInteger)shedResourcesForPressure:(PDFKResourcePressure)pressure
+{
+    NSUInteger bytes = [self resourceBytes];
+    [self removeAllDocuments];
+    return bytes;
+}
+
+@end
+
+CGPDFDocumentRef CGPDFDocumentCreate(NSURL *url, NSString *password)
+{
+    return [[PDFKSharedDocuments sharedDocuments] copyDocumentWithURL:url password:password];
+}
+
+BOOL CGPDFDocumentCanBeUnlockedWithPassword(NSURL *url, NSString *password)
+{
+    if (url == nil) {
         #ifdef DEBUG
         NSLog(@"CGPDFDocumentCanBeUnlockedWithPassword: No URL Provided");
         #endif
-	}
+        return NO;
+    }
+    
+    //Unlocking keeps the document open, ready for use.
+    CGPDFDocumentRef docRef = CGPDFDocumentCreate(url, password);
+    BOOL unlockable = (docRef != NULL);
+    CGPDFDocumentRelease(docRef);
     
 	return unlockable;
 }
+
+void CGPDFDocumentUnlockInBackground(NSURL *url, NSString *password, void (^completion)(BOOL unlocked))
+{
+    dispatch_async(dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_DEFAULT, 0), ^{
+        BOOL unlocked = CGPDFDocumentCanBeUnlockedWithPassword(url, password);
+        if (completion != nil) {
+            dispatch_async(dispatch_get_main_queue(), ^{
+                completion(unlocked);
+            });
+        }
+    });
+}
+
+void CGPDFDocumentRemoveSharedDocuments(void)
+{
+    [[PDFKSharedDocuments sharedDocuments] removeAllDocuments];
+}
@@ -25,6 +25,8 @@
 
 #import <Foundation/Foundation.h>
 #import <UIKit/UIKit.h>
+#import "PDFKPageSet.h"
+#import "PDFKNavigationModel.h"
 
 /**
  A object that represents a single PDF File.
@@ -39,7 +41,23 @@
 /**
  The set of numbers defining the bookmarked pages.
  */
-@property (nonatomic, strong, readonly) NSMutableIndexSet *bookmarks;
+@property (nonatomic, strong, readonly) PDFKPageSet *bookmarks;
+/**
+ The set of pages that have been displaied.
+ */
+@property (nonatomic, strong, readonly) PDFKPageSet *readPages;
+/**
+ The set of pages that the user has highlighted.
+ */
+@property (nonatomic, strong, readonly) PDFKPageSet *highlightedPages;
+/**
+ The set of pages that match the current search. This is not archived. It is updated on the main thread when a search completes.
+ */
+@property (nonatomic, strong, readonly) PDFKPageSet *searchResultPages;
+/**
+ The moves between pages of the document, recorded when the current page changes. Used to get the likely next pages ready.
+ */
+@property (nonatomic, strong, readonly) PDFKNavigationModel *navigationModel;
 /**
  The password to open the PDF file if necessary.
  */
@@ -52,6 +70,12 @@
  The globally unique identifier for the PDF document.
  */
 @property (nonatomic, strong, readonly) NSString *guid;
+/**
+ An identifier derived from the file identifier and the size of the PDF file, or from the contents of the PDF file if it has no identifier. Copies of the same file have the same fingerprint, so it is used as the key of the thumb cache, and copies share their thumbs. The fingerprint changes when the document is updated.
+ 
+ @note The contents of a file without an identifier are hashed in the background when the document is loaded on the main thread. Until then the fingerprint is derived from the ends of the file, and it changes once the hash is ready.
+ */
+@property (nonatomic, strong, readonly) NSString *fingerprint;
 /**
  The last time the PDF file was opened.
  */
@@ -133,6 +157,26 @@
  @return A new PDFKDocument.
  */
 - (id)initWithContentsOfFile:(NSString *)filePath password:(NSString *)password;
+
+/**@name Fingerprints*/
+/**
+ The fingerprint of a version of a PDF file, from both halves of its file identifier and its size.
+ 
+ @param documentRef The document.
+ @param fileSize    The size of the PDF file in bytes.
+ 
+ @return The fingerprint, or nil if the document has no file identifier.
+ */
++ (NSString *)fingerprintForDocument:(CGPDFDocumentRef)documentRef fileSize:(unsigned long long)fileSize;
+/**
+ A fingerprint from the size and both ends of a PDF file, so the whole file does not have to be read.
+ 
+ @param fileURL  The URL of the PDF file.
+ @param fileSize The size of the PDF file in bytes.
+ 
+ @return The fingerprint.
+ */
++ (NSString *)provisionalFingerprintForFileAtURL:(NSURL *)fileURL fileSize:(unsigned long long)fileSize;
 /**
  Save the document information to the archive.
  */
@@ -141,5 +185,24 @@
  Reload the document properties from the PDF file.
  */
 - (void)updateProperties;
+/**
+ Write the bookmarks and highlighted pages into the PDF file, so they stay with the file when it is copied to another device. Only the changes are appended to the file. The document properties are reloaded and the document information is saved to the archive afterwards.
+ 
+ @return YES if the file was updated. Encrypted files can not be updated.
+ */
+- (BOOL)saveUserStateToFile;
+
+/**@name Search*/
+/**
+ Search the text of the pages in the background. Case and diacritics are ignored. Starting a search cancels the previous one.
+ 
+ @param text       The text to search for.
+ @param completion Called on the main thread with the matching pages, after the search result pages are updated. The pages are empty if the document can not be opened. Not called if the search is cancelled.
+ */
+- (void)searchForText:(NSString *)text completion:(void (^)(PDFKPageSet *pages))completion;
+/**
+ Cancel the current search. The search result pages are left as they are.
+ */
+- (void)cancelSearch;
 
 @end
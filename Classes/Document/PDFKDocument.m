@@ -27,6 +27,14 @@
 #import <CommonCrypto/CommonCrypto.h>
 #import "PDFKDocument.h"
 #import "CGPDFDocument.h"
+#import "PDFKDocumentMetadata.h"
+#import "PDFKIncrementalWriter.h"
+#import "PDFKTextExtractor.h"
+#import "PDFKThumbCache.h"
+#import <libkern/OSAtomic.h>
+
+//The number of bytes hashed from each end of the file for a provisional fingerprint
+#define PROVISIONAL_SAMPLE_LENGTH 65536
 
 static inline NSString *NSStringCCHashFunction(unsigned char *(function)(const void *data, CC_LONG len, unsigned char *md), CC_LONG digestLength, NSString *string)
 {
@@ -46,6 +54,24 @@ static inline NSString *NSStringCCHashFunction(unsigned char *(function)(const v
 }
 
 @implementation PDFKDocument
+{
+    /**
+     The metadata of the document, decoded when it is first read.
+     */
+    PDFKDocumentMetadata *_metadata;
+    /**
+     The modification date of the file when the document information was loaded.
+     */
+    NSDate *_fileModificationDate;
+    /**
+     Wether the fingerprint was derived from the ends of the file, and is replaced once the whole file is hashed.
+     */
+    BOOL _provisionalFingerprint;
+    /**
+     Counts the searches started, a search stops when a newer one starts.
+     */
+    volatile int64_t _searchGeneration;
+}
 
 #pragma mark - Creation
 
@@ -76,6 +102,9 @@ static inline NSString *NSStringCCHashFunction(unsigned char *(function)(const v
 {
 	PDFKDocument *document = nil;
     
+    //Remove a partially written update, before the file is read.
+    [PDFKIncrementalWriter recoverFileAtPath:filePath];
+    
 	document = [PDFKDocument unarchiveDocumentForContentsOfFile:filePath password:password];
     
     //Unarchive failed so we create a new ReaderDocument object
@@ -88,6 +117,11 @@ static inline NSString *NSStringCCHashFunction(unsigned char *(function)(const v
 
 
 - (id)initWithContentsOfFile:(NSString *)filePath password:(NSString *)password
+{
+	return [self initWithContentsOfFile:filePath password:password saveArchive:YES];
+}
+
+- (id)initWithContentsOfFile:(NSString *)filePath password:(NSString *)password saveArchive:(BOOL)saveArchive
 {
 	id object = nil;
     //Does the PDF exist, and is it a PDF
@@ -96,7 +130,11 @@ static inline NSString *NSStringCCHashFunction(unsigned char *(function)(const v
             //Set the initial properties
 			_guid = [PDFKDocument GUID];
 			_password = [password copy];
-			_bookmarks = [NSMutableIndexSet new];
+			_bookmarks = [PDFKPageSet pageSet];
+			_readPages = [PDFKPageSet pageSet];
+			_highlightedPages = [PDFKPageSet pageSet];
+			_searchResultPages = [PDFKPageSet pageSet];
+			_navigationModel = [PDFKNavigationModel new];
 			_currentPage = 1;
             _fileURL = [[NSURL alloc] initFileURLWithPath:filePath isDirectory:NO];
             
@@ -104,8 +142,10 @@ static inline NSString *NSStringCCHashFunction(unsigned char *(function)(const v
             
 			_lastOpenedDate = [NSDate dateWithTimeIntervalSinceReferenceDate:0.0];
             
-            //Save the document information to the archive.
-			[self saveReaderDocument];
+            //Save the document information to the archive. Importers save in batches instead.
+			if (saveArchive) {
+				[self saveReaderDocument];
+			}
             
 			object = self;
 		}
@@ -120,15 +160,35 @@ static inline NSString *NSStringCCHashFunction(unsigned char *(function)(const v
 	{
 		_guid = [decoder decodeObjectForKey:@"FileGUID"];
 		_currentPage = ((NSNumber *)[decoder decodeObjectForKey:@"CurrentPage"]).unsignedIntegerValue;
-		_bookmarks = [decoder decodeObjectForKey:@"Bookmarks"];
+		_bookmarks = [PDFKDocument pageSetFromArchivedObject:[decoder decodeObjectForKey:@"Bookmarks"]];
+		_readPages = [PDFKDocument pageSetFromArchivedObject:[decoder decodeObjectForKey:@"ReadPages"]];
+		_highlightedPages = [PDFKDocument pageSetFromArchivedObject:[decoder decodeObjectForKey:@"HighlightedPages"]];
+		_searchResultPages = [PDFKPageSet pageSet];
+		_navigationModel = [decoder decodeObjectForKey:@"NavigationModel"];
+		if (_navigationModel == nil) _navigationModel = [PDFKNavigationModel new];
 		_lastOpenedDate = [decoder decodeObjectForKey:@"LastOpen"];
         _fileURL = [NSURL fileURLWithPath:[decoder decodeObjectForKey:@"URL"]];
 		if (_guid == nil) _guid = [PDFKDocument GUID];
-		if (_bookmarks != nil)
-			_bookmarks = [_bookmarks mutableCopy];
-		else
-			_bookmarks = [NSMutableIndexSet new];
-        [self loadDocumentInformation];
+        
+        //Use the archived document information if the file has not changed since, otherwise the document has to be opened.
+        _metadata = [decoder decodeObjectForKey:@"Metadata"];
+        _fingerprint = [decoder decodeObjectForKey:@"Fingerprint"];
+        _provisionalFingerprint = [decoder decodeBoolForKey:@"FingerprintProvisional"];
+        _fileModificationDate = [decoder decodeObjectForKey:@"FileModificationDate"];
+        _fileSize = ((NSNumber *)[decoder decodeObjectForKey:@"FileSize"]).unsignedIntegerValue;
+        _pageCount = ((NSNumber *)[decoder decodeObjectForKey:@"PageCount"]).unsignedIntegerValue;
+        _version = ((NSNumber *)[decoder decodeObjectForKey:@"Version"]).doubleValue;
+        
+        NSDictionary *fileAttributes = [[NSFileManager new] attributesOfItemAtPath:[_fileURL path] error:nil];
+        BOOL unchanged = (_metadata != nil && _fingerprint != nil && _fileModificationDate != nil && _pageCount > 0 &&
+                          ((NSNumber *)fileAttributes[NSFileSize]).unsignedIntegerValue == _fileSize &&
+                          [fileAttributes[NSFileModificationDate] isEqualToDate:_fileModificationDate]);
+        if (unchanged == NO) {
+            [self loadDocumentInformation];
+        } else if (_provisionalFingerprint) {
+            //The whole file was not hashed before the document was archived
+            [self loadFileFingerprint];
+        }
 	}
     
 	return self;
@@ -142,93 +202,209 @@ static inline NSString *NSStringCCHashFunction(unsigned char *(function)(const v
         //This shouldn't happen
         NSAssert(NO, @"CGPDFDocumentRef == NULL");
     }
-    //Load the information dictionary
-    CGPDFDictionaryRef infoDict = CGPDFDocumentGetInfo(thePDFDocRef);
-    CGPDFStringRef string;
+    //Load the metadata, the strings are decoded when they are first read.
+    _metadata = [[PDFKDocumentMetadata alloc] initWithDocumentRef:thePDFDocRef fileURL:_fileURL password:_password];
     
-    //Title
-    if (CGPDFDictionaryGetString(infoDict, "Title", &string)) {
-        CFStringRef ref = CGPDFStringCopyTextString(string);
-        if (ref != NULL) {
-            _title = (NSString *)CFBridgingRelease(ref);
-        }
+    //Version
+    int majorVersion, minorVersion;
+    CGPDFDocumentGetVersion(thePDFDocRef, &majorVersion, &minorVersion);
+    CGFloat divisor = 10.0;
+    while (minorVersion >= divisor) {
+        divisor *= 10.0;
     }
+    _version = majorVersion + (minorVersion / divisor);
+
+    //Page Count
+    _pageCount = CGPDFDocumentGetNumberOfPages(thePDFDocRef);
     
-    //Author
-    if (CGPDFDictionaryGetString(infoDict, "Author", &string)) {
-        CFStringRef ref = CGPDFStringCopyTextString(string);
-        if (ref != NULL) {
-            _author = (NSString *)CFBridgingRelease(ref);
-        }
-    }
+    //File Size
+    NSFileManager *fileManager = [NSFileManager new];
+    NSDictionary *fileAttributes = [fileManager attributesOfItemAtPath:[_fileURL path] error:nil];
+    _fileSize = ((NSNumber *)[fileAttributes objectForKey:NSFileSize]).unsignedIntegerValue; // File size (bytes)
+    _fileModificationDate = [fileAttributes objectForKey:NSFileModificationDate];
     
-    //Subject
-    if (CGPDFDictionaryGetString(infoDict, "Subject", &string)) {
-        CFStringRef ref = CGPDFStringCopyTextString(string);
-        if (ref != NULL) {
-            _subject = (NSString *)CFBridgingRelease(ref);
+    //Fingerprint, from the file identifier or the contents of the file
+    _fingerprint = [PDFKDocument fingerprintForDocument:thePDFDocRef fileSize:_fileSize];
+    _provisionalFingerprint = NO;
+    if (_fingerprint == nil) {
+        if ([NSThread isMainThread]) {
+            //Hashing the whole file would block the main thread, use the ends of the file until the hash is ready.
+            _fingerprint = [PDFKDocument provisionalFingerprintForFileAtURL:_fileURL fileSize:_fileSize];
+            _provisionalFingerprint = YES;
+            [self loadFileFingerprint];
+        } else {
+            _fingerprint = [PDFKDocument fingerprintForFileAtURL:_fileURL];
         }
     }
     
-    //Keywords
-    if (CGPDFDictionaryGetString(infoDict, "Keywords", &string)) {
-        CFStringRef ref = CGPDFStringCopyTextString(string);
-        if (ref != NULL) {
-            _keywords = (NSString *)CFBridgingRelease(ref);
-        }
+    //Cleanup
+    CGPDFDocumentRelease(thePDFDocRef);
+}
+
+/**
+ Replace the provisional fingerprint with the hash of the whole file. The file is hashed in the background when called on the main thread.
+ */
+- (void)loadFileFingerprint
+{
+    NSURL *fileURL = _fileURL;
+    NSString *provisionalFingerprint = _fingerprint;
+    if ([NSThread isMainThread] == NO) {
+        [self replaceProvisionalFingerprint:provisionalFingerprint withFingerprint:[PDFKDocument fingerprintForFileAtURL:fileURL]];
+        return;
     }
     
-    //Creator
-    if (CGPDFDictionaryGetString(infoDict, "Creator", &string)) {
-        CFStringRef ref = CGPDFStringCopyTextString(string);
-        if (ref != NULL) {
-            _creator = (NSString *)CFBridgingRelease(ref);
-        }
+    NSDate *fileModificationDate = _fileModificationDate;
+    dispatch_async(dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_LOW, 0), ^{
+        NSString *fingerprint = [PDFKDocument fingerprintForFileAtURL:fileURL];
+        dispatch_async(dispatch_get_main_queue(), ^{
+            //The file may have changed, or been loaded again, while it was hashed
+            if (fingerprint == nil || [self->_fingerprint isEqualToString:provisionalFingerprint] == NO || [self->_fileModificationDate isEqualToDate:fileModificationDate] == NO) {
+                return;
+            }
+            [self replaceProvisionalFingerprint:provisionalFingerprint withFingerprint:fingerprint];
+            [self saveReaderDocument];
+        });
+    });
+}
+
+- (void)replaceProvisionalFingerprint:(NSString *)provisionalFingerprint withFingerprint:(NSString *)fingerprint
+{
+    if (fingerprint == nil) {
+        return;
     }
+    [self willChangeValueForKey:@"fingerprint"];
+    _fingerprint = fingerprint;
+    _provisionalFingerprint = NO;
+    [self didChangeValueForKey:@"fingerprint"];
     
-    //Producer
-    if (CGPDFDictionaryGetString(infoDict, "Producer", &string)) {
-        CFStringRef ref = CGPDFStringCopyTextString(string);
-        if (ref != NULL) {
-            _producer = (NSString *)CFBridgingRelease(ref);
-        }
+    //The thumbs cached with the provisional fingerprint are not found again
+    [PDFKThumbCache removeThumbCacheWithGUID:provisionalFingerprint];
+}
+
+#pragma mark - Metadata
+
+- (NSString *)title
+{
+    return _metadata.title;
+}
+
+- (NSString *)author
+{
+    return _metadata.author;
+}
+
+- (NSString *)subject
+{
+    return _metadata.subject;
+}
+
+- (NSString *)keywords
+{
+    return _metadata.keywords;
+}
+
+- (NSString *)creator
+{
+    return _metadata.creator;
+}
+
+- (NSString *)producer
+{
+    return _metadata.producer;
+}
+
+- (NSDate *)modificationDate
+{
+    return _metadata.modificationDate;
+}
+
+- (NSDate *)creationDate
+{
+    return _metadata.creationDate;
+}
+
+- (void)setPassword:(NSString *)password
+{
+    //Unarchived documents are given their password after they are decoded.
+    _password = [password copy];
+    _metadata.password = _password;
+}
+
+#pragma mark - Helper Methods
+
++ (PDFKPageSet *)pageSetFromArchivedObject:(id)object
+{
+    //Older archives stored the bookmarks as an NSIndexSet.
+    if ([object isKindOfClass:[PDFKPageSet class]]) {
+        return object;
+    } else if ([object isKindOfClass:[NSIndexSet class]]) {
+        return [PDFKPageSet pageSetWithIndexSet:object];
     }
-    
-    //CreationDate
-    if (CGPDFDictionaryGetString(infoDict, "CreationDate", &string)) {
-        CFDateRef date = CGPDFStringCopyDate(string);
-        if (date != NULL) {
-            _creationDate = (NSDate *)CFBridgingRelease(date);
-        }
+    return [PDFKPageSet pageSet];
+}
+
++ (NSString *)fingerprintForDocument:(CGPDFDocumentRef)documentRef fileSize:(unsigned long long)fileSize
+{
+    //The first half of the file identifier stays the same when the document is updated, so both halves and the size identify this version of the file.
+    CGPDFArrayRef identifier = CGPDFDocumentGetID(documentRef);
+    if (identifier == NULL) {
+        return nil;
     }
-    
-    //ModificationDate
-    if (CGPDFDictionaryGetString(infoDict, "ModDate", &string)) {
-        CFDateRef date = CGPDFStringCopyDate(string);
-        if (date != NULL) {
-            _modificationDate = (NSDate *)CFBridgingRelease(date);
+    NSMutableData *data = [NSMutableData dataWithBytes:&fileSize length:sizeof(fileSize)];
+    NSUInteger sizeLength = data.length;
+    for (size_t index = 0; index < MIN(CGPDFArrayGetCount(identifier), (size_t)2); index++) {
+        CGPDFStringRef string = NULL;
+        if (CGPDFArrayGetString(identifier, index, &string) && string != NULL) {
+            [data appendBytes:CGPDFStringGetBytePtr(string) length:CGPDFStringGetLength(string)];
         }
     }
-    
-    //Version
-    int majorVersion, minorVersion;
-    CGPDFDocumentGetVersion(thePDFDocRef, &majorVersion, &minorVersion);
-    NSString *versionString = [NSString stringWithFormat:@"%d.%d", majorVersion, minorVersion];
-    _version = versionString.floatValue;
+    if (data.length == sizeLength) {
+        return nil;
+    }
+    return [PDFKDocument fingerprintForData:data];
+}
 
-    //Page Count
-    _pageCount = CGPDFDocumentGetNumberOfPages(thePDFDocRef);
++ (NSString *)fingerprintForFileAtURL:(NSURL *)fileURL
+{
+    NSData *data = [NSData dataWithContentsOfURL:fileURL options:NSDataReadingMappedIfSafe error:NULL];
+    if (data == nil) {
+        return nil;
+    }
+    return [PDFKDocument fingerprintForData:data];
+}
+
++ (NSString *)provisionalFingerprintForFileAtURL:(NSURL *)fileURL fileSize:(unsigned long long)fileSize
+{
+    //The size and both ends of the file, the trailer and the last update are at the end.
+    NSData *data = [NSData dataWithContentsOfURL:fileURL options:NSDataReadingMappedIfSafe error:NULL];
+    NSUInteger sampleLength = MIN((NSUInteger)PROVISIONAL_SAMPLE_LENGTH, data.length);
+    NSMutableData *sample = [NSMutableData dataWithBytes:&fileSize length:sizeof(fileSize)];
+    [sample appendData:[data subdataWithRange:NSMakeRange(0, sampleLength)]];
+    [sample appendData:[data subdataWithRange:NSMakeRange(data.length - sampleLength, sampleLength)]];
+    return [PDFKDocument fingerprintForData:sample];
+}
+
++ (NSString *)fingerprintForData:(NSData *)data
+{
+    CC_SHA256_CTX context;
+    CC_SHA256_Init(&context);
+    const uint8_t *bytes = data.bytes;
+    NSUInteger length = data.length;
+    for (NSUInteger offset = 0; offset < length; offset += 1048576) {
+        NSUInteger chunk = MIN((NSUInteger)1048576, length - offset);
+        CC_SHA256_Update(&context, (bytes + offset), (CC_LONG)chunk);
+    }
     
-    //File Size
-    NSFileManager *fileManager = [NSFileManager new];
-    NSDictionary *fileAttributes = [fileManager attributesOfItemAtPath:[_fileURL path] error:nil];
-    _fileSize = ((NSNumber *)[fileAttributes objectForKey:NSFileSize]).unsignedIntegerValue; // File size (bytes)
+    uint8_t digest[CC_SHA256_DIGEST_LENGTH];
+    CC_SHA256_Final(digest, &context);
     
-    //Cleanup
-    CGPDFDocumentRelease(thePDFDocRef);
+    NSMutableString *output = [NSMutableString stringWithCapacity:CC_SHA256_DIGEST_LENGTH * 2];
+    for (int i = 0; i < CC_SHA256_DIGEST_LENGTH; i++) {
+        [output appendFormat:@"%02x", digest[i]];
+    }
+    return output;
 }
 
-#pragma mark - Helper Methods
 + (NSString *)GUID
 {
     //Create a globally unique string.
@@ -305,6 +481,65 @@ static inline NSString *NSStringCCHashFunction(unsigned char *(function)(const v
 	[self loadDocumentInformation];
 }
 
+- (BOOL)saveUserStateToFile
+{
+    PDFKIncrementalWriter *writer = [[PDFKIncrementalWriter alloc] initWithFilePath:_fileURL.path];
+    if ([writer writeBookmarks:_bookmarks highlightedPages:_highlightedPages] == NO) {
+        return NO;
+    }
+    //The size and identifier of the file changed
+    [self updateProperties];
+    [self saveReaderDocument];
+    return YES;
+}
+
+#pragma mark - Search
+
+- (void)searchForText:(NSString *)text completion:(void (^)(PDFKPageSet *pages))completion
+{
+    int64_t generation = OSAtomicIncrement64Barrier(&_searchGeneration);
+    NSURL *fileURL = _fileURL;
+    NSString *password = _password;
+    NSUInteger pageCount = _pageCount;
+    dispatch_async(dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_DEFAULT, 0), ^{
+        PDFKPageSet *pages = [PDFKPageSet pageSet];
+        //A document that can not be opened has no matching pages
+        CGPDFDocumentRef docRef = CGPDFDocumentCreate(fileURL, password);
+        PDFKTextExtractor *extractor = nil;
+        if (docRef != NULL) {
+            extractor = [[PDFKTextExtractor alloc] initWithDocument:docRef];
+            CGPDFDocumentRelease(docRef);
+        }
+        for (NSUInteger page = 1; extractor != nil && page <= pageCount; page++) {
+            @autoreleasepool {
+                if (OSAtomicAdd64Barrier(0, &self->_searchGeneration) != generation) {
+                    return;
+                }
+                NSString *pageText = [extractor textOfPage:page];
+                if ([pageText rangeOfString:text options:(NSCaseInsensitiveSearch | NSDiacriticInsensitiveSearch)].location != NSNotFound) {
+                    [pages addIndex:page];
+                }
+            }
+        }
+        dispatch_async(dispatch_get_main_queue(), ^{
+            //A newer search may have started while this one finished
+            if (OSAtomicAdd64Barrier(0, &self->_searchGeneration) != generation) {
+                return;
+            }
+            [self->_searchResultPages removeAllIndexes];
+            [self->_searchResultPages unionPageSet:pages];
+            if (completion != nil) {
+                completion(pages);
+            }
+        });
+    });
+}
+
+- (void)cancelSearch
+{
+    OSAtomicIncrement64Barrier(&_searchGeneration);
+}
+
 - (void)setCurrentPage:(NSUInteger)currentPage
 {
     if (currentPage < 1) {
@@ -312,7 +547,11 @@ static inline NSString *NSStringCCHashFunction(unsigned char *(function)(const v
     } else if (currentPage > _pageCount) {
         currentPage = _pageCount;
     }
+    if (currentPage != _currentPage) {
+        [_navigationModel recordTransitionFromPage:_currentPage toPage:currentPage];
+    }
     _currentPage = currentPage;
+    [_readPages addIndex:currentPage];
 }
 
 #pragma mark NSCoding protocol methods
@@ -322,8 +561,18 @@ static inline NSString *NSStringCCHashFunction(unsigned char *(function)(const v
 	[encoder encodeObject:_guid forKey:@"FileGUID"];
 	[encoder encodeObject:[NSNumber numberWithUnsignedInteger:_currentPage] forKey:@"CurrentPage"];
 	[encoder encodeObject:_bookmarks forKey:@"Bookmarks"];
+	[encoder encodeObject:_readPages forKey:@"ReadPages"];
+	[encoder encodeObject:_highlightedPages forKey:@"HighlightedPages"];
+	[encoder encodeObject:_navigationModel forKey:@"NavigationModel"];
 	[encoder encodeObject:_lastOpenedDate forKey:@"LastOpen"];
     [encoder encodeObject:[_fileURL path] forKey:@"URL"];
+    [encoder encodeObject:_metadata forKey:@"Metadata"];
+    [encoder encodeObject:_fingerprint forKey:@"Fingerprint"];
+    [encoder encodeBool:_provisionalFingerprint forKey:@"FingerprintProvisional"];
+    [encoder encodeObject:_fileModificationDate forKey:@"FileModificationDate"];
+    [encoder encodeObject:[NSNumber numberWithUnsignedInteger:_fileSize] forKey:@"FileSize"];
+    [encoder encodeObject:[NSNumber numberWithUnsignedInteger:_pageCount] forKey:@"PageCount"];
+    [encoder encodeObject:[NSNumber numberWithDouble:_version] forKey:@"Version"];
 }
 
 
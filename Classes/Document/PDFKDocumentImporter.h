@@ -0,0 +1,66 @@
+/*
+ //  PDFKDocumentImporter.h
+ //  M13PDFKit
+ //
+ Copyright (c) 2014 Brandon McQuilkin
+ 
+ Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated documentation files (the
+ "Software"), to deal in the Software without restriction, including without limitation the rights to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software, and to permit persons to whom the Software is furnished to do so, subject to
+ the following conditions:
+ 
+ The above copyright notice and this permission notice shall be included in all copies or substantial portions of the Software.
+ 
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#import <Foundation/Foundation.h>
+
+@class PDFKDocument;
+
+/**
+ Imports many PDF files at once. The files are opened and their information read on several threads, the documents are streamed back in batches, and their archives are written in batches off the calling thread. Files with the same content fingerprint are only imported once.
+ */
+@interface PDFKDocumentImporter : NSObject
+
+/**
+ Find the files in a directory and its subdirectories that may be PDF files, by their extension.
+ 
+ @param directoryPath The directory to search.
+ 
+ @return The paths of the files.
+ */
++ (NSArray *)PDFFilePathsInDirectory:(NSString *)directoryPath;
+/**
+ Create an importer for the given files.
+ 
+ @param filePaths The paths of the files to import.
+ @param password  The password to unlock the files with, if necessary. May be nil.
+ 
+ @return A new importer.
+ */
+- (id)initWithFilePaths:(NSArray *)filePaths password:(NSString *)password;
+/**
+ The number of files imported at once. Defaults to the number of active processors.
+ */
+@property (nonatomic, assign) NSUInteger maximumConcurrentImports;
+/**
+ The number of documents returned to the progress block, and archived, at a time. Defaults to 64.
+ */
+@property (nonatomic, assign) NSUInteger batchSize;
+/**
+ Start importing. Can only be called once.
+ 
+ @param progress   Called on the main thread with each batch of imported documents, and the number of files processed so far. May be nil.
+ @param completion Called on the main thread once all the files are processed, with all the imported documents and the statistics. May be nil.
+ */
+- (void)importWithProgress:(void (^)(NSArray *documents, NSUInteger processedCount, NSUInteger totalCount))progress completion:(void (^)(NSArray *documents, NSDictionary *statistics))completion;
+/**
+ Stop importing. Files that are not yet being imported are skipped, and the completion block is still called.
+ */
+- (void)cancel;
+/**
+ The statistics of the import. The keys are "Files", "Imported", "Duplicates" (files with the same fingerprint as an imported document), "Failed" (files that are not PDFs, or could not be unlocked), "Skipped" (files not imported because of cancelling), "Elapsed" (in seconds) and "DocumentsPerSecond".
+ */
+@property (nonatomic, readonly) NSDictionary *statistics;
+
+@end
@@ -0,0 +1,277 @@
+/*
+ //  PDFKDocumentImporter.m
+ //  M13PDFKit
+ //
+ Copyright (c) 2014 Brandon McQuilkin
+ 
+ Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated documentation files (the
+ "Software"), to deal in the Software without restriction, including without limitation the rights to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software, and to permit persons to whom the Software is furnished to do so, subject to
+ the following conditions:
+ 
+ The above copyright notice and this permission notice shall be included in all copies or substantial portions of the Software.
+ 
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#import "PDFKDocumentImporter.h"
+#import "PDFKDocument.h"
+#import "CGPDFDocument.h"
+#import <QuartzCore/QuartzCore.h>
+#import <stdatomic.h>
+
+//The default number of documents in a batch
+#define DEFAULT_BATCH_SIZE 64
+
+@interface PDFKDocument (Importing)
+
++ (BOOL)isPDF:(NSString *)filePath;
+- (id)initWithContentsOfFile:(NSString *)filePath password:(NSString *)password saveArchive:(BOOL)saveArchive;
+
+@end
+
+@implementation PDFKDocumentImporter
+{
+    NSArray *filePaths;
+    NSString *password;
+    /**
+     Opens the files.
+     */
+    NSOperationQueue *importQueue;
+    /**
+     Collects the results in order, all the state below is only used on this queue.
+     */
+    dispatch_queue_t collectQueue;
+    /**
+     Writes the archives of the imported documents.
+     */
+    dispatch_queue_t archiveQueue;
+    atomic_bool cancelled;
+    BOOL started;
+    
+    void (^progressBlock)(NSArray *documents, NSUInteger processedCount, NSUInteger totalCount);
+    void (^completionBlock)(NSArray *documents, NSDictionary *statistics);
+    
+    NSMutableSet *fingerprints;
+    NSMutableArray *documents;
+    NSMutableArray *pendingDocuments;
+    NSMutableArray *pendingArchives;
+    
+    //Statistics
+    NSUInteger processedCount;
+    NSUInteger importedCount;
+    NSUInteger duplicateCount;
+    NSUInteger failedCount;
+    NSUInteger skippedCount;
+    CFTimeInterval startTime;
+    CFTimeInterval endTime;
+}
+
++ (NSArray *)PDFFilePathsInDirectory:(NSString *)directoryPath
+{
+    NSMutableArray *paths = [NSMutableArray new];
+    NSDirectoryEnumerator *enumerator = [[NSFileManager new] enumeratorAtPath:directoryPath];
+    for (NSString *file in enumerator) {
+        if ([[file pathExtension] caseInsensitiveCompare:@"pdf"] == NSOrderedSame) {
+            [paths addObject:[directoryPath stringByAppendingPathComponent:file]];
+        }
+    }
+    return paths;
+}
+
+- (id)initWithFilePaths:(NSArray *)paths password:(NSString *)phrase
+{
+    if ((self = [super init])) {
+        filePaths = [paths copy];
+        password = [phrase copy];
+        _maximumConcurrentImports = [NSProcessInfo processInfo].activeProcessorCount;
+        _batchSize = DEFAULT_BATCH_SIZE;
+        atomic_init(&cancelled, false);
+        
+        importQueue = [NSOperationQueue new];
+        [importQueue setName:@"PDFKDocumentImportQueue"];
+        collectQueue = dispatch_queue_create("PDFKDocumentImportCollectQueue", DISPATCH_QUEUE_SERIAL);
+        archiveQueue = dispatch_queue_create("PDFKDocumentImportArchiveQueue", DISPATCH_QUEUE_SERIAL);
+        
+        fingerprints = [NSMutableSet new];
+        documents = [NSMutableArray new];
+        pendingDocuments = [NSMutableArray new];
+        pendingArchives = [NSMutableArray new];
+    }
+    return self;
+}
+
+#pragma mark Importing
+
+- (void)importWithProgress:(void (^)(NSArray *, NSUInteger, NSUInteger))progress completion:(void (^)(NSArray *, NSDictionary *))completion
+{
+    NSAssert(started == NO, @"An importer can only import once.");
+    started = YES;
+    progressBlock = [progress copy];
+    completionBlock = [completion copy];
+    startTime = CACurrentMediaTime();
+    
+    if (filePaths.count == 0) {
+        dispatch_async(collectQueue, ^{
+            [self finish];
+        });
+        return;
+    }
+    
+    [importQueue setMaxConcurrentOperationCount:MAX((NSUInteger)1, _maximumConcurrentImports)];
+    NSMutableArray *operations = [NSMutableArray arrayWithCapacity:filePaths.count];
+    for (NSString *path in filePaths) {
+        NSBlockOperation *operation = [NSBlockOperation blockOperationWithBlock:^{
+            [self importFileAtPath:path];
+        }];
+        operation.qualityOfService = NSQualityOfServiceUtility;
+        [operations addObject:operation];
+    }
+    [importQueue addOperations:operations waitUntilFinished:NO];
+}
+
+- (void)cancel
+{
+    atomic_store(&cancelled, true);
+}
+
+- (void)importFileAtPath:(NSString *)path
+{
+    PDFKDocument *document = nil;
+    BOOL needsArchive = NO;
+    BOOL skipped = atomic_load(&cancelled);
+    
+    if (skipped == NO) {
+        @autoreleasepool {
+            //Only open files that are PDFs and can be unlocked. The unlocked document is shared with the document loading below.
+            if ([PDFKDocument isPDF:path] && CGPDFDocumentCanBeUnlockedWithPassword([NSURL fileURLWithPath:path], password)) {
+                document = [PDFKDocument unarchiveDocumentForContentsOfFile:path password:password];
+                if (document == nil) {
+                    document = [[PDFKDocument alloc] initWithContentsOfFile:path password:password saveArchive:NO];
+                    needsArchive = (document != nil);
+                }
+            }
+        }
+    }
+    
+    dispatch_async(collectQueue, ^{
+        [self collectDocument:document needsArchive:needsArchive skipped:skipped];
+    });
+}
+
+- (void)collectDocument:(PDFKDocument *)document needsArchive:(BOOL)needsArchive skipped:(BOOL)skipped
+{
+    processedCount++;
+    
+    if (skipped) {
+        skippedCount++;
+    } else if (document == nil) {
+        failedCount++;
+    } else if (document.fingerprint != nil && [fingerprints containsObject:document.fingerprint]) {
+        //The same content as a document that was already imported
+        duplicateCount++;
+    } else {
+        if (document.fingerprint != nil) {
+            [fingerprints addObject:document.fingerprint];
+        }
+        importedCount++;
+        [documents addObject:document];
+        [pendingDocuments addObject:document];
+        if (needsArchive) {
+            [pendingArchives addObject:document];
+        }
+    }
+    
+    BOOL finished = (processedCount == filePaths.count);
+    if (pendingArchives.count >= _batchSize || finished) {
+        [self commitArchives];
+    }
+    if (pendingDocuments.count >= _batchSize || finished) {
+        [self deliverProgress];
+    }
+    if (finished) {
+        [self finish];
+    }
+}
+
+- (void)commitArchives
+{
+    if (pendingArchives.count == 0) {
+        return;
+    }
+    NSArray *batch = pendingArchives;
+    pendingArchives = [NSMutableArray new];
+    
+    dispatch_async(archiveQueue, ^{
+        @autoreleasepool {
+            for (PDFKDocument *document in batch) {
+                [document saveReaderDocument];
+            }
+        }
+    });
+}
+
+- (void)deliverProgress
+{
+    if (pendingDocuments.count == 0 || progressBlock == nil) {
+        [pendingDocuments removeAllObjects];
+        return;
+    }
+    NSArray *batch = pendingDocuments;
+    pendingDocuments = [NSMutableArray new];
+    
+    void (^progress)(NSArray *, NSUInteger, NSUInteger) = progressBlock;
+    NSUInteger processed = processedCount;
+    NSUInteger total = filePaths.count;
+    dispatch_async(dispatch_get_main_queue(), ^{
+        progress(batch, processed, total);
+    });
+}
+
+- (void)finish
+{
+    endTime = CACurrentMediaTime();
+    
+    void (^completion)(NSArray *, NSDictionary *) = completionBlock;
+    progressBlock = nil;
+    completionBlock = nil;
+    if (completion == nil) {
+        return;
+    }
+    
+    //Complete once the archives are written
+    NSArray *imported = [documents copy];
+    NSDictionary *statistics = [self currentStatistics];
+    dispatch_async(archiveQueue, ^{
+        dispatch_async(dispatch_get_main_queue(), ^{
+            completion(imported, statistics);
+        });
+    });
+}
+
+#pragma mark Statistics
+
+- (NSDictionary *)currentStatistics
+{
+    CFTimeInterval elapsed = 0.0;
+    if (startTime > 0.0) {
+        elapsed = ((endTime > 0.0 ? endTime : CACurrentMediaTime()) - startTime);
+    }
+    return @{@"Files": @(filePaths.count),
+             @"Imported": @(importedCount),
+             @"Duplicates": @(duplicateCount),
+             @"Failed": @(failedCount),
+             @"Skipped": @(skippedCount),
+             @"Elapsed": @(elapsed),
+             @"DocumentsPerSecond": @(elapsed > 0.0 ? (processedCount - skippedCount) / elapsed : 0.0)};
+}
+
+- (NSDictionary *)statistics
+{
+    __block NSDictionary *statistics = nil;
+    dispatch_sync(collectQueue, ^{
+        statistics = [self currentStatistics];
+    });
+    return statistics;
+}
+
+@end
@@ -0,0 +1,99 @@
+/*
+ //  PDFKDocumentMetadata.h
+ //  M13PDFKit
+ //
+ Copyright (c) 2014 Brandon McQuilkin
+ 
+ Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated documentation files (the
+ "Software"), to deal in the Software without restriction, including without limitation the rights to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software, and to permit persons to whom the Software is furnished to do so, subject to
+ the following conditions:
+ 
+ The above copyright notice and this permission notice shall be included in all copies or substantial portions of the Software.
+ 
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#import <Foundation/Foundation.h>
+#import <CoreGraphics/CoreGraphics.h>
+
+/**
+ The descriptive metadata of a PDF document, from its Info dictionary, or from its XMP metadata for entries the Info dictionary does not have. The Info entries are copied as they are stored when the metadata is created, and only decoded when accessed. The XMP metadata is only read when an entry is accessed that the Info dictionary does not have.
+ */
+@interface PDFKDocumentMetadata : NSObject <NSCoding>
+
+/**
+ Read the metadata of a document.
+ 
+ @param documentRef The unlocked document.
+ @param fileURL     The URL of the document, used to reopen the document if the XMP metadata is needed.
+ @param password    The password to unlock the document with when reopening it.
+ 
+ @return The metadata of the document.
+ */
+- (id)initWithDocumentRef:(CGPDFDocumentRef)documentRef fileURL:(NSURL *)fileURL password:(NSString *)password;
+
+/**
+ The password to unlock the document with when reopening it.
+ */
+@property (nonatomic, copy) NSString *password;
+
+/**
+ The title of the document.
+ */
+@property (nonatomic, readonly) NSString *title;
+/**
+ The author of the document.
+ */
+@property (nonatomic, readonly) NSString *author;
+/**
+ The subject of the document.
+ */
+@property (nonatomic, readonly) NSString *subject;
+/**
+ Keywords decribing the document's contents.
+ */
+@property (nonatomic, readonly) NSString *keywords;
+/**
+ The application that created the original document.
+ */
+@property (nonatomic, readonly) NSString *creator;
+/**
+ The application that produced the PDF.
+ */
+@property (nonatomic, readonly) NSString *producer;
+/**
+ The date the document was created.
+ */
+@property (nonatomic, readonly) NSDate *creationDate;
+/**
+ The date the document was last modified.
+ */
+@property (nonatomic, readonly) NSDate *modificationDate;
+
+/**
+ Decode a PDF text string. Strings starting with a UTF-16BE or UTF-8 byte order mark are decoded as such, other strings as PDFDocEncoding.
+ 
+ @param bytes  The bytes of the string.
+ @param length The number of bytes.
+ 
+ @return The decoded string.
+ */
++ (NSString *)stringWithPDFTextBytes:(const uint8_t *)bytes length:(size_t)length;
+/**
+ Parse a date in the PDF format, "D:YYYYMMDDHHmmSSOHH'mm'", or in the ISO 8601 format used by XMP. All the parts after the year are optional.
+ 
+ @param string The date string.
+ 
+ @return The date, or nil if the string is not a date.
+ */
++ (NSDate *)dateWithPDFDateString:(NSString *)string;
+/**
+ Read the entries from an XMP packet. The keys are the names of the matching Info dictionary entries: "Title", "Author", "Subject", "Keywords", "Creator", "Producer", "CreationDate" and "ModDate". The values are NSStrings.
+ 
+ @param data The XMP packet.
+ 
+ @return The entries found.
+ */
++ (NSDictionary *)entriesWithXMPData:(NSData *)data;
+
+@end
@@ -0,0 +1,495 @@
+/*
+ //  PDFKDocumentMetadata.m
+ //  M13PDFKit
+ //
+ Copyright (c) 2014 Brandon McQuilkin
+ 
+ Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated documentation files (the
+ "Software"), to deal in the Software without restriction, including without limitation the rights to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software, and to permit persons to whom the Software is furnished to do so, subject to
+ the following conditions:
+ 
+ The above copyright notice and this permission notice shall be included in all copies or substantial portions of the Software.
+ 
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#import "PDFKDocumentMetadata.h"
+#import "CGPDFDocument.h"
+
+//The Info dictionary entries that are read
+static const char *const PDFKInfoKeys[] = {"Title", "Author", "Subject", "Keywords", "Creator", "Producer", "CreationDate", "ModDate"};
+#define INFO_KEY_COUNT (sizeof(PDFKInfoKeys) / sizeof(PDFKInfoKeys[0]))
+
+//The XMP namespaces the entries are in
+#define XMP_DC_NAMESPACE @"http://purl.org/dc/elements/1.1/"
+#define XMP_PDF_NAMESPACE @"http://ns.adobe.com/pdf/1.3/"
+#define XMP_BASIC_NAMESPACE @"http://ns.adobe.com/xap/1.0/"
+#define XMP_RDF_NAMESPACE @"http://www.w3.org/1999/02/22-rdf-syntax-ns#"
+
+/**
+ The characters of PDFDocEncoding that differ from ISO Latin 1, from 0x18 to 0x1F and from 0x80 to 0xA0. Undefined codes map to the replacement character.
+ */
+static const unichar PDFDocEncodingLow[8] = {
+    0x02D8, 0x02C7, 0x02C6, 0x02D9, 0x02DD, 0x02DB, 0x02DA, 0x02DC
+};
+static const unichar PDFDocEncodingHigh[33] = {
+    0x2022, 0x2020, 0x2021, 0x2026, 0x2014, 0x2013, 0x0192, 0x2044,
+    0x2039, 0x203A, 0x2212, 0x2030, 0x201E, 0x201C, 0x201D, 0x2018,
+    0x2019, 0x201A, 0x2122, 0xFB01, 0xFB02, 0x0141, 0x0152, 0x0160,
+    0x0178, 0x017D, 0x0131, 0x0142, 0x0153, 0x0161, 0x017E, 0xFFFD,
+    0x20AC
+};
+
+#pragma mark Dates
+
+/**
+ Read a number of exactly the given number of digits.
+ */
+static BOOL PDFKReadDigits(const char **cursor, const char *end, int count, int *value)
+{
+    const char *p = *cursor;
+    if (end - p < count) {
+        return NO;
+    }
+    int result = 0;
+    for (int index = 0; index < count; index++) {
+        if (p[index] < '0' || p[index] > '9') {
+            return NO;
+        }
+        result = (result * 10) + (p[index] - '0');
+    }
+    *value = result;
+    *cursor = p + count;
+    return YES;
+}
+
+/**
+ The days from 1970-01-01 to the given date in the proleptic Gregorian calendar.
+ */
+static int64_t PDFKDaysFromCivil(int64_t year, unsigned month, unsigned day)
+{
+    year -= (month <= 2);
+    int64_t era = (year >= 0 ? year : year - 399) / 400;
+    unsigned yearOfEra = (unsigned)(year - era * 400);
+    unsigned dayOfYear = (153 * (month > 2 ? month - 3 : month + 9) + 2) / 5 + day - 1;
+    unsigned dayOfEra = yearOfEra * 365 + yearOfEra / 4 - yearOfEra / 100 + dayOfYear;
+    return era * 146097 + (int64_t)dayOfEra - 719468;
+}
+
+/**
+ Parse a PDF or ISO 8601 date into seconds since 1970. Returns NO if the string is not a date.
+ */
+static BOOL PDFKParseDate(const char *p, const char *end, double *seconds)
+{
+    //Skip the PDF prefix
+    if (end - p >= 2 && p[0] == 'D' && p[1] == ':') {
+        p += 2;
+    }
+    
+    int year = 0;
+    if (PDFKReadDigits(&p, end, 4, &year) == NO) {
+        return NO;
+    }
+    
+    //Month, day, hour, minute, second. Each is optional, and ISO 8601 separates them.
+    int parts[5] = {1, 1, 0, 0, 0};
+    const char separators[5] = {'-', '-', 'T', ':', ':'};
+    for (int index = 0; index < 5; index++) {
+        const char *start = p;
+        if (p < end && *p == separators[index]) {
+            p++;
+        }
+        if (PDFKReadDigits(&p, end, 2, &parts[index]) == NO) {
+            p = start;
+            break;
+        }
+    }
+    
+    //Fractions of a second
+    double fraction = 0.0;
+    if (p < end && *p == '.') {
+        double scale = 0.1;
+        for (p++; p < end && *p >= '0' && *p <= '9'; p++, scale /= 10.0) {
+            fraction += (*p - '0') * scale;
+        }
+    }
+    
+    //Time zone, local time is treated as UTC.
+    int offset = 0;
+    if (p < end && (*p == '+' || *p == '-')) {
+        int sign = (*p == '-' ? -1 : 1);
+        int hours = 0;
+        int minutes = 0;
+        p++;
+        if (PDFKReadDigits(&p, end, 2, &hours)) {
+            if (p < end && (*p == '\'' || *p == ':')) {
+                p++;
+            }
+            PDFKReadDigits(&p, end, 2, &minutes);
+        }
+        offset = sign * ((hours * 3600) + (minutes * 60));
+    }
+    
+    if (parts[0] < 1 || parts[0] > 12 || parts[1] < 1 || parts[1] > 31 || parts[2] > 23 || parts[3] > 59 || parts[4] > 60) {
+        return NO;
+    }
+    
+    int64_t days = PDFKDaysFromCivil(year, (unsigned)parts[0], (unsigned)parts[1]);
+    *seconds = (double)(days * 86400 + parts[2] * 3600 + parts[3] * 60 + parts[4] - offset) + fraction;
+    return YES;
+}
+
+#pragma mark XMP
+
+/**
+ Collects the entries of an XMP packet. Array and alternative values use their first item.
+ */
+@interface PDFKXMPReader : NSObject <NSXMLParserDelegate>
+
+@property (nonatomic, strong) NSMutableDictionary *entries;
+
+@end
+
+@implementation PDFKXMPReader
+{
+    NSString *currentKey;
+    NSMutableString *currentText;
+    NSInteger depth;
+    BOOL firstItemRead;
+}
+
++ (NSString *)entryKeyForProperty:(NSString *)name namespace:(NSString *)namespaceURI
+{
+    static NSDictionary *keys = nil;
+    static dispatch_once_t predicate = 0;
+    dispatch_once(&predicate, ^{
+        keys = @{XMP_DC_NAMESPACE: @{@"title": @"Title", @"creator": @"Author", @"description": @"Subject"},
+                 XMP_PDF_NAMESPACE: @{@"Keywords": @"Keywords", @"Producer": @"Producer"},
+                 XMP_BASIC_NAMESPACE: @{@"CreatorTool": @"Creator", @"CreateDate": @"CreationDate", @"ModifyDate": @"ModDate"}};
+    });
+    return keys[namespaceURI][name];
+}
+
+- (id)init
+{
+    if ((self = [super init])) {
+        _entries = [NSMutableDictionary new];
+    }
+    return self;
+}
+
+- (void)parser:(NSXMLParser *)parser didStartElement:(NSString *)elementName namespaceURI:(NSString *)namespaceURI qualifiedName:(NSString *)qName attributes:(NSDictionary *)attributeDict
+{
+    if (currentKey != nil) {
+        depth++;
+        return;
+    }
+    
+    //Simple values can be attributes of the description
+    if ([elementName isEqualToString:@"Description"] && [namespaceURI isEqualToString:XMP_RDF_NAMESPACE]) {
+        for (NSString *attribute in attributeDict) {
+            NSRange colon = [attribute rangeOfString:@":"];
+            NSString *name = (colon.location != NSNotFound ? [attribute substringFromIndex:colon.location + 1] : attribute);
+            NSString *prefix = (colon.location != NSNotFound ? [attribute substringToIndex:colon.location] : nil);
+            NSString *attributeNamespace = (prefix != nil ? [self namespaceForPrefix:prefix] : nil);
+            NSString *key = [PDFKXMPReader entryKeyForProperty:name namespace:attributeNamespace];
+            if (key != nil && _entries[key] == nil) {
+                _entries[key] = attributeDict[attribute];
+            }
+        }
+        return;
+    }
+    
+    NSString *key = [PDFKXMPReader entryKeyForProperty:elementName namespace:namespaceURI];
+    if (key != nil && _entries[key] == nil) {
+        currentKey = key;
+        currentText = [NSMutableString new];
+        depth = 0;
+        firstItemRead = NO;
+    }
+}
+
+- (void)parser:(NSXMLParser *)parser foundCharacters:(NSString *)string
+{
+    if (currentKey != nil && firstItemRead == NO) {
+        [currentText appendString:string];
+    }
+}
+
+- (void)parser:(NSXMLParser *)parser didEndElement:(NSString *)elementName namespaceURI:(NSString *)namespaceURI qualifiedName:(NSString *)qName
+{
+    if (currentKey == nil) {
+        return;
+    }
+    if (depth > 0) {
+        //Only the first item of an array or alternative
+        if ([elementName isEqualToString:@"li"]) {
+            firstItemRead = YES;
+        }
+        depth--;
+        return;
+    }
+    
+    NSString *value = [currentText stringByTrimmingCharactersInSet:[NSCharacterSet whitespaceAndNewlineCharacterSet]];
+    if (value.length > 0) {
+        _entries[currentKey] = value;
+    }
+    currentKey = nil;
+    currentText = nil;
+}
+
+/**
+ The namespaces of the usual prefixes, for attributes. NSXMLParser does not report the namespaces of attributes.
+ */
+- (NSString *)namespaceForPrefix:(NSString *)prefix
+{
+    static NSDictionary *namespaces = nil;
+    static dispatch_once_t predicate = 0;
+    dispatch_once(&predicate, ^{
+        namespaces = @{@"dc": XMP_DC_NAMESPACE, @"pdf": XMP_PDF_NAMESPACE, @"xmp": XMP_BASIC_NAMESPACE, @"xap": XMP_BASIC_NAMESPACE};
+    });
+    return namespaces[prefix];
+}
+
+@end
+
+#pragma mark Metadata
+
+@implementation PDFKDocumentMetadata
+{
+    NSURL *_fileURL;
+    /**
+     The Info dictionary strings as they are stored, keyed by entry name.
+     */
+    NSDictionary *rawEntries;
+    /**
+     The decoded entries, NSNull for entries that are missing.
+     */
+    NSMutableDictionary *decodedEntries;
+    /**
+     The XMP entries, once read.
+     */
+    NSDictionary *xmpEntries;
+    /**
+     Whether or not the document has XMP metadata.
+     */
+    BOOL hasXMP;
+}
+
+- (id)initWithDocumentRef:(CGPDFDocumentRef)documentRef fileURL:(NSURL *)fileURL password:(NSString *)password
+{
+    if ((self = [super init])) {
+        _fileURL = fileURL;
+        _password = [password copy];
+        decodedEntries = [NSMutableDictionary new];
+        
+        //Copy the strings without decoding them
+        NSMutableDictionary *entries = [NSMutableDictionary new];
+        CGPDFDictionaryRef infoDict = (documentRef != NULL ? CGPDFDocumentGetInfo(documentRef) : NULL);
+        if (infoDict != NULL) {
+            for (size_t index = 0; index < INFO_KEY_COUNT; index++) {
+                CGPDFStringRef string = NULL;
+                if (CGPDFDictionaryGetString(infoDict, PDFKInfoKeys[index], &string) && string != NULL) {
+                    entries[@(PDFKInfoKeys[index])] = [NSData dataWithBytes:CGPDFStringGetBytePtr(string) length:CGPDFStringGetLength(string)];
+                }
+            }
+        }
+        rawEntries = entries;
+        
+        //Only note if there is XMP metadata, it is read if needed.
+        CGPDFDictionaryRef catalog = (documentRef != NULL ? CGPDFDocumentGetCatalog(documentRef) : NULL);
+        CGPDFStreamRef stream = NULL;
+        hasXMP = (catalog != NULL && CGPDFDictionaryGetStream(catalog, "Metadata", &stream));
+    }
+    return self;
+}
+
+#pragma mark Entries
+
+- (id)decodedEntryForKey:(NSString *)key date:(BOOL)date
+{
+    @synchronized(self) {
+        id value = decodedEntries[key];
+        if (value == nil) {
+            NSString *string = nil;
+            NSData *raw = rawEntries[key];
+            if (raw != nil) {
+                string = [PDFKDocumentMetadata stringWithPDFTextBytes:raw.bytes length:raw.length];
+            }
+            if (string.length == 0) {
+                string = [self xmpEntries][key];
+            }
+            value = (date ? [PDFKDocumentMetadata dateWithPDFDateString:string] : string);
+            decodedEntries[key] = (value ?: [NSNull null]);
+        }
+        return (value == [NSNull null] ? nil : value);
+    }
+}
+
+- (NSDictionary *)xmpEntries
+{
+    if (xmpEntries == nil) {
+        xmpEntries = @{};
+        if (hasXMP) {
+            CGPDFDocumentRef documentRef = CGPDFDocumentCreate(_fileURL, self.password);
+            CGPDFDictionaryRef catalog = (documentRef != NULL ? CGPDFDocumentGetCatalog(documentRef) : NULL);
+            CGPDFStreamRef stream = NULL;
+            if (catalog != NULL && CGPDFDictionaryGetStream(catalog, "Metadata", &stream)) {
+                CGPDFDataFormat format;
+                CFDataRef data = CGPDFStreamCopyData(stream, &format);
+                if (data != NULL) {
+                    if (format == CGPDFDataFormatRaw) {
+                        xmpEntries = [PDFKDocumentMetadata entriesWithXMPData:(__bridge NSData *)data];
+                    }
+                    CFRelease(data);
+                }
+            }
+            CGPDFDocumentRelease(documentRef);
+        }
+    }
+    return xmpEntries;
+}
+
+- (NSString *)title
+{
+    return [self decodedEntryForKey:@"Title" date:NO];
+}
+
+- (NSString *)author
+{
+    return [self decodedEntryForKey:@"Author" date:NO];
+}
+
+- (NSString *)subject
+{
+    return [self decodedEntryForKey:@"Subject" date:NO];
+}
+
+- (NSString *)keywords
+{
+    return [self decodedEntryForKey:@"Keywords" date:NO];
+}
+
+- (NSString *)creator
+{
+    return [self decodedEntryForKey:@"Creator" date:NO];
+}
+
+- (NSString *)producer
+{
+    return [self decodedEntryForKey:@"Producer" date:NO];
+}
+
+- (NSDate *)creationDate
+{
+    return [self decodedEntryForKey:@"CreationDate" date:YES];
+}
+
+- (NSDate *)modificationDate
+{
+    return [self decodedEntryForKey:@"ModDate" date:YES];
+}
+
+#pragma mark Decoding
+
++ (NSString *)stringWithPDFTextBytes:(const uint8_t *)bytes length:(size_t)length
+{
+    if (bytes == NULL || length == 0) {
+        return @"";
+    }
+    
+    //UTF-16BE, with language escapes removed
+    if (length >= 2 && bytes[0] == 0xFE && bytes[1] == 0xFF) {
+        NSString *string = [[NSString alloc] initWithBytes:(bytes + 2) length:((length - 2) & ~(size_t)1) encoding:NSUTF16BigEndianStringEncoding];
+        if ([string rangeOfString:@"\x1b"].location != NSNotFound) {
+            NSArray *parts = [string componentsSeparatedByString:@"\x1b"];
+            NSMutableString *stripped = [NSMutableString new];
+            for (NSUInteger index = 0; index < parts.count; index += 2) {
+                [stripped appendString:parts[index]];
+            }
+            string = stripped;
+        }
+        return string ?: @"";
+    }
+    
+    //UTF-8, PDF 2.0
+    if (length >= 3 && bytes[0] == 0xEF && bytes[1] == 0xBB && bytes[2] == 0xBF) {
+        return [[NSString alloc] initWithBytes:(bytes + 3) length:(length - 3) encoding:NSUTF8StringEncoding] ?: @"";
+    }
+    
+    //PDFDocEncoding
+    unichar *characters = malloc(length * sizeof(unichar));
+    if (characters == NULL) {
+        return @"";
+    }
+    for (size_t index = 0; index < length; index++) {
+        uint8_t byte = bytes[index];
+        if (byte >= 0x18 && byte <= 0x1F) {
+            characters[index] = PDFDocEncodingLow[byte - 0x18];
+        } else if (byte >= 0x80 && byte <= 0xA0) {
+            characters[index] = PDFDocEncodingHigh[byte - 0x80];
+        } else if (byte == 0xAD || byte == 0x7F) {
+            characters[index] = 0xFFFD;
+        } else {
+            characters[index] = byte;
+        }
+    }
+    return [[NSString alloc] initWithCharactersNoCopy:characters length:length freeWhenDone:YES];
+}
+
++ (NSDate *)dateWithPDFDateString:(NSString *)string
+{
+    const char *text = string.UTF8String;
+    if (text == NULL) {
+        return nil;
+    }
+    //Leading space is common
+    while (*text == ' ') {
+        text++;
+    }
+    double seconds = 0.0;
+    if (PDFKParseDate(text, text + strlen(text), &seconds) == NO) {
+        return nil;
+    }
+    return [NSDate dateWithTimeIntervalSince1970:seconds];
+}
+
++ (NSDictionary *)entriesWithXMPData:(NSData *)data
+{
+    if (data.length == 0) {
+        return @{};
+    }
+    NSXMLParser *parser = [[NSXMLParser alloc] initWithData:data];
+    parser.shouldProcessNamespaces = YES;
+    PDFKXMPReader *reader = [PDFKXMPReader new];
+    parser.delegate = reader;
+    [parser parse];
+    return [reader.entries copy];
+}
+
+#pragma mark NSCoding
+
+- (id)initWithCoder:(NSCoder *)decoder
+{
+    if ((self = [super init])) {
+        NSString *path = [decoder decodeObjectForKey:@"URL"];
+        _fileURL = (path != nil ? [NSURL fileURLWithPath:path] : nil);
+        rawEntries = [decoder decodeObjectForKey:@"InfoEntries"] ?: @{};
+        xmpEntries = [decoder decodeObjectForKey:@"XMPEntries"];
+        hasXMP = [decoder decodeBoolForKey:@"HasXMP"];
+        decodedEntries = [NSMutableDictionary new];
+    }
+    return self;
+}
+
+- (void)encodeWithCoder:(NSCoder *)encoder
+{
+    @synchronized(self) {
+        [encoder encodeObject:[_fileURL path] forKey:@"URL"];
+        [encoder encodeObject:rawEntries forKey:@"InfoEntries"];
+        [encoder encodeObject:xmpEntries forKey:@"XMPEntries"];
+        [encoder encodeBool:hasXMP forKey:@"HasXMP"];
+    }
+}
+
+@end
@@ -0,0 +1,276 @@
+/*
+ //  PDFKFileReader.h
+ //  M13PDFKit
+ //
+ Copyright (c) 2014 Brandon McQuilkin
+ 
+ Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated documentation files (the
+ "Software"), to deal in the Software without restriction, including without limitation the rights to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software, and to permit persons to whom the Software is furnished to do so, subject to
+ the following conditions:
+ 
+ The above copyright notice and this permission notice shall be included in all copies or substantial portions of the Software.
+ 
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#import <Foundation/Foundation.h>
+
+/**
+ A small reader for the structure of PDF files: the cross reference table and the syntax of objects. It is used to write changes to files, which CGPDFDocument can not do. Content streams are not parsed, and only the filters used for cross reference and object streams are decoded.
+ */
+
+#pragma mark - Buffers
+
+/**
+ A growable byte buffer. A zeroed buffer is empty.
+ */
+typedef struct {
+    uint8_t *bytes;
+    size_t length;
+    size_t capacity;
+} PDFKBuffer;
+
+/**
+ Append bytes to the buffer.
+ 
+ @param buffer The buffer to append to.
+ @param bytes  The bytes to append.
+ @param length The number of bytes.
+ 
+ @return NO if the buffer could not grow.
+ */
+BOOL PDFKBufferAppend(PDFKBuffer *buffer, const void *bytes, size_t length);
+/**
+ Append formatted text to the buffer.
+ 
+ @param buffer The buffer to append to.
+ @param format A printf format string.
+ 
+ @return NO if the buffer could not grow.
+ */
+BOOL PDFKBufferAppendFormat(PDFKBuffer *buffer, const char *format, ...) __attribute__((format(printf, 2, 3)));
+/**
+ Free the bytes of the buffer, leaving it empty.
+ 
+ @param buffer The buffer to free.
+ */
+void PDFKBufferFree(PDFKBuffer *buffer);
+
+#pragma mark - Syntax
+
+//Returned when a value could not be parsed
+#define PDFK_NOT_FOUND SIZE_MAX
+
+static inline BOOL PDFKIsWhitespace(uint8_t c)
+{
+    return (c == 0 || c == 9 || c == 10 || c == 12 || c == 13 || c == 32);
+}
+
+static inline BOOL PDFKIsDelimiter(uint8_t c)
+{
+    return (c == '(' || c == ')' || c == '<' || c == '>' || c == '[' || c == ']' || c == '{' || c == '}' || c == '/' || c == '%');
+}
+
+static inline BOOL PDFKIsRegular(uint8_t c)
+{
+    return (PDFKIsWhitespace(c) == NO && PDFKIsDelimiter(c) == NO);
+}
+
+/**
+ A reference to an indirect object.
+ */
+typedef struct {
+    uint32_t number;
+    uint16_t generation;
+} PDFKReference;
+
+/**
+ Skip whitespace and comments.
+ 
+ @return The position of the next token.
+ */
+size_t PDFKSkipSpace(const uint8_t *bytes, size_t length, size_t position);
+/**
+ Skip a run of regular characters, a number, keyword or the rest of a name.
+ 
+ @return The position after the run.
+ */
+size_t PDFKSkipRegular(const uint8_t *bytes, size_t length, size_t position);
+/**
+ Skip the value at the position. References ("12 0 R") are one value.
+ 
+ @return The position after the value, or PDFK_NOT_FOUND if it is not a complete value.
+ */
+size_t PDFKSkipValue(const uint8_t *bytes, size_t length, size_t position);
+/**
+ Parse a signed integer that fills the range.
+ 
+ @return NO if the range is not an integer.
+ */
+BOOL PDFKParseInteger(const uint8_t *bytes, size_t start, size_t end, long long *value);
+/**
+ Parse a reference that fills the range.
+ 
+ @return NO if the range is not a reference.
+ */
+BOOL PDFKParseReference(const uint8_t *bytes, size_t start, size_t end, PDFKReference *reference);
+/**
+ Find the value of a key in the dictionary that starts at the position.
+ 
+ @param key           The key, without the slash.
+ @param entryStart    Set to the start of the key. May be NULL.
+ @param valueStart    Set to the start of the value.
+ @param valueEnd      Set to the end of the value.
+ @param dictionaryEnd Set to the position of the closing ">>" if the key is not found. May be NULL.
+ 
+ @return YES if the key was found.
+ */
+BOOL PDFKDictionaryFind(const uint8_t *bytes, size_t length, size_t position, const char *key, size_t *entryStart, size_t *valueStart, size_t *valueEnd, size_t *dictionaryEnd);
+/**
+ Get a direct integer value from a dictionary.
+ */
+BOOL PDFKDictionaryGetInteger(const uint8_t *bytes, size_t length, const char *key, long long *value);
+/**
+ Get a reference value from a dictionary.
+ */
+BOOL PDFKDictionaryGetReference(const uint8_t *bytes, size_t length, const char *key, PDFKReference *reference);
+/**
+ Copy a dictionary with a key set to a new value.
+ 
+ @param value The new value as PDF syntax, or NULL to remove the key.
+ 
+ @return NO if the bytes are not a dictionary.
+ */
+BOOL PDFKDictionarySet(const uint8_t *bytes, size_t length, const char *key, const char *value, PDFKBuffer *output);
+/**
+ Set a key of the dictionary in the buffer, in place.
+ 
+ @param value The new value as PDF syntax, or NULL to remove the key.
+ 
+ @return NO if the buffer is not a dictionary.
+ */
+BOOL PDFKBufferSetDictionaryValue(PDFKBuffer *dictionary, const char *key, const char *value);
+/**
+ Step through the elements of the array at the start of the bytes.
+ 
+ @param cursor Keeps the position between calls, starts at 0.
+ @param start  Set to the start of the element.
+ @param end    Set to the end of the element.
+ 
+ @return NO once there are no more elements.
+ */
+BOOL PDFKArrayNextElement(const uint8_t *bytes, size_t length, size_t *cursor, size_t *start, size_t *end);
+
+#pragma mark - Files
+
+/**
+ An entry of the cross reference table.
+ */
+typedef struct {
+    /**
+     The offset of the object in the file, or its index in its object stream.
+     */
+    uint64_t offset;
+    /**
+     The object stream the object is in.
+     */
+    uint32_t stream;
+    uint16_t generation;
+    /**
+     0 if the object is unknown or free, 1 if it is in the file, 2 if it is in an object stream.
+     */
+    uint8_t type;
+    /**
+     1 if a section has listed the object, in use or free. Older sections do not replace it. 2 while the section being read has only listed it as free, its cross reference stream can still replace it.
+     */
+    uint8_t listed;
+} PDFKCrossReference;
+
+//The number of decoded object streams kept while reading
+#define OBJECT_STREAM_CACHE_SIZE 4
+
+/**
+ An open PDF file and its cross reference table.
+ */
+typedef struct {
+    int fd;
+    uint64_t length;
+    /**
+     The offset of the newest cross reference section.
+     */
+    uint64_t startCrossReference;
+    /**
+     Wether the newest section is a cross reference stream.
+     */
+    BOOL crossReferenceStream;
+    /**
+     The newest trailer dictionary.
+     */
+    PDFKBuffer trailer;
+    PDFKCrossReference *entries;
+    size_t entryCount;
+    /**
+     The numbers of the objects the section being read has listed as free, while the file is opened.
+     */
+    PDFKBuffer sectionFreeEntries;
+    uint32_t cachedStreams[OBJECT_STREAM_CACHE_SIZE];
+    PDFKBuffer cachedStreamData[OBJECT_STREAM_CACHE_SIZE];
+    PDFKBuffer cachedStreamDictionaries[OBJECT_STREAM_CACHE_SIZE];
+    size_t nextCachedStream;
+} PDFKFile;
+
+/**
+ Where the data of a stream object is in the file.
+ */
+typedef struct {
+    uint64_t offset;
+    uint64_t length;
+} PDFKStreamLocation;
+
+/**
+ Open a file and read its cross reference table. The file must be closed with PDFKFileClose, even if opening fails.
+ 
+ @param file The file to open.
+ @param fd   The file descriptor to read from. It is not closed by PDFKFileClose.
+ 
+ @return NO if the file does not have a readable cross reference table.
+ */
+BOOL PDFKFileOpen(PDFKFile *file, int fd);
+/**
+ Free the table and buffers of the file.
+ */
+void PDFKFileClose(PDFKFile *file);
+/**
+ Read bytes from the file into the buffer, replacing its contents. Fewer bytes are read at the end of the file.
+ */
+BOOL PDFKFileRead(PDFKFile *file, uint64_t offset, size_t length, PDFKBuffer *buffer);
+/**
+ Copy the value of an object to the output. For a stream, this is its dictionary.
+ */
+BOOL PDFKFileCopyObject(PDFKFile *file, uint32_t number, PDFKBuffer *output);
+/**
+ Copy the value of an object to the output, and find the data of a stream object without reading it.
+ 
+ @param isStream Set to wether the object is a stream.
+ @param location Set to the location of the stream data, if the object is a stream.
+ */
+BOOL PDFKFileCopyObjectWithStream(PDFKFile *file, uint32_t number, PDFKBuffer *output, BOOL *isStream, PDFKStreamLocation *location);
+/**
+ Copy a value to the output, reading the object if the value is a reference.
+ */
+BOOL PDFKFileCopyResolvedValue(PDFKFile *file, const uint8_t *bytes, size_t start, size_t end, PDFKBuffer *output);
+/**
+ Copy the value of a key of a dictionary to the output, reading the object if the value is a reference.
+ */
+BOOL PDFKFileCopyDictionaryValue(PDFKFile *file, const PDFKBuffer *dictionary, const char *key, PDFKBuffer *output);
+/**
+ Find the page objects of the given pages.
+ 
+ @param catalog    The document catalog.
+ @param pages      The page numbers, sorted and unique.
+ @param count      The number of pages.
+ @param references Set to the references of the page objects.
+ 
+ @return NO if a page could not be found.
+ */
+BOOL PDFKFileFindPages(PDFKFile *file, const PDFKBuffer *catalog, const uint32_t *pages, size_t count, PDFKReference *references);
@@ -0,0 +1,1228 @@
+/*
+ //  PDFKFileReader.m
+ //  M13PDFKit
+ //
+ Copyright (c) 2014 Brandon McQuilkin
+ 
+ Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated documentation files (the
+ "Software"), to deal in the Software without restriction, including without limitation the rights to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software, and to permit persons to whom the Software is furnished to do so, subject to
+ the following conditions:
+ 
+ The above copyright notice and this permission notice shall be included in all copies or substantial portions of the Software.
+ 
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#import "PDFKFileReader.h"
+#import <zlib.h>
+#import <fcntl.h>
+#import <unistd.h>
+#import <sys/stat.h>
+
+#pragma mark - Buffers
+
+static BOOL PDFKBufferReserve(PDFKBuffer *buffer, size_t length)
+{
+    if (buffer->length + length <= buffer->capacity) {
+        return YES;
+    }
+    size_t capacity = MAX(buffer->capacity * 2, buffer->length + length + 256);
+    uint8_t *bytes = realloc(buffer->bytes, capacity);
+    if (bytes == NULL) {
+        return NO;
+    }
+    buffer->bytes = bytes;
+    buffer->capacity = capacity;
+    return YES;
+}
+
+BOOL PDFKBufferAppend(PDFKBuffer *buffer, const void *bytes, size_t length)
+{
+    if (PDFKBufferReserve(buffer, length) == NO) {
+        return NO;
+    }
+    if (length > 0) {
+        memcpy(buffer->bytes + buffer->length, bytes, length);
+    }
+    buffer->length += length;
+    return YES;
+}
+
+BOOL PDFKBufferAppendFormat(PDFKBuffer *buffer, const char *format, ...)
+{
+    va_list arguments;
+    va_start(arguments, format);
+    int length = vsnprintf(NULL, 0, format, arguments);
+    va_end(arguments);
+    if (length < 0 || PDFKBufferReserve(buffer, (size_t)length + 1) == NO) {
+        return NO;
+    }
+    va_start(arguments, format);
+    vsnprintf((char *)(buffer->bytes + buffer->length), (size_t)length + 1, format, arguments);
+    va_end(arguments);
+    buffer->length += (size_t)length;
+    return YES;
+}
+
+void PDFKBufferFree(PDFKBuffer *buffer)
+{
+    free(buffer->bytes);
+    buffer->bytes = NULL;
+    buffer->length = 0;
+    buffer->capacity = 0;
+}
+
+#pragma mark - Syntax
+
+//The deepest nesting of arrays and dictionaries that is parsed
+#define MAXIMUM_NESTING 64
+
+size_t PDFKSkipSpace(const uint8_t *bytes, size_t length, size_t position)
+{
+    while (position < length) {
+        if (PDFKIsWhitespace(bytes[position])) {
+            position++;
+        } else if (bytes[position] == '%') {
+            while (position < length && bytes[position] != '\r' && bytes[position] != '\n') {
+                position++;
+            }
+        } else {
+            break;
+        }
+    }
+    return position;
+}
+
+size_t PDFKSkipRegular(const uint8_t *bytes, size_t length, size_t position)
+{
+    while (position < length && PDFKIsRegular(bytes[position])) {
+        position++;
+    }
+    return position;
+}
+
+static BOOL PDFKIsUnsignedInteger(const uint8_t *bytes, size_t start, size_t end)
+{
+    if (start >= end) {
+        return NO;
+    }
+    for (size_t index = start; index < end; index++) {
+        if (bytes[index] < '0' || bytes[index] > '9') {
+            return NO;
+        }
+    }
+    return YES;
+}
+
+/**
+ The end of the object that starts at the position, or PDFK_NOT_FOUND. References ("12 0 R") are one object.
+ */
+static size_t PDFKSkipValueAtDepth(const uint8_t *bytes, size_t length, size_t position, int depth)
+{
+    if (position >= length || depth > MAXIMUM_NESTING) {
+        return PDFK_NOT_FOUND;
+    }
+    uint8_t c = bytes[position];
+    
+    //Dictionaries and arrays
+    if ((c == '<' && position + 1 < length && bytes[position + 1] == '<') || c == '[') {
+        BOOL dictionary = (c == '<');
+        position += (dictionary ? 2 : 1);
+        while (YES) {
+            position = PDFKSkipSpace(bytes, length, position);
+            if (position >= length) {
+                return PDFK_NOT_FOUND;
+            }
+            if (dictionary && bytes[position] == '>' && position + 1 < length && bytes[position + 1] == '>') {
+                return position + 2;
+            }
+            if (dictionary == NO && bytes[position] == ']') {
+                return position + 1;
+            }
+            position = PDFKSkipValueAtDepth(bytes, length, position, depth + 1);
+            if (position == PDFK_NOT_FOUND) {
+                return PDFK_NOT_FOUND;
+            }
+        }
+    }
+    
+    //Literal strings, with balanced parentheses and escapes
+    if (c == '(') {
+        int nesting = 0;
+        for (; position < length; position++) {
+            if (bytes[position] == '\\') {
+                position++;
+            } else if (bytes[position] == '(') {
+                nesting++;
+            } else if (bytes[position] == ')') {
+                nesting--;
+                if (nesting == 0) {
+                    return position + 1;
+                }
+            }
+        }
+        return PDFK_NOT_FOUND;
+    }
+    
+    //Hexadecimal strings
+    if (c == '<') {
+        for (position++; position < length; position++) {
+            if (bytes[position] == '>') {
+                return position + 1;
+            }
+        }
+        return PDFK_NOT_FOUND;
+    }
+    
+    //Names
+    if (c == '/') {
+        return PDFKSkipRegular(bytes, length, position + 1);
+    }
+    
+    if (PDFKIsRegular(c) == NO) {
+        return PDFK_NOT_FOUND;
+    }
+    
+    //Numbers and keywords. An integer followed by another integer and "R" is a reference.
+    size_t end = PDFKSkipRegular(bytes, length, position);
+    if (PDFKIsUnsignedInteger(bytes, position, end)) {
+        size_t generationStart = PDFKSkipSpace(bytes, length, end);
+        size_t generationEnd = PDFKSkipRegular(bytes, length, generationStart);
+        if (generationStart > end && PDFKIsUnsignedInteger(bytes, generationStart, generationEnd)) {
+            size_t keyword = PDFKSkipSpace(bytes, length, generationEnd);
+            if (keyword > generationEnd && keyword < length && bytes[keyword] == 'R' && PDFKSkipRegular(bytes, length, keyword) == keyword + 1) {
+                return keyword + 1;
+            }
+        }
+    }
+    return end;
+}
+
+size_t PDFKSkipValue(const uint8_t *bytes, size_t length, size_t position)
+{
+    return PDFKSkipValueAtDepth(bytes, length, position, 0);
+}
+
+BOOL PDFKParseInteger(const uint8_t *bytes, size_t start, size_t end, long long *value)
+{
+    BOOL negative = NO;
+    if (start < end && (bytes[start] == '-' || bytes[start] == '+')) {
+        negative = (bytes[start] == '-');
+        start++;
+    }
+    if (PDFKIsUnsignedInteger(bytes, start, end) == NO || end - start > 18) {
+        return NO;
+    }
+    long long result = 0;
+    for (size_t index = start; index < end; index++) {
+        result = (result * 10) + (bytes[index] - '0');
+    }
+    *value = (negative ? -result : result);
+    return YES;
+}
+
+BOOL PDFKParseReference(const uint8_t *bytes, size_t start, size_t end, PDFKReference *reference)
+{
+    size_t numberEnd = PDFKSkipRegular(bytes, end, start);
+    size_t generationStart = PDFKSkipSpace(bytes, end, numberEnd);
+    size_t generationEnd = PDFKSkipRegular(bytes, end, generationStart);
+    size_t keyword = PDFKSkipSpace(bytes, end, generationEnd);
+    long long number = 0;
+    long long generation = 0;
+    if (PDFKParseInteger(bytes, start, numberEnd, &number) == NO || PDFKParseInteger(bytes, generationStart, generationEnd, &generation) == NO ||
+        keyword + 1 != end || bytes[keyword] != 'R' || number <= 0 || number > UINT32_MAX || generation < 0 || generation > UINT16_MAX) {
+        return NO;
+    }
+    reference->number = (uint32_t)number;
+    reference->generation = (uint16_t)generation;
+    return YES;
+}
+
+BOOL PDFKDictionaryFind(const uint8_t *bytes, size_t length, size_t position, const char *key, size_t *entryStart, size_t *valueStart, size_t *valueEnd, size_t *dictionaryEnd)
+{
+    position = PDFKSkipSpace(bytes, length, position);
+    if (position + 1 >= length || bytes[position] != '<' || bytes[position + 1] != '<') {
+        return NO;
+    }
+    size_t keyLength = strlen(key);
+    position += 2;
+    while (YES) {
+        position = PDFKSkipSpace(bytes, length, position);
+        if (position + 1 >= length) {
+            return NO;
+        }
+        if (bytes[position] == '>' && bytes[position + 1] == '>') {
+            if (dictionaryEnd != NULL) {
+                *dictionaryEnd = position;
+            }
+            return NO;
+        }
+        size_t keyStart = position;
+        size_t keyEnd = PDFKSkipValue(bytes, length, keyStart);
+        if (keyEnd == PDFK_NOT_FOUND) {
+            return NO;
+        }
+        size_t start = PDFKSkipSpace(bytes, length, keyEnd);
+        size_t end = PDFKSkipValue(bytes, length, start);
+        if (end == PDFK_NOT_FOUND) {
+            return NO;
+        }
+        if (bytes[keyStart] == '/' && keyEnd - keyStart - 1 == keyLength && memcmp(bytes + keyStart + 1, key, keyLength) == 0) {
+            if (entryStart != NULL) {
+                *entryStart = keyStart;
+            }
+            *valueStart = start;
+            *valueEnd = end;
+            return YES;
+        }
+        position = end;
+    }
+}
+
+BOOL PDFKDictionaryGetInteger(const uint8_t *bytes, size_t length, const char *key, long long *value)
+{
+    size_t start = 0;
+    size_t end = 0;
+    return (PDFKDictionaryFind(bytes, length, 0, key, NULL, &start, &end, NULL) && PDFKParseInteger(bytes, start, end, value));
+}
+
+BOOL PDFKDictionaryGetReference(const uint8_t *bytes, size_t length, const char *key, PDFKReference *reference)
+{
+    size_t start = 0;
+    size_t end = 0;
+    return (PDFKDictionaryFind(bytes, length, 0, key, NULL, &start, &end, NULL) && PDFKParseReference(bytes, start, end, reference));
+}
+
+BOOL PDFKDictionarySet(const uint8_t *bytes, size_t length, const char *key, const char *value, PDFKBuffer *output)
+{
+    size_t entryStart = 0;
+    size_t valueStart = 0;
+    size_t valueEnd = 0;
+    size_t dictionaryEnd = PDFK_NOT_FOUND;
+    output->length = 0;
+    if (PDFKDictionaryFind(bytes, length, 0, key, &entryStart, &valueStart, &valueEnd, &dictionaryEnd)) {
+        BOOL appended = PDFKBufferAppend(output, bytes, entryStart);
+        if (value != NULL) {
+            appended = appended && PDFKBufferAppendFormat(output, "/%s %s", key, value);
+        }
+        return appended && PDFKBufferAppend(output, bytes + valueEnd, length - valueEnd);
+    }
+    if (dictionaryEnd == PDFK_NOT_FOUND) {
+        return NO;
+    }
+    BOOL appended = PDFKBufferAppend(output, bytes, dictionaryEnd);
+    if (value != NULL) {
+        appended = appended && PDFKBufferAppendFormat(output, " /%s %s ", key, value);
+    }
+    return appended && PDFKBufferAppend(output, bytes + dictionaryEnd, length - dictionaryEnd);
+}
+
+BOOL PDFKBufferSetDictionaryValue(PDFKBuffer *dictionary, const char *key, const char *value)
+{
+    PDFKBuffer output = {0};
+    if (PDFKDictionarySet(dictionary->bytes, dictionary->length, key, value, &output) == NO) {
+        PDFKBufferFree(&output);
+        return NO;
+    }
+    PDFKBufferFree(dictionary);
+    *dictionary = output;
+    return YES;
+}
+
+BOOL PDFKArrayNextElement(const uint8_t *bytes, size_t length, size_t *cursor, size_t *start, size_t *end)
+{
+    size_t position = *cursor;
+    if (position == 0) {
+        position = PDFKSkipSpace(bytes, length, 0);
+        if (position >= length || bytes[position] != '[') {
+            return NO;
+        }
+        position++;
+    }
+    position = PDFKSkipSpace(bytes, length, position);
+    if (position >= length || bytes[position] == ']') {
+        return NO;
+    }
+    size_t elementEnd = PDFKSkipValue(bytes, length, position);
+    if (elementEnd == PDFK_NOT_FOUND) {
+        return NO;
+    }
+    *start = position;
+    *end = elementEnd;
+    *cursor = elementEnd;
+    return YES;
+}
+
+#pragma mark - Streams
+
+/**
+ Inflate zlib compressed data.
+ */
+static BOOL PDFKInflate(const uint8_t *bytes, size_t length, PDFKBuffer *output)
+{
+    z_stream stream;
+    memset(&stream, 0, sizeof(stream));
+    if (inflateInit(&stream) != Z_OK) {
+        return NO;
+    }
+    stream.next_in = (Bytef *)bytes;
+    stream.avail_in = (uInt)length;
+    int result = Z_OK;
+    while (result == Z_OK) {
+        if (PDFKBufferReserve(output, MAX(length * 2, (size_t)4096)) == NO) {
+            break;
+        }
+        stream.next_out = output->bytes + output->length;
+        stream.avail_out = (uInt)(output->capacity - output->length);
+        result = inflate(&stream, Z_NO_FLUSH);
+        output->length = output->capacity - stream.avail_out;
+        //Truncated streams are common, keep what was inflated.
+        if (result == Z_BUF_ERROR && stream.avail_in == 0) {
+            result = Z_STREAM_END;
+        }
+    }
+    inflateEnd(&stream);
+    return (result == Z_STREAM_END);
+}
+
+/**
+ Undo the PNG predictors, in place. Each row starts with the predictor that was used for it.
+ */
+static BOOL PDFKUnpredictPNG(PDFKBuffer *data, size_t columns, size_t bytesPerPixel)
+{
+    size_t rowLength = columns;
+    if (rowLength == 0 || bytesPerPixel == 0) {
+        return NO;
+    }
+    size_t rows = data->length / (rowLength + 1);
+    uint8_t *previous = calloc(rowLength, 1);
+    if (previous == NULL) {
+        return NO;
+    }
+    uint8_t *output = data->bytes;
+    for (size_t row = 0; row < rows; row++) {
+        uint8_t predictor = data->bytes[row * (rowLength + 1)];
+        //Rows move down by one byte as their predictor bytes are dropped. The source is always ahead of the output.
+        uint8_t *source = data->bytes + (row * (rowLength + 1)) + 1;
+        uint8_t *current = output + (row * rowLength);
+        for (size_t index = 0; index < rowLength; index++) {
+            uint8_t left = (index >= bytesPerPixel ? current[index - bytesPerPixel] : 0);
+            uint8_t up = previous[index];
+            uint8_t upLeft = (index >= bytesPerPixel ? previous[index - bytesPerPixel] : 0);
+            uint8_t value = source[index];
+            switch (predictor) {
+                case 0: break;
+                case 1: value += left; break;
+                case 2: value += up; break;
+                case 3: value += (uint8_t)((left + up) / 2); break;
+                case 4: {
+                    int estimate = left + up - upLeft;
+                    int distanceLeft = abs(estimate - left);
+                    int distanceUp = abs(estimate - up);
+                    int distanceUpLeft = abs(estimate - upLeft);
+                    value += ((distanceLeft <= distanceUp && distanceLeft <= distanceUpLeft) ? left : (distanceUp <= distanceUpLeft ? up : upLeft));
+                    break;
+                }
+                default:
+                    free(previous);
+                    return NO;
+            }
+            current[index] = value;
+        }
+        memcpy(previous, current, rowLength);
+    }
+    free(previous);
+    data->length = rows * rowLength;
+    return YES;
+}
+
+/**
+ Decode the data of a stream with the given dictionary. Only the filters used for cross reference and object streams are supported.
+ */
+static BOOL PDFKDecodeStream(const uint8_t *dictionary, size_t dictionaryLength, const uint8_t *bytes, size_t length, PDFKBuffer *output)
+{
+    size_t start = 0;
+    size_t end = 0;
+    output->length = 0;
+    if (PDFKDictionaryFind(dictionary, dictionaryLength, 0, "Filter", NULL, &start, &end, NULL) == NO) {
+        return PDFKBufferAppend(output, bytes, length);
+    }
+    
+    //A single FlateDecode filter, possibly in an array.
+    const char *flate = "/FlateDecode";
+    size_t flateLength = strlen(flate);
+    size_t nameStart = start;
+    size_t nameEnd = end;
+    if (dictionary[start] == '[') {
+        size_t cursor = 0;
+        if (PDFKArrayNextElement(dictionary + start, end - start, &cursor, &nameStart, &nameEnd) == NO) {
+            return NO;
+        }
+        size_t next = cursor;
+        size_t ignored = 0;
+        if (PDFKArrayNextElement(dictionary + start, end - start, &next, &ignored, &ignored)) {
+            return NO;
+        }
+        nameStart += start;
+        nameEnd += start;
+    }
+    if (nameEnd - nameStart != flateLength || memcmp(dictionary + nameStart, flate, flateLength) != 0) {
+        return NO;
+    }
+    if (PDFKInflate(bytes, length, output) == NO) {
+        return NO;
+    }
+    
+    //Predictors
+    if (PDFKDictionaryFind(dictionary, dictionaryLength, 0, "DecodeParms", NULL, &start, &end, NULL)) {
+        size_t parametersStart = start;
+        if (dictionary[start] == '[') {
+            size_t cursor = 0;
+            if (PDFKArrayNextElement(dictionary + start, end - start, &cursor, &parametersStart, &end) == NO) {
+                return YES;
+            }
+            end += start;
+            parametersStart += start;
+        }
+        const uint8_t *parameters = dictionary + parametersStart;
+        size_t parametersLength = end - parametersStart;
+        long long predictor = 1;
+        long long columns = 1;
+        long long colors = 1;
+        long long bitsPerComponent = 8;
+        PDFKDictionaryGetInteger(parameters, parametersLength, "Predictor", &predictor);
+        PDFKDictionaryGetInteger(parameters, parametersLength, "Columns", &columns);
+        PDFKDictionaryGetInteger(parameters, parametersLength, "Colors", &colors);
+        PDFKDictionaryGetInteger(parameters, parametersLength, "BitsPerComponent", &bitsPerComponent);
+        if (predictor >= 10) {
+            if (columns <= 0 || colors <= 0 || bitsPerComponent != 8 || columns > INT32_MAX) {
+                return NO;
+            }
+            return PDFKUnpredictPNG(output, (size_t)(columns * colors), (size_t)colors);
+        } else if (predictor != 1) {
+            return NO;
+        }
+    }
+    return YES;
+}
+
+#pragma mark - Files
+
+//The most cross reference sections that are followed
+#define MAXIMUM_SECTIONS 1024
+
+BOOL PDFKFileRead(PDFKFile *file, uint64_t offset, size_t length, PDFKBuffer *buffer)
+{
+    buffer->length = 0;
+    if (offset >= file->length) {
+        return NO;
+    }
+    length = (size_t)MIN((uint64_t)length, file->length - offset);
+    if (PDFKBufferReserve(buffer, length) == NO) {
+        return NO;
+    }
+    size_t done = 0;
+    while (done < length) {
+        ssize_t count = pread(file->fd, buffer->bytes + done, length - done, (off_t)(offset + done));
+        if (count < 0 && errno == EINTR) {
+            continue;
+        }
+        if (count <= 0) {
+            return NO;
+        }
+        done += (size_t)count;
+    }
+    buffer->length = length;
+    return YES;
+}
+
+/**
+ Check for a keyword at the position.
+ */
+static BOOL PDFKHasKeyword(const uint8_t *bytes, size_t length, size_t position, const char *keyword)
+{
+    size_t keywordLength = strlen(keyword);
+    return (position + keywordLength <= length && memcmp(bytes + position, keyword, keywordLength) == 0 &&
+            (position + keywordLength == length || PDFKIsRegular(bytes[position + keywordLength]) == NO));
+}
+
+/**
+ Read the object header, "12 0 obj", at the start of the buffer. Returns the position after it.
+ */
+static size_t PDFKSkipObjectHeader(const uint8_t *bytes, size_t length, uint32_t number)
+{
+    size_t position = PDFKSkipSpace(bytes, length, 0);
+    size_t numberEnd = PDFKSkipRegular(bytes, length, position);
+    long long value = 0;
+    if (PDFKParseInteger(bytes, position, numberEnd, &value) == NO || (number != 0 && value != number)) {
+        return PDFK_NOT_FOUND;
+    }
+    position = PDFKSkipSpace(bytes, length, numberEnd);
+    size_t generationEnd = PDFKSkipRegular(bytes, length, position);
+    if (PDFKParseInteger(bytes, position, generationEnd, &value) == NO) {
+        return PDFK_NOT_FOUND;
+    }
+    position = PDFKSkipSpace(bytes, length, generationEnd);
+    if (PDFKHasKeyword(bytes, length, position, "obj") == NO) {
+        return PDFK_NOT_FOUND;
+    }
+    return position + 3;
+}
+
+/**
+ Read the object at an offset in the file. The value is copied to the output. If isStream is given, it is set to wether the object is a stream, and the location of the stream data is found.
+ */
+static BOOL PDFKFileReadObjectAtOffset(PDFKFile *file, uint64_t offset, uint32_t number, PDFKBuffer *output, BOOL *isStream, PDFKStreamLocation *location)
+{
+    PDFKBuffer window = {0};
+    size_t windowLength = 4096;
+    BOOL success = NO;
+    while (YES) {
+        if (PDFKFileRead(file, offset, windowLength, &window) == NO) {
+            break;
+        }
+        BOOL complete = (offset + window.length >= file->length);
+        size_t start = PDFKSkipObjectHeader(window.bytes, window.length, number);
+        if (start == PDFK_NOT_FOUND) {
+            if (complete) {
+                break;
+            }
+            windowLength *= 4;
+            continue;
+        }
+        start = PDFKSkipSpace(window.bytes, window.length, start);
+        size_t end = PDFKSkipValue(window.bytes, window.length, start);
+        
+        //Make sure the whole value, and the stream keyword after it, is in the window.
+        size_t keyword = (end != PDFK_NOT_FOUND ? PDFKSkipSpace(window.bytes, window.length, end) : PDFK_NOT_FOUND);
+        if (keyword == PDFK_NOT_FOUND || keyword + 8 > window.length) {
+            if (complete == NO) {
+                windowLength *= 4;
+                continue;
+            }
+            if (end == PDFK_NOT_FOUND) {
+                break;
+            }
+        }
+        output->length = 0;
+        if (PDFKBufferAppend(output, window.bytes + start, end - start) == NO) {
+            break;
+        }
+        if (isStream == NULL) {
+            success = YES;
+            break;
+        }
+        
+        //The stream data starts after the end of the line after the keyword
+        *isStream = (keyword != PDFK_NOT_FOUND && PDFKHasKeyword(window.bytes, window.length, keyword, "stream"));
+        if (*isStream == NO) {
+            success = YES;
+            break;
+        }
+        size_t dataStart = keyword + 6;
+        if (dataStart < window.length && window.bytes[dataStart] == '\r') {
+            dataStart++;
+        }
+        if (dataStart < window.length && window.bytes[dataStart] == '\n') {
+            dataStart++;
+        }
+        long long dataLength = 0;
+        size_t lengthStart = 0;
+        size_t lengthEnd = 0;
+        if (PDFKDictionaryFind(output->bytes, output->length, 0, "Length", NULL, &lengthStart, &lengthEnd, NULL) == NO) {
+            break;
+        }
+        PDFKReference lengthReference;
+        if (PDFKParseReference(output->bytes, lengthStart, lengthEnd, &lengthReference)) {
+            PDFKBuffer lengthObject = {0};
+            BOOL resolved = (PDFKFileCopyObject(file, lengthReference.number, &lengthObject) &&
+                             PDFKParseInteger(lengthObject.bytes, 0, PDFKSkipRegular(lengthObject.bytes, lengthObject.length, 0), &dataLength));
+            PDFKBufferFree(&lengthObject);
+            if (resolved == NO) {
+                break;
+            }
+        } else if (PDFKParseInteger(output->bytes, lengthStart, lengthEnd, &dataLength) == NO) {
+            break;
+        }
+        if (dataLength < 0 || offset + dataStart + (uint64_t)dataLength > file->length) {
+            break;
+        }
+        location->offset = offset + dataStart;
+        location->length = (uint64_t)dataLength;
+        success = YES;
+        break;
+    }
+    PDFKBufferFree(&window);
+    return success;
+}
+
+/**
+ Read and decode a stream object.
+ */
+static BOOL PDFKFileReadStreamAtOffset(PDFKFile *file, uint64_t offset, uint32_t number, PDFKBuffer *dictionary, PDFKBuffer *decoded)
+{
+    PDFKBuffer data = {0};
+    BOOL isStream = NO;
+    PDFKStreamLocation location;
+    BOOL success = (PDFKFileReadObjectAtOffset(file, offset, number, dictionary, &isStream, &location) && isStream && location.length <= SIZE_MAX &&
+                    PDFKFileRead(file, location.offset, (size_t)location.length, &data) &&
+                    PDFKDecodeStream(dictionary->bytes, dictionary->length, data.bytes, data.length, decoded));
+    PDFKBufferFree(&data);
+    return success;
+}
+
+/**
+ Copy the value of an object in an object stream.
+ */
+static BOOL PDFKFileCopyCompressedObject(PDFKFile *file, uint32_t number, uint32_t stream, uint64_t index, PDFKBuffer *output)
+{
+    //Decode the stream, unless it is cached.
+    size_t slot = OBJECT_STREAM_CACHE_SIZE;
+    for (size_t cached = 0; cached < OBJECT_STREAM_CACHE_SIZE; cached++) {
+        if (file->cachedStreams[cached] == stream) {
+            slot = cached;
+            break;
+        }
+    }
+    if (slot == OBJECT_STREAM_CACHE_SIZE) {
+        if (stream >= file->entryCount || file->entries[stream].type != 1) {
+            return NO;
+        }
+        slot = file->nextCachedStream;
+        file->nextCachedStream = (file->nextCachedStream + 1) % OBJECT_STREAM_CACHE_SIZE;
+        file->cachedStreams[slot] = 0;
+        if (PDFKFileReadStreamAtOffset(file, file->entries[stream].offset, stream, &file->cachedStreamDictionaries[slot], &file->cachedStreamData[slot]) == NO) {
+            return NO;
+        }
+        file->cachedStreams[slot] = stream;
+    }
+    
+    const uint8_t *bytes = file->cachedStreamData[slot].bytes;
+    size_t length = file->cachedStreamData[slot].length;
+    PDFKBuffer *dictionary = &file->cachedStreamDictionaries[slot];
+    long long count = 0;
+    long long first = 0;
+    if (PDFKDictionaryGetInteger(dictionary->bytes, dictionary->length, "N", &count) == NO ||
+        PDFKDictionaryGetInteger(dictionary->bytes, dictionary->length, "First", &first) == NO ||
+        index >= (uint64_t)count || first < 0 || (uint64_t)first > length) {
+        return NO;
+    }
+    
+    //The header has pairs of object numbers and offsets
+    size_t position = 0;
+    for (long long pair = 0; pair <= (long long)index; pair++) {
+        long long objectNumber = 0;
+        long long objectOffset = 0;
+        position = PDFKSkipSpace(bytes, (size_t)first, position);
+        size_t numberEnd = PDFKSkipRegular(bytes, (size_t)first, position);
+        size_t offsetStart = PDFKSkipSpace(bytes, (size_t)first, numberEnd);
+        size_t offsetEnd = PDFKSkipRegular(bytes, (size_t)first, offsetStart);
+        if (PDFKParseInteger(bytes, position, numberEnd, &objectNumber) == NO || PDFKParseInteger(bytes, offsetStart, offsetEnd, &objectOffset) == NO) {
+            return NO;
+        }
+        position = offsetEnd;
+        if (pair == (long long)index) {
+            if (objectNumber != number || objectOffset < 0 || (uint64_t)(first + objectOffset) >= length) {
+                return NO;
+            }
+            size_t start = PDFKSkipSpace(bytes, length, (size_t)(first + objectOffset));
+            size_t end = PDFKSkipValue(bytes, length, start);
+            output->length = 0;
+            return (end != PDFK_NOT_FOUND && PDFKBufferAppend(output, bytes + start, end - start));
+        }
+    }
+    return NO;
+}
+
+BOOL PDFKFileCopyObject(PDFKFile *file, uint32_t number, PDFKBuffer *output)
+{
+    if (number >= file->entryCount) {
+        return NO;
+    }
+    PDFKCrossReference entry = file->entries[number];
+    if (entry.type == 1) {
+        return PDFKFileReadObjectAtOffset(file, entry.offset, number, output, NULL, NULL);
+    } else if (entry.type == 2) {
+        return PDFKFileCopyCompressedObject(file, number, entry.stream, entry.offset, output);
+    }
+    return NO;
+}
+
+BOOL PDFKFileCopyObjectWithStream(PDFKFile *file, uint32_t number, PDFKBuffer *output, BOOL *isStream, PDFKStreamLocation *location)
+{
+    *isStream = NO;
+    if (number >= file->entryCount) {
+        return NO;
+    }
+    PDFKCrossReference entry = file->entries[number];
+    if (entry.type == 1) {
+        return PDFKFileReadObjectAtOffset(file, entry.offset, number, output, isStream, location);
+    } else if (entry.type == 2) {
+        //Streams are never in object streams
+        return PDFKFileCopyCompressedObject(file, number, entry.stream, entry.offset, output);
+    }
+    return NO;
+}
+
+BOOL PDFKFileCopyResolvedValue(PDFKFile *file, const uint8_t *bytes, size_t start, size_t end, PDFKBuffer *output)
+{
+    PDFKReference reference;
+    if (PDFKParseReference(bytes, start, end, &reference)) {
+        return PDFKFileCopyObject(file, reference.number, output);
+    }
+    output->length = 0;
+    return PDFKBufferAppend(output, bytes + start, end - start);
+}
+
+BOOL PDFKFileCopyDictionaryValue(PDFKFile *file, const PDFKBuffer *dictionary, const char *key, PDFKBuffer *output)
+{
+    size_t start = 0;
+    size_t end = 0;
+    return (PDFKDictionaryFind(dictionary->bytes, dictionary->length, 0, key, NULL, &start, &end, NULL) &&
+            PDFKFileCopyResolvedValue(file, dictionary->bytes, start, end, output));
+}
+
+#pragma mark - Cross Reference Table
+
+//The entry is listed by a section
+#define ENTRY_LISTED 1
+//The entry is listed as free by the section being read
+#define ENTRY_LISTED_FREE_IN_SECTION 2
+
+/**
+ Record an entry, unless a newer section already had the object. Free entries are recorded too, so an object deleted by a newer section stays deleted. Until the section is ended, its free entries can be replaced by its cross reference stream, hybrid files list the objects in object streams as free in the table.
+ */
+static void PDFKFileSetEntry(PDFKFile *file, uint64_t number, uint8_t type, uint64_t offset, uint32_t stream, uint16_t generation)
+{
+    if (number >= file->entryCount) {
+        return;
+    }
+    PDFKCrossReference *entry = &file->entries[number];
+    if (entry->listed == 0 && type == 0) {
+        uint32_t value = (uint32_t)number;
+        if (PDFKBufferAppend(&file->sectionFreeEntries, &value, sizeof(value))) {
+            entry->listed = ENTRY_LISTED_FREE_IN_SECTION;
+        } else {
+            entry->listed = ENTRY_LISTED;
+        }
+    } else if (entry->listed == 0 || (entry->listed == ENTRY_LISTED_FREE_IN_SECTION && type != 0)) {
+        entry->listed = ENTRY_LISTED;
+    } else {
+        return;
+    }
+    entry->type = type;
+    entry->offset = offset;
+    entry->stream = stream;
+    entry->generation = generation;
+}
+
+/**
+ Make the free entries of the section that was read final, so older sections do not replace them.
+ */
+static void PDFKFileEndSection(PDFKFile *file)
+{
+    const uint32_t *numbers = (const uint32_t *)file->sectionFreeEntries.bytes;
+    for (size_t index = 0; index < file->sectionFreeEntries.length / sizeof(uint32_t); index++) {
+        if (file->entries[numbers[index]].listed == ENTRY_LISTED_FREE_IN_SECTION) {
+            file->entries[numbers[index]].listed = ENTRY_LISTED;
+        }
+    }
+    file->sectionFreeEntries.length = 0;
+}
+
+/**
+ Allocate the entries for the size in the newest trailer.
+ */
+static BOOL PDFKFileAllocateEntries(PDFKFile *file, const PDFKBuffer *trailer)
+{
+    long long size = 0;
+    if (PDFKDictionaryGetInteger(trailer->bytes, trailer->length, "Size", &size) == NO || size <= 0 || size > 8388607) {
+        return NO;
+    }
+    file->entries = calloc((size_t)size, sizeof(PDFKCrossReference));
+    file->entryCount = (size_t)size;
+    return (file->entries != NULL);
+}
+
+/**
+ Read a cross reference stream, and copy its dictionary to the trailer output.
+ */
+static BOOL PDFKFileReadCrossReferenceStream(PDFKFile *file, uint64_t offset, PDFKBuffer *trailer)
+{
+    PDFKBuffer data = {0};
+    BOOL success = NO;
+    do {
+        if (PDFKFileReadStreamAtOffset(file, offset, 0, trailer, &data) == NO) {
+            break;
+        }
+        if (file->entries == NULL && PDFKFileAllocateEntries(file, trailer) == NO) {
+            break;
+        }
+        
+        //Field widths
+        size_t start = 0;
+        size_t end = 0;
+        if (PDFKDictionaryFind(trailer->bytes, trailer->length, 0, "W", NULL, &start, &end, NULL) == NO) {
+            break;
+        }
+        long long widths[3] = {0, 0, 0};
+        size_t cursor = 0;
+        size_t elementStart = 0;
+        size_t elementEnd = 0;
+        int fieldCount = 0;
+        while (fieldCount < 3 && PDFKArrayNextElement(trailer->bytes + start, end - start, &cursor, &elementStart, &elementEnd)) {
+            if (PDFKParseInteger(trailer->bytes + start, elementStart, elementEnd, &widths[fieldCount]) == NO || widths[fieldCount] < 0 || widths[fieldCount] > 8) {
+                break;
+            }
+            fieldCount++;
+        }
+        size_t rowLength = (size_t)(widths[0] + widths[1] + widths[2]);
+        if (fieldCount != 3 || rowLength == 0) {
+            break;
+        }
+        
+        //Subsections, the whole table if there is no index
+        long long size = 0;
+        PDFKDictionaryGetInteger(trailer->bytes, trailer->length, "Size", &size);
+        long long subsections[2 * MAXIMUM_SECTIONS];
+        size_t subsectionValues = 0;
+        if (PDFKDictionaryFind(trailer->bytes, trailer->length, 0, "Index", NULL, &start, &end, NULL)) {
+            cursor = 0;
+            while (subsectionValues < 2 * MAXIMUM_SECTIONS && PDFKArrayNextElement(trailer->bytes + start, end - start, &cursor, &elementStart, &elementEnd) &&
+                   PDFKParseInteger(trailer->bytes + start, elementStart, elementEnd, &subsections[subsectionValues])) {
+                subsectionValues++;
+            }
+        } else {
+            subsections[0] = 0;
+            subsections[1] = size;
+            subsectionValues = 2;
+        }
+        
+        const uint8_t *row = data.bytes;
+        const uint8_t *rowsEnd = data.bytes + data.length;
+        for (size_t subsection = 0; subsection + 1 < subsectionValues; subsection += 2) {
+            for (long long number = subsections[subsection]; number < subsections[subsection] + subsections[subsection + 1] && row + rowLength <= rowsEnd; number++) {
+                uint64_t fields[3] = {1, 0, 0};
+                const uint8_t *field = row;
+                for (int index = 0; index < 3; index++) {
+                    if (widths[index] > 0) {
+                        fields[index] = 0;
+                        for (long long byte = 0; byte < widths[index]; byte++) {
+                            fields[index] = (fields[index] << 8) | *field++;
+                        }
+                    }
+                }
+                if (number >= 0 && fields[0] == 0) {
+                    PDFKFileSetEntry(file, (uint64_t)number, 0, 0, 0, (uint16_t)fields[2]);
+                } else if (number >= 0 && (fields[0] == 1 || fields[0] == 2)) {
+                    PDFKFileSetEntry(file, (uint64_t)number, (uint8_t)fields[0], (fields[0] == 1 ? fields[1] : fields[2]),
+                                     (fields[0] == 2 ? (uint32_t)fields[1] : 0), (fields[0] == 1 ? (uint16_t)fields[2] : 0));
+                }
+                row += rowLength;
+            }
+        }
+        success = YES;
+    } while (NO);
+    PDFKBufferFree(&data);
+    return success;
+}
+
+/**
+ Read an entry of a cross reference table: the offset, the generation and "n" or "f". Entries should be 20 bytes, but some writers end them with a single end of line character, so the fields are found by the whitespace between them.
+ 
+ @return The position after the entry, the length if the entry may continue past the end of the bytes, or PDFK_NOT_FOUND if it is not an entry.
+ */
+static size_t PDFKReadCrossReferenceEntry(const uint8_t *bytes, size_t length, size_t position, long long *offset, long long *generation, uint8_t *type)
+{
+    size_t offsetEnd = PDFKSkipRegular(bytes, length, position);
+    size_t generationStart = PDFKSkipSpace(bytes, length, offsetEnd);
+    size_t generationEnd = PDFKSkipRegular(bytes, length, generationStart);
+    size_t typeStart = PDFKSkipSpace(bytes, length, generationEnd);
+    size_t typeEnd = PDFKSkipRegular(bytes, length, typeStart);
+    if (typeEnd >= length) {
+        return length;
+    }
+    if (typeEnd != typeStart + 1 || (bytes[typeStart] != 'n' && bytes[typeStart] != 'f') ||
+        PDFKParseInteger(bytes, position, offsetEnd, offset) == NO || PDFKParseInteger(bytes, generationStart, generationEnd, generation) == NO) {
+        return PDFK_NOT_FOUND;
+    }
+    *type = bytes[typeStart];
+    return typeEnd;
+}
+
+/**
+ Read a cross reference table, and copy the trailer after it to the trailer output.
+ */
+static BOOL PDFKFileReadCrossReferenceTable(PDFKFile *file, uint64_t offset, PDFKBuffer *trailer)
+{
+    PDFKBuffer window = {0};
+    size_t windowLength = 65536;
+    BOOL success = NO;
+    while (YES) {
+        if (PDFKFileRead(file, offset, windowLength, &window) == NO) {
+            break;
+        }
+        BOOL complete = (offset + window.length >= file->length);
+        const uint8_t *bytes = window.bytes;
+        size_t length = window.length;
+        size_t position = PDFKSkipSpace(bytes, length, 0) + 4;
+        BOOL truncated = NO;
+        BOOL malformed = NO;
+        
+        //The entries can only be recorded once the size is known from the trailer, so find it first.
+        size_t sections = position;
+        while (truncated == NO && malformed == NO) {
+            position = PDFKSkipSpace(bytes, length, position);
+            if (PDFKHasKeyword(bytes, length, position, "trailer")) {
+                break;
+            }
+            size_t startEnd = PDFKSkipRegular(bytes, length, position);
+            size_t countStart = PDFKSkipSpace(bytes, length, startEnd);
+            size_t countEnd = PDFKSkipRegular(bytes, length, countStart);
+            long long first = 0;
+            long long count = 0;
+            if (countEnd >= length) {
+                truncated = YES;
+            } else if (PDFKParseInteger(bytes, position, startEnd, &first) == NO || PDFKParseInteger(bytes, countStart, countEnd, &count) == NO || first < 0 || count < 0) {
+                malformed = YES;
+            } else {
+                //The entries start on the next line
+                position = PDFKSkipSpace(bytes, length, countEnd);
+                for (long long index = 0; index < count && truncated == NO && malformed == NO; index++) {
+                    long long entryOffset = 0;
+                    long long generation = 0;
+                    uint8_t type = 0;
+                    size_t entryEnd = PDFKReadCrossReferenceEntry(bytes, length, position, &entryOffset, &generation, &type);
+                    if (entryEnd == PDFK_NOT_FOUND) {
+                        malformed = YES;
+                    } else if (entryEnd >= length) {
+                        truncated = YES;
+                    } else {
+                        position = PDFKSkipSpace(bytes, length, entryEnd);
+                    }
+                }
+            }
+        }
+        if (malformed) {
+            break;
+        }
+        size_t trailerStart = (truncated ? length : PDFKSkipSpace(bytes, length, position + 7));
+        size_t trailerEnd = (truncated ? PDFK_NOT_FOUND : PDFKSkipValue(bytes, length, trailerStart));
+        if (trailerEnd == PDFK_NOT_FOUND) {
+            if (complete) {
+                break;
+            }
+            windowLength *= 4;
+            continue;
+        }
+        trailer->length = 0;
+        if (PDFKBufferAppend(trailer, bytes + trailerStart, trailerEnd - trailerStart) == NO) {
+            break;
+        }
+        if (file->entries == NULL && PDFKFileAllocateEntries(file, trailer) == NO) {
+            break;
+        }
+        
+        //Record the entries
+        position = sections;
+        while (YES) {
+            position = PDFKSkipSpace(bytes, length, position);
+            if (PDFKHasKeyword(bytes, length, position, "trailer")) {
+                break;
+            }
+            size_t startEnd = PDFKSkipRegular(bytes, length, position);
+            size_t countStart = PDFKSkipSpace(bytes, length, startEnd);
+            size_t countEnd = PDFKSkipRegular(bytes, length, countStart);
+            long long first = 0;
+            long long count = 0;
+            PDFKParseInteger(bytes, position, startEnd, &first);
+            PDFKParseInteger(bytes, countStart, countEnd, &count);
+            position = PDFKSkipSpace(bytes, length, countEnd);
+            for (long long index = 0; index < count; index++) {
+                long long entryOffset = 0;
+                long long generation = 0;
+                uint8_t type = 0;
+                position = PDFKReadCrossReferenceEntry(bytes, length, position, &entryOffset, &generation, &type);
+                if (type == 'n') {
+                    PDFKFileSetEntry(file, (uint64_t)(first + index), 1, (uint64_t)entryOffset, 0, (uint16_t)generation);
+                } else {
+                    PDFKFileSetEntry(file, (uint64_t)(first + index), 0, 0, 0, (uint16_t)generation);
+                }
+                position = PDFKSkipSpace(bytes, length, position);
+            }
+        }
+        success = YES;
+        break;
+    }
+    PDFKBufferFree(&window);
+    return success;
+}
+
+BOOL PDFKFileOpen(PDFKFile *file, int fd)
+{
+    memset(file, 0, sizeof(PDFKFile));
+    file->fd = fd;
+    struct stat status;
+    if (fstat(fd, &status) != 0 || status.st_size < 32) {
+        return NO;
+    }
+    file->length = (uint64_t)status.st_size;
+    
+    //Find the last startxref
+    PDFKBuffer tail = {0};
+    uint64_t tailOffset = (file->length > 1024 ? file->length - 1024 : 0);
+    if (PDFKFileRead(file, tailOffset, 1024, &tail) == NO) {
+        PDFKBufferFree(&tail);
+        return NO;
+    }
+    long long startCrossReference = -1;
+    for (size_t position = tail.length; position-- > 0;) {
+        if (PDFKHasKeyword(tail.bytes, tail.length, position, "startxref") && (position == 0 || PDFKIsRegular(tail.bytes[position - 1]) == NO)) {
+            size_t start = PDFKSkipSpace(tail.bytes, tail.length, position + 9);
+            PDFKParseInteger(tail.bytes, start, PDFKSkipRegular(tail.bytes, tail.length, start), &startCrossReference);
+            break;
+        }
+    }
+    PDFKBufferFree(&tail);
+    if (startCrossReference < 0 || (uint64_t)startCrossReference >= file->length) {
+        return NO;
+    }
+    file->startCrossReference = (uint64_t)startCrossReference;
+    
+    //Follow the sections from the newest to the oldest
+    PDFKBuffer window = {0};
+    PDFKBuffer trailer = {0};
+    uint64_t offset = file->startCrossReference;
+    BOOL success = YES;
+    for (int section = 0; section < MAXIMUM_SECTIONS; section++) {
+        if (PDFKFileRead(file, offset, 32, &window) == NO) {
+            success = NO;
+            break;
+        }
+        size_t position = PDFKSkipSpace(window.bytes, window.length, 0);
+        BOOL table = PDFKHasKeyword(window.bytes, window.length, position, "xref");
+        if (table) {
+            success = PDFKFileReadCrossReferenceTable(file, offset, &trailer);
+        } else {
+            success = PDFKFileReadCrossReferenceStream(file, offset, &trailer);
+        }
+        if (success == NO) {
+            break;
+        }
+        if (section == 0) {
+            file->crossReferenceStream = (table == NO);
+            success = PDFKBufferAppend(&file->trailer, trailer.bytes, trailer.length);
+        }
+        
+        //Hybrid files have a cross reference stream for the objects that are in object streams
+        long long value = 0;
+        if (table && PDFKDictionaryGetInteger(trailer.bytes, trailer.length, "XRefStm", &value) && value > 0 && (uint64_t)value < file->length) {
+            PDFKBuffer streamTrailer = {0};
+            PDFKFileReadCrossReferenceStream(file, (uint64_t)value, &streamTrailer);
+            PDFKBufferFree(&streamTrailer);
+        }
+        PDFKFileEndSection(file);
+        
+        if (PDFKDictionaryGetInteger(trailer.bytes, trailer.length, "Prev", &value) == NO) {
+            break;
+        }
+        if (value < 0 || (uint64_t)value >= file->length || (uint64_t)value == offset) {
+            success = NO;
+            break;
+        }
+        offset = (uint64_t)value;
+    }
+    PDFKBufferFree(&window);
+    PDFKBufferFree(&trailer);
+    PDFKBufferFree(&file->sectionFreeEntries);
+    return success;
+}
+
+void PDFKFileClose(PDFKFile *file)
+{
+    PDFKBufferFree(&file->trailer);
+    for (size_t index = 0; index < OBJECT_STREAM_CACHE_SIZE; index++) {
+        PDFKBufferFree(&file->cachedStreamData[index]);
+        PDFKBufferFree(&file->cachedStreamDictionaries[index]);
+    }
+    free(file->entries);
+    file->entries = NULL;
+}
+
+#pragma mark - Pages
+
+//The deepest page tree that is followed
+#define MAXIMUM_PAGE_TREE_DEPTH 32
+
+/**
+ Find the references of pages in a page tree node. The pages are sorted, and in the node, which starts at the given page number.
+ */
+static BOOL PDFKFileFindPagesInNode(PDFKFile *file, const PDFKBuffer *node, PDFKReference nodeReference, uint64_t firstPage, const uint32_t *pages, size_t count, PDFKReference *references, int depth)
+{
+    if (depth > MAXIMUM_PAGE_TREE_DEPTH) {
+        return NO;
+    }
+    PDFKBuffer kids = {0};
+    if (PDFKFileCopyDictionaryValue(file, node, "Kids", &kids) == NO) {
+        //A page
+        if (count > 0 && pages[0] == firstPage) {
+            references[0] = nodeReference;
+            return YES;
+        }
+        return NO;
+    }
+    
+    BOOL success = YES;
+    PDFKBuffer kid = {0};
+    size_t found = 0;
+    uint64_t page = firstPage;
+    size_t cursor = 0;
+    size_t start = 0;
+    size_t end = 0;
+    while (found < count && success && PDFKArrayNextElement(kids.bytes, kids.length, &cursor, &start, &end)) {
+        PDFKReference kidReference;
+        if (PDFKParseReference(kids.bytes, start, end, &kidReference) == NO || PDFKFileCopyObject(file, kidReference.number, &kid) == NO) {
+            success = NO;
+            break;
+        }
+        //A page counts as one, a node has the count of its pages.
+        long long kidCount = 1;
+        size_t kidsStart = 0;
+        size_t kidsEnd = 0;
+        if (PDFKDictionaryFind(kid.bytes, kid.length, 0, "Kids", NULL, &kidsStart, &kidsEnd, NULL) &&
+            (PDFKDictionaryGetInteger(kid.bytes, kid.length, "Count", &kidCount) == NO || kidCount < 0)) {
+            success = NO;
+        }
+        size_t last = found;
+        while (last < count && pages[last] < page + (uint64_t)kidCount) {
+            last++;
+        }
+        if (success && last > found) {
+            success = PDFKFileFindPagesInNode(file, &kid, kidReference, page, pages + found, last - found, references + found, depth + 1);
+        }
+        found = last;
+        page += (uint64_t)kidCount;
+    }
+    PDFKBufferFree(&kid);
+    PDFKBufferFree(&kids);
+    return (success && found == count);
+}
+
+BOOL PDFKFileFindPages(PDFKFile *file, const PDFKBuffer *catalog, const uint32_t *pages, size_t count, PDFKReference *references)
+{
+    if (count == 0) {
+        return YES;
+    }
+    size_t start = 0;
+    size_t end = 0;
+    PDFKReference root;
+    if (PDFKDictionaryFind(catalog->bytes, catalog->length, 0, "Pages", NULL, &start, &end, NULL) == NO ||
+        PDFKParseReference(catalog->bytes, start, end, &root) == NO) {
+        return NO;
+    }
+    PDFKBuffer node = {0};
+    BOOL success = (PDFKFileCopyObject(file, root.number, &node) && PDFKFileFindPagesInNode(file, &node, root, 1, pages, count, references, 0));
+    PDFKBufferFree(&node);
+    return success;
+}
+
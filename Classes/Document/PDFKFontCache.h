@@ -0,0 +1,90 @@
+/*
+ //  PDFKFontCache.h
+ //  M13PDFKit
+ //
+ Copyright (c) 2014 Brandon McQuilkin
+ 
+ Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated documentation files (the
+ "Software"), to deal in the Software without restriction, including without limitation the rights to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software, and to permit persons to whom the Software is furnished to do so, subject to
+ the following conditions:
+ 
+ The above copyright notice and this permission notice shall be included in all copies or substantial portions of the Software.
+ 
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+
+#import <Foundation/Foundation.h>
+#import <CoreGraphics/CoreGraphics.h>
+#import "PDFKResourceGovernor.h"
+
+/**
+ The text of the character codes of a PDF font, parsed from its ToUnicode map and its encoding.
+ */
+@interface PDFKFont : NSObject
+
+/**
+ Parse a font.
+ 
+ @param dictionary The font dictionary.
+ 
+ @return A new font. Fonts without a known encoding have no text.
+ */
+- (id)initWithFontDictionary:(CGPDFDictionaryRef)dictionary;
+/**
+ The number of bytes in a character code, 1 for simple fonts and usually 2 for composite fonts.
+ */
+@property (nonatomic, assign, readonly) NSUInteger bytesPerCode;
+/**
+ The number of character codes the font has text for.
+ */
+@property (nonatomic, assign, readonly) NSUInteger codeCount;
+/**
+ Append the text of a string shown with the font.
+ 
+ @param string The string, as it is in the content stream.
+ @param text   The text to append to.
+ 
+ @return The number of character codes in the string.
+ */
+- (NSUInteger)appendTextOfString:(CGPDFStringRef)string toText:(NSMutableString *)text;
+
+@end
+
+/**
+ Keeps the parsed fonts of a document. The same fonts are used on most pages of a document, and parsing their ToUnicode maps again for every page takes longer than finding the text.
+ 
+ Fonts are looked up without waiting on a lock: the fonts are kept in an immutable dictionary that is replaced when a font is added. Fonts are parsed outside of the lock.
+ */
+@interface PDFKFontCache : NSObject <PDFKResourceConsumer>
+
+/**
+ Get the font cache of a document. The caches of the most recently used documents are kept, each keeps its document open.
+ 
+ @param documentRef The document.
+ 
+ @return The font cache of the document.
+ */
++ (PDFKFontCache *)cacheForDocument:(CGPDFDocumentRef)documentRef;
+/**
+ Remove the font caches of all documents.
+ */
++ (void)removeAllCaches;
+/**
+ Get the parsed font for a font dictionary of the document, parsing it the first time.
+ 
+ @param dictionary The font dictionary.
+ 
+ @return The parsed font.
+ */
+- (PDFKFont *)fontForDictionary:(CGPDFDictionaryRef)dictionary;
+/**
+ Remove all the parsed fonts.
+ */
+- (void)removeAllFonts;
+/**
+ Statistics for the cache. The keys are "Fonts", "Hits", "Misses" and "Bytes".
+ */
+@property (nonatomic, readonly) NSDictionary *statistics;
+
+@end
@@ -0,0 +1,639 @@
+/*
+ //  PDFKFontCache.m
+ //  M13PDFKit
+ //
+ Copyright (c) 2014 Brandon McQuilkin
+ 
+ Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated documentation files (the
+ "Software"), to deal in the Software without restriction, including without limitation the rights to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software, and to permit persons to whom the Software is furnished to do so, subject to
+ the following conditions:
+ 
+ The above copyright notice and this permission notice shall be included in all copies or substantial portions of the Software.
+ 
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+
+#import "PDFKFontCache.h"
+#import <libkern/OSAtomic.h>
+
+//The number of documents whose fonts are kept
+#define MAXIMUM_CACHED_DOCUMENTS 2
+//The most codes a single bfrange of a ToUnicode map gives text to
+#define MAXIMUM_RANGE_LENGTH 65536
+//The most UTF-16 units of text for a single character code
+#define MAXIMUM_CODE_UNITS 16
+//The estimated bytes of a parsed code, for accounting
+#define CODE_BYTES 48
+
+#pragma mark - ToUnicode Maps
+
+typedef enum {
+    PDFKCMapTokenEnd = 0,
+    PDFKCMapTokenHex,
+    PDFKCMapTokenArrayStart,
+    PDFKCMapTokenArrayEnd,
+    PDFKCMapTokenKeyword,
+    PDFKCMapTokenOther
+} PDFKCMapTokenType;
+
+typedef struct {
+    PDFKCMapTokenType type;
+    const uint8_t *start;
+    size_t length;
+} PDFKCMapToken;
+
+/**
+ Called for each character code a ToUnicode map gives text to.
+ */
+typedef void (*PDFKCMapMappingFunction)(uint32_t code, const uint16_t *units, size_t unitCount, void *info);
+
+static inline BOOL PDFKCMapIsDelimiter(uint8_t c)
+{
+    return (c == ' ' || c == '\t' || c == '\r' || c == '\n' || c == '\f' || c == '\0' || c == '<' || c == '>' || c == '[' || c == ']' ||
+            c == '(' || c == ')' || c == '{' || c == '}' || c == '/' || c == '%');
+}
+
+/**
+ Read the next token of a CMap. Strings and dictionaries are read as other tokens.
+ */
+static size_t PDFKCMapNextToken(const uint8_t *bytes, size_t length, size_t position, PDFKCMapToken *token)
+{
+    while (position < length) {
+        uint8_t c = bytes[position];
+        if (c == '%') {
+            while (position < length && bytes[position] != '\r' && bytes[position] != '\n') {
+                position++;
+            }
+        } else if (c == ' ' || c == '\t' || c == '\r' || c == '\n' || c == '\f' || c == '\0') {
+            position++;
+        } else {
+            break;
+        }
+    }
+    token->type = PDFKCMapTokenEnd;
+    token->start = bytes + position;
+    token->length = 0;
+    if (position >= length) {
+        return position;
+    }
+    
+    uint8_t c = bytes[position];
+    size_t start = position;
+    if (c == '<' && position + 1 < length && bytes[position + 1] != '<') {
+        while (position < length && bytes[position] != '>') {
+            position++;
+        }
+        token->type = PDFKCMapTokenHex;
+        token->start = bytes + start + 1;
+        token->length = position - start - 1;
+        return MIN(position + 1, length);
+    }
+    if (c == '[' || c == ']') {
+        token->type = (c == '[' ? PDFKCMapTokenArrayStart : PDFKCMapTokenArrayEnd);
+        token->length = 1;
+        return position + 1;
+    }
+    if (c == '(') {
+        //Strings, with nested parentheses and escapes
+        NSInteger depth = 0;
+        while (position < length) {
+            if (bytes[position] == '\\') {
+                position++;
+            } else if (bytes[position] == '(') {
+                depth++;
+            } else if (bytes[position] == ')' && --depth == 0) {
+                position++;
+                break;
+            }
+            position++;
+        }
+    } else if (PDFKCMapIsDelimiter(c)) {
+        position += ((c == '<' || c == '>') && position + 1 < length && bytes[position + 1] == c ? 2 : 1);
+        if (c == '/') {
+            while (position < length && PDFKCMapIsDelimiter(bytes[position]) == NO) {
+                position++;
+            }
+        }
+    } else {
+        while (position < length && PDFKCMapIsDelimiter(bytes[position]) == NO) {
+            position++;
+        }
+        BOOL keyword = ((c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z'));
+        token->type = (keyword ? PDFKCMapTokenKeyword : PDFKCMapTokenOther);
+        token->length = MIN(position, length) - start;
+        return MIN(position, length);
+    }
+    token->type = PDFKCMapTokenOther;
+    token->length = MIN(position, length) - start;
+    return MIN(position, length);
+}
+
+static inline BOOL PDFKCMapTokenIsKeyword(const PDFKCMapToken *token, const char *keyword)
+{
+    size_t keywordLength = strlen(keyword);
+    return (token->type == PDFKCMapTokenKeyword && token->length == keywordLength && memcmp(token->start, keyword, keywordLength) == 0);
+}
+
+/**
+ Decode the digits of a hex string.
+ 
+ @return The number of bytes decoded.
+ */
+static size_t PDFKCMapHexBytes(const PDFKCMapToken *token, uint8_t *output, size_t capacity)
+{
+    size_t count = 0;
+    int high = -1;
+    for (size_t index = 0; index < token->length; index++) {
+        uint8_t c = token->start[index];
+        int value = -1;
+        if (c >= '0' && c <= '9') {
+            value = c - '0';
+        } else if (c >= 'a' && c <= 'f') {
+            value = c - 'a' + 10;
+        } else if (c >= 'A' && c <= 'F') {
+            value = c - 'A' + 10;
+        }
+        if (value < 0) {
+            continue;
+        }
+        if (high < 0) {
+            high = value;
+        } else if (count < capacity) {
+            output[count++] = (uint8_t)((high << 4) | value);
+            high = -1;
+        } else {
+            high = -1;
+        }
+    }
+    //An odd final digit is followed by 0
+    if (high >= 0 && count < capacity) {
+        output[count++] = (uint8_t)(high << 4);
+    }
+    return count;
+}
+
+/**
+ Read a source code of a map. Codes are at most 4 bytes.
+ */
+static BOOL PDFKCMapCode(const PDFKCMapToken *token, uint32_t *code, size_t *byteCount)
+{
+    uint8_t bytes[4];
+    size_t count = PDFKCMapHexBytes(token, bytes, sizeof(bytes));
+    if (token->type != PDFKCMapTokenHex || count == 0) {
+        return NO;
+    }
+    *code = 0;
+    for (size_t index = 0; index < count; index++) {
+        *code = (*code << 8) | bytes[index];
+    }
+    if (byteCount != NULL) {
+        *byteCount = count;
+    }
+    return YES;
+}
+
+/**
+ Read the destination text of a map, as UTF-16 units.
+ */
+static size_t PDFKCMapUnits(const PDFKCMapToken *token, uint16_t *units)
+{
+    uint8_t bytes[MAXIMUM_CODE_UNITS * 2];
+    size_t count = PDFKCMapHexBytes(token, bytes, sizeof(bytes));
+    if (count == 1) {
+        units[0] = bytes[0];
+        return 1;
+    }
+    for (size_t index = 0; index + 1 < count; index += 2) {
+        units[index / 2] = (uint16_t)((bytes[index] << 8) | bytes[index + 1]);
+    }
+    return count / 2;
+}
+
+/**
+ Parse the mappings of a ToUnicode CMap.
+ 
+ @return The number of bytes of the codes in the first code space range, or 0 if there is none.
+ */
+static size_t PDFKCMapParse(const uint8_t *bytes, size_t length, PDFKCMapMappingFunction function, void *info)
+{
+    size_t codeLength = 0;
+    size_t position = 0;
+    PDFKCMapToken token;
+    uint16_t units[MAXIMUM_CODE_UNITS];
+    while ((position = PDFKCMapNextToken(bytes, length, position, &token)), token.type != PDFKCMapTokenEnd) {
+        if (PDFKCMapTokenIsKeyword(&token, "begincodespacerange")) {
+            PDFKCMapToken low;
+            PDFKCMapToken high;
+            while ((position = PDFKCMapNextToken(bytes, length, position, &low)), low.type == PDFKCMapTokenHex) {
+                position = PDFKCMapNextToken(bytes, length, position, &high);
+                uint32_t code = 0;
+                size_t byteCount = 0;
+                if (codeLength == 0 && PDFKCMapCode(&low, &code, &byteCount)) {
+                    codeLength = byteCount;
+                }
+            }
+        } else if (PDFKCMapTokenIsKeyword(&token, "beginbfchar")) {
+            PDFKCMapToken source;
+            PDFKCMapToken destination;
+            while ((position = PDFKCMapNextToken(bytes, length, position, &source)), source.type == PDFKCMapTokenHex) {
+                position = PDFKCMapNextToken(bytes, length, position, &destination);
+                uint32_t code = 0;
+                if (destination.type == PDFKCMapTokenHex && PDFKCMapCode(&source, &code, NULL)) {
+                    size_t unitCount = PDFKCMapUnits(&destination, units);
+                    if (unitCount > 0) {
+                        function(code, units, unitCount, info);
+                    }
+                }
+            }
+        } else if (PDFKCMapTokenIsKeyword(&token, "beginbfrange")) {
+            PDFKCMapToken low;
+            PDFKCMapToken high;
+            PDFKCMapToken destination;
+            while ((position = PDFKCMapNextToken(bytes, length, position, &low)), low.type == PDFKCMapTokenHex) {
+                position = PDFKCMapNextToken(bytes, length, position, &high);
+                position = PDFKCMapNextToken(bytes, length, position, &destination);
+                uint32_t first = 0;
+                uint32_t last = 0;
+                BOOL valid = (PDFKCMapCode(&low, &first, NULL) && PDFKCMapCode(&high, &last, NULL) && first <= last && last - first < MAXIMUM_RANGE_LENGTH);
+                if (destination.type == PDFKCMapTokenArrayStart) {
+                    //A destination for each code
+                    PDFKCMapToken element;
+                    uint32_t code = first;
+                    while ((position = PDFKCMapNextToken(bytes, length, position, &element)), element.type == PDFKCMapTokenHex) {
+                        size_t unitCount = PDFKCMapUnits(&element, units);
+                        if (valid && code <= last && unitCount > 0) {
+                            function(code, units, unitCount, info);
+                        }
+                        code++;
+                    }
+                } else if (valid && destination.type == PDFKCMapTokenHex) {
+                    //The last unit of the destination counts up with the code
+                    size_t unitCount = PDFKCMapUnits(&destination, units);
+                    if (unitCount > 0) {
+                        uint16_t lastUnit = units[unitCount - 1];
+                        for (uint32_t code = first; code <= last; code++) {
+                            units[unitCount - 1] = (uint16_t)(lastUnit + (code - first));
+                            function(code, units, unitCount, info);
+                        }
+                    }
+                }
+            }
+        }
+    }
+    return codeLength;
+}
+
+#pragma mark - Encodings
+
+/**
+ The text of glyph names used in Differences arrays, other than single letters and uniXXXX names.
+ */
+static const struct {
+    const char *name;
+    uint16_t unit;
+} PDFKGlyphNames[] = {
+    {"space", ' '}, {"exclam", '!'}, {"quotedbl", '"'}, {"numbersign", '#'}, {"dollar", '$'}, {"percent", '%'}, {"ampersand", '&'},
+    {"quotesingle", '\''}, {"parenleft", '('}, {"parenright", ')'}, {"asterisk", '*'}, {"plus", '+'}, {"comma", ','}, {"hyphen", '-'},
+    {"period", '.'}, {"slash", '/'}, {"zero", '0'}, {"one", '1'}, {"two", '2'}, {"three", '3'}, {"four", '4'}, {"five", '5'}, {"six", '6'},
+    {"seven", '7'}, {"eight", '8'}, {"nine", '9'}, {"colon", ':'}, {"semicolon", ';'}, {"less", '<'}, {"equal", '='}, {"greater", '>'},
+    {"question", '?'}, {"at", '@'}, {"bracketleft", '['}, {"backslash", '\\'}, {"bracketright", ']'}, {"asciicircum", '^'},
+    {"underscore", '_'}, {"grave", '`'}, {"braceleft", '{'}, {"bar", '|'}, {"braceright", '}'}, {"asciitilde", '~'},
+    {"quoteleft", 0x2018}, {"quoteright", 0x2019}, {"quotedblleft", 0x201C}, {"quotedblright", 0x201D}, {"endash", 0x2013},
+    {"emdash", 0x2014}, {"bullet", 0x2022}, {"ellipsis", 0x2026}, {"minus", 0x2212}, {"nbspace", 0x00A0}, {"degree", 0x00B0},
+    {"copyright", 0x00A9}, {"registered", 0x00AE}, {"trademark", 0x2122}, {"section", 0x00A7}, {"paragraph", 0x00B6}
+};
+
+static const struct {
+    const char *name;
+    const char *text;
+} PDFKLigatureNames[] = {
+    {"fi", "fi"}, {"fl", "fl"}, {"ff", "ff"}, {"ffi", "ffi"}, {"ffl", "ffl"}
+};
+
+/**
+ The text of a glyph name.
+ 
+ @return The number of UTF-16 units, 0 if the name is not known.
+ */
+static size_t PDFKGlyphNameUnits(const char *glyphName, uint16_t *units)
+{
+    //Variants like "a.sc" have the text of their base glyph
+    char name[64];
+    size_t length = 0;
+    while (glyphName[length] != '\0' && glyphName[length] != '.' && length + 1 < sizeof(name)) {
+        name[length] = glyphName[length];
+        length++;
+    }
+    name[length] = '\0';
+    if (length == 1 && ((name[0] >= 'a' && name[0] <= 'z') || (name[0] >= 'A' && name[0] <= 'Z'))) {
+        units[0] = (uint16_t)name[0];
+        return 1;
+    }
+    if ((length == 7 && strncmp(name, "uni", 3) == 0) || ((length == 5 || length == 6 || length == 7) && name[0] == 'u')) {
+        char *end = NULL;
+        unsigned long value = strtoul(name + (name[1] == 'n' && name[2] == 'i' ? 3 : 1), &end, 16);
+        if (end != NULL && *end == '\0' && value > 0 && value <= 0xFFFF) {
+            units[0] = (uint16_t)value;
+            return 1;
+        }
+    }
+    for (size_t index = 0; index < sizeof(PDFKGlyphNames) / sizeof(PDFKGlyphNames[0]); index++) {
+        if (strcmp(name, PDFKGlyphNames[index].name) == 0) {
+            units[0] = PDFKGlyphNames[index].unit;
+            return 1;
+        }
+    }
+    for (size_t index = 0; index < sizeof(PDFKLigatureNames) / sizeof(PDFKLigatureNames[0]); index++) {
+        if (strcmp(name, PDFKLigatureNames[index].name) == 0) {
+            size_t count = strlen(PDFKLigatureNames[index].text);
+            for (size_t unit = 0; unit < count; unit++) {
+                units[unit] = (uint16_t)PDFKLigatureNames[index].text[unit];
+            }
+            return count;
+        }
+    }
+    return 0;
+}
+
+#pragma mark - Fonts
+
+static void PDFKFontAddMapping(uint32_t code, const uint16_t *units, size_t unitCount, void *info)
+{
+    CFMutableDictionaryRef codes = info;
+    CFStringRef text = CFStringCreateWithCharacters(NULL, units, (CFIndex)unitCount);
+    if (text != NULL) {
+        //Codes are offset by one, 0 is not a valid key.
+        CFDictionarySetValue(codes, (const void *)(uintptr_t)(code + 1), text);
+        CFRelease(text);
+    }
+}
+
+@implementation PDFKFont
+{
+    /**
+     The text of each code, by code + 1.
+     */
+    CFMutableDictionaryRef codes;
+}
+
+- (id)initWithFontDictionary:(CGPDFDictionaryRef)dictionary
+{
+    if ((self = [super init])) {
+        codes = CFDictionaryCreateMutable(NULL, 0, NULL, &kCFTypeDictionaryValueCallBacks);
+        const char *subtype = NULL;
+        BOOL composite = (CGPDFDictionaryGetName(dictionary, "Subtype", &subtype) && strcmp(subtype, "Type0") == 0);
+        _bytesPerCode = (composite ? 2 : 1);
+        if (composite == NO) {
+            [self addEncodingOfFont:dictionary];
+        }
+        
+        //The ToUnicode map has the last word
+        CGPDFStreamRef toUnicode = NULL;
+        if (CGPDFDictionaryGetStream(dictionary, "ToUnicode", &toUnicode)) {
+            CGPDFDataFormat format;
+            CFDataRef data = CGPDFStreamCopyData(toUnicode, &format);
+            if (data != NULL && format == CGPDFDataFormatRaw) {
+                size_t codeLength = PDFKCMapParse(CFDataGetBytePtr(data), (size_t)CFDataGetLength(data), PDFKFontAddMapping, codes);
+                if (composite && (codeLength == 1 || codeLength == 2)) {
+                    _bytesPerCode = codeLength;
+                }
+            }
+            if (data != NULL) {
+                CFRelease(data);
+            }
+        }
+    }
+    return self;
+}
+
+- (void)dealloc
+{
+    CFRelease(codes);
+}
+
+/**
+ The text of the codes of a simple font, from its base encoding and its differences.
+ */
+- (void)addEncodingOfFont:(CGPDFDictionaryRef)dictionary
+{
+    const char *encodingName = NULL;
+    CGPDFDictionaryRef encoding = NULL;
+    if (CGPDFDictionaryGetDictionary(dictionary, "Encoding", &encoding)) {
+        CGPDFDictionaryGetName(encoding, "BaseEncoding", &encodingName);
+    } else {
+        CGPDFDictionaryGetName(dictionary, "Encoding", &encodingName);
+    }
+    
+    //Symbolic fonts without an encoding use their own, there is no text to find.
+    const char *baseFont = NULL;
+    if (encodingName == NULL && CGPDFDictionaryGetName(dictionary, "BaseFont", &baseFont) && (strstr(baseFont, "Symbol") != NULL || strstr(baseFont, "Dingbats") != NULL)) {
+        return;
+    }
+    CFStringEncoding stringEncoding = ((encodingName != NULL && strcmp(encodingName, "MacRomanEncoding") == 0) ? kCFStringEncodingMacRoman : kCFStringEncodingWindowsLatin1);
+    BOOL standard = (encodingName == NULL || strcmp(encodingName, "StandardEncoding") == 0);
+    for (uint32_t code = 32; code < 256; code++) {
+        uint16_t unit = 0;
+        if (standard && (code == '\'' || code == '`')) {
+            //The quotes of the standard encoding
+            unit = (code == '\'' ? 0x2019 : 0x2018);
+            PDFKFontAddMapping(code, &unit, 1, codes);
+            continue;
+        }
+        if (standard && code >= 127) {
+            continue;
+        }
+        uint8_t byte = (uint8_t)code;
+        CFStringRef text = CFStringCreateWithBytes(NULL, &byte, 1, stringEncoding, false);
+        if (text != NULL) {
+            CFDictionarySetValue(codes, (const void *)(uintptr_t)(code + 1), text);
+            CFRelease(text);
+        }
+    }
+    
+    //Glyph names for some codes
+    CGPDFArrayRef differences = NULL;
+    if (encoding == NULL || CGPDFDictionaryGetArray(encoding, "Differences", &differences) == false) {
+        return;
+    }
+    CGPDFInteger code = 0;
+    uint16_t units[MAXIMUM_CODE_UNITS];
+    for (size_t index = 0; index < CGPDFArrayGetCount(differences); index++) {
+        const char *glyphName = NULL;
+        if (CGPDFArrayGetInteger(differences, index, &code)) {
+            continue;
+        }
+        if (CGPDFArrayGetName(differences, index, &glyphName) && code >= 0 && code < 256) {
+            size_t unitCount = PDFKGlyphNameUnits(glyphName, units);
+            if (unitCount > 0) {
+                PDFKFontAddMapping((uint32_t)code, units, unitCount, codes);
+            } else {
+                CFDictionaryRemoveValue(codes, (const void *)(uintptr_t)(code + 1));
+            }
+            code++;
+        }
+    }
+}
+
+- (NSUInteger)appendTextOfString:(CGPDFStringRef)string toText:(NSMutableString *)text
+{
+    const unsigned char *bytes = CGPDFStringGetBytePtr(string);
+    size_t length = CGPDFStringGetLength(string);
+    NSUInteger count = 0;
+    for (size_t index = 0; index + _bytesPerCode <= length; index += _bytesPerCode) {
+        uint32_t code = bytes[index];
+        if (_bytesPerCode == 2) {
+            code = (code << 8) | bytes[index + 1];
+        }
+        CFStringRef codeText = CFDictionaryGetValue(codes, (const void *)(uintptr_t)(code + 1));
+        if (codeText != NULL) {
+            CFStringAppend((__bridge CFMutableStringRef)text, codeText);
+        }
+        count++;
+    }
+    return count;
+}
+
+- (NSUInteger)codeCount
+{
+    return (NSUInteger)CFDictionaryGetCount(codes);
+}
+
+@end
+
+#pragma mark - Font Cache
+
+@interface PDFKFontCache ()
+
+/**
+ The parsed fonts by font dictionary. The dictionary is never changed, it is replaced when a font is added.
+ */
+@property (atomic, strong) NSDictionary *fonts;
+
+@end
+
+@implementation PDFKFontCache
+{
+    CGPDFDocumentRef documentRef;
+    volatile int64_t hitCount;
+    volatile int64_t missCount;
+}
+
+static NSMutableArray *documentCaches = nil;
+
++ (PDFKFontCache *)cacheForDocument:(CGPDFDocumentRef)documentRef
+{
+    @synchronized([PDFKFontCache class]) {
+        if (documentCaches == nil) {
+            documentCaches = [NSMutableArray new];
+        }
+        //Most recently used last
+        for (PDFKFontCache *cache in documentCaches) {
+            if (cache->documentRef == documentRef) {
+                [documentCaches removeObjectIdenticalTo:cache];
+                [documentCaches addObject:cache];
+                return cache;
+            }
+        }
+        PDFKFontCache *cache = [[PDFKFontCache alloc] initWithDocument:documentRef];
+        [documentCaches addObject:cache];
+        while (documentCaches.count > MAXIMUM_CACHED_DOCUMENTS) {
+            [documentCaches removeObjectAtIndex:0];
+        }
+        return cache;
+    }
+}
+
++ (void)removeAllCaches
+{
+    @synchronized([PDFKFontCache class]) {
+        [documentCaches removeAllObjects];
+    }
+}
+
+- (id)initWithDocument:(CGPDFDocumentRef)document
+{
+    if ((self = [super init])) {
+        //The font dictionaries belong to the document
+        documentRef = CGPDFDocumentRetain(document);
+        self.fonts = @{};
+        
+        //Fonts are parsed again when needed.
+        [[PDFKResourceGovernor sharedGovernor] registerConsumer:self category:PDFKResourceCategoryDisplayLists priority:PDFKResourcePriorityLow];
+    }
+    return self;
+}
+
+- (void)dealloc
+{
+    CGPDFDocumentRelease(documentRef);
+}
+
+- (PDFKFont *)fontForDictionary:(CGPDFDictionaryRef)dictionary
+{
+    NSNumber *key = @((uintptr_t)dictionary);
+    PDFKFont *font = self.fonts[key];
+    if (font != nil) {
+        OSAtomicIncrement64Barrier(&hitCount);
+        return font;
+    }
+    
+    OSAtomicIncrement64Barrier(&missCount);
+    font = [[PDFKFont alloc] initWithFontDictionary:dictionary];
+    @synchronized(self) {
+        //Another thread may have parsed the font first
+        PDFKFont *existingFont = self.fonts[key];
+        if (existingFont != nil) {
+            return existingFont;
+        }
+        NSMutableDictionary *fonts = [self.fonts mutableCopy];
+        fonts[key] = font;
+        self.fonts = fonts;
+    }
+    return font;
+}
+
+- (void)removeAllFonts
+{
+    @synchronized(self) {
+        self.fonts = @{};
+    }
+}
+
+- (NSUInteger)byteCount
+{
+    NSUInteger bytes = 0;
+    for (PDFKFont *font in self.fonts.allValues) {
+        bytes += [font codeCount] * CODE_BYTES;
+    }
+    return bytes;
+}
+
+- (NSDictionary *)statistics
+{
+    return @{@"Fonts": @(self.fonts.count),
+             @"Hits": @(OSAtomicAdd64Barrier(0, &hitCount)),
+             @"Misses": @(OSAtomicAdd64Barrier(0, &missCount)),
+             @"Bytes": @([self byteCount])};
+}
+
+#pragma mark PDFKResourceConsumer
+
+- (NSUInteger)resourceBytes
+{
+    return [self byteCount];
+}
+
+- (NSUInteger)shedResourcesForPressure:(PDFKResourcePressure)pressure
+{
+    NSUInteger bytes = [self byteCount];
+    [self removeAllFonts];
+    
+    //Close the document too
+    @synchronized([PDFKFontCache class]) {
+        [documentCaches removeObjectIdenticalTo:self];
+    }
+    return bytes;
+}
+
+@end
@@ -0,0 +1,59 @@
+/*
+ //  PDFKIncrementalWriter.h
+ //  M13PDFKit
+ //
+ Copyright (c) 2014 Brandon McQuilkin
+ 
+ Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated documentation files (the
+ "Software"), to deal in the Software without restriction, including without limitation the rights to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software, and to permit persons to whom the Software is furnished to do so, subject to
+ the following conditions:
+ 
+ The above copyright notice and this permission notice shall be included in all copies or substantial portions of the Software.
+ 
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#import <Foundation/Foundation.h>
+
+@class PDFKPageSet;
+
+/**
+ Saves the bookmarks and highlighted pages of a document into its PDF file, as an incremental update. Only the changed objects, and a new cross reference section for them, are appended to the end of the file, so the time to save depends on the size of the change, not the size of the file.
+ 
+ The bookmarks are written as items of a "Bookmarks" item at the end of the document outline, and the highlighted pages as highlight annotations. Saving again replaces the items and annotations written by the previous save.
+ 
+ The length of the file is written to a journal next to the file before appending, and both are flushed to permanent storage. If the app stops while appending, the partial update is removed the next time the file is recovered.
+ */
+@interface PDFKIncrementalWriter : NSObject
+
+/**
+ Remove an update that was not completely appended to the file, if there is one.
+ 
+ @param filePath The path of the PDF file.
+ 
+ @return YES if a partial update was removed.
+ */
++ (BOOL)recoverFileAtPath:(NSString *)filePath;
+/**
+ Create a writer for a PDF file.
+ 
+ @param filePath The path of the PDF file.
+ 
+ @return A new writer.
+ */
+- (id)initWithFilePath:(NSString *)filePath;
+/**
+ Append an update to the file with the given bookmarks and highlighted pages. Encrypted files are not supported.
+ 
+ @param bookmarks        The bookmarked pages.
+ @param highlightedPages The highlighted pages.
+ 
+ @return YES if the update was appended, NO if the file is not changed.
+ */
+- (BOOL)writeBookmarks:(PDFKPageSet *)bookmarks highlightedPages:(PDFKPageSet *)highlightedPages;
+/**
+ The statistics of the last update. The keys are "AppendedBytes", "Objects" (the number of objects written) and "Elapsed" (in seconds).
+ */
+@property (nonatomic, readonly) NSDictionary *statistics;
+
+@end
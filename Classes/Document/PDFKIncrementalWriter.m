@@ -0,0 +1,765 @@
+/*
+ //  PDFKIncrementalWriter.m
+ //  M13PDFKit
+ //
+ Copyright (c) 2014 Brandon McQuilkin
+ 
+ Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated documentation files (the
+ "Software"), to deal in the Software without restriction, including without limitation the rights to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software, and to permit persons to whom the Software is furnished to do so, subject to
+ the following conditions:
+ 
+ The above copyright notice and this permission notice shall be included in all copies or substantial portions of the Software.
+ 
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#import "PDFKIncrementalWriter.h"
+#import "PDFKPageSet.h"
+#import "CGPDFDocument.h"
+#import "PDFKFileReader.h"
+#import <QuartzCore/QuartzCore.h>
+#import <fcntl.h>
+#import <unistd.h>
+#import <sys/stat.h>
+
+#pragma mark - Updates
+
+/**
+ An object written by an update.
+ */
+typedef struct {
+    uint32_t number;
+    uint16_t generation;
+    uint64_t offset;
+} PDFKUpdateEntry;
+
+/**
+ The objects appended to a file.
+ */
+typedef struct {
+    PDFKFile *file;
+    PDFKBuffer body;
+    PDFKUpdateEntry *entries;
+    size_t entryCount;
+    size_t entryCapacity;
+    uint32_t nextNumber;
+} PDFKUpdate;
+
+static void PDFKUpdateBegin(PDFKUpdate *update, PDFKFile *file)
+{
+    memset(update, 0, sizeof(PDFKUpdate));
+    update->file = file;
+    update->nextNumber = (uint32_t)file->entryCount;
+    //Start on a new line, the file may not end with one.
+    PDFKBufferAppend(&update->body, "\n", 1);
+}
+
+static void PDFKUpdateFree(PDFKUpdate *update)
+{
+    PDFKBufferFree(&update->body);
+    free(update->entries);
+    update->entries = NULL;
+}
+
+static PDFKReference PDFKUpdateNewReference(PDFKUpdate *update)
+{
+    PDFKReference reference = {update->nextNumber++, 0};
+    return reference;
+}
+
+/**
+ The reference to an existing object.
+ */
+static PDFKReference PDFKUpdateExistingReference(PDFKUpdate *update, uint32_t number)
+{
+    PDFKReference reference = {number, 0};
+    if (number < update->file->entryCount && update->file->entries[number].type == 1) {
+        reference.generation = update->file->entries[number].generation;
+    }
+    return reference;
+}
+
+static BOOL PDFKUpdateAddEntry(PDFKUpdate *update, PDFKReference reference, uint64_t offset)
+{
+    if (update->entryCount == update->entryCapacity) {
+        size_t capacity = MAX(update->entryCapacity * 2, (size_t)16);
+        PDFKUpdateEntry *entries = realloc(update->entries, capacity * sizeof(PDFKUpdateEntry));
+        if (entries == NULL) {
+            return NO;
+        }
+        update->entries = entries;
+        update->entryCapacity = capacity;
+    }
+    PDFKUpdateEntry *entry = &update->entries[update->entryCount++];
+    entry->number = reference.number;
+    entry->generation = reference.generation;
+    entry->offset = offset;
+    return YES;
+}
+
+static BOOL PDFKUpdateWriteObject(PDFKUpdate *update, PDFKReference reference, const uint8_t *bytes, size_t length)
+{
+    return (PDFKUpdateAddEntry(update, reference, update->file->length + update->body.length) &&
+            PDFKBufferAppendFormat(&update->body, "%u %u obj\n", reference.number, reference.generation) &&
+            PDFKBufferAppend(&update->body, bytes, length) &&
+            PDFKBufferAppend(&update->body, "\nendobj\n", 8));
+}
+
+static BOOL PDFKUpdateWriteBuffer(PDFKUpdate *update, PDFKReference reference, const PDFKBuffer *buffer)
+{
+    return PDFKUpdateWriteObject(update, reference, buffer->bytes, buffer->length);
+}
+
+static int PDFKCompareUpdateEntries(const void *first, const void *second)
+{
+    uint32_t a = ((const PDFKUpdateEntry *)first)->number;
+    uint32_t b = ((const PDFKUpdateEntry *)second)->number;
+    return (a < b ? -1 : (a > b ? 1 : 0));
+}
+
+/**
+ Append the trailer entries that are kept from the previous trailer.
+ */
+static BOOL PDFKUpdateAppendTrailerEntries(PDFKUpdate *update, PDFKBuffer *output)
+{
+    const PDFKBuffer *trailer = &update->file->trailer;
+    const char *keys[] = {"Root", "Info"};
+    for (size_t index = 0; index < 2; index++) {
+        size_t start = 0;
+        size_t end = 0;
+        if (PDFKDictionaryFind(trailer->bytes, trailer->length, 0, keys[index], NULL, &start, &end, NULL)) {
+            if (PDFKBufferAppendFormat(output, " /%s ", keys[index]) == NO || PDFKBufferAppend(output, trailer->bytes + start, end - start) == NO) {
+                return NO;
+            }
+        }
+    }
+    
+    //Keep the permanent half of the identifier, and change the other half.
+    BOOL appended = PDFKBufferAppend(output, " /ID [", 6);
+    size_t start = 0;
+    size_t end = 0;
+    size_t cursor = 0;
+    size_t elementStart = 0;
+    size_t elementEnd = 0;
+    uint8_t identifier[16];
+    if (PDFKDictionaryFind(trailer->bytes, trailer->length, 0, "ID", NULL, &start, &end, NULL) &&
+        PDFKArrayNextElement(trailer->bytes + start, end - start, &cursor, &elementStart, &elementEnd)) {
+        appended = appended && PDFKBufferAppend(output, trailer->bytes + start + elementStart, elementEnd - elementStart);
+    } else {
+        arc4random_buf(identifier, sizeof(identifier));
+        appended = appended && PDFKBufferAppend(output, "<", 1);
+        for (size_t index = 0; index < sizeof(identifier); index++) {
+            appended = appended && PDFKBufferAppendFormat(output, "%02X", identifier[index]);
+        }
+        appended = appended && PDFKBufferAppend(output, ">", 1);
+    }
+    arc4random_buf(identifier, sizeof(identifier));
+    appended = appended && PDFKBufferAppend(output, " <", 2);
+    for (size_t index = 0; index < sizeof(identifier); index++) {
+        appended = appended && PDFKBufferAppendFormat(output, "%02X", identifier[index]);
+    }
+    return appended && PDFKBufferAppendFormat(output, "> ] /Prev %llu", (unsigned long long)update->file->startCrossReference);
+}
+
+/**
+ Write the cross reference section and trailer. The section has the same form as the previous one.
+ */
+static BOOL PDFKUpdateFinish(PDFKUpdate *update)
+{
+    PDFKBuffer *body = &update->body;
+    uint64_t crossReferenceOffset = update->file->length + body->length;
+    BOOL appended = YES;
+    
+    if (update->file->crossReferenceStream) {
+        //The stream is an object too, and has an entry for itself.
+        PDFKReference streamReference = PDFKUpdateNewReference(update);
+        appended = PDFKUpdateAddEntry(update, streamReference, crossReferenceOffset);
+        
+        qsort(update->entries, update->entryCount, sizeof(PDFKUpdateEntry), PDFKCompareUpdateEntries);
+        int offsetWidth = 1;
+        while (offsetWidth < 8 && (crossReferenceOffset >> (offsetWidth * 8)) != 0) {
+            offsetWidth++;
+        }
+        
+        PDFKBuffer rows = {0};
+        PDFKBuffer index = {0};
+        for (size_t entry = 0; entry < update->entryCount; entry++) {
+            if (entry == 0 || update->entries[entry].number != update->entries[entry - 1].number + 1) {
+                size_t run = 1;
+                while (entry + run < update->entryCount && update->entries[entry + run].number == update->entries[entry].number + run) {
+                    run++;
+                }
+                appended = appended && PDFKBufferAppendFormat(&index, "%u %zu ", update->entries[entry].number, run);
+            }
+            uint8_t row[11];
+            row[0] = 1;
+            for (int byte = 0; byte < offsetWidth; byte++) {
+                row[1 + byte] = (uint8_t)(update->entries[entry].offset >> ((offsetWidth - 1 - byte) * 8));
+            }
+            row[1 + offsetWidth] = (uint8_t)(update->entries[entry].generation >> 8);
+            row[2 + offsetWidth] = (uint8_t)update->entries[entry].generation;
+            appended = appended && PDFKBufferAppend(&rows, row, (size_t)(3 + offsetWidth));
+        }
+        
+        appended = appended && PDFKBufferAppendFormat(body, "%u 0 obj\n<< /Type /XRef /Size %u /W [1 %d 2] /Index [", streamReference.number, update->nextNumber, offsetWidth);
+        appended = appended && PDFKBufferAppend(body, index.bytes, index.length);
+        appended = appended && PDFKBufferAppend(body, "]", 1);
+        appended = appended && PDFKUpdateAppendTrailerEntries(update, body);
+        appended = appended && PDFKBufferAppendFormat(body, " /Length %zu >>\nstream\n", rows.length);
+        appended = appended && PDFKBufferAppend(body, rows.bytes, rows.length);
+        appended = appended && PDFKBufferAppend(body, "\nendstream\nendobj\n", 18);
+        PDFKBufferFree(&rows);
+        PDFKBufferFree(&index);
+    } else {
+        qsort(update->entries, update->entryCount, sizeof(PDFKUpdateEntry), PDFKCompareUpdateEntries);
+        appended = PDFKBufferAppend(body, "xref\n", 5);
+        for (size_t entry = 0; entry < update->entryCount && appended; entry++) {
+            if (entry == 0 || update->entries[entry].number != update->entries[entry - 1].number + 1) {
+                size_t run = 1;
+                while (entry + run < update->entryCount && update->entries[entry + run].number == update->entries[entry].number + run) {
+                    run++;
+                }
+                appended = PDFKBufferAppendFormat(body, "%u %zu\n", update->entries[entry].number, run);
+            }
+            appended = appended && PDFKBufferAppendFormat(body, "%010llu %05u n\r\n", (unsigned long long)update->entries[entry].offset, update->entries[entry].generation);
+        }
+        appended = appended && PDFKBufferAppendFormat(body, "trailer\n<< /Size %u", update->nextNumber);
+        appended = appended && PDFKUpdateAppendTrailerEntries(update, body);
+        appended = appended && PDFKBufferAppend(body, " >>\n", 4);
+    }
+    
+    return appended && PDFKBufferAppendFormat(body, "startxref\n%llu\n%%%%EOF\n", (unsigned long long)crossReferenceOffset);
+}
+
+#pragma mark - User State
+
+/**
+ Append an array of references.
+ */
+static BOOL PDFKBufferAppendReferences(PDFKBuffer *buffer, const PDFKReference *references, size_t count)
+{
+    BOOL appended = PDFKBufferAppend(buffer, "[", 1);
+    for (size_t index = 0; index < count && appended; index++) {
+        appended = PDFKBufferAppendFormat(buffer, "%s%u %u R", (index > 0 ? " " : ""), references[index].number, references[index].generation);
+    }
+    return appended && PDFKBufferAppend(buffer, "]", 1);
+}
+
+/**
+ Read the references in an array value of a dictionary.
+ */
+static size_t PDFKFileCopyReferences(PDFKFile *file, const PDFKBuffer *dictionary, const char *key, PDFKReference **references)
+{
+    PDFKBuffer array = {0};
+    size_t count = 0;
+    *references = NULL;
+    if (PDFKFileCopyDictionaryValue(file, dictionary, key, &array)) {
+        size_t cursor = 0;
+        size_t start = 0;
+        size_t end = 0;
+        size_t capacity = 0;
+        while (PDFKArrayNextElement(array.bytes, array.length, &cursor, &start, &end)) {
+            PDFKReference reference;
+            if (PDFKParseReference(array.bytes, start, end, &reference) == NO) {
+                continue;
+            }
+            if (count == capacity) {
+                capacity = MAX(capacity * 2, (size_t)16);
+                PDFKReference *grown = realloc(*references, capacity * sizeof(PDFKReference));
+                if (grown == NULL) {
+                    break;
+                }
+                *references = grown;
+            }
+            (*references)[count++] = reference;
+        }
+    }
+    PDFKBufferFree(&array);
+    return count;
+}
+
+static BOOL PDFKReferencesContain(const PDFKReference *references, size_t count, uint32_t number)
+{
+    for (size_t index = 0; index < count; index++) {
+        if (references[index].number == number) {
+            return YES;
+        }
+    }
+    return NO;
+}
+
+/**
+ Write the bookmark outline items. The container item is the top level "Bookmarks" item, it is rewritten if a previous update added it, otherwise it is added to the end of the document outline.
+ */
+static BOOL PDFKUpdateWriteBookmarks(PDFKUpdate *update, PDFKBuffer *catalog, const PDFKBuffer *previousState, const uint32_t *pages, const PDFKReference *pageReferences, size_t count, PDFKReference *container)
+{
+    PDFKFile *file = update->file;
+    PDFKBuffer object = {0};
+    PDFKBuffer value = {0};
+    BOOL success = YES;
+    char reference[32];
+    
+    PDFKReference previousContainer;
+    BOOL hasContainer = (previousState != NULL && PDFKDictionaryGetReference(previousState->bytes, previousState->length, "Bookmarks", &previousContainer) &&
+                         PDFKFileCopyObject(file, previousContainer.number, &object));
+    if (hasContainer == NO && count == 0) {
+        container->number = 0;
+        return YES;
+    }
+    
+    //The items
+    PDFKReference first = {update->nextNumber, 0};
+    update->nextNumber += (uint32_t)count;
+    
+    if (hasContainer) {
+        *container = PDFKUpdateExistingReference(update, previousContainer.number);
+    } else {
+        *container = PDFKUpdateNewReference(update);
+        
+        //Add the container to the end of the document outline, or create an outline.
+        size_t start = 0;
+        size_t end = 0;
+        PDFKReference outline;
+        BOOL hasOutline = PDFKDictionaryFind(catalog->bytes, catalog->length, 0, "Outlines", NULL, &start, &end, NULL);
+        if (hasOutline && PDFKParseReference(catalog->bytes, start, end, &outline)) {
+            outline = PDFKUpdateExistingReference(update, outline.number);
+            hasOutline = PDFKFileCopyObject(file, outline.number, &value);
+        } else if (hasOutline) {
+            //An outline in the catalog is moved to its own object
+            outline = PDFKUpdateNewReference(update);
+            value.length = 0;
+            hasOutline = PDFKBufferAppend(&value, catalog->bytes + start, end - start);
+        }
+        if (hasOutline == NO) {
+            outline = PDFKUpdateNewReference(update);
+            value.length = 0;
+            success = PDFKBufferAppendFormat(&value, "<< /Type /Outlines >>");
+        }
+        
+        PDFKReference last;
+        BOOL hasLast = PDFKDictionaryGetReference(value.bytes, value.length, "Last", &last);
+        long long outlineCount = 0;
+        PDFKDictionaryGetInteger(value.bytes, value.length, "Count", &outlineCount);
+        
+        snprintf(reference, sizeof(reference), "%u %u R", container->number, container->generation);
+        if (hasLast == NO) {
+            success = success && PDFKBufferSetDictionaryValue(&value, "First", reference);
+        }
+        success = success && PDFKBufferSetDictionaryValue(&value, "Last", reference);
+        char countString[32];
+        snprintf(countString, sizeof(countString), "%lld", (outlineCount >= 0 ? outlineCount + 1 : outlineCount - 1));
+        success = success && PDFKBufferSetDictionaryValue(&value, "Count", countString);
+        success = success && PDFKUpdateWriteBuffer(update, outline, &value);
+        
+        if (success && hasLast) {
+            //Link the previous last item to the container
+            PDFKReference lastReference = PDFKUpdateExistingReference(update, last.number);
+            success = (PDFKFileCopyObject(file, last.number, &value) &&
+                       PDFKBufferSetDictionaryValue(&value, "Next", reference) &&
+                       PDFKUpdateWriteBuffer(update, lastReference, &value));
+        }
+        
+        snprintf(reference, sizeof(reference), "%u %u R", outline.number, outline.generation);
+        success = success && PDFKBufferSetDictionaryValue(catalog, "Outlines", reference);
+        
+        object.length = 0;
+        success = success && PDFKBufferAppendFormat(&object, "<< /Title (Bookmarks) /Parent %s", reference);
+        if (hasLast) {
+            success = success && PDFKBufferAppendFormat(&object, " /Prev %u %u R", last.number, PDFKUpdateExistingReference(update, last.number).generation);
+        }
+        success = success && PDFKBufferAppendFormat(&object, " >>");
+    }
+    
+    //The container lists the items, closed.
+    if (count > 0) {
+        snprintf(reference, sizeof(reference), "%u 0 R", first.number);
+        success = success && PDFKBufferSetDictionaryValue(&object, "First", reference);
+        snprintf(reference, sizeof(reference), "%u 0 R", first.number + (uint32_t)count - 1);
+        success = success && PDFKBufferSetDictionaryValue(&object, "Last", reference);
+        snprintf(reference, sizeof(reference), "-%zu", count);
+        success = success && PDFKBufferSetDictionaryValue(&object, "Count", reference);
+    } else {
+        success = (success && PDFKBufferSetDictionaryValue(&object, "First", NULL) && PDFKBufferSetDictionaryValue(&object, "Last", NULL) &&
+                   PDFKBufferSetDictionaryValue(&object, "Count", NULL));
+    }
+    success = success && PDFKUpdateWriteBuffer(update, *container, &object);
+    
+    //One item for each bookmarked page
+    for (size_t index = 0; index < count && success; index++) {
+        PDFKReference item = {first.number + (uint32_t)index, 0};
+        value.length = 0;
+        success = PDFKBufferAppendFormat(&value, "<< /Title (Page %u) /Parent %u %u R", pages[index], container->number, container->generation);
+        if (index > 0) {
+            success = success && PDFKBufferAppendFormat(&value, " /Prev %u 0 R", item.number - 1);
+        }
+        if (index + 1 < count) {
+            success = success && PDFKBufferAppendFormat(&value, " /Next %u 0 R", item.number + 1);
+        }
+        success = success && PDFKBufferAppendFormat(&value, " /Dest [%u %u R /Fit] >>", pageReferences[index].number, pageReferences[index].generation);
+        success = success && PDFKUpdateWriteBuffer(update, item, &value);
+    }
+    
+    PDFKBufferFree(&object);
+    PDFKBufferFree(&value);
+    return success;
+}
+
+/**
+ Write a highlight annotation for each highlighted page, and update the annotations of the pages. The annotations written by the previous update are removed.
+ */
+static BOOL PDFKUpdateWriteHighlights(PDFKUpdate *update, const PDFKBuffer *previousState, const PDFKReference *pageReferences, const double *rects, size_t count, PDFKBuffer *stateEntries)
+{
+    PDFKFile *file = update->file;
+    PDFKReference *previousAnnotations = NULL;
+    PDFKReference *previousPages = NULL;
+    size_t previousAnnotationCount = 0;
+    size_t previousPageCount = 0;
+    if (previousState != NULL) {
+        previousAnnotationCount = PDFKFileCopyReferences(file, previousState, "Highlights", &previousAnnotations);
+        previousPageCount = PDFKFileCopyReferences(file, previousState, "HighlightedPages", &previousPages);
+    }
+    
+    //The annotations
+    PDFKReference *annotations = calloc(MAX(count, (size_t)1), sizeof(PDFKReference));
+    PDFKBuffer value = {0};
+    BOOL success = (annotations != NULL);
+    for (size_t index = 0; index < count && success; index++) {
+        annotations[index] = PDFKUpdateNewReference(update);
+        const double *rect = rects + (index * 4);
+        value.length = 0;
+        success = (PDFKBufferAppendFormat(&value, "<< /Type /Annot /Subtype /Highlight /Rect [%.2f %.2f %.2f %.2f] /QuadPoints [%.2f %.2f %.2f %.2f %.2f %.2f %.2f %.2f]",
+                                          rect[0], rect[1], rect[2], rect[3], rect[0], rect[3], rect[2], rect[3], rect[0], rect[1], rect[2], rect[1]) &&
+                   PDFKBufferAppendFormat(&value, " /C [1 0.9 0.2] /CA 0.35 /F 4 /NM (PDFKHighlight) /P %u %u R >>", pageReferences[index].number, pageReferences[index].generation) &&
+                   PDFKUpdateWriteBuffer(update, annotations[index], &value));
+    }
+    
+    //The annotations of every page that was or is highlighted
+    PDFKBuffer page = {0};
+    PDFKBuffer array = {0};
+    PDFKBuffer elements = {0};
+    for (size_t index = 0; index < previousPageCount + count && success; index++) {
+        BOOL previous = (index < previousPageCount);
+        PDFKReference pageReference = (previous ? previousPages[index] : pageReferences[index - previousPageCount]);
+        if (previous == NO && PDFKReferencesContain(previousPages, previousPageCount, pageReference.number)) {
+            continue;
+        }
+        if (PDFKFileCopyObject(file, pageReference.number, &page) == NO) {
+            continue;
+        }
+        pageReference = PDFKUpdateExistingReference(update, pageReference.number);
+        
+        size_t start = 0;
+        size_t end = 0;
+        PDFKReference arrayReference = {0, 0};
+        BOOL hasArray = PDFKDictionaryFind(page.bytes, page.length, 0, "Annots", NULL, &start, &end, NULL);
+        if (hasArray && PDFKParseReference(page.bytes, start, end, &arrayReference)) {
+            hasArray = PDFKFileCopyObject(file, arrayReference.number, &array);
+            arrayReference = PDFKUpdateExistingReference(update, arrayReference.number);
+        } else if (hasArray) {
+            array.length = 0;
+            PDFKBufferAppend(&array, page.bytes + start, end - start);
+        }
+        
+        //Keep the other annotations
+        elements.length = 0;
+        BOOL changed = NO;
+        success = PDFKBufferAppend(&elements, "[", 1);
+        size_t cursor = 0;
+        while (hasArray && success && PDFKArrayNextElement(array.bytes, array.length, &cursor, &start, &end)) {
+            PDFKReference annotation;
+            if (PDFKParseReference(array.bytes, start, end, &annotation) && PDFKReferencesContain(previousAnnotations, previousAnnotationCount, annotation.number)) {
+                changed = YES;
+                continue;
+            }
+            success = (PDFKBufferAppend(&elements, array.bytes + start, end - start) && PDFKBufferAppend(&elements, " ", 1));
+        }
+        for (size_t annotation = 0; annotation < count && success; annotation++) {
+            if (pageReferences[annotation].number == pageReference.number) {
+                success = PDFKBufferAppendFormat(&elements, "%u %u R ", annotations[annotation].number, annotations[annotation].generation);
+                changed = YES;
+            }
+        }
+        success = success && PDFKBufferAppend(&elements, "]", 1);
+        if (changed == NO || success == NO) {
+            continue;
+        }
+        
+        if (arrayReference.number != 0) {
+            success = PDFKUpdateWriteBuffer(update, arrayReference, &elements);
+        } else {
+            PDFKBufferAppend(&elements, "", 1);
+            elements.length--;
+            success = (PDFKBufferSetDictionaryValue(&page, "Annots", (const char *)elements.bytes) && PDFKUpdateWriteBuffer(update, pageReference, &page));
+        }
+    }
+    
+    //Remember what was written, for the next update
+    success = (success && PDFKBufferAppend(stateEntries, " /Highlights ", 13) && PDFKBufferAppendReferences(stateEntries, annotations, count) &&
+               PDFKBufferAppend(stateEntries, " /HighlightedPages ", 19) && PDFKBufferAppendReferences(stateEntries, pageReferences, count));
+    
+    PDFKBufferFree(&page);
+    PDFKBufferFree(&array);
+    PDFKBufferFree(&elements);
+    PDFKBufferFree(&value);
+    free(annotations);
+    free(previousAnnotations);
+    free(previousPages);
+    return success;
+}
+
+/**
+ Build an update that writes the bookmarks as outline items and the highlighted pages as highlight annotations. The pages are sorted and unique, and each highlighted page has a rect (x0, y0, x1, y1) in its default user space.
+ */
+static BOOL PDFKBuildUserStateUpdate(PDFKFile *file, const uint32_t *bookmarks, size_t bookmarkCount, const uint32_t *highlights, const double *highlightRects, size_t highlightCount, PDFKUpdate *update)
+{
+    size_t start = 0;
+    size_t end = 0;
+    PDFKReference root;
+    if (PDFKDictionaryFind(file->trailer.bytes, file->trailer.length, 0, "Encrypt", NULL, &start, &end, NULL) ||
+        PDFKDictionaryGetReference(file->trailer.bytes, file->trailer.length, "Root", &root) == NO) {
+        //Objects of encrypted documents would have to be encrypted too.
+        return NO;
+    }
+    
+    PDFKUpdateBegin(update, file);
+    PDFKBuffer catalog = {0};
+    PDFKBuffer state = {0};
+    PDFKBuffer stateEntries = {0};
+    PDFKReference *bookmarkReferences = calloc(MAX(bookmarkCount, (size_t)1), sizeof(PDFKReference));
+    PDFKReference *highlightReferences = calloc(MAX(highlightCount, (size_t)1), sizeof(PDFKReference));
+    BOOL success = (bookmarkReferences != NULL && highlightReferences != NULL && PDFKFileCopyObject(file, root.number, &catalog) &&
+                    PDFKFileFindPages(file, &catalog, bookmarks, bookmarkCount, bookmarkReferences) &&
+                    PDFKFileFindPages(file, &catalog, highlights, highlightCount, highlightReferences));
+    BOOL hasState = (success && PDFKFileCopyDictionaryValue(file, &catalog, "PDFKUserState", &state));
+    
+    PDFKReference container = {0, 0};
+    success = (success && PDFKUpdateWriteBookmarks(update, &catalog, (hasState ? &state : NULL), bookmarks, bookmarkReferences, bookmarkCount, &container) &&
+               PDFKUpdateWriteHighlights(update, (hasState ? &state : NULL), highlightReferences, highlightRects, highlightCount, &stateEntries));
+    
+    //The state of this update, and the catalog that links to it.
+    if (success) {
+        PDFKReference stateReference = PDFKUpdateNewReference(update);
+        state.length = 0;
+        success = PDFKBufferAppend(&state, "<<", 2);
+        if (container.number != 0) {
+            success = success && PDFKBufferAppendFormat(&state, " /Bookmarks %u %u R", container.number, container.generation);
+        }
+        success = (success && PDFKBufferAppend(&state, stateEntries.bytes, stateEntries.length) && PDFKBufferAppend(&state, " >>", 3) &&
+                   PDFKUpdateWriteBuffer(update, stateReference, &state));
+        
+        char reference[32];
+        snprintf(reference, sizeof(reference), "%u %u R", stateReference.number, stateReference.generation);
+        success = (success && PDFKBufferSetDictionaryValue(&catalog, "PDFKUserState", reference) &&
+                   PDFKUpdateWriteBuffer(update, PDFKUpdateExistingReference(update, root.number), &catalog) &&
+                   PDFKUpdateFinish(update));
+    }
+    
+    PDFKBufferFree(&catalog);
+    PDFKBufferFree(&state);
+    PDFKBufferFree(&stateEntries);
+    free(bookmarkReferences);
+    free(highlightReferences);
+    return success;
+}
+
+#pragma mark - Appending
+
+/**
+ Flush the file to permanent storage.
+ */
+static BOOL PDFKSynchronize(int fd)
+{
+#ifdef F_FULLFSYNC
+    //fsync only reaches the drive's cache on Darwin
+    if (fcntl(fd, F_FULLFSYNC) == 0) {
+        return YES;
+    }
+#endif
+    return (fsync(fd) == 0);
+}
+
+static BOOL PDFKWriteAll(int fd, const uint8_t *bytes, size_t length, uint64_t offset)
+{
+    size_t done = 0;
+    while (done < length) {
+        ssize_t count = pwrite(fd, bytes + done, length - done, (off_t)(offset + done));
+        if (count < 0 && errno == EINTR) {
+            continue;
+        }
+        if (count <= 0) {
+            return NO;
+        }
+        done += (size_t)count;
+    }
+    return YES;
+}
+
+/**
+ Undo an append that did not finish. The journal records the length of the file before the append.
+ */
+static BOOL PDFKRecoverFile(const char *path, const char *journalPath)
+{
+    int journal = open(journalPath, O_RDONLY);
+    if (journal < 0) {
+        return NO;
+    }
+    char text[32] = {0};
+    ssize_t count = read(journal, text, sizeof(text) - 1);
+    close(journal);
+    long long length = (count > 0 ? strtoll(text, NULL, 10) : 0);
+    BOOL recovered = NO;
+    if (length > 0) {
+        int fd = open(path, O_RDWR);
+        struct stat status;
+        if (fd >= 0 && fstat(fd, &status) == 0 && status.st_size > length) {
+            recovered = (ftruncate(fd, (off_t)length) == 0 && PDFKSynchronize(fd));
+        }
+        if (fd >= 0) {
+            close(fd);
+        }
+    }
+    unlink(journalPath);
+    return recovered;
+}
+
+/**
+ Append the update to the file. The journal is written first, so an append cut short by a crash is undone the next time the file is opened.
+ */
+static BOOL PDFKAppendUpdate(int fd, const char *journalPath, const PDFKUpdate *update)
+{
+    int journal = open(journalPath, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (journal < 0) {
+        return NO;
+    }
+    char text[32];
+    int textLength = snprintf(text, sizeof(text), "%llu\n", (unsigned long long)update->file->length);
+    BOOL journaled = (PDFKWriteAll(journal, (const uint8_t *)text, (size_t)textLength, 0) && PDFKSynchronize(journal));
+    close(journal);
+    if (journaled == NO) {
+        unlink(journalPath);
+        return NO;
+    }
+    
+    if (PDFKWriteAll(fd, update->body.bytes, update->body.length, update->file->length) == NO || PDFKSynchronize(fd) == NO) {
+        //Leave the file as it was
+        if (ftruncate(fd, (off_t)update->file->length) == 0 && PDFKSynchronize(fd)) {
+            unlink(journalPath);
+        }
+        return NO;
+    }
+    unlink(journalPath);
+    return YES;
+}
+
+#pragma mark - Writer
+
+/**
+ Copy the pages of a page set to an array.
+ */
+static uint32_t *PDFKCopyPages(PDFKPageSet *pageSet, size_t pageCount, BOOL *valid)
+{
+    uint32_t *pages = malloc(MAX(pageSet.count, (NSUInteger)1) * sizeof(uint32_t));
+    __block size_t index = 0;
+    [pageSet enumerateIndexesUsingBlock:^(NSUInteger page, BOOL *stop) {
+        if (page < 1 || page > pageCount) {
+            *valid = NO;
+            *stop = YES;
+            return;
+        }
+        pages[index++] = (uint32_t)page;
+    }];
+    return pages;
+}
+
+@implementation PDFKIncrementalWriter
+{
+    NSString *filePath;
+    NSDictionary *statistics;
+}
+
++ (NSString *)journalPathForFileAtPath:(NSString *)filePath
+{
+    return [filePath stringByAppendingString:@".pdfkjournal"];
+}
+
++ (BOOL)recoverFileAtPath:(NSString *)filePath
+{
+    NSString *journalPath = [PDFKIncrementalWriter journalPathForFileAtPath:filePath];
+    return PDFKRecoverFile([filePath fileSystemRepresentation], [journalPath fileSystemRepresentation]);
+}
+
+- (id)initWithFilePath:(NSString *)path
+{
+    if ((self = [super init])) {
+        filePath = [path copy];
+    }
+    return self;
+}
+
+- (NSDictionary *)statistics
+{
+    return statistics;
+}
+
+- (BOOL)writeBookmarks:(PDFKPageSet *)bookmarks highlightedPages:(PDFKPageSet *)highlightedPages
+{
+    CFTimeInterval startTime = CACurrentMediaTime();
+    CGPDFDocumentRef documentRef = CGPDFDocumentCreate([NSURL fileURLWithPath:filePath isDirectory:NO], nil);
+    if (documentRef == NULL) {
+        return NO;
+    }
+    
+    //The pages must be in the document
+    BOOL valid = YES;
+    size_t pageCount = CGPDFDocumentGetNumberOfPages(documentRef);
+    uint32_t *bookmarkPages = PDFKCopyPages(bookmarks, pageCount, &valid);
+    uint32_t *highlightPages = PDFKCopyPages(highlightedPages, pageCount, &valid);
+    
+    //The highlights cover the visible area of the pages
+    double *highlightRects = malloc(MAX(highlightedPages.count, (NSUInteger)1) * 4 * sizeof(double));
+    for (NSUInteger index = 0; index < highlightedPages.count && valid; index++) {
+        CGPDFPageRef pageRef = CGPDFDocumentGetPage(documentRef, highlightPages[index]);
+        CGRect rect = CGRectIntersection(CGPDFPageGetBoxRect(pageRef, kCGPDFCropBox), CGPDFPageGetBoxRect(pageRef, kCGPDFMediaBox));
+        highlightRects[(index * 4)] = CGRectGetMinX(rect);
+        highlightRects[(index * 4) + 1] = CGRectGetMinY(rect);
+        highlightRects[(index * 4) + 2] = CGRectGetMaxX(rect);
+        highlightRects[(index * 4) + 3] = CGRectGetMaxY(rect);
+    }
+    CGPDFDocumentRelease(documentRef);
+    
+    //Remove a previous update that did not finish before adding to it.
+    [PDFKIncrementalWriter recoverFileAtPath:filePath];
+    NSString *journalPath = [PDFKIncrementalWriter journalPathForFileAtPath:filePath];
+    
+    PDFKFile file;
+    PDFKUpdate update;
+    memset(&file, 0, sizeof(PDFKFile));
+    memset(&update, 0, sizeof(PDFKUpdate));
+    int fd = (valid ? open([filePath fileSystemRepresentation], O_RDWR) : -1);
+    BOOL written = (fd >= 0 && PDFKFileOpen(&file, fd) &&
+                    PDFKBuildUserStateUpdate(&file, bookmarkPages, bookmarks.count, highlightPages, highlightRects, highlightedPages.count, &update) &&
+                    PDFKAppendUpdate(fd, [journalPath fileSystemRepresentation], &update));
+    
+    if (written) {
+        statistics = @{@"AppendedBytes": @(update.body.length),
+                       @"Objects": @(update.entryCount),
+                       @"Elapsed": @(CACurrentMediaTime() - startTime)};
+    }
+#ifdef DEBUG
+    else {
+        NSLog(@"%s Unable to write the update to %@", __FUNCTION__, filePath);
+    }
+#endif
+    
+    PDFKUpdateFree(&update);
+    PDFKFileClose(&file);
+    if (fd >= 0) {
+        close(fd);
+    }
+    free(bookmarkPages);
+    free(highlightPages);
+    free(highlightRects);
+    return written;
+}
+
+@end
@@ -0,0 +1,75 @@
+/*
+ //  PDFKNavigationModel.h
+ //  M13PDFKit
+ //
+ Copyright (c) 2014 Brandon McQuilkin
+ 
+ Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated documentation files (the
+ "Software"), to deal in the Software without restriction, including without limitation the rights to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software, and to permit persons to whom the Software is furnished to do so, subject to
+ the following conditions:
+ 
+ The above copyright notice and this permission notice shall be included in all copies or substantial portions of the Software.
+ 
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+
+#import <Foundation/Foundation.h>
+
+/**
+ Learns where a reader goes from each page of a document, to get the likely next pages ready before they are displayed. It counts the moves from page to page (a first order Markov model), and adds the targets of the links on the page and the next page as likely moves that have not been seen yet. Old moves count less over time. Safe to use from any thread.
+ */
+@interface PDFKNavigationModel : NSObject <NSCoding>
+
+/**
+ Create an empty model.
+ 
+ @return A new model.
+ */
+- (id)init;
+/**
+ Load a model that was serialized with serializedData.
+ 
+ @param data The serialized model.
+ 
+ @return The model, or nil if the data is not a valid model.
+ */
+- (id)initWithSerializedData:(NSData *)data;
+/**
+ A compact, platform independent representation of the model.
+ 
+ @return The serialized model.
+ */
+- (NSData *)serializedData;
+/**
+ Record a move from one page to another.
+ 
+ @param fromPage The page that was displayed.
+ @param toPage   The page displayed next.
+ */
+- (void)recordTransitionFromPage:(NSUInteger)fromPage toPage:(NSUInteger)toPage;
+/**
+ The number of recorded moves from one page to another, after aging.
+ 
+ @param fromPage The page that was displayed.
+ @param toPage   The page displayed next.
+ 
+ @return The count.
+ */
+- (NSUInteger)transitionCountFromPage:(NSUInteger)fromPage toPage:(NSUInteger)toPage;
+/**
+ Predict the pages that are displayed after a page, the most likely first.
+ 
+ @param page        The page being displayed.
+ @param linkTargets The pages the links on the page go to, NSNumbers. May be nil.
+ @param count       The most pages to return.
+ 
+ @return The predicted pages, NSNumbers. The page itself is never predicted.
+ */
+- (NSArray *)predictedPagesAfterPage:(NSUInteger)page linkTargets:(NSArray *)linkTargets count:(NSUInteger)count;
+/**
+ Statistics for the model. The keys are "Pages" (pages moved from), "Transitions" (moves recorded), "Predictions" (predictions followed by a recorded move from the same page), "PredictionHits" (of those, the ones that included the page moved to) and "HitRate".
+ */
+@property (nonatomic, readonly) NSDictionary *statistics;
+
+@end
@@ -0,0 +1,252 @@
+/*
+ //  PDFKNavigationModel.m
+ //  M13PDFKit
+ //
+ Copyright (c) 2014 Brandon McQuilkin
+ 
+ Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated documentation files (the
+ "Software"), to deal in the Software without restriction, including without limitation the rights to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software, and to permit persons to whom the Software is furnished to do so, subject to
+ the following conditions:
+ 
+ The above copyright notice and this permission notice shall be included in all copies or substantial portions of the Software.
+ 
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+
+#import "PDFKNavigationModel.h"
+#import <libkern/OSByteOrder.h>
+
+//The header of the serialized model: "PNM1"
+#define SERIAL_MAGIC 0x314D4E50
+#define SERIAL_VERSION 1
+//The most pages moved to that are counted for each page, the least counted are dropped
+#define MAXIMUM_TARGETS_PER_PAGE 8
+//The most pages moved from that are counted
+#define MAXIMUM_MODEL_PAGES 4096
+//When the moves counted from a page reach this, the counts are halved, so recent moves count more.
+#define AGING_THRESHOLD 64
+//The weight of moves that have not been seen, as a number of seen moves
+#define NEXT_PAGE_PRIOR 2.0
+#define PREVIOUS_PAGE_PRIOR 0.5
+#define LINK_TARGETS_PRIOR 2.0
+
+@implementation PDFKNavigationModel
+{
+    /**
+     The counts of the moves from each page: page number to a dictionary of page number to count.
+     */
+    NSMutableDictionary *transitions;
+    NSUInteger transitionCount;
+    
+    //Prediction accuracy
+    NSUInteger lastPredictedPage;
+    NSArray *lastPrediction;
+    NSUInteger predictionCount;
+    NSUInteger predictionHitCount;
+}
+
+- (id)init
+{
+    if ((self = [super init])) {
+        transitions = [NSMutableDictionary new];
+    }
+    return self;
+}
+
+#pragma mark Moves
+
+- (void)recordTransitionFromPage:(NSUInteger)fromPage toPage:(NSUInteger)toPage
+{
+    if (fromPage == 0 || toPage == 0 || fromPage == toPage || fromPage > UINT32_MAX || toPage > UINT32_MAX) {
+        return;
+    }
+    @synchronized(self) {
+        //Was the move predicted?
+        if (lastPrediction != nil && lastPredictedPage == fromPage) {
+            predictionCount++;
+            if ([lastPrediction containsObject:@(toPage)]) {
+                predictionHitCount++;
+            }
+            lastPrediction = nil;
+        }
+        
+        NSMutableDictionary *targets = transitions[@(fromPage)];
+        if (targets == nil) {
+            if (transitions.count >= MAXIMUM_MODEL_PAGES) {
+                return;
+            }
+            targets = [NSMutableDictionary new];
+            transitions[@(fromPage)] = targets;
+        }
+        [self addCount:1 toPage:toPage ofTargets:targets];
+        transitionCount++;
+        
+        //Age the counts of the page
+        NSUInteger total = [[targets.allValues valueForKeyPath:@"@sum.self"] unsignedIntegerValue];
+        if (total >= AGING_THRESHOLD) {
+            for (NSNumber *target in targets.allKeys) {
+                NSUInteger count = [targets[target] unsignedIntegerValue] / 2;
+                if (count == 0) {
+                    [targets removeObjectForKey:target];
+                } else {
+                    targets[target] = @(count);
+                }
+            }
+        }
+    }
+}
+
+- (void)addCount:(NSUInteger)count toPage:(NSUInteger)page ofTargets:(NSMutableDictionary *)targets
+{
+    NSNumber *key = @(page);
+    if (targets[key] == nil && targets.count >= MAXIMUM_TARGETS_PER_PAGE) {
+        //Make room by dropping the least counted page
+        NSNumber *least = nil;
+        for (NSNumber *target in targets) {
+            if (least == nil || [targets[target] unsignedIntegerValue] < [targets[least] unsignedIntegerValue]) {
+                least = target;
+            }
+        }
+        [targets removeObjectForKey:least];
+    }
+    targets[key] = @([targets[key] unsignedIntegerValue] + count);
+}
+
+- (NSUInteger)transitionCountFromPage:(NSUInteger)fromPage toPage:(NSUInteger)toPage
+{
+    @synchronized(self) {
+        return [transitions[@(fromPage)][@(toPage)] unsignedIntegerValue];
+    }
+}
+
+- (NSArray *)predictedPagesAfterPage:(NSUInteger)page linkTargets:(NSArray *)linkTargets count:(NSUInteger)count
+{
+    if (page == 0 || count == 0) {
+        return @[];
+    }
+    
+    //The seen moves, and the likely moves that have not been seen yet
+    NSMutableDictionary *scores = [NSMutableDictionary new];
+    void (^addScore)(NSUInteger target, double score) = ^(NSUInteger target, double score) {
+        if (target > 0 && target != page) {
+            scores[@(target)] = @([scores[@(target)] doubleValue] + score);
+        }
+    };
+    @synchronized(self) {
+        NSDictionary *targets = transitions[@(page)];
+        for (NSNumber *target in targets) {
+            addScore(target.unsignedIntegerValue, [targets[target] doubleValue]);
+        }
+    }
+    addScore(page + 1, NEXT_PAGE_PRIOR);
+    addScore(page - 1, PREVIOUS_PAGE_PRIOR);
+    NSOrderedSet *uniqueTargets = [NSOrderedSet orderedSetWithArray:(linkTargets ?: @[])];
+    for (NSNumber *target in uniqueTargets) {
+        addScore(target.unsignedIntegerValue, LINK_TARGETS_PRIOR / uniqueTargets.count);
+    }
+    
+    //Highest score first, then the nearest page
+    NSArray *ranked = [scores.allKeys sortedArrayUsingComparator:^NSComparisonResult(NSNumber *first, NSNumber *second) {
+        double firstScore = [scores[first] doubleValue];
+        double secondScore = [scores[second] doubleValue];
+        if (firstScore != secondScore) {
+            return (firstScore > secondScore ? NSOrderedAscending : NSOrderedDescending);
+        }
+        NSUInteger firstDistance = (NSUInteger)labs((long)first.unsignedIntegerValue - (long)page);
+        NSUInteger secondDistance = (NSUInteger)labs((long)second.unsignedIntegerValue - (long)page);
+        if (firstDistance != secondDistance) {
+            return (firstDistance < secondDistance ? NSOrderedAscending : NSOrderedDescending);
+        }
+        return [first compare:second];
+    }];
+    NSArray *predicted = [ranked subarrayWithRange:NSMakeRange(0, MIN(count, ranked.count))];
+    
+    @synchronized(self) {
+        lastPredictedPage = page;
+        lastPrediction = predicted;
+    }
+    return predicted;
+}
+
+- (NSDictionary *)statistics
+{
+    @synchronized(self) {
+        return @{@"Pages": @(transitions.count),
+                 @"Transitions": @(transitionCount),
+                 @"Predictions": @(predictionCount),
+                 @"PredictionHits": @(predictionHitCount),
+                 @"HitRate": @(predictionCount > 0 ? ((double)predictionHitCount / predictionCount) : 0.0)};
+    }
+}
+
+#pragma mark Serialization
+
+- (NSData *)serializedData
+{
+    @synchronized(self) {
+        //Header, then the page moved from, the page moved to and the count of each move, sorted.
+        NSMutableData *data = [NSMutableData new];
+        uint32_t header[3] = {OSSwapHostToLittleInt32(SERIAL_MAGIC), OSSwapHostToLittleInt32(SERIAL_VERSION), 0};
+        [data appendBytes:header length:sizeof(header)];
+        uint32_t moveCount = 0;
+        for (NSNumber *fromPage in [transitions.allKeys sortedArrayUsingSelector:@selector(compare:)]) {
+            NSDictionary *targets = transitions[fromPage];
+            for (NSNumber *toPage in [targets.allKeys sortedArrayUsingSelector:@selector(compare:)]) {
+                uint32_t move[3] = {OSSwapHostToLittleInt32(fromPage.unsignedIntValue), OSSwapHostToLittleInt32(toPage.unsignedIntValue), OSSwapHostToLittleInt32([targets[toPage] unsignedIntValue])};
+                [data appendBytes:move length:sizeof(move)];
+                moveCount++;
+            }
+        }
+        uint32_t count = OSSwapHostToLittleInt32(moveCount);
+        [data replaceBytesInRange:NSMakeRange(8, 4) withBytes:&count];
+        return data;
+    }
+}
+
+- (id)initWithSerializedData:(NSData *)data
+{
+    if ((self = [self init])) {
+        const uint32_t *words = data.bytes;
+        if (data.length < 12 || OSSwapLittleToHostInt32(words[0]) != SERIAL_MAGIC || OSSwapLittleToHostInt32(words[1]) != SERIAL_VERSION) {
+            return nil;
+        }
+        uint32_t moveCount = OSSwapLittleToHostInt32(words[2]);
+        if ((data.length - 12) / 12 < moveCount) {
+            return nil;
+        }
+        for (uint32_t move = 0; move < moveCount; move++) {
+            uint32_t fromPage = OSSwapLittleToHostInt32(words[3 + (move * 3)]);
+            uint32_t toPage = OSSwapLittleToHostInt32(words[4 + (move * 3)]);
+            uint32_t count = OSSwapLittleToHostInt32(words[5 + (move * 3)]);
+            if (fromPage == 0 || toPage == 0 || fromPage == toPage || count == 0) {
+                return nil;
+            }
+            NSMutableDictionary *targets = transitions[@(fromPage)];
+            if (targets == nil) {
+                if (transitions.count >= MAXIMUM_MODEL_PAGES) {
+                    continue;
+                }
+                targets = [NSMutableDictionary new];
+                transitions[@(fromPage)] = targets;
+            }
+            [self addCount:count toPage:toPage ofTargets:targets];
+            transitionCount += count;
+        }
+    }
+    return self;
+}
+
+#pragma mark NSCoding
+
+- (id)initWithCoder:(NSCoder *)decoder
+{
+    return [self initWithSerializedData:[decoder decodeObjectForKey:@"NavigationModelData"]];
+}
+
+- (void)encodeWithCoder:(NSCoder *)encoder
+{
+    [encoder encodeObject:[self serializedData] forKey:@"NavigationModelData"];
+}
+
+@end
@@ -0,0 +1,120 @@
+/*
+ //  PDFKPage.h
+ //  M13PDFKit
+ //
+ Copyright (c) 2014 Brandon McQuilkin
+ 
+ Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated documentation files (the
+ "Software"), to deal in the Software without restriction, including without limitation the rights to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software, and to permit persons to whom the Software is furnished to do so, subject to
+ the following conditions:
+ 
+ The above copyright notice and this permission notice shall be included in all copies or substantial portions of the Software.
+ 
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#import <Foundation/Foundation.h>
+#import <CoreGraphics/CoreGraphics.h>
+
+/**
+ The parsed information for a page of a PDF document: the page reference, its geometry, and its links. Creating a page does not touch UIKit, so pages can be built off the main thread and handed to a PDFKPageContent.
+ */
+@interface PDFKPage : NSObject
+
+/**
+ Load the page from an open document. The document and page are retained for the life of the page.
+ 
+ @param documentRef The document to load the page from.
+ @param page        The page number to load. It is clamped to the pages in the document.
+ 
+ @return A new page, or nil if the page could not be loaded.
+ */
+- (id)initWithDocumentRef:(CGPDFDocumentRef)documentRef page:(NSInteger)page;
+/**
+ Get the size of the view that displays a page, without loading the page's links.
+ 
+ @param pageRef The page.
+ 
+ @return The size of the view that displays the page, in points.
+ */
++ (CGSize)viewSizeForPageRef:(CGPDFPageRef)pageRef;
+/**
+ The document the page belongs to.
+ */
+@property (nonatomic, readonly) CGPDFDocumentRef documentRef;
+/**
+ The page reference.
+ */
+@property (nonatomic, readonly) CGPDFPageRef pageRef;
+/**
+ The page number.
+ */
+@property (nonatomic, readonly) NSInteger pageNumber;
+/**
+ The angle of the page (0, 90, 180, 270).
+ */
+@property (nonatomic, readonly) NSInteger pageAngle;
+/**
+ The size of the view that displays the page, in points.
+ */
+@property (nonatomic, readonly) CGSize viewSize;
+/**
+ The links on the page, PDFKDocumentLink objects in view coordinates.
+ */
+@property (nonatomic, readonly) NSArray *links;
+/**
+ Get the target of the link at the given point.
+ 
+ @param point The point in view coordinates.
+ 
+ @return A NSNumber with the target page number, a NSURL, or nil if there is no link at the point.
+ */
+- (id)linkTargetAtPoint:(CGPoint)point;
+/**
+ Get the links that intersect an area, found through a spatial index of the links.
+ 
+ @param rect The area in view coordinates.
+ 
+ @return PDFKDocumentLink objects, in the order of links.
+ */
+- (NSArray *)linksInRect:(CGRect)rect;
+/**
+ The pages the links on the page go to, NSNumbers without repeats, in the order of links. Links to URLs are skipped. Resolving named destinations can be slow, so this is resolved once, off the main thread if possible, and only for the first links of pages with many links.
+ */
+@property (nonatomic, readonly) NSArray *linkTargetPages;
+
+@end
+
+/**
+ A object representation of a link on a PDF page.
+ */
+@interface PDFKDocumentLink : NSObject
+
+/**
+ The rect of the link in the page.
+ */
+@property (nonatomic, assign, readonly) CGRect rect;
+/**
+ The link's information.
+ */
+@property (nonatomic, assign, readonly) CGPDFDictionaryRef dictionary;
+/**
+ Create a new document link.
+ 
+ @param linkRect       The rect of the link on the page.
+ @param linkDictionary The link's information.
+ 
+ @return A new document link.
+ */
++ (id)newWithRect:(CGRect)linkRect dictionary:(CGPDFDictionaryRef)linkDictionary;
+/**
+ Create a new document link.
+
+@param linkRect       The rect of the link on the page.
+@param linkDictionary The link's information.
+
+@return A new document link.
+*/
+- (id)initWithRect:(CGRect)linkRect dictionary:(CGPDFDictionaryRef)linkDictionary;
+
+@end
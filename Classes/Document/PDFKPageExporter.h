@@ -0,0 +1,52 @@
+/*
+ //  PDFKPageExporter.h
+ //  M13PDFKit
+ //
+ Copyright (c) 2014 Brandon McQuilkin
+ 
+ Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated documentation files (the
+ "Software"), to deal in the Software without restriction, including without limitation the rights to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software, and to permit persons to whom the Software is furnished to do so, subject to
+ the following conditions:
+ 
+ The above copyright notice and this permission notice shall be included in all copies or substantial portions of the Software.
+ 
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+
+#import <Foundation/Foundation.h>
+
+@class PDFKPageSet;
+
+/**
+ Writes a new PDF file with some of the pages of a document, for sharing part of a document.
+ 
+ Only the objects the pages use are copied. They are copied one at a time, straight to the new file, and the data of streams is copied as it is, without decoding and encoding it again. References are renumbered while the objects are copied, so memory use depends on the number of objects in the document, not on the size of their data.
+ 
+ The structure tree, article threads, outline and form of the document are not copied. Encrypted files are not supported.
+ */
+@interface PDFKPageExporter : NSObject
+
+/**
+ Create an exporter for a PDF file.
+ 
+ @param filePath The path of the PDF file.
+ 
+ @return A new exporter.
+ */
+- (id)initWithFilePath:(NSString *)filePath;
+/**
+ Write a new PDF file with the given pages.
+ 
+ @param pages The pages to export. They are written in the order of the document.
+ @param path  The path to write the new file to. An existing file is replaced.
+ 
+ @return YES if the file was written.
+ */
+- (BOOL)exportPages:(PDFKPageSet *)pages toPath:(NSString *)path;
+/**
+ The statistics of the last export. The keys are "WrittenBytes", "Objects" (the number of objects written) and "Elapsed" (in seconds).
+ */
+@property (nonatomic, readonly) NSDictionary *statistics;
+
+@end
@@ -0,0 +1,532 @@
+/*
+ //  PDFKPageExporter.m
+ //  M13PDFKit
+ //
+ Copyright (c) 2014 Brandon McQuilkin
+ 
+ Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated documentation files (the
+ "Software"), to deal in the Software without restriction, including without limitation the rights to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software, and to permit persons to whom the Software is furnished to do so, subject to
+ the following conditions:
+ 
+ The above copyright notice and this permission notice shall be included in all copies or substantial portions of the Software.
+ 
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+
+#import "PDFKPageExporter.h"
+#import "PDFKPageSet.h"
+#import "CGPDFDocument.h"
+#import "PDFKFileReader.h"
+#import <QuartzCore/QuartzCore.h>
+#import <fcntl.h>
+#import <unistd.h>
+
+#pragma mark - Exporting
+
+//The size of the output buffer, and of the chunks stream data is copied in
+#define EXPORT_BUFFER_SIZE 65536
+//The deepest page tree that is followed
+#define MAXIMUM_PAGE_TREE_DEPTH 32
+//The keys pages inherit from the page tree
+static const char *const PDFKInheritedPageKeys[] = {"Resources", "MediaBox", "CropBox", "Rotate"};
+#define INHERITED_PAGE_KEY_COUNT (sizeof(PDFKInheritedPageKeys) / sizeof(PDFKInheritedPageKeys[0]))
+//The header of a file whose version could not be read, and the binary comment that follows the version
+static const char PDFKExportHeader[] = "%PDF-1.7\n%\xE2\xE3\xCF\xD3\n";
+static const char PDFKExportBinaryComment[] = "\n%\xE2\xE3\xCF\xD3\n";
+
+/**
+ The state of an export. Objects are copied as they are found, so only the tables below grow with the document, not the data of its objects.
+ */
+typedef struct {
+    PDFKFile *file;
+    int fd;
+    /**
+     Written to the output when it is full.
+     */
+    PDFKBuffer output;
+    /**
+     The number of bytes written and buffered.
+     */
+    uint64_t offset;
+    /**
+     The new number of each object of the file, 0 if it is not copied (yet).
+     */
+    uint32_t *numbers;
+    /**
+     A bit for each object of the file that is not copied, the catalog and the page tree.
+     */
+    uint8_t *excluded;
+    /**
+     The objects that have a new number but have not been copied.
+     */
+    uint32_t *pending;
+    size_t pendingCount;
+    size_t pendingCapacity;
+    /**
+     The offsets of the copied objects, by new number.
+     */
+    uint64_t *offsets;
+    size_t offsetCapacity;
+    uint32_t nextNumber;
+    PDFKBuffer chunk;
+} PDFKExport;
+
+static BOOL PDFKExportFlush(PDFKExport *export)
+{
+    size_t done = 0;
+    while (done < export->output.length) {
+        ssize_t count = write(export->fd, export->output.bytes + done, export->output.length - done);
+        if (count < 0 && errno == EINTR) {
+            continue;
+        }
+        if (count <= 0) {
+            return NO;
+        }
+        done += (size_t)count;
+    }
+    export->output.length = 0;
+    return YES;
+}
+
+static BOOL PDFKExportWrite(PDFKExport *export, const void *bytes, size_t length)
+{
+    if (PDFKBufferAppend(&export->output, bytes, length) == NO) {
+        return NO;
+    }
+    export->offset += length;
+    return (export->output.length < EXPORT_BUFFER_SIZE || PDFKExportFlush(export));
+}
+
+static BOOL PDFKExportWriteFormat(PDFKExport *export, const char *format, ...) __attribute__((format(printf, 2, 3)));
+static BOOL PDFKExportWriteFormat(PDFKExport *export, const char *format, ...)
+{
+    char text[128];
+    va_list arguments;
+    va_start(arguments, format);
+    int length = vsnprintf(text, sizeof(text), format, arguments);
+    va_end(arguments);
+    return (length >= 0 && (size_t)length < sizeof(text) && PDFKExportWrite(export, text, (size_t)length));
+}
+
+static inline BOOL PDFKExportIsExcluded(PDFKExport *export, uint32_t number)
+{
+    return (export->excluded[number / 8] & (1 << (number % 8))) != 0;
+}
+
+static inline void PDFKExportExclude(PDFKExport *export, uint32_t number)
+{
+    if (number < export->file->entryCount) {
+        export->excluded[number / 8] |= (uint8_t)(1 << (number % 8));
+    }
+}
+
+/**
+ Give an object of the file a new number, it is copied later.
+ */
+static uint32_t PDFKExportNumberObject(PDFKExport *export, uint32_t number)
+{
+    if (export->numbers[number] != 0) {
+        return export->numbers[number];
+    }
+    if (export->pendingCount == export->pendingCapacity) {
+        size_t capacity = MAX(export->pendingCapacity * 2, (size_t)64);
+        uint32_t *pending = realloc(export->pending, capacity * sizeof(uint32_t));
+        if (pending == NULL) {
+            return 0;
+        }
+        export->pending = pending;
+        export->pendingCapacity = capacity;
+    }
+    export->pending[export->pendingCount++] = number;
+    export->numbers[number] = export->nextNumber++;
+    return export->numbers[number];
+}
+
+/**
+ Write a reference to the new number of an object. References to objects that are not copied become null.
+ */
+static BOOL PDFKExportWriteReference(PDFKExport *export, PDFKReference reference)
+{
+    uint32_t number = reference.number;
+    if (number >= export->file->entryCount || export->file->entries[number].type == 0 ||
+        (export->numbers[number] == 0 && PDFKExportIsExcluded(export, number))) {
+        return PDFKExportWrite(export, "null", 4);
+    }
+    uint32_t newNumber = PDFKExportNumberObject(export, number);
+    return (newNumber != 0 && PDFKExportWriteFormat(export, "%u 0 R", newNumber));
+}
+
+/**
+ Write a value, renumbering the references in it. Strings are copied as they are.
+ */
+static BOOL PDFKExportWriteValue(PDFKExport *export, const uint8_t *bytes, size_t length)
+{
+    size_t copied = 0;
+    size_t position = 0;
+    while (position < length) {
+        uint8_t c = bytes[position];
+        if (PDFKIsWhitespace(c) || c == '[' || c == ']' || c == '{' || c == '}' || c == '>' || c == '%') {
+            position = (c == '%' ? PDFKSkipSpace(bytes, length, position) : position + 1);
+        } else if (c == '(' || (c == '<' && (position + 1 >= length || bytes[position + 1] != '<'))) {
+            position = PDFKSkipValue(bytes, length, position);
+            if (position == PDFK_NOT_FOUND) {
+                return NO;
+            }
+        } else if (c == '<') {
+            position += 2;
+        } else if (c == '/') {
+            position = PDFKSkipRegular(bytes, length, position + 1);
+        } else {
+            size_t end = PDFKSkipRegular(bytes, length, position);
+            size_t generationStart = PDFKSkipSpace(bytes, length, end);
+            size_t keyword = PDFKSkipSpace(bytes, length, PDFKSkipRegular(bytes, length, generationStart));
+            PDFKReference reference;
+            if (c >= '0' && c <= '9' && keyword < length && bytes[keyword] == 'R' && (keyword + 1 == length || PDFKIsRegular(bytes[keyword + 1]) == NO) &&
+                PDFKParseReference(bytes, position, keyword + 1, &reference)) {
+                if (PDFKExportWrite(export, bytes + copied, position - copied) == NO || PDFKExportWriteReference(export, reference) == NO) {
+                    return NO;
+                }
+                copied = keyword + 1;
+                end = keyword + 1;
+            }
+            position = MAX(end, position + 1);
+        }
+    }
+    return PDFKExportWrite(export, bytes + copied, length - copied);
+}
+
+#pragma mark - Objects
+
+static BOOL PDFKExportBeginObject(PDFKExport *export, uint32_t newNumber)
+{
+    if (newNumber >= export->offsetCapacity) {
+        size_t capacity = MAX(export->offsetCapacity * 2, (size_t)newNumber + 64);
+        uint64_t *offsets = realloc(export->offsets, capacity * sizeof(uint64_t));
+        if (offsets == NULL) {
+            return NO;
+        }
+        memset(offsets + export->offsetCapacity, 0, (capacity - export->offsetCapacity) * sizeof(uint64_t));
+        export->offsets = offsets;
+        export->offsetCapacity = capacity;
+    }
+    export->offsets[newNumber] = export->offset;
+    return PDFKExportWriteFormat(export, "%u 0 obj\n", newNumber);
+}
+
+/**
+ Copy an object of the file. The data of streams is copied as it is, in chunks.
+ */
+static BOOL PDFKExportCopyObject(PDFKExport *export, uint32_t number, PDFKBuffer *value)
+{
+    BOOL isStream = NO;
+    PDFKStreamLocation location;
+    if (PDFKExportBeginObject(export, export->numbers[number]) == NO) {
+        return NO;
+    }
+    if (PDFKFileCopyObjectWithStream(export->file, number, value, &isStream, &location) == NO) {
+        //Keep the numbering valid
+        return PDFKExportWrite(export, "null\nendobj\n", 12);
+    }
+    if (isStream == NO) {
+        return (PDFKExportWriteValue(export, value->bytes, value->length) && PDFKExportWrite(export, "\nendobj\n", 8));
+    }
+    
+    //The length is written directly, instead of copying its object.
+    char length[32];
+    snprintf(length, sizeof(length), "%llu", (unsigned long long)location.length);
+    if (PDFKBufferSetDictionaryValue(value, "Length", length) == NO ||
+        PDFKExportWriteValue(export, value->bytes, value->length) == NO || PDFKExportWrite(export, "\nstream\n", 8) == NO) {
+        return NO;
+    }
+    for (uint64_t copied = 0; copied < location.length;) {
+        size_t chunkLength = (size_t)MIN((uint64_t)EXPORT_BUFFER_SIZE, location.length - copied);
+        if (PDFKFileRead(export->file, location.offset + copied, chunkLength, &export->chunk) == NO || export->chunk.length != chunkLength ||
+            PDFKExportWrite(export, export->chunk.bytes, chunkLength) == NO) {
+            return NO;
+        }
+        copied += chunkLength;
+    }
+    return PDFKExportWrite(export, "\nendstream\nendobj\n", 18);
+}
+
+#pragma mark - Pages
+
+/**
+ Exclude the nodes of the page tree, and the pages. Pages are only read when their parent has other nodes as kids.
+ */
+static BOOL PDFKExportExcludePageTree(PDFKExport *export, uint32_t number, int depth)
+{
+    if (depth > MAXIMUM_PAGE_TREE_DEPTH || number >= export->file->entryCount) {
+        return NO;
+    }
+    PDFKExportExclude(export, number);
+    PDFKBuffer node = {0};
+    PDFKBuffer kids = {0};
+    BOOL success = YES;
+    if (PDFKFileCopyObject(export->file, number, &node) && PDFKFileCopyDictionaryValue(export->file, &node, "Kids", &kids)) {
+        long long count = 0;
+        size_t kidCount = 0;
+        size_t cursor = 0;
+        size_t start = 0;
+        size_t end = 0;
+        while (PDFKArrayNextElement(kids.bytes, kids.length, &cursor, &start, &end)) {
+            kidCount++;
+        }
+        BOOL leaves = (PDFKDictionaryGetInteger(node.bytes, node.length, "Count", &count) && count == (long long)kidCount);
+        cursor = 0;
+        while (success && PDFKArrayNextElement(kids.bytes, kids.length, &cursor, &start, &end)) {
+            PDFKReference kid;
+            if (PDFKParseReference(kids.bytes, start, end, &kid)) {
+                if (leaves) {
+                    PDFKExportExclude(export, kid.number);
+                } else {
+                    success = PDFKExportExcludePageTree(export, kid.number, depth + 1);
+                }
+            }
+        }
+    }
+    PDFKBufferFree(&node);
+    PDFKBufferFree(&kids);
+    return success;
+}
+
+/**
+ Write a page, with the attributes it inherits, as a kid of the new page tree.
+ */
+static BOOL PDFKExportWritePage(PDFKExport *export, PDFKReference reference, PDFKBuffer *page)
+{
+    PDFKFile *file = export->file;
+    if (PDFKFileCopyObject(file, reference.number, page) == NO) {
+        return NO;
+    }
+    BOOL success = YES;
+    PDFKBuffer node = {0};
+    PDFKBuffer parent = {0};
+    PDFKBuffer inherited = {0};
+    size_t start = 0;
+    size_t end = 0;
+    for (size_t index = 0; index < INHERITED_PAGE_KEY_COUNT && success; index++) {
+        const char *key = PDFKInheritedPageKeys[index];
+        if (PDFKDictionaryFind(page->bytes, page->length, 0, key, NULL, &start, &end, NULL)) {
+            continue;
+        }
+        //Look up the tree for the closest node that has the key
+        node.length = 0;
+        PDFKBufferAppend(&node, page->bytes, page->length);
+        for (int depth = 0; depth < MAXIMUM_PAGE_TREE_DEPTH; depth++) {
+            PDFKReference parentReference;
+            if (PDFKDictionaryGetReference(node.bytes, node.length, "Parent", &parentReference) == NO ||
+                PDFKFileCopyObject(file, parentReference.number, &parent) == NO) {
+                break;
+            }
+            if (PDFKDictionaryFind(parent.bytes, parent.length, 0, key, NULL, &start, &end, NULL)) {
+                inherited.length = 0;
+                success = (PDFKBufferAppend(&inherited, parent.bytes + start, end - start) && PDFKBufferAppend(&inherited, "", 1) &&
+                           PDFKBufferSetDictionaryValue(page, key, (const char *)inherited.bytes));
+                break;
+            }
+            PDFKBuffer swap = node;
+            node = parent;
+            parent = swap;
+        }
+    }
+    PDFKBufferFree(&node);
+    PDFKBufferFree(&parent);
+    PDFKBufferFree(&inherited);
+    
+    //The structure tree and article threads are not copied. The parent is the new page tree, it is added after the references are renumbered.
+    size_t dictionaryEnd = PDFK_NOT_FOUND;
+    success = (success && PDFKBufferSetDictionaryValue(page, "Parent", NULL) && PDFKBufferSetDictionaryValue(page, "StructParents", NULL) &&
+               PDFKBufferSetDictionaryValue(page, "B", NULL));
+    if (success == NO || PDFKDictionaryFind(page->bytes, page->length, 0, "Parent", NULL, &start, &end, &dictionaryEnd) || dictionaryEnd == PDFK_NOT_FOUND) {
+        return NO;
+    }
+    return (PDFKExportBeginObject(export, export->numbers[reference.number]) && PDFKExportWriteValue(export, page->bytes, dictionaryEnd) &&
+            PDFKExportWrite(export, " /Parent 2 0 R ", 15) && PDFKExportWriteValue(export, page->bytes + dictionaryEnd, page->length - dictionaryEnd) &&
+            PDFKExportWrite(export, "\nendobj\n", 8));
+}
+
+/**
+ Write a new document with the given pages of the file, and the objects they use. The pages are sorted and unique.
+ */
+static BOOL PDFKExportPages(PDFKFile *file, const uint32_t *pages, size_t count, int fd, size_t *objectCount, uint64_t *byteCount)
+{
+    size_t start = 0;
+    size_t end = 0;
+    PDFKReference root;
+    PDFKReference pageTree;
+    if (count == 0 || PDFKDictionaryFind(file->trailer.bytes, file->trailer.length, 0, "Encrypt", NULL, &start, &end, NULL) ||
+        PDFKDictionaryGetReference(file->trailer.bytes, file->trailer.length, "Root", &root) == NO) {
+        return NO;
+    }
+    
+    PDFKExport export;
+    memset(&export, 0, sizeof(PDFKExport));
+    export.file = file;
+    export.fd = fd;
+    export.nextNumber = 1;
+    export.numbers = calloc(file->entryCount + 1, sizeof(uint32_t));
+    export.excluded = calloc((file->entryCount / 8) + 1, 1);
+    PDFKReference *references = calloc(count, sizeof(PDFKReference));
+    PDFKBuffer catalog = {0};
+    PDFKBuffer value = {0};
+    BOOL success = (export.numbers != NULL && export.excluded != NULL && references != NULL && PDFKFileCopyObject(file, root.number, &catalog) &&
+                    PDFKDictionaryGetReference(catalog.bytes, catalog.length, "Pages", &pageTree) &&
+                    PDFKFileFindPages(file, &catalog, pages, count, references) &&
+                    PDFKExportExcludePageTree(&export, pageTree.number, 0));
+    PDFKExportExclude(&export, root.number);
+    
+    //The version of the file
+    if (success && PDFKFileRead(file, 0, 16, &value) && value.length >= 8 && memcmp(value.bytes, "%PDF-", 5) == 0) {
+        size_t versionEnd = 5;
+        while (versionEnd < value.length && PDFKIsRegular(value.bytes[versionEnd])) {
+            versionEnd++;
+        }
+        success = (PDFKExportWrite(&export, value.bytes, versionEnd) && PDFKExportWrite(&export, PDFKExportBinaryComment, sizeof(PDFKExportBinaryComment) - 1));
+    } else {
+        success = success && PDFKExportWrite(&export, PDFKExportHeader, sizeof(PDFKExportHeader) - 1);
+    }
+    
+    //The catalog is 1, the page tree 2, then the pages.
+    export.nextNumber = 3;
+    for (size_t index = 0; index < count && success; index++) {
+        export.numbers[references[index].number] = export.nextNumber++;
+    }
+    uint32_t pageCount = (uint32_t)count;
+    success = (success && PDFKExportBeginObject(&export, 1) && PDFKExportWrite(&export, "<< /Type /Catalog /Pages 2 0 R >>\nendobj\n", 41) &&
+               PDFKExportBeginObject(&export, 2) && PDFKExportWrite(&export, "<< /Type /Pages /Kids [", 23));
+    for (uint32_t page = 0; page < pageCount && success; page++) {
+        success = PDFKExportWriteFormat(&export, "%u 0 R ", page + 3);
+    }
+    success = success && PDFKExportWriteFormat(&export, "] /Count %u >>\nendobj\n", pageCount);
+    for (size_t index = 0; index < count && success; index++) {
+        success = PDFKExportWritePage(&export, references[index], &value);
+    }
+    
+    //Everything the pages use, and the document information.
+    PDFKReference information;
+    uint32_t informationNumber = 0;
+    if (success && PDFKDictionaryGetReference(file->trailer.bytes, file->trailer.length, "Info", &information) && information.number < file->entryCount &&
+        file->entries[information.number].type != 0) {
+        informationNumber = PDFKExportNumberObject(&export, information.number);
+    }
+    while (success && export.pendingCount > 0) {
+        uint32_t number = export.pending[--export.pendingCount];
+        success = PDFKExportCopyObject(&export, number, &value);
+    }
+    
+    //The cross reference table
+    uint64_t crossReferenceOffset = export.offset;
+    success = success && PDFKExportWriteFormat(&export, "xref\n0 %u\n0000000000 65535 f\r\n", export.nextNumber);
+    for (uint32_t number = 1; number < export.nextNumber && success; number++) {
+        success = PDFKExportWriteFormat(&export, "%010llu 00000 n\r\n", (unsigned long long)export.offsets[number]);
+    }
+    uint8_t identifier[16];
+    arc4random_buf(identifier, sizeof(identifier));
+    success = success && PDFKExportWriteFormat(&export, "trailer\n<< /Size %u /Root 1 0 R", export.nextNumber);
+    if (informationNumber != 0) {
+        success = success && PDFKExportWriteFormat(&export, " /Info %u 0 R", informationNumber);
+    }
+    success = success && PDFKExportWrite(&export, " /ID [<", 7);
+    for (int pass = 0; pass < 2 && success; pass++) {
+        for (size_t index = 0; index < sizeof(identifier) && success; index++) {
+            success = PDFKExportWriteFormat(&export, "%02X", identifier[index]);
+        }
+        success = success && PDFKExportWrite(&export, (pass == 0 ? "> <" : ">] >>\n"), (pass == 0 ? 3 : 6));
+    }
+    success = (success && PDFKExportWriteFormat(&export, "startxref\n%llu\n%%%%EOF\n", (unsigned long long)crossReferenceOffset) &&
+               PDFKExportFlush(&export));
+    
+    *objectCount = export.nextNumber - 1;
+    *byteCount = export.offset;
+    PDFKBufferFree(&export.output);
+    PDFKBufferFree(&export.chunk);
+    PDFKBufferFree(&catalog);
+    PDFKBufferFree(&value);
+    free(export.numbers);
+    free(export.excluded);
+    free(export.pending);
+    free(export.offsets);
+    free(references);
+    return success;
+}
+
+#pragma mark - Exporter
+
+@implementation PDFKPageExporter
+{
+    NSString *filePath;
+    NSDictionary *statistics;
+}
+
+- (id)initWithFilePath:(NSString *)path
+{
+    if ((self = [super init])) {
+        filePath = [path copy];
+    }
+    return self;
+}
+
+- (NSDictionary *)statistics
+{
+    return statistics;
+}
+
+- (BOOL)exportPages:(PDFKPageSet *)pageSet toPath:(NSString *)path
+{
+    CFTimeInterval startTime = CACurrentMediaTime();
+    if (pageSet.count == 0 || path.length == 0) {
+        return NO;
+    }
+    CGPDFDocumentRef documentRef = CGPDFDocumentCreate([NSURL fileURLWithPath:filePath isDirectory:NO], nil);
+    if (documentRef == NULL) {
+        return NO;
+    }
+    size_t pageCount = CGPDFDocumentGetNumberOfPages(documentRef);
+    CGPDFDocumentRelease(documentRef);
+    
+    //The pages must be in the document
+    if (pageSet.firstIndex < 1 || pageSet.lastIndex > pageCount) {
+        return NO;
+    }
+    uint32_t *pages = malloc(pageSet.count * sizeof(uint32_t));
+    __block size_t count = 0;
+    [pageSet enumerateIndexesUsingBlock:^(NSUInteger page, BOOL *stop) {
+        pages[count++] = (uint32_t)page;
+    }];
+    
+    //Write next to the destination, and move it into place once it is complete.
+    NSString *temporaryPath = [path stringByAppendingString:@".partial"];
+    PDFKFile file;
+    memset(&file, 0, sizeof(PDFKFile));
+    size_t objectCount = 0;
+    uint64_t byteCount = 0;
+    int fd = open([filePath fileSystemRepresentation], O_RDONLY);
+    int output = open([temporaryPath fileSystemRepresentation], O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    BOOL written = (fd >= 0 && output >= 0 && PDFKFileOpen(&file, fd) && PDFKExportPages(&file, pages, count, output, &objectCount, &byteCount));
+    if (output >= 0) {
+        written = (close(output) == 0 && written);
+    }
+    written = (written && rename([temporaryPath fileSystemRepresentation], [path fileSystemRepresentation]) == 0);
+    
+    if (written) {
+        statistics = @{@"WrittenBytes": @(byteCount),
+                       @"Objects": @(objectCount),
+                       @"Elapsed": @(CACurrentMediaTime() - startTime)};
+    } else {
+        unlink([temporaryPath fileSystemRepresentation]);
+#ifdef DEBUG
+        NSLog(@"%s Unable to export the pages of %@", __FUNCTION__, filePath);
+#endif
+    }
+    
+    PDFKFileClose(&file);
+    if (fd >= 0) {
+        close(fd);
+    }
+    free(pages);
+    return written;
+}
+
+@end
@@ -0,0 +1,153 @@
+/*
+ //  PDFKPageSet.h
+ //  M13PDFKit
+ //
+ Copyright (c) 2014 Brandon McQuilkin
+ 
+ Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated documentation files (the
+ "Software"), to deal in the Software without restriction, including without limitation the rights to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software, and to permit persons to whom the Software is furnished to do so, subject to
+ the following conditions:
+ 
+ The above copyright notice and this permission notice shall be included in all copies or substantial portions of the Software.
+ 
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#import <Foundation/Foundation.h>
+
+/**
+ A compressed set of page numbers.
+ 
+ The set is split into chunks of 65536 pages. Each chunk is stored either as a sorted array of 16 bit offsets, or as a bitmap once it holds more than 4096 pages. This keeps small sets (bookmarks) tiny, and large sets (read pages, search hits in huge documents) fast to combine.
+ 
+ The interface mirrors NSMutableIndexSet so it can be used in its place.
+ */
+@interface PDFKPageSet : NSObject <NSCopying, NSCoding>
+
+/**@name Creation*/
+/**
+ Create an empty page set.
+ 
+ @return A new page set.
+ */
++ (PDFKPageSet *)pageSet;
+/**
+ Create a page set containing the indexes of the given index set.
+ 
+ @param indexSet The index set to copy.
+ 
+ @return A new page set.
+ */
++ (PDFKPageSet *)pageSetWithIndexSet:(NSIndexSet *)indexSet;
+/**
+ Initalize a page set from data created with serializedData.
+ 
+ @param data The serialized page set.
+ 
+ @return A new page set, or nil if the data is not a valid page set.
+ */
+- (id)initWithSerializedData:(NSData *)data;
+
+/**@name Querying*/
+/**
+ The number of pages in the set.
+ */
+@property (nonatomic, assign, readonly) NSUInteger count;
+/**
+ The smallest page in the set, NSNotFound if the set is empty.
+ */
+@property (nonatomic, assign, readonly) NSUInteger firstIndex;
+/**
+ The largest page in the set, NSNotFound if the set is empty.
+ */
+@property (nonatomic, assign, readonly) NSUInteger lastIndex;
+/**
+ Wether or not the set contains the given page.
+ 
+ @param index The page to check.
+ 
+ @return YES if the page is in the set.
+ */
+- (BOOL)containsIndex:(NSUInteger)index;
+/**
+ The number of pages in the set that are smaller than or equal to the given page.
+ 
+ @param index The page to count up to.
+ 
+ @return The rank of the page.
+ */
+- (NSUInteger)rankOfIndex:(NSUInteger)index;
+/**
+ The page at the given position when the set is sorted. For example, the page of the n-th bookmark.
+ 
+ @param rank The zero based position of the page.
+ 
+ @return The page, or NSNotFound if the rank is out of bounds.
+ */
+- (NSUInteger)indexAtRank:(NSUInteger)rank;
+/**
+ Enumerate the pages in the set in ascending order.
+ 
+ @param block The block to call for each page.
+ */
+- (void)enumerateIndexesUsingBlock:(void (^)(NSUInteger idx, BOOL *stop))block;
+/**
+ Create an index set with the same contents.
+ 
+ @return An index set.
+ */
+- (NSIndexSet *)indexSet;
+
+/**@name Modifying*/
+/**
+ Add the given page to the set.
+ 
+ @param index The page to add.
+ */
+- (void)addIndex:(NSUInteger)index;
+/**
+ Add the pages in the given range to the set.
+ 
+ @param range The pages to add.
+ */
+- (void)addIndexesInRange:(NSRange)range;
+/**
+ Remove the given page from the set.
+ 
+ @param index The page to remove.
+ */
+- (void)removeIndex:(NSUInteger)index;
+/**
+ Remove all pages from the set.
+ */
+- (void)removeAllIndexes;
+/**
+ Add all the pages from the given set to the set.
+ 
+ @param pageSet The pages to add.
+ */
+- (void)unionPageSet:(PDFKPageSet *)pageSet;
+/**
+ Remove the pages that are not in the given set from the set.
+ 
+ @param pageSet The pages to keep.
+ */
+- (void)intersectPageSet:(PDFKPageSet *)pageSet;
+/**
+ Create a new set containing the pages in both sets.
+ 
+ @param pageSet The set to intersect with.
+ 
+ @return A new page set.
+ */
+- (PDFKPageSet *)pageSetByIntersectingWithPageSet:(PDFKPageSet *)pageSet;
+
+/**@name Serialization*/
+/**
+ A compact representation of the set. Each chunk is written in the smallest of its array, bitmap, or run length forms.
+ 
+ @return The serialized set.
+ */
+- (NSData *)serializedData;
+
+@end
@@ -0,0 +1,953 @@
+/*
+ //  PDFKPageSet.m
+ //  M13PDFKit
+ //
+ Copyright (c) 2014 Brandon McQuilkin
+ 
+ Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated documentation files (the
+ "Software"), to deal in the Software without restriction, including without limitation the rights to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software, and to permit persons to whom the Software is furnished to do so, subject to
+ the following conditions:
+ 
+ The above copyright notice and this permission notice shall be included in all copies or substantial portions of the Software.
+ 
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#import "PDFKPageSet.h"
+
+//The largest number of pages stored as an array in a chunk. Larger chunks are stored as bitmaps. (At 4096 pages both take 8KB)
+#define ARRAY_MAX_CARDINALITY 4096
+//The number of 64 bit words in a bitmap chunk. (65536 bits)
+#define BITMAP_WORD_COUNT 1024
+
+//Serialized data identifier "PKPS" and version
+#define SERIAL_MAGIC 0x53504B50
+#define SERIAL_VERSION 1
+
+typedef NS_ENUM(uint8_t, PDFKPageSetChunkType) {
+    PDFKPageSetChunkTypeArray = 0,
+    PDFKPageSetChunkTypeBitmap = 1,
+    PDFKPageSetChunkTypeRuns = 2
+};
+
+/**
+ A chunk of 65536 pages that share the same upper 16 bits.
+ */
+typedef struct {
+    uint16_t key;
+    BOOL bitmap;
+    uint32_t cardinality;
+    uint32_t capacity;
+    union {
+        uint16_t *array;
+        uint64_t *words;
+    };
+} PDFKPageSetChunk;
+
+#pragma mark - Chunks
+
+static inline NSInteger PDFKPageSetArraySearch(const uint16_t *array, uint32_t count, uint16_t value)
+{
+    //Binary search, returns the index if found, or -(insertion point + 1)
+    NSInteger low = 0;
+    NSInteger high = (NSInteger)count - 1;
+    while (low <= high) {
+        NSInteger middle = (low + high) >> 1;
+        uint16_t current = array[middle];
+        if (current < value) {
+            low = middle + 1;
+        } else if (current > value) {
+            high = middle - 1;
+        } else {
+            return middle;
+        }
+    }
+    return -(low + 1);
+}
+
+static inline uint32_t PDFKPageSetBitmapCardinality(const uint64_t *words)
+{
+    uint32_t cardinality = 0;
+    for (NSUInteger i = 0; i < BITMAP_WORD_COUNT; i++) {
+        cardinality += __builtin_popcountll(words[i]);
+    }
+    return cardinality;
+}
+
+static void PDFKPageSetChunkFree(PDFKPageSetChunk *chunk)
+{
+    free(chunk->array);
+    chunk->array = NULL;
+}
+
+static void PDFKPageSetChunkConvertToBitmap(PDFKPageSetChunk *chunk)
+{
+    uint64_t *words = calloc(BITMAP_WORD_COUNT, sizeof(uint64_t));
+    for (uint32_t i = 0; i < chunk->cardinality; i++) {
+        uint16_t value = chunk->array[i];
+        words[value >> 6] |= (1ULL << (value & 63));
+    }
+    free(chunk->array);
+    chunk->words = words;
+    chunk->bitmap = YES;
+    chunk->capacity = 0;
+}
+
+static void PDFKPageSetChunkConvertToArray(PDFKPageSetChunk *chunk)
+{
+    uint32_t capacity = (chunk->cardinality > 4 ? chunk->cardinality : 4);
+    uint16_t *array = malloc(capacity * sizeof(uint16_t));
+    uint32_t count = 0;
+    for (NSUInteger i = 0; i < BITMAP_WORD_COUNT; i++) {
+        uint64_t word = chunk->words[i];
+        while (word != 0) {
+            array[count++] = (uint16_t)((i << 6) + __builtin_ctzll(word));
+            word &= (word - 1);
+        }
+    }
+    free(chunk->words);
+    chunk->array = array;
+    chunk->bitmap = NO;
+    chunk->capacity = capacity;
+}
+
+static inline void PDFKPageSetChunkNormalize(PDFKPageSetChunk *chunk)
+{
+    //Keep the representation canonical, so equal chunks are stored the same way.
+    if (chunk->bitmap && chunk->cardinality <= ARRAY_MAX_CARDINALITY) {
+        PDFKPageSetChunkConvertToArray(chunk);
+    } else if (!chunk->bitmap && chunk->cardinality > ARRAY_MAX_CARDINALITY) {
+        PDFKPageSetChunkConvertToBitmap(chunk);
+    }
+}
+
+static PDFKPageSetChunk PDFKPageSetChunkCopy(const PDFKPageSetChunk *chunk)
+{
+    PDFKPageSetChunk copy = *chunk;
+    if (chunk->bitmap) {
+        copy.words = malloc(BITMAP_WORD_COUNT * sizeof(uint64_t));
+        memcpy(copy.words, chunk->words, BITMAP_WORD_COUNT * sizeof(uint64_t));
+    } else {
+        copy.capacity = (chunk->cardinality > 4 ? chunk->cardinality : 4);
+        copy.array = malloc(copy.capacity * sizeof(uint16_t));
+        memcpy(copy.array, chunk->array, chunk->cardinality * sizeof(uint16_t));
+    }
+    return copy;
+}
+
+static inline BOOL PDFKPageSetChunkContains(const PDFKPageSetChunk *chunk, uint16_t value)
+{
+    if (chunk->bitmap) {
+        return (chunk->words[value >> 6] & (1ULL << (value & 63))) != 0;
+    }
+    return PDFKPageSetArraySearch(chunk->array, chunk->cardinality, value) >= 0;
+}
+
+static BOOL PDFKPageSetChunkAdd(PDFKPageSetChunk *chunk, uint16_t value)
+{
+    if (!chunk->bitmap) {
+        NSInteger location = PDFKPageSetArraySearch(chunk->array, chunk->cardinality, value);
+        if (location >= 0) {
+            return NO;
+        }
+        if (chunk->cardinality < ARRAY_MAX_CARDINALITY) {
+            //Insert into the array
+            location = -location - 1;
+            if (chunk->cardinality == chunk->capacity) {
+                chunk->capacity = (chunk->capacity < 4 ? 4 : chunk->capacity * 2);
+                chunk->array = realloc(chunk->array, chunk->capacity * sizeof(uint16_t));
+            }
+            memmove(chunk->array + location + 1, chunk->array + location, (chunk->cardinality - location) * sizeof(uint16_t));
+            chunk->array[location] = value;
+            chunk->cardinality++;
+            return YES;
+        }
+        //Too large for an array
+        PDFKPageSetChunkConvertToBitmap(chunk);
+    }
+    
+    uint64_t *word = &chunk->words[value >> 6];
+    uint64_t bit = (1ULL << (value & 63));
+    if ((*word & bit) != 0) {
+        return NO;
+    }
+    *word |= bit;
+    chunk->cardinality++;
+    return YES;
+}
+
+static BOOL PDFKPageSetChunkRemove(PDFKPageSetChunk *chunk, uint16_t value)
+{
+    if (chunk->bitmap) {
+        uint64_t *word = &chunk->words[value >> 6];
+        uint64_t bit = (1ULL << (value & 63));
+        if ((*word & bit) == 0) {
+            return NO;
+        }
+        *word &= ~bit;
+        chunk->cardinality--;
+        PDFKPageSetChunkNormalize(chunk);
+        return YES;
+    }
+    
+    NSInteger location = PDFKPageSetArraySearch(chunk->array, chunk->cardinality, value);
+    if (location < 0) {
+        return NO;
+    }
+    memmove(chunk->array + location, chunk->array + location + 1, (chunk->cardinality - location - 1) * sizeof(uint16_t));
+    chunk->cardinality--;
+    return YES;
+}
+
+static uint32_t PDFKPageSetChunkRank(const PDFKPageSetChunk *chunk, uint16_t value)
+{
+    //The number of values smaller than or equal to the given value.
+    if (!chunk->bitmap) {
+        NSInteger location = PDFKPageSetArraySearch(chunk->array, chunk->cardinality, value);
+        return (uint32_t)(location >= 0 ? location + 1 : -location - 1);
+    }
+    
+    uint32_t rank = 0;
+    NSUInteger wordIndex = (value >> 6);
+    for (NSUInteger i = 0; i < wordIndex; i++) {
+        rank += __builtin_popcountll(chunk->words[i]);
+    }
+    uint64_t mask = ((2ULL << (value & 63)) - 1);
+    rank += __builtin_popcountll(chunk->words[wordIndex] & mask);
+    return rank;
+}
+
+static uint16_t PDFKPageSetChunkSelect(const PDFKPageSetChunk *chunk, uint32_t rank)
+{
+    //The value at the given rank, the rank must be less than the cardinality.
+    if (!chunk->bitmap) {
+        return chunk->array[rank];
+    }
+    
+    for (NSUInteger i = 0; i < BITMAP_WORD_COUNT; i++) {
+        uint64_t word = chunk->words[i];
+        uint32_t bits = __builtin_popcountll(word);
+        if (rank < bits) {
+            //Clear the lower set bits until we reach the one we want.
+            while (rank-- > 0) {
+                word &= (word - 1);
+            }
+            return (uint16_t)((i << 6) + __builtin_ctzll(word));
+        }
+        rank -= bits;
+    }
+    return 0;
+}
+
+static PDFKPageSetChunk PDFKPageSetChunkUnion(const PDFKPageSetChunk *a, const PDFKPageSetChunk *b)
+{
+    PDFKPageSetChunk result;
+    result.key = a->key;
+    
+    if (a->bitmap || b->bitmap) {
+        //Start with the bitmap, and merge the other chunk into it.
+        const PDFKPageSetChunk *bitmapChunk = (a->bitmap ? a : b);
+        const PDFKPageSetChunk *otherChunk = (a->bitmap ? b : a);
+        result = PDFKPageSetChunkCopy(bitmapChunk);
+        if (otherChunk->bitmap) {
+            for (NSUInteger i = 0; i < BITMAP_WORD_COUNT; i++) {
+                result.words[i] |= otherChunk->words[i];
+            }
+        } else {
+            for (uint32_t i = 0; i < otherChunk->cardinality; i++) {
+                uint16_t value = otherChunk->array[i];
+                result.words[value >> 6] |= (1ULL << (value & 63));
+            }
+        }
+        result.cardinality = PDFKPageSetBitmapCardinality(result.words);
+        return result;
+    }
+    
+    //Merge the two sorted arrays
+    result.bitmap = NO;
+    result.capacity = a->cardinality + b->cardinality;
+    result.array = malloc(result.capacity * sizeof(uint16_t));
+    uint32_t i = 0, j = 0, count = 0;
+    while (i < a->cardinality && j < b->cardinality) {
+        uint16_t va = a->array[i];
+        uint16_t vb = b->array[j];
+        if (va < vb) {
+            result.array[count++] = va; i++;
+        } else if (va > vb) {
+            result.array[count++] = vb; j++;
+        } else {
+            result.array[count++] = va; i++; j++;
+        }
+    }
+    while (i < a->cardinality) result.array[count++] = a->array[i++];
+    while (j < b->cardinality) result.array[count++] = b->array[j++];
+    result.cardinality = count;
+    PDFKPageSetChunkNormalize(&result);
+    return result;
+}
+
+static PDFKPageSetChunk PDFKPageSetChunkIntersect(const PDFKPageSetChunk *a, const PDFKPageSetChunk *b)
+{
+    PDFKPageSetChunk result;
+    result.key = a->key;
+    
+    if (a->bitmap && b->bitmap) {
+        result = PDFKPageSetChunkCopy(a);
+        for (NSUInteger i = 0; i < BITMAP_WORD_COUNT; i++) {
+            result.words[i] &= b->words[i];
+        }
+        result.cardinality = PDFKPageSetBitmapCardinality(result.words);
+        PDFKPageSetChunkNormalize(&result);
+        return result;
+    }
+    
+    result.bitmap = NO;
+    result.cardinality = 0;
+    
+    if (a->bitmap || b->bitmap) {
+        //Keep the array values found in the bitmap
+        const PDFKPageSetChunk *bitmapChunk = (a->bitmap ? a : b);
+        const PDFKPageSetChunk *arrayChunk = (a->bitmap ? b : a);
+        result.capacity = (arrayChunk->cardinality > 4 ? arrayChunk->cardinality : 4);
+        result.array = malloc(result.capacity * sizeof(uint16_t));
+        for (uint32_t i = 0; i < arrayChunk->cardinality; i++) {
+            uint16_t value = arrayChunk->array[i];
+            if (PDFKPageSetChunkContains(bitmapChunk, value)) {
+                result.array[result.cardinality++] = value;
+            }
+        }
+        return result;
+    }
+    
+    //Intersect the two sorted arrays
+    uint32_t smallest = (a->cardinality < b->cardinality ? a->cardinality : b->cardinality);
+    result.capacity = (smallest > 4 ? smallest : 4);
+    result.array = malloc(result.capacity * sizeof(uint16_t));
+    uint32_t i = 0, j = 0;
+    while (i < a->cardinality && j < b->cardinality) {
+        uint16_t va = a->array[i];
+        uint16_t vb = b->array[j];
+        if (va < vb) {
+            i++;
+        } else if (va > vb) {
+            j++;
+        } else {
+            result.array[result.cardinality++] = va; i++; j++;
+        }
+    }
+    return result;
+}
+
+static BOOL PDFKPageSetChunkEqual(const PDFKPageSetChunk *a, const PDFKPageSetChunk *b)
+{
+    //Chunks are normalized, so equal chunks always have the same representation.
+    if (a->key != b->key || a->cardinality != b->cardinality || a->bitmap != b->bitmap) {
+        return NO;
+    }
+    if (a->bitmap) {
+        return memcmp(a->words, b->words, BITMAP_WORD_COUNT * sizeof(uint64_t)) == 0;
+    }
+    return memcmp(a->array, b->array, a->cardinality * sizeof(uint16_t)) == 0;
+}
+
+static uint32_t PDFKPageSetChunkRunCount(const PDFKPageSetChunk *chunk)
+{
+    uint32_t runs = 0;
+    if (chunk->bitmap) {
+        //A run starts at every set bit whose previous bit is clear.
+        uint64_t carry = 0;
+        for (NSUInteger i = 0; i < BITMAP_WORD_COUNT; i++) {
+            uint64_t word = chunk->words[i];
+            runs += __builtin_popcountll(word & ~((word << 1) | carry));
+            carry = (word >> 63);
+        }
+    } else {
+        for (uint32_t i = 0; i < chunk->cardinality; i++) {
+            if (i == 0 || chunk->array[i] != chunk->array[i - 1] + 1) {
+                runs++;
+            }
+        }
+    }
+    return runs;
+}
+
+/**
+ Reads little endian values from serialized data, failing on truncated data.
+ */
+typedef struct {
+    const uint8_t *bytes;
+    NSUInteger length;
+    NSUInteger offset;
+} PDFKPageSetReader;
+
+static inline BOOL PDFKPageSetRead(PDFKPageSetReader *reader, void *value, size_t size)
+{
+    if (reader->offset + size > reader->length) {
+        return NO;
+    }
+    memcpy(value, reader->bytes + reader->offset, size);
+    reader->offset += size;
+    return YES;
+}
+
+static inline BOOL PDFKPageSetReadUInt16(PDFKPageSetReader *reader, uint16_t *value)
+{
+    if (!PDFKPageSetRead(reader, value, sizeof(uint16_t))) return NO;
+    *value = OSSwapLittleToHostInt16(*value);
+    return YES;
+}
+
+static inline BOOL PDFKPageSetReadUInt32(PDFKPageSetReader *reader, uint32_t *value)
+{
+    if (!PDFKPageSetRead(reader, value, sizeof(uint32_t))) return NO;
+    *value = OSSwapLittleToHostInt32(*value);
+    return YES;
+}
+
+static inline BOOL PDFKPageSetReadUInt64(PDFKPageSetReader *reader, uint64_t *value)
+{
+    if (!PDFKPageSetRead(reader, value, sizeof(uint64_t))) return NO;
+    *value = OSSwapLittleToHostInt64(*value);
+    return YES;
+}
+
+static inline void PDFKPageSetAppendRun(NSMutableData *data, int32_t start, int32_t end)
+{
+    //Each run is written as its start and length - 1.
+    uint16_t run[2] = {OSSwapHostToLittleInt16((uint16_t)start), OSSwapHostToLittleInt16((uint16_t)(end - start))};
+    [data appendBytes:run length:4];
+}
+
+static inline void PDFKPageSetAppendRunValue(NSMutableData *data, int32_t *start, int32_t *previous, int32_t value)
+{
+    if (*start < 0) {
+        *start = value;
+    } else if (value != *previous + 1) {
+        PDFKPageSetAppendRun(data, *start, *previous);
+        *start = value;
+    }
+    *previous = value;
+}
+
+static void PDFKPageSetAppendRuns(NSMutableData *data, const PDFKPageSetChunk *chunk)
+{
+    int32_t start = -1;
+    int32_t previous = -1;
+    if (chunk->bitmap) {
+        for (NSUInteger i = 0; i < BITMAP_WORD_COUNT; i++) {
+            uint64_t word = chunk->words[i];
+            while (word != 0) {
+                PDFKPageSetAppendRunValue(data, &start, &previous, (int32_t)((i << 6) + __builtin_ctzll(word)));
+                word &= (word - 1);
+            }
+        }
+    } else {
+        for (uint32_t i = 0; i < chunk->cardinality; i++) {
+            PDFKPageSetAppendRunValue(data, &start, &previous, chunk->array[i]);
+        }
+    }
+    if (start >= 0) {
+        PDFKPageSetAppendRun(data, start, previous);
+    }
+}
+
+@implementation PDFKPageSet
+{
+    /**
+     The chunks, sorted by key.
+     */
+    PDFKPageSetChunk *_chunks;
+    NSUInteger _chunkCount;
+    NSUInteger _chunkCapacity;
+    /**
+     The total number of pages.
+     */
+    NSUInteger _count;
+}
+
+#pragma mark - Creation
+
++ (PDFKPageSet *)pageSet
+{
+    return [[PDFKPageSet alloc] init];
+}
+
++ (PDFKPageSet *)pageSetWithIndexSet:(NSIndexSet *)indexSet
+{
+    PDFKPageSet *pageSet = [[PDFKPageSet alloc] init];
+    [indexSet enumerateRangesUsingBlock:^(NSRange range, BOOL *stop) {
+        [pageSet addIndexesInRange:range];
+    }];
+    return pageSet;
+}
+
+- (void)dealloc
+{
+    for (NSUInteger i = 0; i < _chunkCount; i++) {
+        PDFKPageSetChunkFree(&_chunks[i]);
+    }
+    free(_chunks);
+}
+
+- (id)copyWithZone:(NSZone *)zone
+{
+    PDFKPageSet *copy = [[PDFKPageSet allocWithZone:zone] init];
+    [copy unionPageSet:self];
+    return copy;
+}
+
+#pragma mark - Chunk Management
+
+- (NSInteger)locationOfChunkWithKey:(uint16_t)key
+{
+    //Binary search, returns the index if found, or -(insertion point + 1)
+    NSInteger low = 0;
+    NSInteger high = (NSInteger)_chunkCount - 1;
+    while (low <= high) {
+        NSInteger middle = (low + high) >> 1;
+        uint16_t current = _chunks[middle].key;
+        if (current < key) {
+            low = middle + 1;
+        } else if (current > key) {
+            high = middle - 1;
+        } else {
+            return middle;
+        }
+    }
+    return -(low + 1);
+}
+
+- (void)insertChunk:(PDFKPageSetChunk)chunk atLocation:(NSUInteger)location
+{
+    if (_chunkCount == _chunkCapacity) {
+        _chunkCapacity = (_chunkCapacity < 4 ? 4 : _chunkCapacity * 2);
+        _chunks = realloc(_chunks, _chunkCapacity * sizeof(PDFKPageSetChunk));
+    }
+    memmove(_chunks + location + 1, _chunks + location, (_chunkCount - location) * sizeof(PDFKPageSetChunk));
+    _chunks[location] = chunk;
+    _chunkCount++;
+}
+
+- (void)removeChunkAtLocation:(NSUInteger)location
+{
+    PDFKPageSetChunkFree(&_chunks[location]);
+    memmove(_chunks + location, _chunks + location + 1, (_chunkCount - location - 1) * sizeof(PDFKPageSetChunk));
+    _chunkCount--;
+}
+
+#pragma mark - Querying
+
+- (NSUInteger)count
+{
+    return _count;
+}
+
+- (NSUInteger)firstIndex
+{
+    if (_chunkCount == 0) {
+        return NSNotFound;
+    }
+    return ((NSUInteger)_chunks[0].key << 16) | PDFKPageSetChunkSelect(&_chunks[0], 0);
+}
+
+- (NSUInteger)lastIndex
+{
+    if (_chunkCount == 0) {
+        return NSNotFound;
+    }
+    PDFKPageSetChunk *chunk = &_chunks[_chunkCount - 1];
+    return ((NSUInteger)chunk->key << 16) | PDFKPageSetChunkSelect(chunk, chunk->cardinality - 1);
+}
+
+- (BOOL)containsIndex:(NSUInteger)index
+{
+    if (index > UINT32_MAX) {
+        return NO;
+    }
+    NSInteger location = [self locationOfChunkWithKey:(uint16_t)(index >> 16)];
+    if (location < 0) {
+        return NO;
+    }
+    return PDFKPageSetChunkContains(&_chunks[location], (uint16_t)(index & 0xFFFF));
+}
+
+- (NSUInteger)rankOfIndex:(NSUInteger)index
+{
+    if (index > UINT32_MAX) {
+        return _count;
+    }
+    uint16_t key = (uint16_t)(index >> 16);
+    NSUInteger rank = 0;
+    for (NSUInteger i = 0; i < _chunkCount; i++) {
+        PDFKPageSetChunk *chunk = &_chunks[i];
+        if (chunk->key < key) {
+            rank += chunk->cardinality;
+        } else {
+            if (chunk->key == key) {
+                rank += PDFKPageSetChunkRank(chunk, (uint16_t)(index & 0xFFFF));
+            }
+            break;
+        }
+    }
+    return rank;
+}
+
+- (NSUInteger)indexAtRank:(NSUInteger)rank
+{
+    if (rank >= _count) {
+        return NSNotFound;
+    }
+    for (NSUInteger i = 0; i < _chunkCount; i++) {
+        PDFKPageSetChunk *chunk = &_chunks[i];
+        if (rank < chunk->cardinality) {
+            return ((NSUInteger)chunk->key << 16) | PDFKPageSetChunkSelect(chunk, (uint32_t)rank);
+        }
+        rank -= chunk->cardinality;
+    }
+    return NSNotFound;
+}
+
+- (void)enumerateIndexesUsingBlock:(void (^)(NSUInteger, BOOL *))block
+{
+    BOOL stop = NO;
+    for (NSUInteger i = 0; i < _chunkCount && !stop; i++) {
+        PDFKPageSetChunk *chunk = &_chunks[i];
+        NSUInteger high = ((NSUInteger)chunk->key << 16);
+        if (chunk->bitmap) {
+            for (NSUInteger w = 0; w < BITMAP_WORD_COUNT && !stop; w++) {
+                uint64_t word = chunk->words[w];
+                while (word != 0 && !stop) {
+                    block(high | ((w << 6) + __builtin_ctzll(word)), &stop);
+                    word &= (word - 1);
+                }
+            }
+        } else {
+            for (uint32_t j = 0; j < chunk->cardinality && !stop; j++) {
+                block(high | chunk->array[j], &stop);
+            }
+        }
+    }
+}
+
+- (NSIndexSet *)indexSet
+{
+    NSMutableIndexSet *indexSet = [NSMutableIndexSet indexSet];
+    [self enumerateIndexesUsingBlock:^(NSUInteger idx, BOOL *stop) {
+        [indexSet addIndex:idx];
+    }];
+    return [indexSet copy];
+}
+
+#pragma mark - Modifying
+
+- (void)addIndex:(NSUInteger)index
+{
+    if (index > UINT32_MAX) {
+        return;
+    }
+    uint16_t key = (uint16_t)(index >> 16);
+    NSInteger location = [self locationOfChunkWithKey:key];
+    if (location < 0) {
+        PDFKPageSetChunk chunk = {0};
+        chunk.key = key;
+        [self insertChunk:chunk atLocation:(-location - 1)];
+        location = -location - 1;
+    }
+    if (PDFKPageSetChunkAdd(&_chunks[location], (uint16_t)(index & 0xFFFF))) {
+        _count++;
+    }
+}
+
+- (void)addIndexesInRange:(NSRange)range
+{
+    for (NSUInteger index = range.location; index < NSMaxRange(range); index++) {
+        [self addIndex:index];
+    }
+}
+
+- (void)removeIndex:(NSUInteger)index
+{
+    if (index > UINT32_MAX) {
+        return;
+    }
+    NSInteger location = [self locationOfChunkWithKey:(uint16_t)(index >> 16)];
+    if (location < 0) {
+        return;
+    }
+    if (PDFKPageSetChunkRemove(&_chunks[location], (uint16_t)(index & 0xFFFF))) {
+        _count--;
+        if (_chunks[location].cardinality == 0) {
+            [self removeChunkAtLocation:location];
+        }
+    }
+}
+
+- (void)removeAllIndexes
+{
+    for (NSUInteger i = 0; i < _chunkCount; i++) {
+        PDFKPageSetChunkFree(&_chunks[i]);
+    }
+    _chunkCount = 0;
+    _count = 0;
+}
+
+- (void)unionPageSet:(PDFKPageSet *)pageSet
+{
+    if (pageSet == nil || pageSet == self) {
+        return;
+    }
+    for (NSUInteger i = 0; i < pageSet->_chunkCount; i++) {
+        PDFKPageSetChunk *other = &pageSet->_chunks[i];
+        NSInteger location = [self locationOfChunkWithKey:other->key];
+        if (location < 0) {
+            [self insertChunk:PDFKPageSetChunkCopy(other) atLocation:(-location - 1)];
+            _count += other->cardinality;
+        } else {
+            PDFKPageSetChunk *chunk = &_chunks[location];
+            PDFKPageSetChunk merged = PDFKPageSetChunkUnion(chunk, other);
+            _count += (merged.cardinality - chunk->cardinality);
+            PDFKPageSetChunkFree(chunk);
+            *chunk = merged;
+        }
+    }
+}
+
+- (void)intersectPageSet:(PDFKPageSet *)pageSet
+{
+    if (pageSet == self) {
+        return;
+    }
+    NSUInteger location = 0;
+    while (location < _chunkCount) {
+        PDFKPageSetChunk *chunk = &_chunks[location];
+        NSInteger otherLocation = (pageSet != nil ? [pageSet locationOfChunkWithKey:chunk->key] : -1);
+        if (otherLocation < 0) {
+            _count -= chunk->cardinality;
+            [self removeChunkAtLocation:location];
+            continue;
+        }
+        PDFKPageSetChunk intersection = PDFKPageSetChunkIntersect(chunk, &pageSet->_chunks[otherLocation]);
+        _count -= (chunk->cardinality - intersection.cardinality);
+        PDFKPageSetChunkFree(chunk);
+        *chunk = intersection;
+        if (intersection.cardinality == 0) {
+            [self removeChunkAtLocation:location];
+        } else {
+            location++;
+        }
+    }
+}
+
+- (PDFKPageSet *)pageSetByIntersectingWithPageSet:(PDFKPageSet *)pageSet
+{
+    PDFKPageSet *result = [self copy];
+    [result intersectPageSet:pageSet];
+    return result;
+}
+
+#pragma mark - Serialization
+
+- (NSData *)serializedData
+{
+    NSMutableData *data = [NSMutableData dataWithCapacity:(12 + _chunkCount * 8 + _count * 2)];
+    
+    //Header
+    uint32_t magic = OSSwapHostToLittleInt32(SERIAL_MAGIC);
+    uint8_t version[4] = {SERIAL_VERSION, 0, 0, 0};
+    uint32_t chunkCount = OSSwapHostToLittleInt32((uint32_t)_chunkCount);
+    [data appendBytes:&magic length:4];
+    [data appendBytes:version length:4];
+    [data appendBytes:&chunkCount length:4];
+    
+    for (NSUInteger i = 0; i < _chunkCount; i++) {
+        PDFKPageSetChunk *chunk = &_chunks[i];
+        
+        //Pick the smallest representation
+        uint32_t runs = PDFKPageSetChunkRunCount(chunk);
+        NSUInteger arraySize = chunk->cardinality * 2;
+        NSUInteger bitmapSize = BITMAP_WORD_COUNT * 8;
+        NSUInteger runsSize = 4 + runs * 4;
+        PDFKPageSetChunkType type = PDFKPageSetChunkTypeArray;
+        if (runsSize < arraySize && runsSize < bitmapSize) {
+            type = PDFKPageSetChunkTypeRuns;
+        } else if (bitmapSize < arraySize) {
+            type = PDFKPageSetChunkTypeBitmap;
+        }
+        
+        //Chunk header
+        uint16_t key = OSSwapHostToLittleInt16(chunk->key);
+        uint8_t typeAndReserved[2] = {type, 0};
+        uint32_t cardinality = OSSwapHostToLittleInt32(chunk->cardinality);
+        [data appendBytes:&key length:2];
+        [data appendBytes:typeAndReserved length:2];
+        [data appendBytes:&cardinality length:4];
+        
+        switch (type) {
+            case PDFKPageSetChunkTypeArray: {
+                for (uint32_t j = 0; j < chunk->cardinality; j++) {
+                    uint16_t value = OSSwapHostToLittleInt16(chunk->array[j]);
+                    [data appendBytes:&value length:2];
+                }
+                break;
+            }
+            case PDFKPageSetChunkTypeBitmap: {
+                for (NSUInteger w = 0; w < BITMAP_WORD_COUNT; w++) {
+                    uint64_t word = OSSwapHostToLittleInt64(chunk->words[w]);
+                    [data appendBytes:&word length:8];
+                }
+                break;
+            }
+            case PDFKPageSetChunkTypeRuns: {
+                uint32_t runCount = OSSwapHostToLittleInt32(runs);
+                [data appendBytes:&runCount length:4];
+                PDFKPageSetAppendRuns(data, chunk);
+                break;
+            }
+        }
+    }
+    
+    return data;
+}
+
+- (id)initWithSerializedData:(NSData *)data
+{
+    if ((self = [super init])) {
+        PDFKPageSetReader reader = {data.bytes, data.length, 0};
+        
+        //Header
+        uint32_t magic = 0, version = 0, chunkCount = 0;
+        if (!PDFKPageSetReadUInt32(&reader, &magic) || !PDFKPageSetReadUInt32(&reader, &version) || !PDFKPageSetReadUInt32(&reader, &chunkCount)) {
+            return nil;
+        }
+        if (magic != SERIAL_MAGIC || (version & 0xFF) != SERIAL_VERSION || chunkCount > 65536) {
+            return nil;
+        }
+        
+        int32_t lastKey = -1;
+        for (uint32_t i = 0; i < chunkCount; i++) {
+            uint16_t key = 0, typeAndReserved = 0;
+            uint32_t cardinality = 0;
+            if (!PDFKPageSetReadUInt16(&reader, &key) || !PDFKPageSetReadUInt16(&reader, &typeAndReserved) || !PDFKPageSetReadUInt32(&reader, &cardinality)) {
+                return nil;
+            }
+            //Chunks must be sorted and not empty
+            if ((int32_t)key <= lastKey || cardinality == 0 || cardinality > 65536) {
+                return nil;
+            }
+            lastKey = key;
+            
+            PDFKPageSetChunk chunk = {0};
+            chunk.key = key;
+            [self insertChunk:chunk atLocation:_chunkCount];
+            PDFKPageSetChunk *current = &_chunks[_chunkCount - 1];
+            
+            switch ((PDFKPageSetChunkType)(typeAndReserved & 0xFF)) {
+                case PDFKPageSetChunkTypeArray: {
+                    int32_t previous = -1;
+                    for (uint32_t j = 0; j < cardinality; j++) {
+                        uint16_t value = 0;
+                        if (!PDFKPageSetReadUInt16(&reader, &value) || (int32_t)value <= previous) {
+                            return nil;
+                        }
+                        previous = value;
+                        PDFKPageSetChunkAdd(current, value);
+                    }
+                    break;
+                }
+                case PDFKPageSetChunkTypeBitmap: {
+                    PDFKPageSetChunkConvertToBitmap(current);
+                    for (NSUInteger w = 0; w < BITMAP_WORD_COUNT; w++) {
+                        if (!PDFKPageSetReadUInt64(&reader, &current->words[w])) {
+                            return nil;
+                        }
+                    }
+                    current->cardinality = PDFKPageSetBitmapCardinality(current->words);
+                    PDFKPageSetChunkNormalize(current);
+                    break;
+                }
+                case PDFKPageSetChunkTypeRuns: {
+                    uint32_t runCount = 0;
+                    if (!PDFKPageSetReadUInt32(&reader, &runCount) || runCount > 32768) {
+                        return nil;
+                    }
+                    if (cardinality > ARRAY_MAX_CARDINALITY) {
+                        PDFKPageSetChunkConvertToBitmap(current);
+                    }
+                    int32_t previous = -1;
+                    for (uint32_t j = 0; j < runCount; j++) {
+                        uint16_t start = 0, lengthMinusOne = 0;
+                        if (!PDFKPageSetReadUInt16(&reader, &start) || !PDFKPageSetReadUInt16(&reader, &lengthMinusOne)) {
+                            return nil;
+                        }
+                        //Runs must be sorted, not overlapping, and inside the chunk
+                        uint32_t end = (uint32_t)start + lengthMinusOne;
+                        if ((int32_t)start <= previous || end > 0xFFFF || current->cardinality + lengthMinusOne + 1 > cardinality) {
+                            return nil;
+                        }
+                        for (uint32_t value = start; value <= end; value++) {
+                            PDFKPageSetChunkAdd(current, (uint16_t)value);
+                        }
+                        previous = (int32_t)end;
+                    }
+                    break;
+                }
+                default:
+                    return nil;
+            }
+            
+            //The stored cardinality must match the contents.
+            if (current->cardinality != cardinality) {
+                return nil;
+            }
+            _count += cardinality;
+        }
+    }
+    return self;
+}
+
+#pragma mark - NSCoding
+
+- (id)initWithCoder:(NSCoder *)decoder
+{
+    NSData *data = [decoder decodeObjectForKey:@"PageSetData"];
+    return [self initWithSerializedData:data];
+}
+
+- (void)encodeWithCoder:(NSCoder *)encoder
+{
+    [encoder encodeObject:[self serializedData] forKey:@"PageSetData"];
+}
+
+#pragma mark - NSObject
+
+- (BOOL)isEqual:(id)object
+{
+    if (object == self) {
+        return YES;
+    }
+    if (![object isKindOfClass:[PDFKPageSet class]]) {
+        return NO;
+    }
+    PDFKPageSet *other = object;
+    if (other->_count != _count || other->_chunkCount != _chunkCount) {
+        return NO;
+    }
+    for (NSUInteger i = 0; i < _chunkCount; i++) {
+        if (!PDFKPageSetChunkEqual(&_chunks[i], &other->_chunks[i])) {
+            return NO;
+        }
+    }
+    return YES;
+}
+
+- (NSUInteger)hash
+{
+    return _count ^ (_chunkCount > 0 ? [self firstIndex] : 0);
+}
+
+- (NSString *)description
+{
+    return [NSString stringWithFormat:@"<%@: %p> %@", NSStringFromClass([self class]), self, [[self indexSet] description]];
+}
+
+@end
@@ -0,0 +1,46 @@
+/*
+ //  PDFKTextExtractor.h
+ //  M13PDFKit
+ //
+ Copyright (c) 2014 Brandon McQuilkin
+ 
+ Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated documentation files (the
+ "Software"), to deal in the Software without restriction, including without limitation the rights to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software, and to permit persons to whom the Software is furnished to do so, subject to
+ the following conditions:
+ 
+ The above copyright notice and this permission notice shall be included in all copies or substantial portions of the Software.
+ 
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+
+#import <Foundation/Foundation.h>
+#import <CoreGraphics/CoreGraphics.h>
+
+/**
+ Finds the text of the pages of a document, to search them. The fonts of the document are parsed once and shared by all the pages, through the font cache of the document.
+ */
+@interface PDFKTextExtractor : NSObject
+
+/**
+ Initalize a text extractor.
+ 
+ @param documentRef The document to read the text of.
+ 
+ @return A new text extractor.
+ */
+- (id)initWithDocument:(CGPDFDocumentRef)documentRef;
+/**
+ Find the text of a page. Lines are separated by newlines, words by spaces, the layout of the page is not kept.
+ 
+ @param page The number of the page.
+ 
+ @return The text of the page, empty if the page has no text or does not exist.
+ */
+- (NSString *)textOfPage:(NSUInteger)page;
+/**
+ Statistics for the pages read so far. The keys are "Pages", "Glyphs" and "Elapsed".
+ */
+@property (nonatomic, readonly) NSDictionary *statistics;
+
+@end
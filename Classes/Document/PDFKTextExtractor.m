@@ -0,0 +1,258 @@
+/*
+ //  PDFKTextExtractor.m
+ //  M13PDFKit
+ //
+ Copyright (c) 2014 Brandon McQuilkin
+ 
+ Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated documentation files (the
+ "Software"), to deal in the Software without restriction, including without limitation the rights to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software, and to permit persons to whom the Software is furnished to do so, subject to
+ the following conditions:
+ 
+ The above copyright notice and this permission notice shall be included in all copies or substantial portions of the Software.
+ 
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+
+#import "PDFKTextExtractor.h"
+#import "PDFKFontCache.h"
+
+//The deepest form XObjects are read
+#define MAXIMUM_FORM_DEPTH 4
+//The spacing of a TJ array, in thousandths of the font size, that separates words
+#define WORD_SPACING_ADJUSTMENT -180.0f
+
+/**
+ The state of reading the content of a page.
+ */
+@interface PDFKTextScan : NSObject
+
+@property (nonatomic, strong) PDFKFontCache *fontCache;
+@property (nonatomic, strong) PDFKFont *font;
+@property (nonatomic, strong) NSMutableString *text;
+@property (nonatomic, assign) NSUInteger glyphCount;
+@property (nonatomic, assign) NSInteger formDepth;
+
+@end
+
+@implementation PDFKTextScan
+
+@end
+
+#pragma mark - Operators
+
+static CGPDFOperatorTableRef PDFKTextOperatorTable(void);
+
+/**
+ Separate the following text, unless it is already separated.
+ */
+static void PDFKTextScanSeparate(PDFKTextScan *scan, NSString *separator)
+{
+    NSMutableString *text = scan.text;
+    if (text.length == 0) {
+        return;
+    }
+    unichar last = [text characterAtIndex:text.length - 1];
+    if (last == '\n') {
+        return;
+    }
+    if (last == ' ') {
+        if ([separator isEqualToString:@"\n"]) {
+            [text replaceCharactersInRange:NSMakeRange(text.length - 1, 1) withString:separator];
+        }
+        return;
+    }
+    [text appendString:separator];
+}
+
+static void PDFKTextScanShowString(PDFKTextScan *scan, CGPDFStringRef string)
+{
+    if (scan.font != nil && string != NULL) {
+        scan.glyphCount += [scan.font appendTextOfString:string toText:scan.text];
+    }
+}
+
+static void PDFKScanSetFont(CGPDFScannerRef scanner, void *info)
+{
+    PDFKTextScan *scan = (__bridge PDFKTextScan *)info;
+    CGPDFReal size = 0.0f;
+    const char *name = NULL;
+    CGPDFDictionaryRef dictionary = NULL;
+    scan.font = nil;
+    if (CGPDFScannerPopNumber(scanner, &size) == false || CGPDFScannerPopName(scanner, &name) == false) {
+        return;
+    }
+    //The resources of forms are searched before the resources of the page
+    CGPDFObjectRef object = CGPDFContentStreamGetResource(CGPDFScannerGetContentStream(scanner), "Font", name);
+    if (object != NULL && CGPDFObjectGetValue(object, kCGPDFObjectTypeDictionary, &dictionary)) {
+        scan.font = [scan.fontCache fontForDictionary:dictionary];
+    }
+}
+
+static void PDFKScanShowText(CGPDFScannerRef scanner, void *info)
+{
+    PDFKTextScan *scan = (__bridge PDFKTextScan *)info;
+    CGPDFStringRef string = NULL;
+    if (CGPDFScannerPopString(scanner, &string)) {
+        PDFKTextScanShowString(scan, string);
+    }
+}
+
+static void PDFKScanShowTextArray(CGPDFScannerRef scanner, void *info)
+{
+    PDFKTextScan *scan = (__bridge PDFKTextScan *)info;
+    CGPDFArrayRef array = NULL;
+    if (CGPDFScannerPopArray(scanner, &array) == false) {
+        return;
+    }
+    for (size_t index = 0; index < CGPDFArrayGetCount(array); index++) {
+        CGPDFStringRef string = NULL;
+        CGPDFReal adjustment = 0.0f;
+        if (CGPDFArrayGetString(array, index, &string)) {
+            PDFKTextScanShowString(scan, string);
+        } else if (CGPDFArrayGetNumber(array, index, &adjustment) && adjustment < WORD_SPACING_ADJUSTMENT) {
+            //Large gaps are spaces
+            PDFKTextScanSeparate(scan, @" ");
+        }
+    }
+}
+
+static void PDFKScanNextLineShowText(CGPDFScannerRef scanner, void *info)
+{
+    PDFKTextScan *scan = (__bridge PDFKTextScan *)info;
+    CGPDFStringRef string = NULL;
+    PDFKTextScanSeparate(scan, @"\n");
+    if (CGPDFScannerPopString(scanner, &string)) {
+        PDFKTextScanShowString(scan, string);
+    }
+}
+
+static void PDFKScanMoveText(CGPDFScannerRef scanner, void *info)
+{
+    PDFKTextScan *scan = (__bridge PDFKTextScan *)info;
+    CGPDFReal x = 0.0f;
+    CGPDFReal y = 0.0f;
+    if (CGPDFScannerPopNumber(scanner, &y) && CGPDFScannerPopNumber(scanner, &x)) {
+        //Moving along the line starts a new word, moving off it a new line
+        PDFKTextScanSeparate(scan, (y != 0.0f ? @"\n" : @" "));
+    }
+}
+
+static void PDFKScanNextLine(CGPDFScannerRef scanner, void *info)
+{
+    PDFKTextScan *scan = (__bridge PDFKTextScan *)info;
+    PDFKTextScanSeparate(scan, @"\n");
+}
+
+static void PDFKScanDrawObject(CGPDFScannerRef scanner, void *info)
+{
+    PDFKTextScan *scan = (__bridge PDFKTextScan *)info;
+    const char *name = NULL;
+    const char *subtype = NULL;
+    CGPDFStreamRef stream = NULL;
+    CGPDFDictionaryRef resources = NULL;
+    if (scan.formDepth >= MAXIMUM_FORM_DEPTH || CGPDFScannerPopName(scanner, &name) == false) {
+        return;
+    }
+    CGPDFContentStreamRef contentStream = CGPDFScannerGetContentStream(scanner);
+    CGPDFObjectRef object = CGPDFContentStreamGetResource(contentStream, "XObject", name);
+    if (object == NULL || CGPDFObjectGetValue(object, kCGPDFObjectTypeStream, &stream) == false) {
+        return;
+    }
+    CGPDFDictionaryRef dictionary = CGPDFStreamGetDictionary(stream);
+    if (CGPDFDictionaryGetName(dictionary, "Subtype", &subtype) == false || strcmp(subtype, "Form") != 0) {
+        return;
+    }
+    CGPDFDictionaryGetDictionary(dictionary, "Resources", &resources);
+    
+    //Read the text of the form, with the font of the page restored afterwards
+    PDFKFont *font = scan.font;
+    scan.formDepth += 1;
+    CGPDFContentStreamRef formStream = CGPDFContentStreamCreateWithStream(stream, resources, contentStream);
+    CGPDFScannerRef formScanner = CGPDFScannerCreate(formStream, PDFKTextOperatorTable(), info);
+    CGPDFScannerScan(formScanner);
+    CGPDFScannerRelease(formScanner);
+    CGPDFContentStreamRelease(formStream);
+    scan.formDepth -= 1;
+    scan.font = font;
+}
+
+static CGPDFOperatorTableRef PDFKTextOperatorTable(void)
+{
+    static dispatch_once_t predicate = 0;
+    static CGPDFOperatorTableRef table = NULL;
+    dispatch_once(&predicate, ^{
+        table = CGPDFOperatorTableCreate();
+        CGPDFOperatorTableSetCallback(table, "Tf", PDFKScanSetFont);
+        CGPDFOperatorTableSetCallback(table, "Tj", PDFKScanShowText);
+        CGPDFOperatorTableSetCallback(table, "TJ", PDFKScanShowTextArray);
+        CGPDFOperatorTableSetCallback(table, "'", PDFKScanNextLineShowText);
+        CGPDFOperatorTableSetCallback(table, "\"", PDFKScanNextLineShowText);
+        CGPDFOperatorTableSetCallback(table, "Td", PDFKScanMoveText);
+        CGPDFOperatorTableSetCallback(table, "TD", PDFKScanMoveText);
+        CGPDFOperatorTableSetCallback(table, "T*", PDFKScanNextLine);
+        CGPDFOperatorTableSetCallback(table, "Tm", PDFKScanNextLine);
+        CGPDFOperatorTableSetCallback(table, "ET", PDFKScanNextLine);
+        CGPDFOperatorTableSetCallback(table, "Do", PDFKScanDrawObject);
+    });
+    return table;
+}
+
+#pragma mark - Extractor
+
+@implementation PDFKTextExtractor
+{
+    CGPDFDocumentRef documentRef;
+    NSUInteger pageCount;
+    NSUInteger glyphCount;
+    NSTimeInterval elapsed;
+}
+
+- (id)initWithDocument:(CGPDFDocumentRef)document
+{
+    if ((self = [super init])) {
+        documentRef = CGPDFDocumentRetain(document);
+    }
+    return self;
+}
+
+- (void)dealloc
+{
+    CGPDFDocumentRelease(documentRef);
+}
+
+- (NSString *)textOfPage:(NSUInteger)page
+{
+    CGPDFPageRef pageRef = CGPDFDocumentGetPage(documentRef, page);
+    if (pageRef == NULL) {
+        return @"";
+    }
+    CFAbsoluteTime start = CFAbsoluteTimeGetCurrent();
+    
+    //The fonts are shared with the other pages, and the other extractors of the document.
+    PDFKTextScan *scan = [PDFKTextScan new];
+    scan.fontCache = [PDFKFontCache cacheForDocument:documentRef];
+    scan.text = [NSMutableString new];
+    
+    CGPDFContentStreamRef contentStream = CGPDFContentStreamCreateWithPage(pageRef);
+    CGPDFScannerRef scanner = CGPDFScannerCreate(contentStream, PDFKTextOperatorTable(), (__bridge void *)scan);
+    CGPDFScannerScan(scanner);
+    CGPDFScannerRelease(scanner);
+    CGPDFContentStreamRelease(contentStream);
+    
+    @synchronized(self) {
+        pageCount += 1;
+        glyphCount += scan.glyphCount;
+        elapsed += CFAbsoluteTimeGetCurrent() - start;
+    }
+    return scan.text;
+}
+
+- (NSDictionary *)statistics
+{
+    @synchronized(self) {
+        return @{@"Pages": @(pageCount), @"Glyphs": @(glyphCount), @"Elapsed": @(elapsed)};
+    }
+}
+
+@end
@@ -0,0 +1,72 @@
+/*
+ //  PDFKImageCache.h
+ //  M13PDFKit
+ //
+ Copyright (c) 2014 Brandon McQuilkin
+ 
+ Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated documentation files (the
+ "Software"), to deal in the Software without restriction, including without limitation the rights to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software, and to permit persons to whom the Software is furnished to do so, subject to
+ the following conditions:
+ 
+ The above copyright notice and this permission notice shall be included in all copies or substantial portions of the Software.
+ 
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+
+#import <Foundation/Foundation.h>
+#import <CoreGraphics/CoreGraphics.h>
+#import "PDFKResourceGovernor.h"
+
+/**
+ Draw a page into a context, like CGContextDrawPDFPage. Pages that only draw an image, like the pages of scanned documents, are drawn from the decoded images of the document's image cache. The draw is journaled by the shared render guard, pages that crashed or hung before draw a placeholder.
+ 
+ @param context The context to draw into. The page must already be transformed into place.
+ @param pageRef The page to draw.
+ */
+void PDFKImageCacheDrawPage(CGContextRef context, CGPDFPageRef pageRef);
+
+/**
+ Keeps the decoded images of a document, so the thumbs and tiles of a page do not decode the same image again.
+ 
+ CGContextDrawPDFPage decodes the images of a page every time it draws, and gives no way to keep them. The cache recognizes pages whose content only draws one image XObject, clipped by rectangles, and draws those pages itself. Images are kept by the image stream and the size they were decoded at: small targets, like thumbs, are decoded straight to a smaller size, JPEG images without decoding the full size first. A larger decoded image is used for a smaller target.
+ 
+ The decoded images are immutable and are drawn from any thread without being copied.
+ */
+@interface PDFKImageCache : NSObject <PDFKResourceConsumer>
+
+/**
+ Get the image cache of a document. The caches of the most recently used documents are kept, each keeps its document open.
+ 
+ @param documentRef The document.
+ 
+ @return The image cache of the document.
+ */
++ (PDFKImageCache *)cacheForDocument:(CGPDFDocumentRef)documentRef;
+/**
+ Remove the image caches of all documents.
+ */
++ (void)removeAllCaches;
+/**
+ Draw a page from the decoded image it shows.
+ 
+ @param pageRef The page to draw. It must belong to the cache's document.
+ @param context The context to draw into. The page must already be transformed into place.
+ 
+ @return YES if the page was drawn, NO if the page does more than draw an image and must be drawn with CGContextDrawPDFPage.
+ */
+- (BOOL)drawPage:(CGPDFPageRef)pageRef inContext:(CGContextRef)context;
+/**
+ Remove all the decoded images.
+ */
+- (void)removeAllImages;
+/**
+ The maximum number of bytes of decoded images to keep. Defaults to 24MB.
+ */
+@property (nonatomic, assign) NSUInteger byteBudget;
+/**
+ Statistics for the cache. The keys are "ImagePages" (the pages that only draw an image), "Hits", "Decodes", "DownsampledDecodes", "Evictions" and "Bytes".
+ */
+@property (nonatomic, readonly) NSDictionary *statistics;
+
+@end
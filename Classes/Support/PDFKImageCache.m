@@ -0,0 +1,751 @@
+/*
+ //  PDFKImageCache.m
+ //  M13PDFKit
+ //
+ Copyright (c) 2014 Brandon McQuilkin
+ 
+ Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated documentation files (the
+ "Software"), to deal in the Software without restriction, including without limitation the rights to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software, and to permit persons to whom the Software is furnished to do so, subject to
+ the following conditions:
+ 
+ The above copyright notice and this permission notice shall be included in all copies or substantial portions of the Software.
+ 
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+
+#import "PDFKImageCache.h"
+#import "PDFKRenderGuard.h"
+#import <ImageIO/ImageIO.h>
+
+//The default maximum of decoded image bytes kept for a document
+#define DEFAULT_BYTE_BUDGET (24 * 1024 * 1024)
+//The number of documents whose decoded images are kept
+#define MAXIMUM_CACHED_DOCUMENTS 2
+//Pages with more encoded content than this are not checked for only drawing an image
+#define MAXIMUM_IMAGE_PAGE_CONTENT_LENGTH 512
+//The deepest nesting of saved graphics states on an image page
+#define MAXIMUM_STATE_DEPTH 8
+//The most clipping rectangles on an image page
+#define MAXIMUM_CLIP_RECTS 4
+//The smallest size images are decoded at, in pixels
+#define MINIMUM_DECODE_SIZE 64
+
+#pragma mark - Image Pages
+
+/**
+ A rectangle the image is clipped to, in the space it was given in.
+ */
+typedef struct {
+    CGAffineTransform transform;
+    CGRect rect;
+} PDFKClipRect;
+
+/**
+ How a page that only draws an image draws it.
+ */
+typedef struct {
+    CGPDFStreamRef image;
+    size_t width;
+    size_t height;
+    /**
+     Maps the unit square of the image to the page.
+     */
+    CGAffineTransform transform;
+    PDFKClipRect clips[MAXIMUM_CLIP_RECTS];
+    size_t clipCount;
+} PDFKImagePage;
+
+typedef struct {
+    CGAffineTransform transform;
+    size_t clipCount;
+} PDFKGraphicsState;
+
+/**
+ The state of scanning the content of a page.
+ */
+typedef struct {
+    CGPDFDictionaryRef resources;
+    PDFKGraphicsState state;
+    PDFKGraphicsState savedStates[MAXIMUM_STATE_DEPTH];
+    size_t depth;
+    PDFKClipRect clips[MAXIMUM_CLIP_RECTS];
+    //The rectangle of the current path
+    BOOL hasPath;
+    BOOL clipPending;
+    PDFKClipRect path;
+    BOOL hasImage;
+    BOOL unsupported;
+    PDFKImagePage page;
+} PDFKImagePageScan;
+
+static void PDFKScanUnsupported(CGPDFScannerRef scanner, void *info)
+{
+    ((PDFKImagePageScan *)info)->unsupported = YES;
+}
+
+static void PDFKScanIgnored(CGPDFScannerRef scanner, void *info)
+{
+    //Changes to the state that do not change how an image is drawn
+}
+
+static void PDFKScanSaveState(CGPDFScannerRef scanner, void *info)
+{
+    PDFKImagePageScan *scan = info;
+    if (scan->depth == MAXIMUM_STATE_DEPTH) {
+        scan->unsupported = YES;
+        return;
+    }
+    scan->savedStates[scan->depth++] = scan->state;
+}
+
+static void PDFKScanRestoreState(CGPDFScannerRef scanner, void *info)
+{
+    PDFKImagePageScan *scan = info;
+    if (scan->depth == 0) {
+        scan->unsupported = YES;
+        return;
+    }
+    scan->state = scan->savedStates[--scan->depth];
+}
+
+static void PDFKScanConcatTransform(CGPDFScannerRef scanner, void *info)
+{
+    PDFKImagePageScan *scan = info;
+    CGPDFReal values[6];
+    for (NSInteger index = 5; index >= 0; index--) {
+        if (CGPDFScannerPopNumber(scanner, &values[index]) == false) {
+            scan->unsupported = YES;
+            return;
+        }
+    }
+    CGAffineTransform transform = CGAffineTransformMake(values[0], values[1], values[2], values[3], values[4], values[5]);
+    scan->state.transform = CGAffineTransformConcat(transform, scan->state.transform);
+}
+
+static void PDFKScanRectangle(CGPDFScannerRef scanner, void *info)
+{
+    PDFKImagePageScan *scan = info;
+    CGPDFReal values[4];
+    for (NSInteger index = 3; index >= 0; index--) {
+        if (CGPDFScannerPopNumber(scanner, &values[index]) == false) {
+            scan->unsupported = YES;
+            return;
+        }
+    }
+    //Only paths of a single rectangle are used to clip
+    if (scan->hasPath) {
+        scan->unsupported = YES;
+        return;
+    }
+    scan->hasPath = YES;
+    scan->path.transform = scan->state.transform;
+    scan->path.rect = CGRectStandardize(CGRectMake(values[0], values[1], values[2], values[3]));
+}
+
+static void PDFKScanClip(CGPDFScannerRef scanner, void *info)
+{
+    PDFKImagePageScan *scan = info;
+    scan->clipPending = YES;
+}
+
+static void PDFKScanEndPath(CGPDFScannerRef scanner, void *info)
+{
+    PDFKImagePageScan *scan = info;
+    if (scan->clipPending) {
+        if (scan->hasPath == NO || scan->state.clipCount == MAXIMUM_CLIP_RECTS) {
+            scan->unsupported = YES;
+            return;
+        }
+        scan->clips[scan->state.clipCount++] = scan->path;
+    }
+    scan->hasPath = NO;
+    scan->clipPending = NO;
+}
+
+static void PDFKScanGraphicsState(CGPDFScannerRef scanner, void *info)
+{
+    PDFKImagePageScan *scan = info;
+    const char *name = NULL;
+    CGPDFDictionaryRef states = NULL;
+    CGPDFDictionaryRef state = NULL;
+    if (CGPDFScannerPopName(scanner, &name) == false || CGPDFDictionaryGetDictionary(scan->resources, "ExtGState", &states) == false ||
+        CGPDFDictionaryGetDictionary(states, name, &state) == false) {
+        scan->unsupported = YES;
+        return;
+    }
+    //Transparency changes how the image is drawn
+    CGPDFReal alpha = 1.0f;
+    const char *value = NULL;
+    CGPDFObjectRef object = NULL;
+    if ((CGPDFDictionaryGetNumber(state, "ca", &alpha) && alpha < 1.0f) || (CGPDFDictionaryGetNumber(state, "CA", &alpha) && alpha < 1.0f) ||
+        (CGPDFDictionaryGetObject(state, "SMask", &object) && (CGPDFDictionaryGetName(state, "SMask", &value) == false || strcmp(value, "None") != 0)) ||
+        (CGPDFDictionaryGetObject(state, "BM", &object) && (CGPDFDictionaryGetName(state, "BM", &value) == false || (strcmp(value, "Normal") != 0 && strcmp(value, "Compatible") != 0)))) {
+        scan->unsupported = YES;
+    }
+}
+
+static void PDFKScanDrawObject(CGPDFScannerRef scanner, void *info)
+{
+    PDFKImagePageScan *scan = info;
+    const char *name = NULL;
+    const char *subtype = NULL;
+    CGPDFDictionaryRef objects = NULL;
+    CGPDFStreamRef stream = NULL;
+    CGPDFInteger width = 0;
+    CGPDFInteger height = 0;
+    if (scan->hasImage || scan->hasPath || CGPDFScannerPopName(scanner, &name) == false ||
+        CGPDFDictionaryGetDictionary(scan->resources, "XObject", &objects) == false || CGPDFDictionaryGetStream(objects, name, &stream) == false) {
+        scan->unsupported = YES;
+        return;
+    }
+    CGPDFDictionaryRef dictionary = CGPDFStreamGetDictionary(stream);
+    if (CGPDFDictionaryGetName(dictionary, "Subtype", &subtype) == false || strcmp(subtype, "Image") != 0 ||
+        CGPDFDictionaryGetInteger(dictionary, "Width", &width) == false || CGPDFDictionaryGetInteger(dictionary, "Height", &height) == false ||
+        width <= 0 || height <= 0) {
+        scan->unsupported = YES;
+        return;
+    }
+    scan->hasImage = YES;
+    scan->page.image = stream;
+    scan->page.width = (size_t)width;
+    scan->page.height = (size_t)height;
+    scan->page.transform = scan->state.transform;
+    scan->page.clipCount = scan->state.clipCount;
+    memcpy(scan->page.clips, scan->clips, sizeof(scan->clips));
+}
+
+static CGPDFOperatorTableRef PDFKImagePageOperatorTable(void)
+{
+    static dispatch_once_t predicate = 0;
+    static CGPDFOperatorTableRef table = NULL;
+    dispatch_once(&predicate, ^{
+        table = CGPDFOperatorTableCreate();
+        //Operators that draw, or start drawing text, paths or shadings.
+        const char *unsupported[] = {"b", "B", "b*", "B*", "BI", "BT", "c", "d0", "d1", "EI", "ET", "f", "F", "f*", "h", "ID", "l", "m", "s", "S", "sh",
+                                     "T*", "Tc", "Td", "TD", "Tf", "Tj", "TJ", "TL", "Tm", "Tr", "Ts", "Tw", "Tz", "v", "y", "'", "\""};
+        const char *ignored[] = {"BDC", "BMC", "BX", "cs", "CS", "d", "DP", "EMC", "EX", "g", "G", "i", "j", "J", "k", "K", "M", "MP", "rg", "RG", "ri",
+                                 "sc", "SC", "scn", "SCN", "w"};
+        for (size_t index = 0; index < sizeof(unsupported) / sizeof(unsupported[0]); index++) {
+            CGPDFOperatorTableSetCallback(table, unsupported[index], PDFKScanUnsupported);
+        }
+        for (size_t index = 0; index < sizeof(ignored) / sizeof(ignored[0]); index++) {
+            CGPDFOperatorTableSetCallback(table, ignored[index], PDFKScanIgnored);
+        }
+        CGPDFOperatorTableSetCallback(table, "q", PDFKScanSaveState);
+        CGPDFOperatorTableSetCallback(table, "Q", PDFKScanRestoreState);
+        CGPDFOperatorTableSetCallback(table, "cm", PDFKScanConcatTransform);
+        CGPDFOperatorTableSetCallback(table, "re", PDFKScanRectangle);
+        CGPDFOperatorTableSetCallback(table, "W", PDFKScanClip);
+        CGPDFOperatorTableSetCallback(table, "W*", PDFKScanClip);
+        CGPDFOperatorTableSetCallback(table, "n", PDFKScanEndPath);
+        CGPDFOperatorTableSetCallback(table, "gs", PDFKScanGraphicsState);
+        CGPDFOperatorTableSetCallback(table, "Do", PDFKScanDrawObject);
+    });
+    return table;
+}
+
+/**
+ The encoded length of the content of a page, or SIZE_MAX if it is not known.
+ */
+static size_t PDFKPageContentLength(CGPDFDictionaryRef pageDictionary)
+{
+    CGPDFStreamRef stream = NULL;
+    CGPDFArrayRef streams = NULL;
+    CGPDFInteger length = 0;
+    size_t total = 0;
+    if (CGPDFDictionaryGetStream(pageDictionary, "Contents", &stream)) {
+        return (CGPDFDictionaryGetInteger(CGPDFStreamGetDictionary(stream), "Length", &length) && length >= 0 ? (size_t)length : SIZE_MAX);
+    }
+    if (CGPDFDictionaryGetArray(pageDictionary, "Contents", &streams) == false) {
+        return SIZE_MAX;
+    }
+    for (size_t index = 0; index < CGPDFArrayGetCount(streams); index++) {
+        if (CGPDFArrayGetStream(streams, index, &stream) == false ||
+            CGPDFDictionaryGetInteger(CGPDFStreamGetDictionary(stream), "Length", &length) == false || length < 0) {
+            return SIZE_MAX;
+        }
+        total += (size_t)length;
+    }
+    return total;
+}
+
+/**
+ Check if a page only draws an image, and how.
+ */
+static BOOL PDFKImagePageScanPage(CGPDFPageRef pageRef, PDFKImagePage *page)
+{
+    CGPDFDictionaryRef pageDictionary = CGPDFPageGetDictionary(pageRef);
+    if (pageDictionary == NULL || PDFKPageContentLength(pageDictionary) > MAXIMUM_IMAGE_PAGE_CONTENT_LENGTH) {
+        return NO;
+    }
+    
+    PDFKImagePageScan scan;
+    memset(&scan, 0, sizeof(PDFKImagePageScan));
+    scan.state.transform = CGAffineTransformIdentity;
+    
+    //The resources can be inherited from the page tree
+    CGPDFDictionaryRef node = pageDictionary;
+    for (NSInteger depth = 0; node != NULL && depth < 32; depth++) {
+        if (CGPDFDictionaryGetDictionary(node, "Resources", &scan.resources)) {
+            break;
+        }
+        if (CGPDFDictionaryGetDictionary(node, "Parent", &node) == false) {
+            node = NULL;
+        }
+    }
+    if (scan.resources == NULL) {
+        return NO;
+    }
+    
+    CGPDFContentStreamRef contentStream = CGPDFContentStreamCreateWithPage(pageRef);
+    CGPDFScannerRef scanner = CGPDFScannerCreate(contentStream, PDFKImagePageOperatorTable(), &scan);
+    bool scanned = CGPDFScannerScan(scanner);
+    CGPDFScannerRelease(scanner);
+    CGPDFContentStreamRelease(contentStream);
+    
+    if (scanned == false || scan.unsupported || scan.hasImage == NO) {
+        return NO;
+    }
+    *page = scan.page;
+    return YES;
+}
+
+#pragma mark - Decoding
+
+/**
+ The color space of the samples of an image, for images that are not JPEG compressed.
+ */
+static CGColorSpaceRef PDFKImageCreateColorSpace(CGPDFDictionaryRef dictionary, size_t *components)
+{
+    const char *name = NULL;
+    CGPDFArrayRef array = NULL;
+    CGPDFStreamRef profile = NULL;
+    CGPDFInteger count = 0;
+    if (CGPDFDictionaryGetName(dictionary, "ColorSpace", &name)) {
+        if (strcmp(name, "DeviceGray") == 0) {
+            *components = 1;
+            return CGColorSpaceCreateDeviceGray();
+        }
+        if (strcmp(name, "DeviceRGB") == 0) {
+            *components = 3;
+            return CGColorSpaceCreateDeviceRGB();
+        }
+        return NULL;
+    }
+    if (CGPDFDictionaryGetArray(dictionary, "ColorSpace", &array) == false || CGPDFArrayGetName(array, 0, &name) == false || strcmp(name, "ICCBased") != 0 ||
+        CGPDFArrayGetStream(array, 1, &profile) == false || CGPDFDictionaryGetInteger(CGPDFStreamGetDictionary(profile), "N", &count) == false ||
+        (count != 1 && count != 3)) {
+        return NULL;
+    }
+    
+    *components = (size_t)count;
+    CGColorSpaceRef alternate = (count == 1 ? CGColorSpaceCreateDeviceGray() : CGColorSpaceCreateDeviceRGB());
+    CGPDFDataFormat format;
+    CFDataRef data = CGPDFStreamCopyData(profile, &format);
+    CGColorSpaceRef colorSpace = NULL;
+    if (data != NULL && format == CGPDFDataFormatRaw) {
+        const CGFloat range[6] = {0.0f, 1.0f, 0.0f, 1.0f, 0.0f, 1.0f};
+        CGDataProviderRef provider = CGDataProviderCreateWithCFData(data);
+        colorSpace = CGColorSpaceCreateICCBased((size_t)count, range, provider, alternate);
+        CGDataProviderRelease(provider);
+    }
+    if (data != NULL) {
+        CFRelease(data);
+    }
+    if (colorSpace == NULL) {
+        return alternate;
+    }
+    CGColorSpaceRelease(alternate);
+    return colorSpace;
+}
+
+/**
+ Decode an image XObject into a bitmap in the screen's pixel layout, no larger than the given size.
+ 
+ @param stream      The image stream.
+ @param size        The size of the larger side of the bitmap, 0 for the full size of the image.
+ @param downsampled Set to YES if the image was decoded smaller than its full size.
+ 
+ @return The decoded image, or NULL if the image is not supported.
+ */
+static CGImageRef PDFKImageCreateDecoded(CGPDFStreamRef stream, size_t size, BOOL *downsampled) CF_RETURNS_RETAINED;
+static CGImageRef PDFKImageCreateDecoded(CGPDFStreamRef stream, size_t size, BOOL *downsampled)
+{
+    CGPDFDictionaryRef dictionary = CGPDFStreamGetDictionary(stream);
+    CGPDFInteger width = 0;
+    CGPDFInteger height = 0;
+    CGPDFBoolean imageMask = false;
+    CGPDFObjectRef object = NULL;
+    if (CGPDFDictionaryGetInteger(dictionary, "Width", &width) == false || CGPDFDictionaryGetInteger(dictionary, "Height", &height) == false ||
+        width <= 0 || height <= 0 || (CGPDFDictionaryGetBoolean(dictionary, "ImageMask", &imageMask) && imageMask) ||
+        CGPDFDictionaryGetObject(dictionary, "Mask", &object) || CGPDFDictionaryGetObject(dictionary, "SMask", &object) ||
+        CGPDFDictionaryGetObject(dictionary, "Decode", &object)) {
+        return NULL;
+    }
+    
+    //The size to decode to
+    size_t targetWidth = (size_t)width;
+    size_t targetHeight = (size_t)height;
+    size_t largest = MAX(targetWidth, targetHeight);
+    *downsampled = (size > 0 && size < largest);
+    if (*downsampled) {
+        targetWidth = MAX((size_t)1, (size_t)lround((double)width * size / largest));
+        targetHeight = MAX((size_t)1, (size_t)lround((double)height * size / largest));
+    }
+    
+    CGPDFDataFormat format;
+    CFDataRef data = CGPDFStreamCopyData(stream, &format);
+    if (data == NULL) {
+        return NULL;
+    }
+    CGImageRef source = NULL;
+    if (format == CGPDFDataFormatRaw) {
+        //The samples, with the filters removed
+        size_t components = 0;
+        CGPDFInteger bitsPerComponent = 0;
+        CGColorSpaceRef colorSpace = PDFKImageCreateColorSpace(dictionary, &components);
+        if (colorSpace != NULL && CGPDFDictionaryGetInteger(dictionary, "BitsPerComponent", &bitsPerComponent) &&
+            (bitsPerComponent == 8 || (components == 1 && (bitsPerComponent == 1 || bitsPerComponent == 2 || bitsPerComponent == 4)))) {
+            size_t bytesPerRow = (((size_t)width * components * (size_t)bitsPerComponent) + 7) / 8;
+            if ((size_t)CFDataGetLength(data) >= bytesPerRow * (size_t)height) {
+                CGDataProviderRef provider = CGDataProviderCreateWithCFData(data);
+                source = CGImageCreate((size_t)width, (size_t)height, (size_t)bitsPerComponent, (size_t)bitsPerComponent * components, bytesPerRow, colorSpace,
+                                       (CGBitmapInfo)kCGImageAlphaNone, provider, NULL, false, kCGRenderingIntentDefault);
+                CGDataProviderRelease(provider);
+            }
+        }
+        CGColorSpaceRelease(colorSpace);
+    } else {
+        //JPEG and JPEG 2000 data. Small sizes are decoded straight to the smaller size.
+        CGImageSourceRef imageSource = CGImageSourceCreateWithData(data, NULL);
+        if (imageSource != NULL && *downsampled) {
+            NSDictionary *options = @{(NSString *)kCGImageSourceCreateThumbnailFromImageAlways: @YES,
+                                      (NSString *)kCGImageSourceThumbnailMaxPixelSize: @(size)};
+            source = CGImageSourceCreateThumbnailAtIndex(imageSource, 0, (__bridge CFDictionaryRef)options);
+        } else if (imageSource != NULL) {
+            source = CGImageSourceCreateImageAtIndex(imageSource, 0, NULL);
+        }
+        if (imageSource != NULL) {
+            CFRelease(imageSource);
+        }
+    }
+    CFRelease(data);
+    if (source == NULL) {
+        return NULL;
+    }
+    
+    //Draw the pixels once, into the layout the screen draws without converting.
+    CGColorSpaceRef rgb = CGColorSpaceCreateDeviceRGB();
+    CGContextRef context = CGBitmapContextCreate(NULL, targetWidth, targetHeight, 8, 0, rgb, kCGBitmapByteOrder32Little | kCGImageAlphaNoneSkipFirst);
+    CGImageRef image = NULL;
+    if (context != NULL) {
+        CGContextSetInterpolationQuality(context, kCGInterpolationHigh);
+        CGContextDrawImage(context, CGRectMake(0.0f, 0.0f, targetWidth, targetHeight), source);
+        image = CGBitmapContextCreateImage(context);
+        CGContextRelease(context);
+    }
+    CGColorSpaceRelease(rgb);
+    CGImageRelease(source);
+    return image;
+}
+
+#pragma mark - Image Cache
+
+void PDFKImageCacheDrawPage(CGContextRef context, CGPDFPageRef pageRef)
+{
+    //Pages that crashed or hung before are not drawn again
+    PDFKRenderGuard *guard = [PDFKRenderGuard sharedGuard];
+    NSInteger job = [guard beginPage:pageRef];
+    if (job == NSNotFound) {
+        PDFKRenderGuardDrawPlaceholder(context, pageRef);
+        return;
+    }
+    
+    CGPDFDocumentRef documentRef = CGPDFPageGetDocument(pageRef);
+    if (documentRef == NULL || [[PDFKImageCache cacheForDocument:documentRef] drawPage:pageRef inContext:context] == NO) {
+        CGContextDrawPDFPage(context, pageRef);
+    }
+    [guard endJob:job];
+}
+
+@implementation PDFKImageCache
+{
+    CGPDFDocumentRef documentRef;
+    /**
+     How each page that was drawn draws its image, as NSData, or NSNull if it does more than draw an image. By page number.
+     */
+    NSMutableDictionary *pages;
+    /**
+     The decoded images, keyed by the image stream and the size they were decoded at.
+     */
+    NSMutableDictionary *images;
+    /**
+     The keys of the images, least recently used first.
+     */
+    NSMutableArray *accessOrder;
+    /**
+     The decodes in progress, by key. Draws of the same image wait for the decode.
+     */
+    NSMutableDictionary *decodes;
+    /**
+     The images that could not be decoded.
+     */
+    NSMutableSet *failedImages;
+    NSUInteger bytes;
+    NSUInteger imagePageCount;
+    NSUInteger hitCount;
+    NSUInteger decodeCount;
+    NSUInteger downsampledDecodeCount;
+    NSUInteger evictionCount;
+}
+
+static NSMutableArray *documentCaches = nil;
+
++ (PDFKImageCache *)cacheForDocument:(CGPDFDocumentRef)documentRef
+{
+    @synchronized([PDFKImageCache class]) {
+        if (documentCaches == nil) {
+            documentCaches = [NSMutableArray new];
+        }
+        //Most recently used last
+        for (PDFKImageCache *cache in documentCaches) {
+            if (cache->documentRef == documentRef) {
+                [documentCaches removeObjectIdenticalTo:cache];
+                [documentCaches addObject:cache];
+                return cache;
+            }
+        }
+        PDFKImageCache *cache = [[PDFKImageCache alloc] initWithDocument:documentRef];
+        [documentCaches addObject:cache];
+        while (documentCaches.count > MAXIMUM_CACHED_DOCUMENTS) {
+            [documentCaches removeObjectAtIndex:0];
+        }
+        return cache;
+    }
+}
+
++ (void)removeAllCaches
+{
+    @synchronized([PDFKImageCache class]) {
+        [documentCaches removeAllObjects];
+    }
+}
+
+- (id)initWithDocument:(CGPDFDocumentRef)document
+{
+    if ((self = [super init])) {
+        //The image streams belong to the document
+        documentRef = CGPDFDocumentRetain(document);
+        pages = [NSMutableDictionary new];
+        images = [NSMutableDictionary new];
+        accessOrder = [NSMutableArray new];
+        decodes = [NSMutableDictionary new];
+        failedImages = [NSMutableSet new];
+        _byteBudget = DEFAULT_BYTE_BUDGET;
+        
+        //The images are decoded again when needed.
+        [[PDFKResourceGovernor sharedGovernor] registerConsumer:self category:PDFKResourceCategoryImages priority:PDFKResourcePriorityLow];
+    }
+    return self;
+}
+
+- (void)dealloc
+{
+    CGPDFDocumentRelease(documentRef);
+}
+
+- (BOOL)drawPage:(CGPDFPageRef)pageRef inContext:(CGContextRef)context
+{
+    PDFKImagePage page;
+    if ([self getImagePage:&page forPage:pageRef] == NO) {
+        return NO;
+    }
+    
+    CGContextSaveGState(context);
+    CGContextClipToRect(context, CGPDFPageGetBoxRect(pageRef, kCGPDFCropBox));
+    for (size_t index = 0; index < page.clipCount; index++) {
+        CGAffineTransform transform = page.clips[index].transform;
+        CGContextConcatCTM(context, transform);
+        CGContextClipToRect(context, page.clips[index].rect);
+        CGContextConcatCTM(context, CGAffineTransformInvert(transform));
+    }
+    CGContextConcatCTM(context, page.transform);
+    
+    //The size the image is drawn at, in pixels
+    CGAffineTransform deviceTransform = CGContextGetCTM(context);
+    CGFloat drawnSize = MAX(hypot(deviceTransform.a, deviceTransform.b), hypot(deviceTransform.c, deviceTransform.d));
+    CGImageRef image = [self copyImage:page.image width:page.width height:page.height drawnSize:drawnSize];
+    if (image != NULL) {
+        CGContextDrawImage(context, CGRectMake(0.0f, 0.0f, 1.0f, 1.0f), image);
+        CGImageRelease(image);
+    }
+    CGContextRestoreGState(context);
+    return (image != NULL);
+}
+
+/**
+ Find out if a page only draws an image, checking the page the first time it is drawn.
+ */
+- (BOOL)getImagePage:(PDFKImagePage *)page forPage:(CGPDFPageRef)pageRef
+{
+    NSNumber *pageNumber = @(CGPDFPageGetPageNumber(pageRef));
+    id info = nil;
+    @synchronized(self) {
+        info = pages[pageNumber];
+    }
+    if (info == nil) {
+        BOOL imagePage = PDFKImagePageScanPage(pageRef, page);
+        info = (imagePage ? [NSData dataWithBytes:page length:sizeof(PDFKImagePage)] : [NSNull null]);
+        @synchronized(self) {
+            if (pages[pageNumber] == nil && imagePage) {
+                imagePageCount++;
+            }
+            pages[pageNumber] = info;
+        }
+    }
+    if ([info isKindOfClass:[NSData class]] == NO) {
+        return NO;
+    }
+    [info getBytes:page length:sizeof(PDFKImagePage)];
+    return YES;
+}
+
+- (CGImageRef)copyImage:(CGPDFStreamRef)stream width:(size_t)width height:(size_t)height drawnSize:(CGFloat)drawnSize CF_RETURNS_RETAINED
+{
+    //Decode to the next power of two above the drawn size, or the full size.
+    size_t fullSize = MAX(width, height);
+    size_t decodeSize = MINIMUM_DECODE_SIZE;
+    while (decodeSize < drawnSize && decodeSize < fullSize) {
+        decodeSize *= 2;
+    }
+    if (decodeSize >= fullSize) {
+        decodeSize = 0;
+    }
+    
+    NSNumber *streamKey = @((uintptr_t)stream);
+    NSArray *decodeKey = @[streamKey, @(decodeSize)];
+    dispatch_group_t decode = NULL;
+    while (decode == NULL) {
+        dispatch_group_t pending = NULL;
+        @synchronized(self) {
+            if ([failedImages containsObject:streamKey]) {
+                return NULL;
+            }
+            //The decode size, or a larger one
+            for (size_t size = decodeSize; ; size *= 2) {
+                if (size >= fullSize) {
+                    size = 0;
+                }
+                NSArray *key = @[streamKey, @(size)];
+                CGImageRef image = (__bridge CGImageRef)images[key];
+                if (image != NULL) {
+                    hitCount++;
+                    [accessOrder removeObject:key];
+                    [accessOrder addObject:key];
+                    return CGImageRetain(image);
+                }
+                if (size == 0) {
+                    break;
+                }
+            }
+            pending = decodes[decodeKey];
+            if (pending == NULL) {
+                decode = dispatch_group_create();
+                dispatch_group_enter(decode);
+                decodes[decodeKey] = decode;
+            }
+        }
+        if (pending != NULL) {
+            dispatch_group_wait(pending, DISPATCH_TIME_FOREVER);
+        }
+    }
+    
+    BOOL downsampled = NO;
+    CGImageRef image = PDFKImageCreateDecoded(stream, decodeSize, &downsampled);
+    @synchronized(self) {
+        [decodes removeObjectForKey:decodeKey];
+        if (image == NULL) {
+            [failedImages addObject:streamKey];
+        } else {
+            decodeCount++;
+            downsampledDecodeCount += (downsampled ? 1 : 0);
+            NSUInteger imageBytes = CGImageGetBytesPerRow(image) * CGImageGetHeight(image);
+            if (imageBytes <= _byteBudget) {
+                images[decodeKey] = (__bridge id)image;
+                [accessOrder addObject:decodeKey];
+                bytes += imageBytes;
+                [self evictImagesOverBudget];
+            }
+        }
+    }
+    dispatch_group_leave(decode);
+    return image;
+}
+
+/**
+ Must be called in @synchronized(self).
+ */
+- (void)evictImagesOverBudget
+{
+    while (bytes > _byteBudget && accessOrder.count > 0) {
+        NSArray *key = accessOrder.firstObject;
+        CGImageRef image = (__bridge CGImageRef)images[key];
+        bytes -= CGImageGetBytesPerRow(image) * CGImageGetHeight(image);
+        [images removeObjectForKey:key];
+        [accessOrder removeObjectAtIndex:0];
+        evictionCount++;
+    }
+}
+
+- (void)setByteBudget:(NSUInteger)byteBudget
+{
+    @synchronized(self) {
+        _byteBudget = byteBudget;
+        [self evictImagesOverBudget];
+    }
+}
+
+- (void)removeAllImages
+{
+    @synchronized(self) {
+        [images removeAllObjects];
+        [accessOrder removeAllObjects];
+        bytes = 0;
+    }
+}
+
+- (NSDictionary *)statistics
+{
+    @synchronized(self) {
+        return @{@"ImagePages": @(imagePageCount),
+                 @"Hits": @(hitCount),
+                 @"Decodes": @(decodeCount),
+                 @"DownsampledDecodes": @(downsampledDecodeCount),
+                 @"Evictions": @(evictionCount),
+                 @"Bytes": @(bytes)};
+    }
+}
+
+#pragma mark PDFKResourceConsumer
+
+- (NSUInteger)resourceBytes
+{
+    @synchronized(self) {
+        return bytes;
+    }
+}
+
+- (NSUInteger)shedResourcesForPressure:(PDFKResourcePressure)pressure
+{
+    NSUInteger shedBytes = [self resourceBytes];
+    [self removeAllImages];
+    
+    //Close the document too
+    @synchronized([PDFKImageCache class]) {
+        [documentCaches removeObjectIdenticalTo:self];
+    }
+    return shedBytes;
+}
+
+@end
@@ -0,0 +1,85 @@
+/*
+ //  PDFKPixelBufferPool.h
+ //  M13PDFKit
+ //
+ Copyright (c) 2014 Brandon McQuilkin
+ 
+ Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated documentation files (the
+ "Software"), to deal in the Software without restriction, including without limitation the rights to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software, and to permit persons to whom the Software is furnished to do so, subject to
+ the following conditions:
+ 
+ The above copyright notice and this permission notice shall be included in all copies or substantial portions of the Software.
+ 
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#import <Foundation/Foundation.h>
+#import <CoreGraphics/CoreGraphics.h>
+#import "PDFKResourceGovernor.h"
+
+/**
+ The number of bytes in a row of pixels for a 32 bit bitmap of the given width, aligned for drawing.
+ 
+ @param width The width of the bitmap in pixels.
+ 
+ @return The number of bytes in a row.
+ */
+size_t PDFKPixelBufferBytesPerRow(size_t width);
+/**
+ Get a pixel buffer from the pool. Buffers are reused by size class, recently freed buffers on the same thread first. Safe to call from any thread.
+ 
+ @param length The number of bytes needed.
+ 
+ @return A buffer of at least length bytes, that must be returned with PDFKPixelBufferRelease. The contents are undefined. NULL if the memory could not be allocated.
+ */
+void *PDFKPixelBufferAllocate(size_t length);
+/**
+ Return a pixel buffer to the pool. Safe to call from any thread.
+ 
+ @param buffer A buffer from PDFKPixelBufferAllocate, or NULL.
+ */
+void PDFKPixelBufferRelease(void *buffer);
+/**
+ Create an image that uses a pixel buffer as its pixels. The image takes ownership of the buffer, which returns to the pool when the image is destroyed. The buffer must not be changed afterwards.
+ 
+ @param buffer      A buffer from PDFKPixelBufferAllocate.
+ @param width       The width of the image in pixels.
+ @param height      The height of the image in pixels.
+ @param bytesPerRow The number of bytes in a row of pixels.
+ @param bitmapInfo  The layout of the 32 bit RGB pixels.
+ 
+ @return A CGImageRef that must be released by the caller, or NULL if the image could not be created. The buffer is returned to the pool if the image could not be created.
+ */
+CGImageRef PDFKPixelBufferCreateImage(void *buffer, size_t width, size_t height, size_t bytesPerRow, CGBitmapInfo bitmapInfo) CF_RETURNS_RETAINED;
+
+/**
+ The statistics and the resource accounting of the pixel buffer pool.
+ */
+@interface PDFKPixelBufferPool : NSObject <PDFKResourceConsumer>
+
+/**
+ The shared pool. Registered with the resource governor, the free buffers are released under memory pressure.
+ 
+ @return The shared pool.
+ */
++ (PDFKPixelBufferPool *)sharedPool;
+/**
+ The maximum number of bytes of free buffers that are kept for reuse. Defaults to 16MB.
+ */
+@property (nonatomic, assign) NSUInteger maximumCachedBytes;
+/**
+ Release all the free buffers kept for reuse, including the ones kept by each thread.
+ */
+- (void)removeAllCachedBuffers;
+/**
+ The allocator's statistics. "Allocations" is the number of buffers handed out, "Reuses" the number that were free buffers, "SystemAllocations" the number that were allocated from the system. "OutstandingBuffers" and "OutstandingBytes" are the buffers in use; buffers that are never returned show up here. "HighWaterBytes" is the most bytes that were in use at once, and "CachedBytes" the free bytes kept for reuse.
+ 
+ @return A dictionary of NSNumbers.
+ */
+- (NSDictionary *)statistics;
+/**
+ Reset the counters. The outstanding and cached counts are not reset.
+ */
+- (void)resetStatistics;
+
+@end
@@ -0,0 +1,427 @@
+/*
+ //  PDFKPixelBufferPool.m
+ //  M13PDFKit
+ //
+ Copyright (c) 2014 Brandon McQuilkin
+ 
+ Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated documentation files (the
+ "Software"), to deal in the Software without restriction, including without limitation the rights to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software, and to permit persons to whom the Software is furnished to do so, subject to
+ the following conditions:
+ 
+ The above copyright notice and this permission notice shall be included in all copies or substantial portions of the Software.
+ 
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#import "PDFKPixelBufferPool.h"
+#import <stdatomic.h>
+#import <pthread.h>
+
+//The smallest size class, as a power of two: 16KB
+#define SMALLEST_CLASS_SHIFT 14
+//Each doubling of size is split into this many classes, as a power of two, so at most 25% of a buffer is unused.
+#define CLASS_STEPS_SHIFT 2
+//The largest size class, as a power of two: 64MB. Larger buffers are not pooled.
+#define LARGEST_CLASS_SHIFT 26
+//The number of size classes
+#define CLASS_COUNT (((LARGEST_CLASS_SHIFT - SMALLEST_CLASS_SHIFT) << CLASS_STEPS_SHIFT) + 1)
+//The size class of buffers that are not pooled
+#define CLASS_NONE UINT32_MAX
+//The free buffers each thread keeps for itself
+#define THREAD_CACHE_SLOTS 4
+//The most bytes each thread keeps for itself
+#define THREAD_CACHE_BYTES (4 * 1024 * 1024)
+//The default maximum of free bytes kept for reuse
+#define DEFAULT_MAXIMUM_CACHED_BYTES (16 * 1024 * 1024)
+//Marks the header of a pool buffer
+#define BUFFER_MAGIC 0x50444B42
+//The alignment of every allocation, malloc only guarantees 16 bytes
+#define BUFFER_ALIGNMENT 64
+
+/**
+ The header in front of every buffer. Buffers are allocated 64 byte aligned, and the size of the header keeps the pixels 64 byte aligned.
+ */
+typedef union PDFKPixelBufferHeader {
+    struct {
+        union PDFKPixelBufferHeader *next;
+        size_t capacity;
+        uint32_t sizeClass;
+        uint32_t magic;
+    };
+    uint8_t padding[64];
+} PDFKPixelBufferHeader;
+
+/**
+ The free buffers kept by a thread, so most buffers are reused without taking the shared lock. The lock is only taken by another thread when the pool is cleared.
+ */
+typedef struct PDFKPixelBufferThreadCache {
+    pthread_mutex_t lock;
+    PDFKPixelBufferHeader *buffers[THREAD_CACHE_SLOTS];
+    size_t count;
+    size_t bytes;
+    struct PDFKPixelBufferThreadCache *previous;
+    struct PDFKPixelBufferThreadCache *next;
+} PDFKPixelBufferThreadCache;
+
+//The free buffers shared by all threads, by size class
+static PDFKPixelBufferHeader *freeLists[CLASS_COUNT];
+static pthread_mutex_t freeListLock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_key_t threadCacheKey;
+static pthread_once_t threadCacheOnce = PTHREAD_ONCE_INIT;
+//The caches of every thread, so clearing the pool empties the caches of idle threads.
+static PDFKPixelBufferThreadCache *threadCaches = NULL;
+static pthread_mutex_t threadCachesLock = PTHREAD_MUTEX_INITIALIZER;
+static atomic_size_t maximumCachedBytes = DEFAULT_MAXIMUM_CACHED_BYTES;
+
+//Statistics
+static atomic_uint_fast64_t allocationCount = 0;
+static atomic_uint_fast64_t reuseCount = 0;
+static atomic_uint_fast64_t systemAllocationCount = 0;
+static atomic_int_fast64_t outstandingBuffers = 0;
+static atomic_size_t outstandingBytes = 0;
+static atomic_size_t highWaterBytes = 0;
+static atomic_size_t cachedBytes = 0;
+
+#pragma mark Size Classes
+
+/**
+ The size class that fits the length, or CLASS_NONE if it is too large to pool.
+ */
+static inline uint32_t PDFKPixelBufferSizeClass(size_t length)
+{
+    if (length <= ((size_t)1 << SMALLEST_CLASS_SHIFT)) {
+        return 0;
+    }
+    if (length > ((size_t)1 << LARGEST_CLASS_SHIFT)) {
+        return CLASS_NONE;
+    }
+    size_t value = length - 1;
+    uint32_t shift = (uint32_t)(63 - __builtin_clzll(value));
+    uint32_t step = (uint32_t)((value >> (shift - CLASS_STEPS_SHIFT)) & ((1 << CLASS_STEPS_SHIFT) - 1));
+    return ((shift - SMALLEST_CLASS_SHIFT) << CLASS_STEPS_SHIFT) + step + 1;
+}
+
+/**
+ The capacity of the buffers in a size class.
+ */
+static inline size_t PDFKPixelBufferClassCapacity(uint32_t sizeClass)
+{
+    if (sizeClass == 0) {
+        return ((size_t)1 << SMALLEST_CLASS_SHIFT);
+    }
+    uint32_t shift = ((sizeClass - 1) >> CLASS_STEPS_SHIFT) + SMALLEST_CLASS_SHIFT;
+    uint32_t step = (sizeClass - 1) & ((1 << CLASS_STEPS_SHIFT) - 1);
+    return ((size_t)((1 << CLASS_STEPS_SHIFT) + step + 1)) << (shift - CLASS_STEPS_SHIFT);
+}
+
+#pragma mark Free Buffers
+
+static void PDFKPixelBufferFreeToSystem(PDFKPixelBufferHeader *header)
+{
+    header->magic = 0;
+    free(header);
+}
+
+/**
+ Keep a free buffer in the shared lists, or free it if too much is kept. The buffer's bytes are already counted as cached.
+ */
+static void PDFKPixelBufferPushFree(PDFKPixelBufferHeader *header)
+{
+    pthread_mutex_lock(&freeListLock);
+    header->next = freeLists[header->sizeClass];
+    freeLists[header->sizeClass] = header;
+    pthread_mutex_unlock(&freeListLock);
+}
+
+/**
+ Move the buffers kept by a thread to the shared lists, or free them. The cache's lock must be held.
+ */
+static void PDFKPixelBufferFlushThreadCache(PDFKPixelBufferThreadCache *cache, BOOL freeBuffers)
+{
+    for (size_t index = 0; index < cache->count; index++) {
+        PDFKPixelBufferHeader *header = cache->buffers[index];
+        if (freeBuffers) {
+            atomic_fetch_sub_explicit(&cachedBytes, header->capacity, memory_order_relaxed);
+            PDFKPixelBufferFreeToSystem(header);
+        } else {
+            PDFKPixelBufferPushFree(header);
+        }
+    }
+    cache->count = 0;
+    cache->bytes = 0;
+}
+
+static void PDFKPixelBufferThreadCacheDestroy(void *value)
+{
+    PDFKPixelBufferThreadCache *cache = value;
+    pthread_mutex_lock(&threadCachesLock);
+    if (cache->previous != NULL) {
+        cache->previous->next = cache->next;
+    } else {
+        threadCaches = cache->next;
+    }
+    if (cache->next != NULL) {
+        cache->next->previous = cache->previous;
+    }
+    pthread_mutex_unlock(&threadCachesLock);
+    
+    pthread_mutex_lock(&cache->lock);
+    PDFKPixelBufferFlushThreadCache(cache, NO);
+    pthread_mutex_unlock(&cache->lock);
+    pthread_mutex_destroy(&cache->lock);
+    free(cache);
+}
+
+static void PDFKPixelBufferThreadCacheKeyCreate(void)
+{
+    pthread_key_create(&threadCacheKey, PDFKPixelBufferThreadCacheDestroy);
+}
+
+/**
+ The calling thread's cache, registered when the thread first uses the pool.
+ */
+static PDFKPixelBufferThreadCache *PDFKPixelBufferGetThreadCache(void)
+{
+    pthread_once(&threadCacheOnce, PDFKPixelBufferThreadCacheKeyCreate);
+    PDFKPixelBufferThreadCache *cache = pthread_getspecific(threadCacheKey);
+    if (cache == NULL) {
+        cache = calloc(1, sizeof(PDFKPixelBufferThreadCache));
+        if (cache == NULL) {
+            return NULL;
+        }
+        pthread_mutex_init(&cache->lock, NULL);
+        pthread_setspecific(threadCacheKey, cache);
+        
+        pthread_mutex_lock(&threadCachesLock);
+        cache->next = threadCaches;
+        if (threadCaches != NULL) {
+            threadCaches->previous = cache;
+        }
+        threadCaches = cache;
+        pthread_mutex_unlock(&threadCachesLock);
+    }
+    return cache;
+}
+
+#pragma mark Allocation
+
+size_t PDFKPixelBufferBytesPerRow(size_t width)
+{
+    //64 byte aligned rows draw fastest
+    return ((width * 4) + 63) & ~(size_t)63;
+}
+
+void *PDFKPixelBufferAllocate(size_t length)
+{
+    uint32_t sizeClass = PDFKPixelBufferSizeClass(length);
+    PDFKPixelBufferHeader *header = NULL;
+    
+    if (sizeClass != CLASS_NONE) {
+        //A buffer this thread freed recently
+        PDFKPixelBufferThreadCache *cache = PDFKPixelBufferGetThreadCache();
+        if (cache != NULL) {
+            pthread_mutex_lock(&cache->lock);
+            for (size_t index = 0; index < cache->count; index++) {
+                if (cache->buffers[index]->sizeClass == sizeClass) {
+                    header = cache->buffers[index];
+                    cache->buffers[index] = cache->buffers[--cache->count];
+                    cache->bytes -= header->capacity;
+                    break;
+                }
+            }
+            pthread_mutex_unlock(&cache->lock);
+        }
+        
+        //A buffer another thread freed
+        if (header == NULL) {
+            pthread_mutex_lock(&freeListLock);
+            header = freeLists[sizeClass];
+            if (header != NULL) {
+                freeLists[sizeClass] = header->next;
+            }
+            pthread_mutex_unlock(&freeListLock);
+        }
+        
+        if (header != NULL) {
+            atomic_fetch_sub_explicit(&cachedBytes, header->capacity, memory_order_relaxed);
+            atomic_fetch_add_explicit(&reuseCount, 1, memory_order_relaxed);
+        }
+    }
+    
+    //A new buffer
+    if (header == NULL) {
+        //Register the pool for memory pressure once it holds memory.
+        [PDFKPixelBufferPool sharedPool];
+        
+        size_t capacity = (sizeClass != CLASS_NONE ? PDFKPixelBufferClassCapacity(sizeClass) : length);
+        void *allocation = NULL;
+        if (posix_memalign(&allocation, BUFFER_ALIGNMENT, sizeof(PDFKPixelBufferHeader) + capacity) != 0) {
+            return NULL;
+        }
+        header = allocation;
+        header->capacity = capacity;
+        header->sizeClass = sizeClass;
+        header->magic = BUFFER_MAGIC;
+        atomic_fetch_add_explicit(&systemAllocationCount, 1, memory_order_relaxed);
+    }
+    header->next = NULL;
+    
+    //Statistics
+    atomic_fetch_add_explicit(&allocationCount, 1, memory_order_relaxed);
+    atomic_fetch_add_explicit(&outstandingBuffers, 1, memory_order_relaxed);
+    size_t outstanding = atomic_fetch_add_explicit(&outstandingBytes, header->capacity, memory_order_relaxed) + header->capacity;
+    size_t highWater = atomic_load_explicit(&highWaterBytes, memory_order_relaxed);
+    while (outstanding > highWater && !atomic_compare_exchange_weak_explicit(&highWaterBytes, &highWater, outstanding, memory_order_relaxed, memory_order_relaxed)) {
+    }
+    
+    return (header + 1);
+}
+
+void PDFKPixelBufferRelease(void *buffer)
+{
+    if (buffer == NULL) {
+        return;
+    }
+    PDFKPixelBufferHeader *header = ((PDFKPixelBufferHeader *)buffer) - 1;
+    NSCAssert(header->magic == BUFFER_MAGIC, @"The buffer was not allocated by the pixel buffer pool, or was already released.");
+    
+    atomic_fetch_sub_explicit(&outstandingBuffers, 1, memory_order_relaxed);
+    atomic_fetch_sub_explicit(&outstandingBytes, header->capacity, memory_order_relaxed);
+    
+    //Free buffers that are too large, or that do not fit in the pool.
+    size_t cached = atomic_fetch_add_explicit(&cachedBytes, header->capacity, memory_order_relaxed) + header->capacity;
+    if (header->sizeClass == CLASS_NONE || cached > atomic_load_explicit(&maximumCachedBytes, memory_order_relaxed)) {
+        atomic_fetch_sub_explicit(&cachedBytes, header->capacity, memory_order_relaxed);
+        PDFKPixelBufferFreeToSystem(header);
+        return;
+    }
+    
+    //Keep it on this thread if there is room, the next render on this thread will likely want the same size.
+    PDFKPixelBufferThreadCache *cache = PDFKPixelBufferGetThreadCache();
+    if (cache != NULL) {
+        pthread_mutex_lock(&cache->lock);
+        BOOL kept = (cache->count < THREAD_CACHE_SLOTS && cache->bytes + header->capacity <= THREAD_CACHE_BYTES);
+        if (kept) {
+            cache->buffers[cache->count++] = header;
+            cache->bytes += header->capacity;
+        }
+        pthread_mutex_unlock(&cache->lock);
+        if (kept) {
+            return;
+        }
+    }
+    PDFKPixelBufferPushFree(header);
+}
+
+static void PDFKPixelBufferProviderRelease(void *info, const void *data, size_t size)
+{
+    PDFKPixelBufferRelease((void *)data);
+}
+
+CGImageRef PDFKPixelBufferCreateImage(void *buffer, size_t width, size_t height, size_t bytesPerRow, CGBitmapInfo bitmapInfo)
+{
+    if (buffer == NULL) {
+        return NULL;
+    }
+    CGDataProviderRef provider = CGDataProviderCreateWithData(NULL, buffer, bytesPerRow * height, PDFKPixelBufferProviderRelease);
+    if (provider == NULL) {
+        PDFKPixelBufferRelease(buffer);
+        return NULL;
+    }
+    CGColorSpaceRef rgb = CGColorSpaceCreateDeviceRGB();
+    CGImageRef image = CGImageCreate(width, height, 8, 32, bytesPerRow, rgb, bitmapInfo, provider, NULL, false, kCGRenderingIntentDefault);
+    CGColorSpaceRelease(rgb);
+    //The image keeps the provider, or the buffer is released with it.
+    CGDataProviderRelease(provider);
+    return image;
+}
+
+@implementation PDFKPixelBufferPool
+
++ (PDFKPixelBufferPool *)sharedPool
+{
+    static dispatch_once_t predicate = 0;
+    static PDFKPixelBufferPool *sharedPool = nil;
+    dispatch_once(&predicate, ^{
+        sharedPool = [self new];
+        //Free buffers are cheap to allocate again.
+        [[PDFKResourceGovernor sharedGovernor] registerConsumer:sharedPool category:PDFKResourceCategoryPixelBuffers priority:PDFKResourcePriorityLow];
+    });
+    return sharedPool;
+}
+
+- (NSUInteger)maximumCachedBytes
+{
+    return atomic_load_explicit(&maximumCachedBytes, memory_order_relaxed);
+}
+
+- (void)setMaximumCachedBytes:(NSUInteger)maximum
+{
+    atomic_store_explicit(&maximumCachedBytes, maximum, memory_order_relaxed);
+    if (atomic_load_explicit(&cachedBytes, memory_order_relaxed) > maximum) {
+        [self removeAllCachedBuffers];
+    }
+}
+
+- (void)removeAllCachedBuffers
+{
+    //Empty the caches of every thread, idle worker threads may not use the pool again for a long time.
+    pthread_mutex_lock(&threadCachesLock);
+    for (PDFKPixelBufferThreadCache *cache = threadCaches; cache != NULL; cache = cache->next) {
+        pthread_mutex_lock(&cache->lock);
+        PDFKPixelBufferFlushThreadCache(cache, YES);
+        pthread_mutex_unlock(&cache->lock);
+    }
+    pthread_mutex_unlock(&threadCachesLock);
+    
+    PDFKPixelBufferHeader *lists[CLASS_COUNT];
+    pthread_mutex_lock(&freeListLock);
+    memcpy(lists, freeLists, sizeof(freeLists));
+    memset(freeLists, 0, sizeof(freeLists));
+    pthread_mutex_unlock(&freeListLock);
+    
+    for (NSUInteger sizeClass = 0; sizeClass < CLASS_COUNT; sizeClass++) {
+        PDFKPixelBufferHeader *header = lists[sizeClass];
+        while (header != NULL) {
+            PDFKPixelBufferHeader *next = header->next;
+            atomic_fetch_sub_explicit(&cachedBytes, header->capacity, memory_order_relaxed);
+            PDFKPixelBufferFreeToSystem(header);
+            header = next;
+        }
+    }
+}
+
+- (NSDictionary *)statistics
+{
+    return @{@"Allocations": @(atomic_load_explicit(&allocationCount, memory_order_relaxed)),
+             @"Reuses": @(atomic_load_explicit(&reuseCount, memory_order_relaxed)),
+             @"SystemAllocations": @(atomic_load_explicit(&systemAllocationCount, memory_order_relaxed)),
+             @"OutstandingBuffers": @(atomic_load_explicit(&outstandingBuffers, memory_order_relaxed)),
+             @"OutstandingBytes": @(atomic_load_explicit(&outstandingBytes, memory_order_relaxed)),
+             @"HighWaterBytes": @(atomic_load_explicit(&highWaterBytes, memory_order_relaxed)),
+             @"CachedBytes": @(atomic_load_explicit(&cachedBytes, memory_order_relaxed))};
+}
+
+- (void)resetStatistics
+{
+    atomic_store_explicit(&allocationCount, 0, memory_order_relaxed);
+    atomic_store_explicit(&reuseCount, 0, memory_order_relaxed);
+    atomic_store_explicit(&systemAllocationCount, 0, memory_order_relaxed);
+    atomic_store_explicit(&highWaterBytes, atomic_load_explicit(&outstandingBytes, memory_order_relaxed), memory_order_relaxed);
+}
+
+#pragma mark PDFKResourceConsumer
+
+- (NSUInteger)resourceBytes
+{
+    return atomic_load_explicit(&cachedBytes, memory_order_relaxed);
+}
+
+- (NSUInteger)shedResourcesForPressure:(PDFKResourcePressure)pressure
+{
+    NSUInteger bytes = [self resourceBytes];
+    [self removeAllCachedBuffers];
+    return bytes - MIN(bytes, [self resourceBytes]);
+}
+
+@end
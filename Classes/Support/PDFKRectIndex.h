@@ -0,0 +1,74 @@
+/*
+ //  PDFKRectIndex.h
+ //  M13PDFKit
+ //
+ Copyright (c) 2014 Brandon McQuilkin
+ 
+ Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated documentation files (the
+ "Software"), to deal in the Software without restriction, including without limitation the rights to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software, and to permit persons to whom the Software is furnished to do so, subject to
+ the following conditions:
+ 
+ The above copyright notice and this permission notice shall be included in all copies or substantial portions of the Software.
+ 
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+
+#import <Foundation/Foundation.h>
+#import <CoreGraphics/CoreGraphics.h>
+
+/**
+ A spatial index of a fixed set of rects, to find the rects at a point or in an area without testing every rect. The rects are sorted into a grid of cells over their bounds. Pages with thousands of links, like the index of a book, are searched by the few cells that are tapped or drawn. The index can not be changed, it is safe to use from any thread.
+ */
+@interface PDFKRectIndex : NSObject
+
+/**
+ Build an index.
+ 
+ @param rects The rects to index. They are copied.
+ @param count The number of rects.
+ 
+ @return A new index.
+ */
+- (id)initWithRects:(const CGRect *)rects count:(NSUInteger)count;
+/**
+ The number of rects in the index.
+ */
+@property (nonatomic, assign, readonly) NSUInteger count;
+/**
+ The bounds of all the rects.
+ */
+@property (nonatomic, assign, readonly) CGRect bounds;
+/**
+ Get a rect of the index.
+ 
+ @param index The index of the rect, in the order the rects were given.
+ 
+ @return The rect.
+ */
+- (CGRect)rectAtIndex:(NSUInteger)index;
+/**
+ Find the first rect that contains a point.
+ 
+ @param point The point.
+ 
+ @return The index of the first rect, in the order the rects were given, that contains the point. NSNotFound if none does.
+ */
+- (NSUInteger)indexOfRectContainingPoint:(CGPoint)point;
+/**
+ Find the rects that intersect an area.
+ 
+ @param rect The area.
+ 
+ @return The indexes of the rects, in the order the rects were given.
+ */
+- (NSIndexSet *)indexesOfRectsIntersectingRect:(CGRect)rect;
+/**
+ Call a block for each rect that intersects an area, in the order the rects were given, without allocating objects.
+ 
+ @param rect  The area.
+ @param block The block to call, with the index and the rect.
+ */
+- (void)enumerateRectsIntersectingRect:(CGRect)rect usingBlock:(void (^)(NSUInteger index, CGRect indexedRect, BOOL *stop))block;
+
+@end
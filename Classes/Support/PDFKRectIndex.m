@@ -0,0 +1,277 @@
+/*
+ //  PDFKRectIndex.m
+ //  M13PDFKit
+ //
+ Copyright (c) 2014 Brandon McQuilkin
+ 
+ Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated documentation files (the
+ "Software"), to deal in the Software without restriction, including without limitation the rights to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software, and to permit persons to whom the Software is furnished to do so, subject to
+ the following conditions:
+ 
+ The above copyright notice and this permission notice shall be included in all copies or substantial portions of the Software.
+ 
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+
+#import "PDFKRectIndex.h"
+
+//The average number of rects in a cell of the grid
+#define RECTS_PER_CELL 4
+//The most cells on each side of the grid
+#define MAXIMUM_GRID_SIDE 64
+
+/**
+ The rects sorted into a grid of cells. The indexes of the rects in each cell are stored one cell after another, in the order the rects were given.
+ */
+typedef struct {
+    CGRect bounds;
+    size_t columns;
+    size_t rows;
+    CGFloat cellWidth;
+    CGFloat cellHeight;
+    /**
+     The first item of each cell, and the end of the last cell.
+     */
+    uint32_t *cellStarts;
+    uint32_t *cellItems;
+} PDFKRectGrid;
+
+typedef struct {
+    size_t firstColumn;
+    size_t lastColumn;
+    size_t firstRow;
+    size_t lastRow;
+} PDFKRectGridSpan;
+
+static inline size_t PDFKRectGridClamp(CGFloat value, size_t count)
+{
+    if (value <= 0.0f) {
+        return 0;
+    }
+    return MIN((size_t)value, count - 1);
+}
+
+/**
+ The cells covered by a rect.
+ 
+ @return NO if the rect is outside of the grid.
+ */
+static BOOL PDFKRectGridSpanOfRect(const PDFKRectGrid *grid, CGRect rect, PDFKRectGridSpan *span)
+{
+    rect = CGRectStandardize(rect);
+    if (grid->columns == 0 || CGRectIsNull(rect) || CGRectGetMaxX(rect) < CGRectGetMinX(grid->bounds) || CGRectGetMinX(rect) > CGRectGetMaxX(grid->bounds) ||
+        CGRectGetMaxY(rect) < CGRectGetMinY(grid->bounds) || CGRectGetMinY(rect) > CGRectGetMaxY(grid->bounds)) {
+        return NO;
+    }
+    span->firstColumn = PDFKRectGridClamp((CGRectGetMinX(rect) - CGRectGetMinX(grid->bounds)) / grid->cellWidth, grid->columns);
+    span->lastColumn = PDFKRectGridClamp((CGRectGetMaxX(rect) - CGRectGetMinX(grid->bounds)) / grid->cellWidth, grid->columns);
+    span->firstRow = PDFKRectGridClamp((CGRectGetMinY(rect) - CGRectGetMinY(grid->bounds)) / grid->cellHeight, grid->rows);
+    span->lastRow = PDFKRectGridClamp((CGRectGetMaxY(rect) - CGRectGetMinY(grid->bounds)) / grid->cellHeight, grid->rows);
+    return YES;
+}
+
+static BOOL PDFKRectGridBuild(PDFKRectGrid *grid, const CGRect *rects, size_t count)
+{
+    memset(grid, 0, sizeof(PDFKRectGrid));
+    grid->bounds = CGRectNull;
+    for (size_t index = 0; index < count; index++) {
+        if (CGRectIsNull(rects[index]) == NO) {
+            grid->bounds = CGRectUnion(grid->bounds, CGRectStandardize(rects[index]));
+        }
+    }
+    if (CGRectIsNull(grid->bounds)) {
+        return YES;
+    }
+    
+    //About the same number of cells on each side
+    size_t side = 1;
+    while (side < MAXIMUM_GRID_SIDE && side * side * RECTS_PER_CELL < count) {
+        side++;
+    }
+    grid->columns = side;
+    grid->rows = side;
+    grid->cellWidth = MAX(CGRectGetWidth(grid->bounds) / side, 1.0f);
+    grid->cellHeight = MAX(CGRectGetHeight(grid->bounds) / side, 1.0f);
+    
+    //Count the rects of each cell, then fill the cells
+    size_t cellCount = side * side;
+    grid->cellStarts = calloc(cellCount + 1, sizeof(uint32_t));
+    if (grid->cellStarts == NULL) {
+        return NO;
+    }
+    PDFKRectGridSpan span;
+    for (size_t index = 0; index < count; index++) {
+        if (PDFKRectGridSpanOfRect(grid, rects[index], &span)) {
+            for (size_t row = span.firstRow; row <= span.lastRow; row++) {
+                for (size_t column = span.firstColumn; column <= span.lastColumn; column++) {
+                    grid->cellStarts[(row * side) + column + 1]++;
+                }
+            }
+        }
+    }
+    for (size_t cell = 0; cell < cellCount; cell++) {
+        grid->cellStarts[cell + 1] += grid->cellStarts[cell];
+    }
+    grid->cellItems = malloc(MAX(grid->cellStarts[cellCount], 1) * sizeof(uint32_t));
+    uint32_t *filled = calloc(cellCount, sizeof(uint32_t));
+    if (grid->cellItems == NULL || filled == NULL) {
+        free(filled);
+        return NO;
+    }
+    for (size_t index = 0; index < count; index++) {
+        if (PDFKRectGridSpanOfRect(grid, rects[index], &span)) {
+            for (size_t row = span.firstRow; row <= span.lastRow; row++) {
+                for (size_t column = span.firstColumn; column <= span.lastColumn; column++) {
+                    size_t cell = (row * side) + column;
+                    grid->cellItems[grid->cellStarts[cell] + filled[cell]++] = (uint32_t)index;
+                }
+            }
+        }
+    }
+    free(filled);
+    return YES;
+}
+
+static void PDFKRectGridFree(PDFKRectGrid *grid)
+{
+    free(grid->cellStarts);
+    free(grid->cellItems);
+    memset(grid, 0, sizeof(PDFKRectGrid));
+}
+
+static size_t PDFKRectGridIndexAtPoint(const PDFKRectGrid *grid, const CGRect *rects, CGPoint point)
+{
+    PDFKRectGridSpan span;
+    if (PDFKRectGridSpanOfRect(grid, CGRectMake(point.x, point.y, 0.0f, 0.0f), &span) == NO) {
+        return SIZE_MAX;
+    }
+    //The items of a cell are in order, the first that contains the point is the first of all.
+    size_t cell = (span.firstRow * grid->columns) + span.firstColumn;
+    for (uint32_t item = grid->cellStarts[cell]; item < grid->cellStarts[cell + 1]; item++) {
+        if (CGRectContainsPoint(rects[grid->cellItems[item]], point)) {
+            return grid->cellItems[item];
+        }
+    }
+    return SIZE_MAX;
+}
+
+static int PDFKRectGridCompareIndexes(const void *first, const void *second)
+{
+    uint32_t a = *(const uint32_t *)first;
+    uint32_t b = *(const uint32_t *)second;
+    return (a < b ? -1 : (a > b ? 1 : 0));
+}
+
+/**
+ Find the rects that intersect an area.
+ 
+ @param results Room for the index of every rect.
+ 
+ @return The number of rects found, their indexes are in order.
+ */
+static size_t PDFKRectGridQuery(const PDFKRectGrid *grid, const CGRect *rects, CGRect rect, uint32_t *results)
+{
+    PDFKRectGridSpan span;
+    rect = CGRectStandardize(rect);
+    if (PDFKRectGridSpanOfRect(grid, rect, &span) == NO) {
+        return 0;
+    }
+    size_t found = 0;
+    PDFKRectGridSpan itemSpan;
+    for (size_t row = span.firstRow; row <= span.lastRow; row++) {
+        for (size_t column = span.firstColumn; column <= span.lastColumn; column++) {
+            size_t cell = (row * grid->columns) + column;
+            for (uint32_t item = grid->cellStarts[cell]; item < grid->cellStarts[cell + 1]; item++) {
+                uint32_t index = grid->cellItems[item];
+                if (CGRectIntersectsRect(rects[index], rect) == NO) {
+                    continue;
+                }
+                //A rect in several cells is found in the first cell that is both in it and in the area
+                PDFKRectGridSpanOfRect(grid, rects[index], &itemSpan);
+                if (column == MAX(span.firstColumn, itemSpan.firstColumn) && row == MAX(span.firstRow, itemSpan.firstRow)) {
+                    results[found++] = index;
+                }
+            }
+        }
+    }
+    if (span.firstColumn != span.lastColumn || span.firstRow != span.lastRow) {
+        qsort(results, found, sizeof(uint32_t), PDFKRectGridCompareIndexes);
+    }
+    return found;
+}
+
+@implementation PDFKRectIndex
+{
+    CGRect *rects;
+    PDFKRectGrid grid;
+}
+
+- (id)initWithRects:(const CGRect *)indexRects count:(NSUInteger)count
+{
+    if ((self = [super init])) {
+        rects = malloc(MAX(count, 1) * sizeof(CGRect));
+        if (rects == NULL) {
+            return nil;
+        }
+        memcpy(rects, indexRects, count * sizeof(CGRect));
+        for (NSUInteger index = 0; index < count; index++) {
+            rects[index] = CGRectStandardize(rects[index]);
+        }
+        _count = count;
+        if (PDFKRectGridBuild(&grid, rects, count) == NO) {
+            PDFKRectGridFree(&grid);
+            return nil;
+        }
+        _bounds = grid.bounds;
+    }
+    return self;
+}
+
+- (void)dealloc
+{
+    PDFKRectGridFree(&grid);
+    free(rects);
+}
+
+- (CGRect)rectAtIndex:(NSUInteger)index
+{
+    return (index < _count ? rects[index] : CGRectNull);
+}
+
+- (NSUInteger)indexOfRectContainingPoint:(CGPoint)point
+{
+    size_t index = PDFKRectGridIndexAtPoint(&grid, rects, point);
+    return (index == SIZE_MAX ? NSNotFound : (NSUInteger)index);
+}
+
+- (NSIndexSet *)indexesOfRectsIntersectingRect:(CGRect)rect
+{
+    NSMutableIndexSet *indexes = [NSMutableIndexSet new];
+    [self enumerateRectsIntersectingRect:rect usingBlock:^(NSUInteger index, CGRect indexedRect, BOOL *stop) {
+        [indexes addIndex:index];
+    }];
+    return indexes;
+}
+
+- (void)enumerateRectsIntersectingRect:(CGRect)rect usingBlock:(void (^)(NSUInteger index, CGRect indexedRect, BOOL *stop))block
+{
+    if (_count == 0) {
+        return;
+    }
+    uint32_t stackResults[256];
+    uint32_t *results = (_count <= 256 ? stackResults : malloc(_count * sizeof(uint32_t)));
+    if (results == NULL) {
+        return;
+    }
+    size_t found = PDFKRectGridQuery(&grid, rects, rect, results);
+    BOOL stop = NO;
+    for (size_t result = 0; result < found && stop == NO; result++) {
+        block(results[result], rects[results[result]], &stop);
+    }
+    if (results != stackResults) {
+        free(results);
+    }
+}
+
+@end
@@ -0,0 +1,105 @@
+/*
+ //  PDFKRenderGuard.h
+ //  M13PDFKit
+ //
+ Copyright (c) 2014 Brandon McQuilkin
+ 
+ Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated documentation files (the
+ "Software"), to deal in the Software without restriction, including without limitation the rights to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software, and to permit persons to whom the Software is furnished to do so, subject to
+ the following conditions:
+ 
+ The above copyright notice and this permission notice shall be included in all copies or substantial portions of the Software.
+ 
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+
+#import <Foundation/Foundation.h>
+#import <CoreGraphics/CoreGraphics.h>
+
+/**
+ Posted on the main thread when a page takes longer than the timeout to draw. The page is not drawn again in this session. The user info has the "Page" number and the "DocumentKey" of its document, see PDFKRenderGuardDocumentKey.
+ */
+extern NSString *const PDFKRenderGuardPageTimedOutNotification;
+
+/**
+ A key for a document, from its fingerprint, see CGPDFDocumentGetFingerprint. The key changes when the file changes.
+ 
+ @param documentRef The document.
+ 
+ @return The key.
+ */
+uint64_t PDFKRenderGuardDocumentKey(CGPDFDocumentRef documentRef);
+
+/**
+ Protects the reader from pages that crash or hang while drawing.
+ 
+ A malformed page can crash or hang CGContextDrawPDFPage, and drawing can not be moved out of the process on iOS. Instead every draw is written to a journal before it starts and cleared when it ends. The journal is a small memory mapped file with a slot per draw in progress, claimed without locks, so it costs a few memory writes per draw and survives the process being killed. When the guard starts, the draws left in the journal are the ones the process died in, and each counts a strike against its page. A draw that finishes forgets the strikes against its page, so a page with too many strikes crashed every time it was drawn, and it is not drawn again; a placeholder is drawn instead. A strike is also counted for a draw that passes the timeout, and the page is not drawn again in the session. The thread of a hung draw can not be stopped, so the render queues use more than one worker.
+ */
+@interface PDFKRenderGuard : NSObject
+
+/**
+ The shared guard, with its journal and blacklist in the caches directory.
+ 
+ @return The shared guard.
+ */
++ (PDFKRenderGuard *)sharedGuard;
+/**
+ The number of concurrent operations for the queues that draw pages, so a hung draw does not stop the other pages from drawing.
+ 
+ @return The number of workers.
+ */
++ (NSUInteger)workerCount;
+/**
+ Create a guard with its journal and blacklist in a directory. The draws left in the journal by a process that died are counted as strikes.
+ 
+ @param directory The directory to keep the files in.
+ 
+ @return A new guard.
+ */
+- (id)initWithDirectory:(NSString *)directory;
+/**
+ The number of seconds a draw can take before the page is given up on. Defaults to 10 seconds.
+ */
+@property (nonatomic, assign) NSTimeInterval timeout;
+/**
+ Start drawing a page. Safe to call from any thread.
+ 
+ @param pageRef The page to draw.
+ 
+ @return A job to pass to endJob:, or NSNotFound if the page must not be drawn.
+ */
+- (NSInteger)beginPage:(CGPDFPageRef)pageRef;
+/**
+ Finish drawing a page. The strikes against the page are forgotten, a page that timed out is still not drawn again in this session.
+ 
+ @param job The job from beginPage:.
+ */
+- (void)endJob:(NSInteger)job;
+/**
+ Wether a page will not be drawn.
+ 
+ @param page        The page number.
+ @param documentKey The key of the page's document.
+ 
+ @return YES if the page has too many strikes, or timed out in this session.
+ */
+- (BOOL)isPageBlacklisted:(NSUInteger)page documentKey:(uint64_t)documentKey;
+/**
+ Forget all the strikes, so every page is drawn again.
+ */
+- (void)removeAllStrikes;
+/**
+ Statistics for the guard. The keys are "Jobs", "Refused" (draws of blacklisted pages), "Unjournaled" (draws that found no free slot), "TimedOut", "RecoveredCrashes" (draws left in the journal when the guard started), "ActiveJobs" and "BlacklistedPages".
+ */
+@property (nonatomic, readonly) NSDictionary *statistics;
+
+@end
+
+/**
+ Draw the placeholder of a page that is not drawn: a plain gray page.
+ 
+ @param context The context to draw into. The page must already be transformed into place.
+ @param pageRef The page.
+ */
+void PDFKRenderGuardDrawPlaceholder(CGContextRef context, CGPDFPageRef pageRef);
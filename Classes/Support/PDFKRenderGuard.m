@@ -0,0 +1,467 @@
+/*
+ //  PDFKRenderGuard.m
+ //  M13PDFKit
+ //
+ Copyright (c) 2014 Brandon McQuilkin
+ 
+ Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated documentation files (the
+ "Software"), to deal in the Software without restriction, including without limitation the rights to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software, and to permit persons to whom the Software is furnished to do so, subject to
+ the following conditions:
+ 
+ The above copyright notice and this permission notice shall be included in all copies or substantial portions of the Software.
+ 
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+
+#import "PDFKRenderGuard.h"
+#import "CGPDFDocument.h"
+#import <libkern/OSAtomic.h>
+#import <sys/mman.h>
+#import <fcntl.h>
+#import <unistd.h>
+
+NSString *const PDFKRenderGuardPageTimedOutNotification = @"PDFKRenderGuardPageTimedOutNotification";
+
+//The header of the journal: "PRJ1"
+#define JOURNAL_MAGIC 0x314A5250
+#define JOURNAL_VERSION 1
+//The most draws journaled at once. Draws beyond these are not journaled.
+#define JOURNAL_SLOTS 32
+//The strikes before a page is not drawn again. One crash can be a coincidence, like the system ending the app while it draws.
+#define MAXIMUM_STRIKES 2
+//The default number of seconds a draw can take
+#define DEFAULT_TIMEOUT 10.0
+//The most workers drawing pages at once
+#define MAXIMUM_WORKERS 3
+
+//The states of a journal slot
+#define SLOT_FREE 0
+#define SLOT_CLAIMED 1
+#define SLOT_DRAWING 2
+
+/**
+ A draw in progress. The page and document are only valid while the slot is drawing.
+ */
+typedef struct {
+    volatile int32_t state;
+    uint32_t page;
+    uint64_t document;
+    double startTime;
+} PDFKRenderJournalSlot;
+
+/**
+ The journal file, in host byte order, it is only read on the device that wrote it.
+ */
+typedef struct {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t slotCount;
+    uint32_t reserved;
+    PDFKRenderJournalSlot slots[JOURNAL_SLOTS];
+} PDFKRenderJournal;
+
+#pragma mark - Keys
+
+static uint64_t PDFKRenderGuardHash(uint64_t hash, const void *bytes, size_t length)
+{
+    //FNV-1a
+    const uint8_t *data = bytes;
+    for (size_t index = 0; index < length; index++) {
+        hash = (hash ^ data[index]) * 0x100000001B3ULL;
+    }
+    return hash;
+}
+
+uint64_t PDFKRenderGuardDocumentKey(CGPDFDocumentRef documentRef)
+{
+    uint64_t hash = 0xCBF29CE484222325ULL;
+    
+    //The fingerprint changes with the file, so a fixed document is drawn again.
+    const char *fingerprint = [CGPDFDocumentGetFingerprint(documentRef) UTF8String];
+    if (fingerprint != NULL) {
+        hash = PDFKRenderGuardHash(hash, fingerprint, strlen(fingerprint));
+    }
+    return hash;
+}
+
+static NSString *PDFKRenderGuardPageKey(uint64_t documentKey, NSUInteger page)
+{
+    return [NSString stringWithFormat:@"%016llx:%lu", documentKey, (unsigned long)page];
+}
+
+void PDFKRenderGuardDrawPlaceholder(CGContextRef context, CGPDFPageRef pageRef)
+{
+    CGContextSaveGState(context);
+    CGContextSetRGBFillColor(context, 0.9f, 0.9f, 0.9f, 1.0f);
+    CGContextFillRect(context, CGPDFPageGetBoxRect(pageRef, kCGPDFCropBox));
+    CGContextRestoreGState(context);
+}
+
+#pragma mark - Guard
+
+@implementation PDFKRenderGuard
+{
+    NSString *strikesPath;
+    PDFKRenderJournal *journal;
+    BOOL journalMapped;
+    /**
+     The strikes against pages, NSNumbers by page key.
+     */
+    NSMutableDictionary *strikes;
+    /**
+     The size of strikes, so finished draws do not look pages up when it is empty.
+     */
+    volatile int32_t strikeCount;
+    /**
+     The keys of the pages that are not drawn.
+     */
+    NSMutableSet *blacklist;
+    /**
+     The keys of the pages that timed out in this session, they stay blacklisted if their draw finishes.
+     */
+    NSMutableSet *timedOutPages;
+    /**
+     The size of the blacklist, so draws do not look pages up when it is empty.
+     */
+    volatile int32_t blacklistCount;
+    /**
+     The start time of the draw that was reported as timed out, by slot.
+     */
+    double reportedStartTimes[JOURNAL_SLOTS];
+    dispatch_queue_t watchdogQueue;
+    dispatch_source_t watchdog;
+    volatile int32_t watchdogRunning;
+    
+    //Statistics
+    volatile int64_t jobCount;
+    volatile int64_t refusedCount;
+    volatile int64_t unjournaledCount;
+    NSUInteger timedOutCount;
+    NSUInteger recoveredCount;
+}
+
++ (PDFKRenderGuard *)sharedGuard
+{
+    static dispatch_once_t onceToken;
+    static PDFKRenderGuard *guard;
+    dispatch_once(&onceToken, ^{
+        NSArray *cachesPaths = NSSearchPathForDirectoriesInDomains(NSCachesDirectory, NSUserDomainMask, YES);
+        guard = [[self alloc] initWithDirectory:[cachesPaths[0] stringByAppendingPathComponent:@"PDFKRenderGuard"]];
+    });
+    return guard;
+}
+
++ (NSUInteger)workerCount
+{
+    return MAX((NSUInteger)2, MIN([NSProcessInfo processInfo].activeProcessorCount, (NSUInteger)MAXIMUM_WORKERS));
+}
+
+- (id)initWithDirectory:(NSString *)directory
+{
+    if ((self = [super init])) {
+        _timeout = DEFAULT_TIMEOUT;
+        [[NSFileManager new] createDirectoryAtPath:directory withIntermediateDirectories:YES attributes:nil error:nil];
+        
+        strikesPath = [directory stringByAppendingPathComponent:@"Strikes.plist"];
+        strikes = [NSMutableDictionary dictionaryWithContentsOfFile:strikesPath];
+        if (strikes == nil) {
+            strikes = [NSMutableDictionary new];
+        }
+        blacklist = [NSMutableSet new];
+        timedOutPages = [NSMutableSet new];
+        for (NSString *key in strikes) {
+            if ([strikes[key] unsignedIntegerValue] >= MAXIMUM_STRIKES) {
+                [blacklist addObject:key];
+            }
+        }
+        blacklistCount = (int32_t)blacklist.count;
+        strikeCount = (int32_t)strikes.count;
+        
+        [self openJournalAtPath:[directory stringByAppendingPathComponent:@"Journal"]];
+        watchdogQueue = dispatch_queue_create("PDFKRenderGuardWatchdog", DISPATCH_QUEUE_SERIAL);
+    }
+    return self;
+}
+
+- (void)dealloc
+{
+    if (watchdog != nil) {
+        dispatch_source_cancel(watchdog);
+    }
+    if (journalMapped) {
+        munmap(journal, sizeof(PDFKRenderJournal));
+    } else {
+        free(journal);
+    }
+}
+
+#pragma mark Journal
+
+- (void)openJournalAtPath:(NSString *)path
+{
+    //Map the journal, so the draws in progress are written to the file even if the process dies.
+    int file = open(path.fileSystemRepresentation, O_RDWR | O_CREAT, 0644);
+    if (file >= 0) {
+        if (ftruncate(file, sizeof(PDFKRenderJournal)) == 0) {
+            void *mapping = mmap(NULL, sizeof(PDFKRenderJournal), PROT_READ | PROT_WRITE, MAP_SHARED, file, 0);
+            if (mapping != MAP_FAILED) {
+                journal = mapping;
+                journalMapped = YES;
+            }
+        }
+        close(file);
+    }
+    if (journal == NULL) {
+        //Draws still time out, but crashes are not recovered
+        journal = calloc(1, sizeof(PDFKRenderJournal));
+    }
+    
+    //The draws left in the journal are the ones the process died in
+    if (journal->magic == JOURNAL_MAGIC && journal->version == JOURNAL_VERSION && journal->slotCount == JOURNAL_SLOTS) {
+        for (NSUInteger slot = 0; slot < JOURNAL_SLOTS; slot++) {
+            PDFKRenderJournalSlot *entry = &journal->slots[slot];
+            if (entry->state == SLOT_DRAWING) {
+                [self addStrikeToPage:entry->page documentKey:entry->document blacklist:NO];
+                recoveredCount++;
+            }
+        }
+        if (recoveredCount > 0) {
+            [self saveStrikes];
+        }
+    }
+    
+    memset(journal, 0, sizeof(PDFKRenderJournal));
+    journal->magic = JOURNAL_MAGIC;
+    journal->version = JOURNAL_VERSION;
+    journal->slotCount = JOURNAL_SLOTS;
+    OSMemoryBarrier();
+}
+
+#pragma mark Strikes
+
+- (void)addStrikeToPage:(NSUInteger)page documentKey:(uint64_t)documentKey blacklist:(BOOL)blacklistNow
+{
+    @synchronized(self) {
+        NSString *key = PDFKRenderGuardPageKey(documentKey, page);
+        NSUInteger count = [strikes[key] unsignedIntegerValue] + 1;
+        strikes[key] = @(count);
+        if (count >= MAXIMUM_STRIKES || blacklistNow) {
+            [blacklist addObject:key];
+        }
+        if (blacklistNow) {
+            [timedOutPages addObject:key];
+        }
+        blacklistCount = (int32_t)blacklist.count;
+        strikeCount = (int32_t)strikes.count;
+        OSMemoryBarrier();
+    }
+}
+
+/**
+ Forget the strikes against a page that was drawn. A page that timed out in this session is still not drawn again until the next session.
+ */
+- (void)removeStrikesFromPage:(NSUInteger)page documentKey:(uint64_t)documentKey
+{
+    @synchronized(self) {
+        NSString *key = PDFKRenderGuardPageKey(documentKey, page);
+        if (strikes[key] == nil) {
+            return;
+        }
+        [strikes removeObjectForKey:key];
+        if ([timedOutPages containsObject:key] == NO) {
+            [blacklist removeObject:key];
+        }
+        blacklistCount = (int32_t)blacklist.count;
+        strikeCount = (int32_t)strikes.count;
+        OSMemoryBarrier();
+    }
+    [self saveStrikes];
+}
+
+- (void)saveStrikes
+{
+    @synchronized(self) {
+        [strikes writeToFile:strikesPath atomically:YES];
+    }
+}
+
+- (BOOL)isPageBlacklisted:(NSUInteger)page documentKey:(uint64_t)documentKey
+{
+    @synchronized(self) {
+        return [blacklist containsObject:PDFKRenderGuardPageKey(documentKey, page)];
+    }
+}
+
+- (void)removeAllStrikes
+{
+    @synchronized(self) {
+        [strikes removeAllObjects];
+        [blacklist removeAllObjects];
+        [timedOutPages removeAllObjects];
+        blacklistCount = 0;
+        strikeCount = 0;
+        OSMemoryBarrier();
+    }
+    [self saveStrikes];
+}
+
+#pragma mark Jobs
+
+- (NSInteger)beginPage:(CGPDFPageRef)pageRef
+{
+    NSUInteger page = CGPDFPageGetPageNumber(pageRef);
+    uint64_t documentKey = PDFKRenderGuardDocumentKey(CGPDFPageGetDocument(pageRef));
+    if (blacklistCount > 0 && [self isPageBlacklisted:page documentKey:documentKey]) {
+        OSAtomicIncrement64Barrier(&refusedCount);
+        return NSNotFound;
+    }
+    OSAtomicIncrement64Barrier(&jobCount);
+    
+    //Claim a free slot, the slot is only written by the thread that claimed it.
+    for (NSInteger slot = 0; slot < JOURNAL_SLOTS; slot++) {
+        PDFKRenderJournalSlot *entry = &journal->slots[slot];
+        if (entry->state == SLOT_FREE && OSAtomicCompareAndSwap32Barrier(SLOT_FREE, SLOT_CLAIMED, &entry->state)) {
+            entry->page = (uint32_t)page;
+            entry->document = documentKey;
+            entry->startTime = CFAbsoluteTimeGetCurrent();
+            OSMemoryBarrier();
+            entry->state = SLOT_DRAWING;
+            OSMemoryBarrier();
+            
+            //Make sure the draw is watched
+            if (watchdogRunning == 0 && OSAtomicCompareAndSwap32Barrier(0, 1, &watchdogRunning)) {
+                dispatch_async(watchdogQueue, ^{
+                    [self startWatchdog];
+                });
+            }
+            return slot;
+        }
+    }
+    
+    OSAtomicIncrement64Barrier(&unjournaledCount);
+    return -1;
+}
+
+- (void)endJob:(NSInteger)job
+{
+    if (job < 0 || job >= JOURNAL_SLOTS) {
+        return;
+    }
+    //The slot is only written by this thread until it is freed
+    PDFKRenderJournalSlot *entry = &journal->slots[job];
+    uint32_t page = entry->page;
+    uint64_t documentKey = entry->document;
+    if (OSAtomicCompareAndSwap32Barrier(SLOT_DRAWING, SLOT_FREE, &entry->state) && strikeCount > 0) {
+        //The page draws, a slow page or one that crashed for another reason is not given up on.
+        [self removeStrikesFromPage:page documentKey:documentKey];
+    }
+}
+
+#pragma mark Watchdog
+
+- (void)startWatchdog
+{
+    //On the watchdog queue
+    if (watchdog != nil) {
+        return;
+    }
+    NSTimeInterval interval = MIN(1.0, MAX(0.05, _timeout / 4.0));
+    watchdog = dispatch_source_create(DISPATCH_SOURCE_TYPE_TIMER, 0, 0, watchdogQueue);
+    dispatch_source_set_timer(watchdog, dispatch_time(DISPATCH_TIME_NOW, (int64_t)(interval * NSEC_PER_SEC)), (uint64_t)(interval * NSEC_PER_SEC), (uint64_t)(interval * NSEC_PER_SEC / 4));
+    __weak PDFKRenderGuard *weakSelf = self;
+    dispatch_source_set_event_handler(watchdog, ^{
+        [weakSelf checkJobs];
+    });
+    dispatch_resume(watchdog);
+}
+
+/**
+ Report the draws that passed the timeout. Returns the number of draws still being watched.
+ */
+- (NSUInteger)checkTimeouts
+{
+    double now = CFAbsoluteTimeGetCurrent();
+    NSUInteger watched = 0;
+    NSMutableArray *timedOut = [NSMutableArray array];
+    for (NSUInteger slot = 0; slot < JOURNAL_SLOTS; slot++) {
+        PDFKRenderJournalSlot *entry = &journal->slots[slot];
+        if (entry->state != SLOT_DRAWING) {
+            continue;
+        }
+        OSMemoryBarrier();
+        uint32_t page = entry->page;
+        uint64_t documentKey = entry->document;
+        double startTime = entry->startTime;
+        OSMemoryBarrier();
+        if (entry->state != SLOT_DRAWING) {
+            //Finished while being read
+            continue;
+        }
+        if (reportedStartTimes[slot] == startTime) {
+            //Hung, and already reported
+            continue;
+        }
+        if (now - startTime < _timeout) {
+            watched++;
+            continue;
+        }
+        
+        reportedStartTimes[slot] = startTime;
+        [self addStrikeToPage:page documentKey:documentKey blacklist:YES];
+        [timedOut addObject:@{@"Page": @(page), @"DocumentKey": @(documentKey)}];
+    }
+    
+    if (timedOut.count > 0) {
+        @synchronized(self) {
+            timedOutCount += timedOut.count;
+        }
+        [self saveStrikes];
+        for (NSDictionary *info in timedOut) {
+            dispatch_async(dispatch_get_main_queue(), ^{
+                [[NSNotificationCenter defaultCenter] postNotificationName:PDFKRenderGuardPageTimedOutNotification object:self userInfo:info];
+            });
+        }
+    }
+    return watched;
+}
+
+- (void)checkJobs
+{
+    //On the watchdog queue
+    if ([self checkTimeouts] > 0) {
+        return;
+    }
+    
+    //Stop watching, unless a draw started while checking. A draw that starts after this restarts the watchdog.
+    watchdogRunning = 0;
+    OSMemoryBarrier();
+    if ([self checkTimeouts] > 0 && OSAtomicCompareAndSwap32Barrier(0, 1, &watchdogRunning)) {
+        return;
+    }
+    dispatch_source_cancel(watchdog);
+    watchdog = nil;
+}
+
+#pragma mark Statistics
+
+- (NSDictionary *)statistics
+{
+    NSUInteger activeJobs = 0;
+    for (NSUInteger slot = 0; slot < JOURNAL_SLOTS; slot++) {
+        if (journal->slots[slot].state != SLOT_FREE) {
+            activeJobs++;
+        }
+    }
+    @synchronized(self) {
+        return @{@"Jobs": @(OSAtomicAdd64Barrier(0, &jobCount)),
+                 @"Refused": @(OSAtomicAdd64Barrier(0, &refusedCount)),
+                 @"Unjournaled": @(OSAtomicAdd64Barrier(0, &unjournaledCount)),
+                 @"TimedOut": @(timedOutCount),
+                 @"RecoveredCrashes": @(recoveredCount),
+                 @"ActiveJobs": @(activeJobs),
+                 @"BlacklistedPages": @(blacklist.count)};
+    }
+}
+
+@end
@@ -0,0 +1,156 @@
+/*
+ //  PDFKResourceGovernor.h
+ //  M13PDFKit
+ //
+ Copyright (c) 2014 Brandon McQuilkin
+ 
+ Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated documentation files (the
+ "Software"), to deal in the Software without restriction, including without limitation the rights to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software, and to permit persons to whom the Software is furnished to do so, subject to
+ the following conditions:
+ 
+ The above copyright notice and this permission notice shall be included in all copies or substantial portions of the Software.
+ 
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#import <Foundation/Foundation.h>
+
+/**
+ Posted on the main thread after the governor sheds resources. The user info contains the memory breakdown after shedding, the same dictionary as `memoryBreakdown`.
+ */
+extern NSString *const PDFKResourceGovernorDidShedResourcesNotification;
+
+/**
+ How much memory pressure the application is under.
+ */
+typedef NS_ENUM(NSInteger, PDFKResourcePressure) {
+    /**
+     No pressure, nothing needs to be released.
+     */
+    PDFKResourcePressureNormal = 0,
+    /**
+     The system is running low on memory, resources that can be cheaply recreated should be released.
+     */
+    PDFKResourcePressureWarning,
+    /**
+     The system is about to terminate applications, release everything that is not needed to show the current page.
+     */
+    PDFKResourcePressureCritical
+};
+
+/**
+ The kinds of resources the governor tracks.
+ */
+typedef NS_ENUM(NSInteger, PDFKResourceCategory) {
+    /**
+     Decoded thumb images held in memory.
+     */
+    PDFKResourceCategoryThumbCache = 0,
+    /**
+     Open PDF document handles.
+     */
+    PDFKResourceCategoryDocuments,
+    /**
+     Rendered page tiles.
+     */
+    PDFKResourceCategoryTiles,
+    /**
+     Recorded drawing commands and other intermediate page data.
+     */
+    PDFKResourceCategoryDisplayLists,
+    /**
+     Free pixel buffers kept for reuse.
+     */
+    PDFKResourceCategoryPixelBuffers,
+    /**
+     Decoded images of PDF documents.
+     */
+    PDFKResourceCategoryImages
+};
+
+/**
+ The order consumers are asked to release resources in. Lower priorities are released first.
+ */
+typedef NS_ENUM(NSInteger, PDFKResourcePriority) {
+    /**
+     Resources that are cheap to recreate, such as thumbs that are cached on disk. Released under warning pressure.
+     */
+    PDFKResourcePriorityLow = 0,
+    /**
+     Resources that are slower to recreate. Released under warning pressure after the low priority resources.
+     */
+    PDFKResourcePriorityNormal = 50,
+    /**
+     Resources that are visible on screen. Only released under critical pressure.
+     */
+    PDFKResourcePriorityHigh = 100
+};
+
+/**
+ An object that holds memory that the governor can account for and ask to be released.
+ */
+@protocol PDFKResourceConsumer <NSObject>
+
+@required
+/**
+ The number of bytes the consumer is currently holding.
+ 
+ @note This may be called from any thread.
+ */
+- (NSUInteger)resourceBytes;
+/**
+ Release resources for the given pressure level.
+ 
+ @note This is called on the main thread.
+ 
+ @param pressure The current memory pressure.
+ 
+ @return The number of bytes released.
+ */
+- (NSUInteger)shedResourcesForPressure:(PDFKResourcePressure)pressure;
+
+@end
+
+/**
+ Tracks the memory held by the thumb caches, documents and page tiles, and releases it in priority order when the system is under memory pressure.
+ */
+@interface PDFKResourceGovernor : NSObject
+
+/**
+ The shared governor. It starts listening for memory pressure when it is first used.
+ 
+ @return The shared governor.
+ */
++ (PDFKResourceGovernor *)sharedGovernor;
+/**
+ Start tracking a consumer. The consumer is not retained, and stops being tracked when it is deallocated.
+ 
+ @param consumer The consumer to track.
+ @param category The kind of resources the consumer holds.
+ @param priority The order in which the consumer is asked to release resources.
+ */
+- (void)registerConsumer:(id <PDFKResourceConsumer>)consumer category:(PDFKResourceCategory)category priority:(PDFKResourcePriority)priority;
+/**
+ Stop tracking a consumer.
+ 
+ @param consumer The consumer to stop tracking.
+ */
+- (void)unregisterConsumer:(id <PDFKResourceConsumer>)consumer;
+/**
+ Ask the consumers to release resources for the given pressure level. Consumers are asked in order of priority, lowest first.
+ 
+ @param pressure The current memory pressure.
+ 
+ @return The number of bytes released.
+ */
+- (NSUInteger)shedResourcesForPressure:(PDFKResourcePressure)pressure;
+/**
+ The bytes currently held by each category. The keys are "ThumbCache", "Documents", "Tiles", "DisplayLists", "PixelBuffers", "Images", and "Total". The values are NSNumbers.
+ */
+@property (nonatomic, readonly) NSDictionary *memoryBreakdown;
+/**
+ The most recent memory pressure level.
+ */
+@property (nonatomic, readonly) PDFKResourcePressure pressure;
+
+@end
@@ -0,0 +1,208 @@
+/*
+ //  PDFKResourceGovernor.m
+ //  M13PDFKit
+ //
+ Copyright (c) 2014 Brandon McQuilkin
+ 
+ Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated documentation files (the
+ "Software"), to deal in the Software without restriction, including without limitation the rights to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software, and to permit persons to whom the Software is furnished to do so, subject to
+ the following conditions:
+ 
+ The above copyright notice and this permission notice shall be included in all copies or substantial portions of the Software.
+ 
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#import "PDFKResourceGovernor.h"
+
+NSString *const PDFKResourceGovernorDidShedResourcesNotification = @"PDFKResourceGovernorDidShedResourcesNotification";
+
+/**
+ How a consumer is tracked.
+ */
+@interface PDFKResourceConsumerInfo : NSObject
+
+@property (nonatomic, assign) PDFKResourceCategory category;
+@property (nonatomic, assign) PDFKResourcePriority priority;
+@property (nonatomic, assign) NSUInteger order;
+
+@end
+
+@implementation PDFKResourceConsumerInfo
+
+@end
+
+@implementation PDFKResourceGovernor
+{
+    /**
+     The tracked consumers, weak keys to PDFKResourceConsumerInfo.
+     */
+    NSMapTable *consumers;
+    /**
+     The number of consumers registered so far, used to keep the shedding order stable within a priority.
+     */
+    NSUInteger registrationCount;
+    /**
+     The source that reports memory pressure from the system.
+     */
+    dispatch_source_t pressureSource;
+}
+
++ (PDFKResourceGovernor *)sharedGovernor
+{
+    static dispatch_once_t predicate = 0;
+    static PDFKResourceGovernor *governor = nil;
+    dispatch_once(&predicate, ^{
+        governor = [self new];
+    });
+    return governor;
+}
+
+- (id)init
+{
+    if ((self = [super init])) {
+        consumers = [NSMapTable weakToStrongObjectsMapTable];
+        
+        //Listen for memory pressure
+        pressureSource = dispatch_source_create(DISPATCH_SOURCE_TYPE_MEMORYPRESSURE, 0, (DISPATCH_MEMORYPRESSURE_WARN | DISPATCH_MEMORYPRESSURE_CRITICAL), dispatch_get_main_queue());
+        if (pressureSource != NULL) {
+            __weak PDFKResourceGovernor *weakSelf = self;
+            dispatch_source_t source = pressureSource;
+            dispatch_source_set_event_handler(pressureSource, ^{
+                unsigned long level = dispatch_source_get_data(source);
+                PDFKResourcePressure pressure = PDFKResourcePressureNormal;
+                if (level & DISPATCH_MEMORYPRESSURE_CRITICAL) {
+                    pressure = PDFKResourcePressureCritical;
+                } else if (level & DISPATCH_MEMORYPRESSURE_WARN) {
+                    pressure = PDFKResourcePressureWarning;
+                }
+                [weakSelf shedResourcesForPressure:pressure];
+            });
+            dispatch_resume(pressureSource);
+        }
+    }
+    return self;
+}
+
+- (void)dealloc
+{
+    if (pressureSource != NULL) {
+        dispatch_source_cancel(pressureSource);
+    }
+}
+
+#pragma mark Consumers
+
+- (void)registerConsumer:(id<PDFKResourceConsumer>)consumer category:(PDFKResourceCategory)category priority:(PDFKResourcePriority)priority
+{
+    if (consumer == nil) {
+        return;
+    }
+    
+    PDFKResourceConsumerInfo *info = [PDFKResourceConsumerInfo new];
+    info.category = category;
+    info.priority = priority;
+    
+    @synchronized(self) {
+        info.order = registrationCount++;
+        [consumers setObject:info forKey:consumer];
+    }
+}
+
+- (void)unregisterConsumer:(id<PDFKResourceConsumer>)consumer
+{
+    if (consumer == nil) {
+        return;
+    }
+    
+    @synchronized(self) {
+        [consumers removeObjectForKey:consumer];
+    }
+}
+
+/**
+ A snapshot of the consumers and their info, so the consumers are not called while locked.
+ */
+- (NSArray *)consumerSnapshot
+{
+    NSMutableArray *snapshot = [NSMutableArray new];
+    @synchronized(self) {
+        for (id <PDFKResourceConsumer> consumer in consumers) {
+            PDFKResourceConsumerInfo *info = [consumers objectForKey:consumer];
+            if (info != nil) {
+                [snapshot addObject:@[consumer, info]];
+            }
+        }
+    }
+    return snapshot;
+}
+
+#pragma mark Shedding
+
+- (NSUInteger)shedResourcesForPressure:(PDFKResourcePressure)pressure
+{
+    NSAssert([NSThread isMainThread], @"Resources must be shed on the main thread.");
+    
+    _pressure = pressure;
+    if (pressure == PDFKResourcePressureNormal) {
+        return 0;
+    }
+    
+    //Lowest priority first, then the oldest consumer first.
+    NSArray *snapshot = [[self consumerSnapshot] sortedArrayUsingComparator:^NSComparisonResult(NSArray *a, NSArray *b) {
+        PDFKResourceConsumerInfo *infoA = a[1];
+        PDFKResourceConsumerInfo *infoB = b[1];
+        if (infoA.priority != infoB.priority) {
+            return (infoA.priority < infoB.priority ? NSOrderedAscending : NSOrderedDescending);
+        }
+        return (infoA.order < infoB.order ? NSOrderedAscending : NSOrderedDescending);
+    }];
+    
+    NSUInteger shedBytes = 0;
+    for (NSArray *entry in snapshot) {
+        id <PDFKResourceConsumer> consumer = entry[0];
+        PDFKResourceConsumerInfo *info = entry[1];
+        
+        //Visible resources are only released when the pressure is critical.
+        if (info.priority >= PDFKResourcePriorityHigh && pressure < PDFKResourcePressureCritical) {
+            continue;
+        }
+        shedBytes += [consumer shedResourcesForPressure:pressure];
+    }
+    
+    NSDictionary *breakdown = self.memoryBreakdown;
+    
+    #ifdef DEBUG
+        NSLog(@"%s pressure %ld released %lu bytes, now %@", __FUNCTION__, (long)pressure, (unsigned long)shedBytes, breakdown);
+    #endif
+    
+    [[NSNotificationCenter defaultCenter] postNotificationName:PDFKResourceGovernorDidShedResourcesNotification object:self userInfo:breakdown];
+    
+    return shedBytes;
+}
+
+#pragma mark Accounting
+
+- (NSDictionary *)memoryBreakdown
+{
+    unsigned long long bytes[PDFKResourceCategoryImages + 1] = {0};
+    unsigned long long total = 0;
+    
+    for (NSArray *entry in [self consumerSnapshot]) {
+        id <PDFKResourceConsumer> consumer = entry[0];
+        PDFKResourceConsumerInfo *info = entry[1];
+        NSUInteger consumerBytes = [consumer resourceBytes];
+        bytes[info.category] += consumerBytes;
+        total += consumerBytes;
+    }
+    
+    return @{@"ThumbCache": @(bytes[PDFKResourceCategoryThumbCache]),
+             @"Documents": @(bytes[PDFKResourceCategoryDocuments]),
+             @"Tiles": @(bytes[PDFKResourceCategoryTiles]),
+             @"DisplayLists": @(bytes[PDFKResourceCategoryDisplayLists]),
+             @"PixelBuffers": @(bytes[PDFKResourceCategoryPixelBuffers]),
+             @"Images": @(bytes[PDFKResourceCategoryImages]),
+             @"Total": @(total)};
+}
+
+@end
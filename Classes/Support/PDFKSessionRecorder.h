@@ -0,0 +1,111 @@
+/*
+ //  PDFKSessionRecorder.h
+ //  M13PDFKit
+ //
+ Copyright (c) 2014 Brandon McQuilkin
+ 
+ Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated documentation files (the
+ "Software"), to deal in the Software without restriction, including without limitation the rights to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software, and to permit persons to whom the Software is furnished to do so, subject to
+ the following conditions:
+ 
+ The above copyright notice and this permission notice shall be included in all copies or substantial portions of the Software.
+ 
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+
+#import <Foundation/Foundation.h>
+
+/**
+ The interactions that are recorded.
+ */
+typedef NS_ENUM(uint8_t, PDFKSessionEventType) {
+    /**
+     The thumbs grid scrolled. The page is the first visible page, the count the number of visible pages.
+     */
+    PDFKSessionEventThumbsVisible = 0,
+    /**
+     The scrubber moved to a page.
+     */
+    PDFKSessionEventScrub,
+    /**
+     The single page view displayed a page.
+     */
+    PDFKSessionEventPageDisplay
+};
+
+/**
+ A recorded interaction.
+ */
+@interface PDFKSessionEvent : NSObject
+
+/**
+ Create an event.
+ 
+ @param type  The interaction.
+ @param time  The time of the interaction in seconds, since recording started.
+ @param page  The page.
+ @param count The number of pages, for events that show a range of pages.
+ 
+ @return A new event.
+ */
+- (id)initWithType:(PDFKSessionEventType)type time:(NSTimeInterval)time page:(NSInteger)page count:(NSInteger)count;
+
+@property (nonatomic, assign, readonly) PDFKSessionEventType type;
+@property (nonatomic, assign, readonly) NSTimeInterval time;
+@property (nonatomic, assign, readonly) NSInteger page;
+@property (nonatomic, assign, readonly) NSInteger count;
+
+@end
+
+/**
+ Records how the user moves through a document: scrolling the thumbs grid, dragging the scrubber and swiping pages. A recorded session can be written to a file and replayed by PDFKSessionReplayer, to measure the thumb and page pipeline with real interaction patterns.
+ */
+@interface PDFKSessionRecorder : NSObject
+
+/**
+ The shared recorder, used by the views.
+ 
+ @return The instance of PDFKSessionRecorder.
+ */
++ (PDFKSessionRecorder *)sharedRecorder;
+/**
+ Wether or not interactions are being recorded. While not recording, recording an event costs a single check.
+ */
+@property (nonatomic, assign, readonly) BOOL recording;
+/**
+ Start recording a new session. Events recorded before are removed.
+ */
+- (void)startRecording;
+/**
+ Stop recording.
+ 
+ @return The recorded events, in order.
+ */
+- (NSArray *)stopRecording;
+/**
+ Record an interaction. Consecutive events that are the same are recorded once. Call from the main thread.
+ 
+ @param type  The interaction.
+ @param page  The page.
+ @param count The number of pages, or 1.
+ */
+- (void)recordEvent:(PDFKSessionEventType)type page:(NSInteger)page count:(NSInteger)count;
+/**
+ Encode a session as JSON.
+ 
+ @param events The events of the session.
+ 
+ @return JSON data.
+ */
++ (NSData *)sessionDataWithEvents:(NSArray *)events;
+/**
+ Decode a session written by sessionDataWithEvents:.
+ 
+ @param data The JSON data.
+ 
+ @return The events of the session, or nil if the data is not a session.
+ */
++ (NSArray *)eventsWithSessionData:(NSData *)data;
+
+@end
@@ -0,0 +1,113 @@
+/*
+ //  PDFKSessionRecorder.m
+ //  M13PDFKit
+ //
+ Copyright (c) 2014 Brandon McQuilkin
+ 
+ Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated documentation files (the
+ "Software"), to deal in the Software without restriction, including without limitation the rights to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software, and to permit persons to whom the Software is furnished to do so, subject to
+ the following conditions:
+ 
+ The above copyright notice and this permission notice shall be included in all copies or substantial portions of the Software.
+ 
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+
+#import "PDFKSessionRecorder.h"
+#import <QuartzCore/QuartzCore.h>
+
+//The most events kept for a session
+#define MAXIMUM_SESSION_EVENTS 100000
+
+@implementation PDFKSessionEvent
+
+- (id)initWithType:(PDFKSessionEventType)type time:(NSTimeInterval)time page:(NSInteger)page count:(NSInteger)count
+{
+    if ((self = [super init])) {
+        _type = type;
+        _time = time;
+        _page = page;
+        _count = count;
+    }
+    return self;
+}
+
+@end
+
+@implementation PDFKSessionRecorder
+{
+    NSMutableArray *events;
+    CFTimeInterval startTime;
+}
+
++ (PDFKSessionRecorder *)sharedRecorder
+{
+    static dispatch_once_t predicate = 0;
+    static PDFKSessionRecorder *sharedRecorder = nil;
+    dispatch_once(&predicate, ^{
+        sharedRecorder = [self new];
+    });
+    return sharedRecorder;
+}
+
+- (void)startRecording
+{
+    events = [NSMutableArray new];
+    startTime = CACurrentMediaTime();
+    _recording = YES;
+}
+
+- (NSArray *)stopRecording
+{
+    _recording = NO;
+    NSArray *recorded = [events copy];
+    events = nil;
+    return recorded;
+}
+
+- (void)recordEvent:(PDFKSessionEventType)type page:(NSInteger)page count:(NSInteger)count
+{
+    if (_recording == NO || events.count >= MAXIMUM_SESSION_EVENTS) {
+        return;
+    }
+    //Scrolling reports the same pages many times
+    PDFKSessionEvent *last = events.lastObject;
+    if (last != nil && last.type == type && last.page == page && last.count == count) {
+        return;
+    }
+    [events addObject:[[PDFKSessionEvent alloc] initWithType:type time:(CACurrentMediaTime() - startTime) page:page count:count]];
+}
+
+#pragma mark Files
+
++ (NSData *)sessionDataWithEvents:(NSArray *)events
+{
+    //Compact arrays of type, time in milliseconds, page and count.
+    NSMutableArray *encoded = [NSMutableArray arrayWithCapacity:events.count];
+    for (PDFKSessionEvent *event in events) {
+        [encoded addObject:@[@(event.type), @(llround(event.time * 1000.0)), @(event.page), @(event.count)]];
+    }
+    return [NSJSONSerialization dataWithJSONObject:@{@"Version": @1, @"Events": encoded} options:0 error:NULL];
+}
+
++ (NSArray *)eventsWithSessionData:(NSData *)data
+{
+    if (data == nil) {
+        return nil;
+    }
+    NSDictionary *session = [NSJSONSerialization JSONObjectWithData:data options:0 error:NULL];
+    if ([session isKindOfClass:[NSDictionary class]] == NO || [session[@"Version"] integerValue] != 1 || [session[@"Events"] isKindOfClass:[NSArray class]] == NO) {
+        return nil;
+    }
+    NSMutableArray *events = [NSMutableArray new];
+    for (NSArray *encoded in session[@"Events"]) {
+        if ([encoded isKindOfClass:[NSArray class]] == NO || encoded.count != 4 || [encoded[0] integerValue] > PDFKSessionEventPageDisplay) {
+            return nil;
+        }
+        [events addObject:[[PDFKSessionEvent alloc] initWithType:(PDFKSessionEventType)[encoded[0] integerValue] time:([encoded[1] doubleValue] / 1000.0) page:[encoded[2] integerValue] count:[encoded[3] integerValue]]];
+    }
+    return events;
+}
+
+@end
@@ -0,0 +1,70 @@
+/*
+ //  PDFKSessionReplayer.h
+ //  M13PDFKit
+ //
+ Copyright (c) 2014 Brandon McQuilkin
+ 
+ Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated documentation files (the
+ "Software"), to deal in the Software without restriction, including without limitation the rights to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software, and to permit persons to whom the Software is furnished to do so, subject to
+ the following conditions:
+ 
+ The above copyright notice and this permission notice shall be included in all copies or substantial portions of the Software.
+ 
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+
+#import <UIKit/UIKit.h>
+
+@class PDFKDocument;
+
+/**
+ Replays a session recorded by PDFKSessionRecorder against a document, without showing anything on screen. Thumbs are requested from the thumb cache as the thumbs grid and scrubber request them, and pages are shown with a page content view pool as the single page view shows them, so the whole thumb fetch and render pipeline and the page render cache do their real work.
+ 
+ The report has the latency distributions, each a dictionary with "Count", "Median", "P90", "P99" and "Max" in seconds:
+ 
+ - "TimeToFirstThumb": from a grid thumb becoming visible to its thumb being shown.
+ - "TimeToScrubThumb": from the scrubber reaching a page to its large thumb being shown, including the pause the scrubber waits for.
+ - "TimeToSharpPage": from a page being displayed to its screen resolution image being ready.
+ 
+ and the wasted work: "AbandonedThumbs" (grid thumbs scrolled away before they were shown), "AbandonedScrubThumbs", "AbandonedPages" (pages swiped away before they were sharp), "UnviewedPageRenders" (page images rendered but never displayed), "CancelledOperations" and "CancelledMilliseconds" (thumb work thrown away). "Events", "Elapsed" and "ThumbCacheHitRatio" are also reported.
+ */
+@interface PDFKSessionReplayer : NSObject
+
+/**
+ Initalize a replayer.
+ 
+ @param document The document to replay the session against.
+ @param events   The recorded events.
+ 
+ @return A new replayer.
+ */
+- (id)initWithDocument:(PDFKDocument *)document events:(NSArray *)events;
+/**
+ The size of the thumbs in the grid. Defaults to the iPad grid size.
+ */
+@property (nonatomic, assign) CGSize thumbSize;
+/**
+ The size of the large scrubber thumb.
+ */
+@property (nonatomic, assign) CGSize scrubThumbSize;
+/**
+ The size of the single page view.
+ */
+@property (nonatomic, assign) CGSize viewportSize;
+/**
+ Multiplies the times of the events. 1.0 replays the session as it was recorded, 0.5 twice as fast. Defaults to 1.0.
+ */
+@property (nonatomic, assign) double timeScale;
+/**
+ The longest time to wait for outstanding thumbs and pages after the last event. Defaults to 10 seconds.
+ */
+@property (nonatomic, assign) NSTimeInterval drainTimeout;
+/**
+ Replay the session. Must be called from the main thread, the main run loop has to run until the replay completes.
+ 
+ @param completion Called on the main thread with the report.
+ */
+- (void)replayWithCompletion:(void (^)(NSDictionary *report))completion;
+
+@end
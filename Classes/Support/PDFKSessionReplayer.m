@@ -0,0 +1,413 @@
+/*
+ //  PDFKSessionReplayer.m
+ //  M13PDFKit
+ //
+ Copyright (c) 2014 Brandon McQuilkin
+ 
+ Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated documentation files (the
+ "Software"), to deal in the Software without restriction, including without limitation the rights to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software, and to permit persons to whom the Software is furnished to do so, subject to
+ the following conditions:
+ 
+ The above copyright notice and this permission notice shall be included in all copies or substantial portions of the Software.
+ 
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+
+#import "PDFKSessionReplayer.h"
+#import "PDFKSessionRecorder.h"
+#import "PDFKDocument.h"
+#import "PDFKPage.h"
+#import "PDFKThumbView.h"
+#import "PDFKThumbRequest.h"
+#import "PDFKThumbCache.h"
+#import "PDFKPageContentView.h"
+#import "PDFKPageContentViewPool.h"
+#import "PDFKPageRenderCache.h"
+#import "PDFKTrace.h"
+#import <QuartzCore/QuartzCore.h>
+
+//How often outstanding thumbs are checked for
+#define POLL_INTERVAL (1.0 / 60.0)
+//The pause before the scrubber requests its large thumb, as the scrubber does
+#define SCRUB_UPGRADE_DELAY 0.12
+
+/**
+ Reports when a thumb is shown.
+ */
+@interface PDFKSessionReplayThumbView : PDFKThumbView
+
+@property (nonatomic, copy) void (^showBlock)(PDFKSessionReplayThumbView *view);
+
+@end
+
+@implementation PDFKSessionReplayThumbView
+
+- (void)showImage:(UIImage *)image
+{
+    [super showImage:image];
+    if (image != nil && _showBlock != nil) {
+        _showBlock(self);
+    }
+}
+
+@end
+
+/**
+ The distribution of a set of latencies.
+ */
+static NSDictionary *PDFKLatencySummary(NSArray *latencies)
+{
+    NSArray *sorted = [latencies sortedArrayUsingSelector:@selector(compare:)];
+    NSUInteger count = sorted.count;
+    if (count == 0) {
+        return @{@"Count": @0, @"Median": @0, @"P90": @0, @"P99": @0, @"Max": @0};
+    }
+    return @{@"Count": @(count),
+             @"Median": sorted[count / 2],
+             @"P90": sorted[MIN(count - 1, (NSUInteger)(count * 0.90))],
+             @"P99": sorted[MIN(count - 1, (NSUInteger)(count * 0.99))],
+             @"Max": sorted.lastObject};
+}
+
+@implementation PDFKSessionReplayer
+{
+    PDFKDocument *document;
+    NSArray *events;
+    void (^completionBlock)(NSDictionary *report);
+    NSTimer *pollTimer;
+    CFTimeInterval startTime;
+    NSUInteger nextEvent;
+    CFTimeInterval lastEventTime;
+    BOOL tracingWasEnabled;
+    NSDictionary *startCounters;
+    
+    //Thumbs grid
+    NSMutableDictionary *visibleThumbViews;
+    NSMutableArray *recycledThumbViews;
+    /**
+     The requests of the visible thumbs that have not been shown, and when they became visible, keyed by page.
+     */
+    NSMutableDictionary *pendingRequests;
+    NSMutableDictionary *pendingTimes;
+    
+    //Scrubber
+    PDFKSessionReplayThumbView *scrubView;
+    PDFKThumbRequest *scrubRequest;
+    NSInteger scrubPage;
+    CFTimeInterval scrubTime;
+    NSUInteger scrubGeneration;
+    
+    //Single page view
+    PDFKPageContentViewPool *pool;
+    PDFKPageContentView *pageView;
+    NSUInteger pageGeneration;
+    BOOL pagePending;
+    NSMutableIndexSet *displayedPages;
+    
+    //Results
+    NSMutableArray *thumbLatencies;
+    NSMutableArray *scrubLatencies;
+    NSMutableArray *pageLatencies;
+    NSUInteger abandonedThumbs;
+    NSUInteger abandonedScrubThumbs;
+    NSUInteger abandonedPages;
+}
+
+- (id)initWithDocument:(PDFKDocument *)object events:(NSArray *)sessionEvents
+{
+    if ((self = [super init])) {
+        document = object;
+        events = [sessionEvents sortedArrayUsingComparator:^NSComparisonResult(PDFKSessionEvent *event1, PDFKSessionEvent *event2) {
+            return [@(event1.time) compare:@(event2.time)];
+        }];
+        _thumbSize = CGSizeMake(140.0f, 180.0f);
+        _scrubThumbSize = CGSizeMake(32.0f, 42.0f);
+        _viewportSize = CGSizeMake(768.0f, 1024.0f);
+        _timeScale = 1.0;
+        _drainTimeout = 10.0;
+    }
+    return self;
+}
+
+- (void)replayWithCompletion:(void (^)(NSDictionary *report))completion
+{
+    completionBlock = [completion copy];
+    visibleThumbViews = [NSMutableDictionary new];
+    recycledThumbViews = [NSMutableArray new];
+    pendingRequests = [NSMutableDictionary new];
+    pendingTimes = [NSMutableDictionary new];
+    displayedPages = [NSMutableIndexSet new];
+    thumbLatencies = [NSMutableArray new];
+    scrubLatencies = [NSMutableArray new];
+    pageLatencies = [NSMutableArray new];
+    pool = [[PDFKPageContentViewPool alloc] initWithDocument:document];
+    pool.viewportSize = _viewportSize;
+    [PDFKThumbCache createThumbCacheWithGUID:document.fingerprint];
+    
+    //Measure the time spent on cancelled work
+    tracingWasEnabled = PDFKTraceIsEnabled();
+    PDFKTraceSetEnabled(YES);
+    startCounters = [PDFKTrace countersSnapshot];
+    
+    //The timer keeps the replayer alive until it completes
+    startTime = CACurrentMediaTime();
+    nextEvent = 0;
+    pollTimer = [NSTimer scheduledTimerWithTimeInterval:POLL_INTERVAL target:self selector:@selector(poll:) userInfo:nil repeats:YES];
+    [self poll:pollTimer];
+}
+
+- (void)poll:(NSTimer *)timer
+{
+    CFTimeInterval now = CACurrentMediaTime();
+    
+    //Replay the events that are due
+    while (nextEvent < events.count) {
+        PDFKSessionEvent *event = events[nextEvent];
+        if (startTime + (event.time * _timeScale) > now) {
+            break;
+        }
+        [self replayEvent:event];
+        nextEvent++;
+        lastEventTime = now;
+    }
+    
+    //Thumbs shown to another view, for example when a page was requested before and is still rendering, arrive in the cache.
+    for (NSNumber *page in pendingRequests.allKeys) {
+        PDFKThumbRequest *request = pendingRequests[page];
+        if ([[[PDFKThumbCache sharedCache] objectForKey:request.cacheKey] isKindOfClass:[UIImage class]]) {
+            [self finishThumbForPage:page];
+        }
+    }
+    if (scrubRequest != nil && [[[PDFKThumbCache sharedCache] objectForKey:scrubRequest.cacheKey] isKindOfClass:[UIImage class]]) {
+        [self finishScrubThumb];
+    }
+    
+    //Done once everything asked for has arrived, or after the timeout
+    BOOL outstanding = (pendingRequests.count > 0 || scrubRequest != nil || pagePending);
+    if (nextEvent == events.count && (outstanding == NO || now - lastEventTime > _drainTimeout)) {
+        [self finish];
+    }
+}
+
+- (void)replayEvent:(PDFKSessionEvent *)event
+{
+    switch (event.type) {
+        case PDFKSessionEventThumbsVisible:
+            [self replayVisibleThumbs:NSMakeRange((NSUInteger)MAX(1, event.page), (NSUInteger)MAX(0, event.count))];
+            break;
+        case PDFKSessionEventScrub:
+            [self replayScrubToPage:event.page];
+            break;
+        case PDFKSessionEventPageDisplay:
+            [self replayDisplayPage:event.page];
+            break;
+    }
+}
+
+#pragma mark Thumbs
+
+- (PDFKSessionReplayThumbView *)dequeueThumbView
+{
+    PDFKSessionReplayThumbView *view = recycledThumbViews.lastObject;
+    if (view != nil) {
+        [recycledThumbViews removeLastObject];
+        return view;
+    }
+    view = [[PDFKSessionReplayThumbView alloc] initWithFrame:CGRectMake(0.0f, 0.0f, _thumbSize.width, _thumbSize.height)];
+    __weak PDFKSessionReplayer *weakSelf = self;
+    view.showBlock = ^(PDFKSessionReplayThumbView *shownView) {
+        [weakSelf thumbViewShowedImage:shownView];
+    };
+    return view;
+}
+
+- (void)replayVisibleThumbs:(NSRange)range
+{
+    NSRange pages = NSIntersectionRange(range, NSMakeRange(1, document.pageCount));
+    
+    //Thumbs that scrolled away, as the grid does when a cell ends displaying
+    for (NSNumber *page in visibleThumbViews.allKeys) {
+        if (NSLocationInRange(page.unsignedIntegerValue, pages) == NO) {
+            PDFKSessionReplayThumbView *view = visibleThumbViews[page];
+            if (pendingRequests[page] != nil) {
+                abandonedThumbs++;
+                [pendingRequests removeObjectForKey:page];
+                [pendingTimes removeObjectForKey:page];
+            }
+            [view clearForReuse];
+            [visibleThumbViews removeObjectForKey:page];
+            [recycledThumbViews addObject:view];
+        }
+    }
+    
+    //Thumbs that scrolled in
+    CFTimeInterval now = CACurrentMediaTime();
+    for (NSUInteger pageNumber = pages.location; pageNumber < NSMaxRange(pages); pageNumber++) {
+        NSNumber *page = @(pageNumber);
+        if (visibleThumbViews[page] != nil) {
+            continue;
+        }
+        PDFKSessionReplayThumbView *view = [self dequeueThumbView];
+        visibleThumbViews[page] = view;
+        view.tag = (NSInteger)pageNumber;
+        PDFKThumbRequest *request = [PDFKThumbRequest newForView:view fileURL:document.fileURL password:document.password guid:document.fingerprint page:(NSInteger)pageNumber size:_thumbSize];
+        id object = [[PDFKThumbCache sharedCache] thumbRequest:request priority:YES];
+        if ([object isKindOfClass:[UIImage class]]) {
+            [thumbLatencies addObject:@0.0];
+            [view showImage:object];
+        } else {
+            pendingRequests[page] = request;
+            pendingTimes[page] = @(now);
+        }
+    }
+}
+
+- (void)thumbViewShowedImage:(PDFKSessionReplayThumbView *)view
+{
+    if (view == scrubView) {
+        if (scrubRequest != nil) {
+            [self finishScrubThumb];
+        }
+        return;
+    }
+    NSNumber *page = @(view.tag);
+    if (pendingRequests[page] != nil && visibleThumbViews[page] == view) {
+        [self finishThumbForPage:page];
+    }
+}
+
+- (void)finishThumbForPage:(NSNumber *)page
+{
+    [thumbLatencies addObject:@(CACurrentMediaTime() - [pendingTimes[page] doubleValue])];
+    [pendingRequests removeObjectForKey:page];
+    [pendingTimes removeObjectForKey:page];
+}
+
+#pragma mark Scrubber
+
+- (void)replayScrubToPage:(NSInteger)page
+{
+    if (page < 1 || page > (NSInteger)document.pageCount || page == scrubPage) {
+        return;
+    }
+    if (scrubView == nil) {
+        scrubView = [self dequeueThumbView];
+        scrubView.frame = CGRectMake(0.0f, 0.0f, _scrubThumbSize.width, _scrubThumbSize.height);
+    }
+    if (scrubRequest != nil) {
+        abandonedScrubThumbs++;
+    }
+    [scrubView clearForReuse];
+    scrubPage = page;
+    scrubTime = CACurrentMediaTime();
+    scrubRequest = [PDFKThumbRequest newForView:scrubView fileURL:document.fileURL password:document.password guid:document.fingerprint page:page size:_scrubThumbSize];
+    
+    //Shown at once if it is in memory, otherwise requested when the touch pauses
+    if ([[[PDFKThumbCache sharedCache] objectForKey:scrubRequest.cacheKey] isKindOfClass:[UIImage class]]) {
+        [self finishScrubThumb];
+        return;
+    }
+    NSUInteger generation = ++scrubGeneration;
+    dispatch_after(dispatch_time(DISPATCH_TIME_NOW, (int64_t)(SCRUB_UPGRADE_DELAY * NSEC_PER_SEC)), dispatch_get_main_queue(), ^{
+        if (generation != self->scrubGeneration || self->scrubRequest == nil) {
+            return;
+        }
+        id object = [[PDFKThumbCache sharedCache] thumbRequest:self->scrubRequest priority:YES];
+        if ([object isKindOfClass:[UIImage class]]) {
+            [self finishScrubThumb];
+        }
+    });
+}
+
+- (void)finishScrubThumb
+{
+    [scrubLatencies addObject:@(CACurrentMediaTime() - scrubTime)];
+    scrubRequest = nil;
+    scrubGeneration++;
+}
+
+#pragma mark Pages
+
+- (void)replayDisplayPage:(NSInteger)page
+{
+    if (pageView != nil) {
+        if (pagePending) {
+            abandonedPages++;
+            pagePending = NO;
+        }
+        [pool recycleView:pageView];
+        pageView = nil;
+    }
+    if (page < 1 || page > (NSInteger)document.pageCount) {
+        return;
+    }
+    
+    pageView = [pool viewForPage:page frame:CGRectMake(0.0f, 0.0f, _viewportSize.width, _viewportSize.height)];
+    [pool prefetchPagesAroundPage:page];
+    [displayedPages addIndex:(NSUInteger)page];
+    if (pageView.page == nil) {
+        return;
+    }
+    
+    //Sharp once the page image is rendered, at once if it was rendered before.
+    CFTimeInterval start = CACurrentMediaTime();
+    NSUInteger generation = ++pageGeneration;
+    pagePending = YES;
+    [pageView.renderCache renderPage:pageView.page completion:^(UIImage *image) {
+        if (generation != self->pageGeneration || self->pagePending == NO) {
+            return;
+        }
+        self->pagePending = NO;
+        [self->pageLatencies addObject:@(CACurrentMediaTime() - start)];
+    }];
+}
+
+#pragma mark Report
+
+- (void)finish
+{
+    [pollTimer invalidate];
+    pollTimer = nil;
+    
+    //Work still outstanding was not shown before the timeout
+    abandonedThumbs += pendingRequests.count;
+    abandonedScrubThumbs += (scrubRequest != nil ? 1 : 0);
+    abandonedPages += (pagePending ? 1 : 0);
+    for (PDFKThumbView *view in visibleThumbViews.allValues) {
+        [view clearForReuse];
+    }
+    [scrubView clearForReuse];
+    [pool recycleView:pageView];
+    
+    NSDictionary *counters = [PDFKTrace countersSnapshot];
+    PDFKTraceSetEnabled(tracingWasEnabled);
+    int64_t cancelled = [counters[@"Cancelled"] longLongValue] - [startCounters[@"Cancelled"] longLongValue];
+    int64_t cancelledNanoseconds = [counters[@"CancelledNanoseconds"] longLongValue] - [startCounters[@"CancelledNanoseconds"] longLongValue];
+    double hits = [counters[@"CacheHits"] doubleValue] - [startCounters[@"CacheHits"] doubleValue];
+    double misses = [counters[@"CacheMisses"] doubleValue] - [startCounters[@"CacheMisses"] doubleValue];
+    NSInteger renders = [pool.statistics[@"RenderCache"][@"Renders"] integerValue];
+    
+    NSDictionary *report = @{@"Events": @(events.count),
+                             @"Elapsed": @(CACurrentMediaTime() - startTime),
+                             @"TimeToFirstThumb": PDFKLatencySummary(thumbLatencies),
+                             @"TimeToScrubThumb": PDFKLatencySummary(scrubLatencies),
+                             @"TimeToSharpPage": PDFKLatencySummary(pageLatencies),
+                             @"AbandonedThumbs": @(abandonedThumbs),
+                             @"AbandonedScrubThumbs": @(abandonedScrubThumbs),
+                             @"AbandonedPages": @(abandonedPages),
+                             @"UnviewedPageRenders": @(MAX(0, renders - (NSInteger)displayedPages.count)),
+                             @"CancelledOperations": @(cancelled),
+                             @"CancelledMilliseconds": @(cancelledNanoseconds / 1000000.0),
+                             @"ThumbCacheHitRatio": @((hits + misses) > 0 ? (hits / (hits + misses)) : 0.0)};
+    
+    void (^completion)(NSDictionary *report) = completionBlock;
+    completionBlock = nil;
+    pool = nil;
+    pageView = nil;
+    if (completion != nil) {
+        completion(report);
+    }
+}
+
+@end
@@ -0,0 +1,161 @@
+/*
+ //  PDFKTrace.h
+ //  M13PDFKit
+ //
+ Copyright (c) 2014 Brandon McQuilkin
+ 
+ Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated documentation files (the
+ "Software"), to deal in the Software without restriction, including without limitation the rights to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software, and to permit persons to whom the Software is furnished to do so, subject to
+ the following conditions:
+ 
+ The above copyright notice and this permission notice shall be included in all copies or substantial portions of the Software.
+ 
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#import <Foundation/Foundation.h>
+
+/**
+ The stages of the render pipeline that are timed.
+ */
+typedef NS_ENUM(uint8_t, PDFKTraceStage) {
+    /**
+     Opening a PDF document.
+     */
+    PDFKTraceStageOpen = 0,
+    /**
+     Getting a page from an open document.
+     */
+    PDFKTraceStagePageFetch,
+    /**
+     Drawing a page into a bitmap.
+     */
+    PDFKTraceStageRasterize,
+    /**
+     Compressing a bitmap to an image file format.
+     */
+    PDFKTraceStageEncode,
+    /**
+     Writing an image file to disk.
+     */
+    PDFKTraceStageDiskWrite,
+    /**
+     Decompressing an image file.
+     */
+    PDFKTraceStageDecode,
+    /**
+     Drawing a tile of a page on screen.
+     */
+    PDFKTraceStageTileDraw,
+    /**
+     Reading a batch of image files from disk.
+     */
+    PDFKTraceStageDiskRead,
+    PDFKTraceStageCount
+};
+
+/**
+ The counters kept by the tracer.
+ */
+typedef NS_ENUM(uint8_t, PDFKTraceCounter) {
+    /**
+     Thumb requests that were in the memory cache.
+     */
+    PDFKTraceCounterCacheHits = 0,
+    /**
+     Thumb requests that were not in the memory cache.
+     */
+    PDFKTraceCounterCacheMisses,
+    /**
+     Operations that were cancelled.
+     */
+    PDFKTraceCounterCancelled,
+    /**
+     Nanoseconds spent on work that was thrown away because its operation was cancelled. Only measured while tracing is enabled.
+     */
+    PDFKTraceCounterCancelledNanoseconds,
+    /**
+     The number of operations in the thumb fetch queue when an operation was last added.
+     */
+    PDFKTraceCounterFetchQueueDepth,
+    /**
+     The number of operations in the thumb work queue when an operation was last added.
+     */
+    PDFKTraceCounterWorkQueueDepth,
+    PDFKTraceCounterCount
+};
+
+/**
+ Enable or disable tracing. Tracing is disabled by default; while disabled, timing a stage costs a single atomic load.
+ 
+ @param enabled Wether or not to record trace events.
+ */
+void PDFKTraceSetEnabled(BOOL enabled);
+/**
+ Wether or not tracing is enabled.
+ 
+ @return YES if trace events are being recorded.
+ */
+BOOL PDFKTraceIsEnabled(void);
+/**
+ Start timing a stage.
+ 
+ @return The start time to pass to PDFKTraceEnd, or 0 if tracing is disabled.
+ */
+uint64_t PDFKTraceBegin(void);
+/**
+ Finish timing a stage, and record it in the trace buffer. Safe to call from any thread.
+ 
+ @param stage The stage that was timed.
+ @param start The time returned by PDFKTraceBegin.
+ @param page  The page the stage worked on, or 0.
+ 
+ @return The duration of the stage in nanoseconds, or 0 if tracing is disabled.
+ */
+uint64_t PDFKTraceEnd(PDFKTraceStage stage, uint64_t start, NSInteger page);
+/**
+ Add to a counter. Counters are updated even if tracing is disabled.
+ 
+ @param counter The counter to update.
+ @param value   The amount to add.
+ */
+void PDFKTraceCounterAdd(PDFKTraceCounter counter, int64_t value);
+/**
+ Set a counter to a value.
+ 
+ @param counter The counter to update.
+ @param value   The new value.
+ */
+void PDFKTraceCounterSet(PDFKTraceCounter counter, int64_t value);
+
+/**
+ Access to the recorded trace events and counters.
+ */
+@interface PDFKTrace : NSObject
+
+/**
+ The recorded events in the Chrome trace event format, ready to be loaded into chrome://tracing. Only the most recent events are kept.
+ 
+ @return JSON data.
+ */
++ (NSData *)chromeTraceJSONData;
+/**
+ Write the recorded events in the Chrome trace event format.
+ 
+ @param url The file to write to.
+ 
+ @return YES if the file was written.
+ */
++ (BOOL)writeChromeTraceToURL:(NSURL *)url;
+/**
+ A snapshot of the counters and per stage timings. The keys are the counter names ("CacheHits", "CacheMisses", "CacheHitRatio", "Cancelled", "CancelledNanoseconds", "FetchQueueDepth", "WorkQueueDepth") and "Stages", a dictionary of stage names to dictionaries with "Count" and "TotalNanoseconds".
+ 
+ @return The snapshot.
+ */
++ (NSDictionary *)countersSnapshot;
+/**
+ Clear the recorded events and counters.
+ */
++ (void)reset;
+
+@end
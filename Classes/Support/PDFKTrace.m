@@ -0,0 +1,211 @@
+/*
+ //  PDFKTrace.m
+ //  M13PDFKit
+ //
+ Copyright (c) 2014 Brandon McQuilkin
+ 
+ Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated documentation files (the
+ "Software"), to deal in the Software without restriction, including without limitation the rights to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software, and to permit persons to whom the Software is furnished to do so, subject to
+ the following conditions:
+ 
+ The above copyright notice and this permission notice shall be included in all copies or substantial portions of the Software.
+ 
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#import "PDFKTrace.h"
+#import <stdatomic.h>
+#import <mach/mach_time.h>
+#import <pthread.h>
+
+//The number of events kept, must be a power of two.
+#define TRACE_BUFFER_SIZE 8192
+
+/**
+ An event in the trace buffer. The sequence is zero while the event is being written, and the event's index + 1 once it is complete.
+ */
+typedef struct {
+    _Atomic uint64_t sequence;
+    uint64_t start;
+    uint64_t duration;
+    uint64_t thread;
+    int64_t page;
+    uint8_t stage;
+} PDFKTraceEvent;
+
+static PDFKTraceEvent traceBuffer[TRACE_BUFFER_SIZE];
+static _Atomic uint64_t traceHead = 0;
+static atomic_bool traceEnabled = false;
+
+static _Atomic int64_t traceCounters[PDFKTraceCounterCount];
+static _Atomic uint64_t traceStageCounts[PDFKTraceStageCount];
+static _Atomic uint64_t traceStageNanoseconds[PDFKTraceStageCount];
+
+static NSString *const PDFKTraceStageNames[PDFKTraceStageCount] = {@"Open", @"PageFetch", @"Rasterize", @"Encode", @"DiskWrite", @"Decode", @"TileDraw", @"DiskRead"};
+static NSString *const PDFKTraceCounterNames[PDFKTraceCounterCount] = {@"CacheHits", @"CacheMisses", @"Cancelled", @"CancelledNanoseconds", @"FetchQueueDepth", @"WorkQueueDepth"};
+
+static inline uint64_t PDFKTraceNanoseconds(uint64_t machTime)
+{
+    static mach_timebase_info_data_t timebase;
+    if (timebase.denom == 0) {
+        mach_timebase_info(&timebase);
+    }
+    return (machTime * timebase.numer) / timebase.denom;
+}
+
+void PDFKTraceSetEnabled(BOOL enabled)
+{
+    atomic_store_explicit(&traceEnabled, (enabled ? true : false), memory_order_relaxed);
+}
+
+BOOL PDFKTraceIsEnabled(void)
+{
+    return atomic_load_explicit(&traceEnabled, memory_order_relaxed) ? YES : NO;
+}
+
+uint64_t PDFKTraceBegin(void)
+{
+    if (atomic_load_explicit(&traceEnabled, memory_order_relaxed) == false) {
+        return 0;
+    }
+    return mach_absolute_time();
+}
+
+uint64_t PDFKTraceEnd(PDFKTraceStage stage, uint64_t start, NSInteger page)
+{
+    if (start == 0 || stage >= PDFKTraceStageCount) {
+        return 0;
+    }
+    
+    uint64_t end = mach_absolute_time();
+    uint64_t duration = PDFKTraceNanoseconds(end - start);
+    
+    atomic_fetch_add_explicit(&traceStageCounts[stage], 1, memory_order_relaxed);
+    atomic_fetch_add_explicit(&traceStageNanoseconds[stage], duration, memory_order_relaxed);
+    
+    //Claim a slot, overwriting the oldest event
+    uint64_t index = atomic_fetch_add_explicit(&traceHead, 1, memory_order_relaxed);
+    PDFKTraceEvent *event = &traceBuffer[index & (TRACE_BUFFER_SIZE - 1)];
+    
+    atomic_store_explicit(&event->sequence, 0, memory_order_relaxed);
+    atomic_thread_fence(memory_order_release);
+    event->start = start;
+    event->duration = duration;
+    event->thread = pthread_mach_thread_np(pthread_self());
+    event->page = page;
+    event->stage = stage;
+    atomic_store_explicit(&event->sequence, index + 1, memory_order_release);
+    
+    return duration;
+}
+
+void PDFKTraceCounterAdd(PDFKTraceCounter counter, int64_t value)
+{
+    if (counter < PDFKTraceCounterCount) {
+        atomic_fetch_add_explicit(&traceCounters[counter], value, memory_order_relaxed);
+    }
+}
+
+void PDFKTraceCounterSet(PDFKTraceCounter counter, int64_t value)
+{
+    if (counter < PDFKTraceCounterCount) {
+        atomic_store_explicit(&traceCounters[counter], value, memory_order_relaxed);
+    }
+}
+
+@implementation PDFKTrace
+
++ (NSArray *)chromeTraceEvents
+{
+    NSMutableArray *events = [NSMutableArray new];
+    
+    uint64_t head = atomic_load_explicit(&traceHead, memory_order_acquire);
+    uint64_t first = (head > TRACE_BUFFER_SIZE ? (head - TRACE_BUFFER_SIZE) : 0);
+    
+    for (uint64_t index = first; index < head; index++) {
+        PDFKTraceEvent *slot = &traceBuffer[index & (TRACE_BUFFER_SIZE - 1)];
+        
+        //Copy the event, skipping it if it is being written
+        uint64_t sequence = atomic_load_explicit(&slot->sequence, memory_order_acquire);
+        if (sequence != index + 1) {
+            continue;
+        }
+        uint64_t start = slot->start;
+        uint64_t duration = slot->duration;
+        uint64_t thread = slot->thread;
+        int64_t page = slot->page;
+        uint8_t stage = slot->stage;
+        atomic_thread_fence(memory_order_acquire);
+        if (atomic_load_explicit(&slot->sequence, memory_order_relaxed) != sequence || stage >= PDFKTraceStageCount) {
+            continue;
+        }
+        
+        //Complete events, times in microseconds
+        [events addObject:@{@"name": PDFKTraceStageNames[stage],
+                            @"cat": @"PDFKit",
+                            @"ph": @"X",
+                            @"ts": @(PDFKTraceNanoseconds(start) / 1000.0),
+                            @"dur": @(duration / 1000.0),
+                            @"pid": @([[NSProcessInfo processInfo] processIdentifier]),
+                            @"tid": @(thread),
+                            @"args": @{@"page": @(page)}}];
+    }
+    
+    return events;
+}
+
++ (NSData *)chromeTraceJSONData
+{
+    NSDictionary *trace = @{@"traceEvents": [self chromeTraceEvents], @"displayTimeUnit": @"ms"};
+    return [NSJSONSerialization dataWithJSONObject:trace options:0 error:NULL];
+}
+
++ (BOOL)writeChromeTraceToURL:(NSURL *)url
+{
+    NSData *data = [self chromeTraceJSONData];
+    return [data writeToURL:url atomically:YES];
+}
+
++ (NSDictionary *)countersSnapshot
+{
+    NSMutableDictionary *snapshot = [NSMutableDictionary new];
+    
+    for (NSInteger counter = 0; counter < PDFKTraceCounterCount; counter++) {
+        snapshot[PDFKTraceCounterNames[counter]] = @(atomic_load_explicit(&traceCounters[counter], memory_order_relaxed));
+    }
+    
+    //Hit ratio
+    double hits = [snapshot[@"CacheHits"] doubleValue];
+    double misses = [snapshot[@"CacheMisses"] doubleValue];
+    snapshot[@"CacheHitRatio"] = @((hits + misses) > 0 ? (hits / (hits + misses)) : 0.0);
+    
+    //Stage timings
+    NSMutableDictionary *stages = [NSMutableDictionary new];
+    for (NSInteger stage = 0; stage < PDFKTraceStageCount; stage++) {
+        stages[PDFKTraceStageNames[stage]] = @{@"Count": @(atomic_load_explicit(&traceStageCounts[stage], memory_order_relaxed)),
+                                               @"TotalNanoseconds": @(atomic_load_explicit(&traceStageNanoseconds[stage], memory_order_relaxed))};
+    }
+    snapshot[@"Stages"] = stages;
+    
+    return snapshot;
+}
+
++ (void)reset
+{
+    //Invalidate the buffered events
+    uint64_t head = atomic_load_explicit(&traceHead, memory_order_acquire);
+    for (NSInteger index = 0; index < TRACE_BUFFER_SIZE; index++) {
+        atomic_store_explicit(&traceBuffer[index].sequence, 0, memory_order_relaxed);
+    }
+    atomic_store_explicit(&traceHead, head + TRACE_BUFFER_SIZE, memory_order_release);
+    
+    for (NSInteger counter = 0; counter < PDFKTraceCounterCount; counter++) {
+        atomic_store_explicit(&traceCounters[counter], 0, memory_order_relaxed);
+    }
+    for (NSInteger stage = 0; stage < PDFKTraceStageCount; stage++) {
+        atomic_store_explicit(&traceStageCounts[stage], 0, memory_order_relaxed);
+        atomic_store_explicit(&traceStageNanoseconds[stage], 0, memory_order_relaxed);
+    }
+}
+
+@end
@@ -25,13 +25,14 @@
 
 #import <Foundation/Foundation.h>
 #import <UIKit/UIKit.h>
+#import "PDFKResourceGovernor.h"
 
 @class PDFKThumbRequest;
 
 /**
  Stores the thumbs for later reuse.
  */
-@interface PDFKThumbCache : NSObject
+@interface PDFKThumbCache : NSObject <PDFKResourceConsumer>
 
 /**
  Get the shared thumb cache.
@@ -40,7 +41,7 @@
  */
 + (PDFKThumbCache *)sharedCache;
 /**
- Update the modification date of the thumb cache coresponding the the GUID.
+ Mark the thumb cache coresponding the the GUID as used now.
  
  @param guid The GUID of the PDF document to update the cache for.
  */
@@ -58,11 +59,17 @@
  */
 + (void)removeThumbCacheWithGUID:(NSString *)guid;
 /**
- Deletes all caches older than the given age.
+ Deletes all caches that have not been used for the given age.
  
  @param age The time to determine what caches to expunge.
  */
 + (void)purgeThumbCachesOlderThan:(NSTimeInterval)age;
+/**
+ The directory that contains the thumb caches of all documents.
+ 
+ @return The path of the caches directory.
+ */
++ (NSString *)appCachesPath;
 /**
  Get the cache path for the PDF document with the given GUID.
  
@@ -75,6 +82,14 @@
 - (id)thumbRequest:(PDFKThumbRequest *)request priority:(BOOL)priority;
 
 - (void)setObject:(UIImage *)image forKey:(NSString *)key;
+/**
+ Get the object in the cache with the given key, without requesting the thumb if it is missing.
+ 
+ @param key The key of the object.
+ 
+ @return The thumb image, a NSNull placeholder if the thumb is being worked on, or nil.
+ */
+- (id)objectForKey:(NSString *)key;
 /**
  Remove the object from the cache with the given key.
  
@@ -28,13 +28,29 @@
 #import "PDFKThumbFetcher.h"
 #import "PDFKThumbView.h"
 #import "PDFKThumbRequest.h"
+#import "PDFKThumbCacheManifest.h"
+#import "PDFKTrace.h"
+#import <libkern/OSAtomic.h>
 
 //The total cost of the cache. 10MB
 #define CACHE_SIZE 10485760
 
+static inline NSUInteger PDFKThumbImageBytes(UIImage *image)
+{
+    return (image.size.width * image.size.height * 4.0f);
+}
+
+@interface PDFKThumbCache () <NSCacheDelegate>
+
+@end
+
 @implementation PDFKThumbCache
 {
 	NSCache *thumbCache;
+    /**
+     The number of bytes of images in the cache. This is updated atomically, as NSCache can evict objects from any thread.
+     */
+    volatile int64_t cachedBytes;
 }
 
 + (PDFKThumbCache *)sharedCache
@@ -71,52 +87,23 @@
 	NSFileManager *fileManager = [NSFileManager new];
 	NSString *cachePath = [PDFKThumbCache thumbCachePathForGUID:guid];
 	[fileManager createDirectoryAtPath:cachePath withIntermediateDirectories:NO attributes:nil error:NULL];
+	[[PDFKThumbCacheManifest sharedManifest] touchCacheWithGUID:guid];
 }
 
 + (void)removeThumbCacheWithGUID:(NSString *)guid
 {
-	dispatch_async(dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_LOW, 0), ^{
-        NSFileManager *fileManager = [NSFileManager new];
-        NSString *cachePath = [PDFKThumbCache thumbCachePathForGUID:guid];
-        [fileManager removeItemAtPath:cachePath error:NULL];
-    });
+	[[PDFKThumbCacheManifest sharedManifest] removeCacheWithGUID:guid];
 }
 
 + (void)touchThumbCacheWithGUID:(NSString *)guid
 {
-	NSFileManager *fileManager = [NSFileManager new];
-	NSString *cachePath = [PDFKThumbCache thumbCachePathForGUID:guid];
-	NSDictionary *attributes = [NSDictionary dictionaryWithObject:[NSDate date] forKey:NSFileModificationDate];
-	[fileManager setAttributes:attributes ofItemAtPath:cachePath error:NULL];
+    //The manifest keeps the access time, file writes can change the directory's modification date.
+	[[PDFKThumbCacheManifest sharedManifest] touchCacheWithGUID:guid];
 }
 
 + (void)purgeThumbCachesOlderThan:(NSTimeInterval)age
 {
-	dispatch_async(dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_LOW, 0), ^{
-        NSDate *now = [NSDate date];
-        //Get the list of all caches
-        NSString *cachesPath = [PDFKThumbCache appCachesPath];
-        NSFileManager *fileManager = [NSFileManager new];
-        NSArray *cachesList = [fileManager contentsOfDirectoryAtPath:cachesPath error:NULL];
-        
-        if (cachesList != nil) {
-            for (NSString *cacheName in cachesList) {
-                //Get the cache attributes
-                NSString *cachePath = [cachesPath stringByAppendingPathComponent:cacheName];
-                NSDictionary *attributes = [fileManager attributesOfItemAtPath:cachePath error:NULL];
-                //Age of the cache
-                NSDate *cacheDate = [attributes objectForKey:NSFileModificationDate];
-                NSTimeInterval seconds = [now timeIntervalSinceDate:cacheDate];
-                //If older than the age, remove
-                if (seconds > age) {
-                    [fileManager removeItemAtPath:cachePath error:NULL];
-                    #ifdef DEBUG
-                        NSLog(@"%s purged %@", __FUNCTION__, cacheName);
-                    #endif
-                }
-            }
-        }
-    });
+	[[PDFKThumbCacheManifest sharedManifest] purgeCachesOlderThan:age];
 }
 
 #pragma mark ReaderThumbCache instance methods
@@ -128,6 +115,10 @@
 		thumbCache = [NSCache new]; // Cache
 		[thumbCache setName:@"PDFKThumbCache"];
 		[thumbCache setTotalCostLimit:CACHE_SIZE];
+        [thumbCache setDelegate:self];
+        
+        //Thumbs are cached on disk, so they can be released first.
+        [[PDFKResourceGovernor sharedGovernor] registerConsumer:self category:PDFKResourceCategoryThumbCache priority:PDFKResourcePriorityLow];
 	}
 	return self;
 }
@@ -139,6 +130,7 @@
 	{
         //See if the object exists in the cache.
 		id object = [thumbCache objectForKey:request.cacheKey];
+		PDFKTraceCounterAdd(([object isKindOfClass:[UIImage class]] ? PDFKTraceCounterCacheHits : PDFKTraceCounterCacheMisses), 1);
         
         //Thumb object does not yet exist in the cache, lets create it.
 		if (object == nil)
@@ -165,8 +157,17 @@
 	@synchronized(thumbCache)
 	{
         //Add the image to the cache
-		NSUInteger bytes = (image.size.width * image.size.height * 4.0f);
+		NSUInteger bytes = PDFKThumbImageBytes(image);
 		[thumbCache setObject:image forKey:key cost:bytes];
+        OSAtomicAdd64Barrier((int64_t)bytes, &cachedBytes);
+	}
+}
+
+- (id)objectForKey:(NSString *)key
+{
+	@synchronized(thumbCache)
+	{
+		return [thumbCache objectForKey:key];
 	}
 }
 
@@ -199,5 +200,30 @@
 	}
 }
 
-@end
+#pragma mark NSCacheDelegate
+
+- (void)cache:(NSCache *)cache willEvictObject:(id)obj
+{
+    if ([obj isKindOfClass:[UIImage class]]) {
+        OSAtomicAdd64Barrier(-(int64_t)PDFKThumbImageBytes(obj), &cachedBytes);
+    }
+}
+
+#pragma mark PDFKResourceConsumer
 
+- (NSUInteger)resourceBytes
+{
+    int64_t bytes = OSAtomicAdd64Barrier(0, &cachedBytes);
+    return (bytes > 0 ? (NSUInteger)bytes : 0);
+}
+
+- (NSUInteger)shedResourcesForPressure:(PDFKResourcePressure)pressure
+{
+    //The thumbs can be reloaded from disk
+    NSUInteger bytes = [self resourceBytes];
+    [self removeAllObjects];
+    NSUInteger remaining = [self resourceBytes];
+    return (bytes > remaining ? (bytes - remaining) : 0);
+}
+
+@end
@@ -0,0 +1,80 @@
+/*
+ //  PDFKThumbCacheManifest.h
+ //  M13PDFKit
+ //
+ Copyright (c) 2014 Brandon McQuilkin
+ 
+ Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated documentation files (the
+ "Software"), to deal in the Software without restriction, including without limitation the rights to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software, and to permit persons to whom the Software is furnished to do so, subject to
+ the following conditions:
+ 
+ The above copyright notice and this permission notice shall be included in all copies or substantial portions of the Software.
+ 
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#import <Foundation/Foundation.h>
+
+/**
+ Keeps track of the size and last access time of each document's thumb cache on disk, in a single manifest file. The caches are kept in least recently used order, so purging only looks at the caches that are removed.
+ */
+@interface PDFKThumbCacheManifest : NSObject
+
+/**
+ Get the shared manifest. It is loaded from disk the first time it is used, or rebuilt from the cache directories if there is no manifest.
+ 
+ @return The shared manifest.
+ */
++ (PDFKThumbCacheManifest *)sharedManifest;
+/**
+ Initalize a manifest stored at the given path. It is loaded in the background, or rebuilt from the cache directories if there is no manifest at the path.
+ 
+ @param path The path of the manifest file.
+ 
+ @return A new manifest.
+ */
+- (id)initWithPath:(NSString *)path;
+/**
+ The maximum number of bytes of thumbs to keep on disk. When the caches grow past the quota, the least recently used caches are removed. Defaults to 100MB.
+ */
+@property (atomic, assign, readwrite) unsigned long long byteQuota;
+/**
+ The total number of bytes of thumbs on disk.
+ */
+@property (nonatomic, readonly) unsigned long long totalBytes;
+/**
+ The number of document caches in the manifest.
+ */
+@property (nonatomic, readonly) NSUInteger cacheCount;
+/**
+ Mark the cache for a document as used now.
+ 
+ @param guid The GUID of the document.
+ */
+- (void)touchCacheWithGUID:(NSString *)guid;
+/**
+ Record that a file was added to a document's cache. The cache is marked as used, and the quota is enforced.
+ 
+ @param bytes         The size of the file.
+ @param replacedBytes The size of the file that was replaced, 0 if the file is new.
+ @param guid          The GUID of the document.
+ */
+- (void)addBytes:(unsigned long long)bytes replacingBytes:(unsigned long long)replacedBytes toCacheWithGUID:(NSString *)guid;
+/**
+ Remove a document's cache from disk and from the manifest.
+ 
+ @param guid The GUID of the document.
+ */
+- (void)removeCacheWithGUID:(NSString *)guid;
+/**
+ Remove the caches that have not been used for the given time.
+ 
+ @param age The age in seconds.
+ */
+- (void)purgeCachesOlderThan:(NSTimeInterval)age;
+/**
+ Write the manifest to disk now, instead of waiting for the pending write.
+ */
+- (void)synchronize;
+
+@end
@@ -0,0 +1,380 @@
+/*
+ //  PDFKThumbCacheManifest.m
+ //  M13PDFKit
+ //
+ Copyright (c) 2014 Brandon McQuilkin
+ 
+ Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated documentation files (the
+ "Software"), to deal in the Software without restriction, including without limitation the rights to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software, and to permit persons to whom the Software is furnished to do so, subject to
+ the following conditions:
+ 
+ The above copyright notice and this permission notice shall be included in all copies or substantial portions of the Software.
+ 
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#import "PDFKThumbCacheManifest.h"
+#import "PDFKThumbCache.h"
+
+//The default disk quota. 100MB
+#define DEFAULT_BYTE_QUOTA 104857600
+//How long to wait before writing changes to the manifest, so many changes are written at once.
+#define MANIFEST_WRITE_DELAY 2.0
+//The version of the manifest file format
+#define MANIFEST_VERSION 1
+
+/**
+ A cache in the manifest.
+ */
+@interface PDFKThumbCacheManifestEntry : NSObject
+
+@property (nonatomic, copy) NSString *guid;
+@property (nonatomic, assign) unsigned long long bytes;
+@property (nonatomic, assign) NSTimeInterval lastAccess;
+/**
+ The entries in least recently used order, the entries are owned by the manifest's dictionary.
+ */
+@property (nonatomic, unsafe_unretained) PDFKThumbCacheManifestEntry *older;
+@property (nonatomic, unsafe_unretained) PDFKThumbCacheManifestEntry *newer;
+
+@end
+
+@implementation PDFKThumbCacheManifestEntry
+
+@end
+
+@implementation PDFKThumbCacheManifest
+{
+    /**
+     The entries keyed by GUID.
+     */
+    NSMutableDictionary *entries;
+    /**
+     The ends of the list of entries, so a cache is moved to the most recently used end without searching for it.
+     */
+    __unsafe_unretained PDFKThumbCacheManifestEntry *oldestEntry;
+    __unsafe_unretained PDFKThumbCacheManifestEntry *newestEntry;
+    /**
+     The path of the manifest file.
+     */
+    NSString *manifestPath;
+    /**
+     All manifest changes happen on this queue.
+     */
+    dispatch_queue_t manifestQueue;
+    /**
+     Wether or not a write of the manifest is scheduled.
+     */
+    BOOL writePending;
+    unsigned long long _totalBytes;
+}
+
++ (PDFKThumbCacheManifest *)sharedManifest
+{
+    static dispatch_once_t predicate = 0;
+    static PDFKThumbCacheManifest *manifest = nil;
+    dispatch_once(&predicate, ^{
+        manifest = [[self alloc] initWithPath:[self manifestPath]];
+    });
+    return manifest;
+}
+
++ (NSString *)manifestPath
+{
+    return [[PDFKThumbCache appCachesPath] stringByAppendingPathComponent:@"Manifest.plist"];
+}
+
+- (id)init
+{
+    return [self initWithPath:[PDFKThumbCacheManifest manifestPath]];
+}
+
+- (id)initWithPath:(NSString *)path
+{
+    if ((self = [super init])) {
+        manifestPath = [path copy];
+        entries = [NSMutableDictionary new];
+        _byteQuota = DEFAULT_BYTE_QUOTA;
+        manifestQueue = dispatch_queue_create("PDFKThumbCacheManifestQueue", DISPATCH_QUEUE_SERIAL);
+        
+        //Load in the background
+        dispatch_async(manifestQueue, ^{
+            if ([self load] == NO) {
+                [self rebuild];
+                [self scheduleWrite];
+            }
+        });
+    }
+    return self;
+}
+
+#pragma mark Loading and saving
+
+- (BOOL)load
+{
+    NSData *data = [NSData dataWithContentsOfFile:manifestPath];
+    if (data == nil) {
+        return NO;
+    }
+    NSDictionary *manifest = [NSPropertyListSerialization propertyListWithData:data options:NSPropertyListImmutable format:NULL error:NULL];
+    if (![manifest isKindOfClass:[NSDictionary class]] || [manifest[@"Version"] integerValue] != MANIFEST_VERSION) {
+        return NO;
+    }
+    
+    //The caches are stored in least recently used order
+    for (NSArray *item in manifest[@"Caches"]) {
+        if (item.count != 3) {
+            continue;
+        }
+        if (entries[item[0]] != nil) {
+            continue;
+        }
+        PDFKThumbCacheManifestEntry *entry = [PDFKThumbCacheManifestEntry new];
+        entry.guid = item[0];
+        entry.bytes = [item[1] unsignedLongLongValue];
+        entry.lastAccess = [item[2] doubleValue];
+        entries[item[0]] = entry;
+        [self appendEntry:entry];
+        _totalBytes += entry.bytes;
+    }
+    return YES;
+}
+
+/**
+ Rebuild the manifest from the cache directories. This is only needed when there is no manifest, such as the first launch after updating.
+ */
+- (void)rebuild
+{
+    NSString *cachesPath = [PDFKThumbCache appCachesPath];
+    NSFileManager *fileManager = [NSFileManager new];
+    NSMutableArray *found = [NSMutableArray new];
+    
+    for (NSString *cacheName in [fileManager contentsOfDirectoryAtPath:cachesPath error:NULL]) {
+        NSString *cachePath = [cachesPath stringByAppendingPathComponent:cacheName];
+        BOOL isDirectory = NO;
+        if ([fileManager fileExistsAtPath:cachePath isDirectory:&isDirectory] == NO || isDirectory == NO) {
+            continue;
+        }
+        
+        //Size of the thumbs
+        unsigned long long bytes = 0;
+        for (NSString *file in [fileManager contentsOfDirectoryAtPath:cachePath error:NULL]) {
+            NSDictionary *attributes = [fileManager attributesOfItemAtPath:[cachePath stringByAppendingPathComponent:file] error:NULL];
+            bytes += [attributes fileSize];
+        }
+        NSDictionary *attributes = [fileManager attributesOfItemAtPath:cachePath error:NULL];
+        
+        PDFKThumbCacheManifestEntry *entry = [PDFKThumbCacheManifestEntry new];
+        entry.guid = cacheName;
+        entry.bytes = bytes;
+        entry.lastAccess = [[attributes fileModificationDate] timeIntervalSinceReferenceDate];
+        entries[cacheName] = entry;
+        [found addObject:cacheName];
+        _totalBytes += bytes;
+    }
+    
+    //Order by last access
+    [found sortUsingComparator:^NSComparisonResult(NSString *a, NSString *b) {
+        NSTimeInterval accessA = ((PDFKThumbCacheManifestEntry *)entries[a]).lastAccess;
+        NSTimeInterval accessB = ((PDFKThumbCacheManifestEntry *)entries[b]).lastAccess;
+        return (accessA < accessB ? NSOrderedAscending : (accessA > accessB ? NSOrderedDescending : NSOrderedSame));
+    }];
+    for (NSString *guid in found) {
+        [self appendEntry:entries[guid]];
+    }
+}
+
+/**
+ Write the manifest soon. Changes made before the write are written together, and the file is rewritten from scratch so it never grows with the number of changes.
+ 
+ @note Must be called on the manifest queue.
+ */
+- (void)scheduleWrite
+{
+    if (writePending) {
+        return;
+    }
+    writePending = YES;
+    dispatch_after(dispatch_time(DISPATCH_TIME_NOW, (int64_t)(MANIFEST_WRITE_DELAY * NSEC_PER_SEC)), manifestQueue, ^{
+        [self write];
+    });
+}
+
+- (void)write
+{
+    writePending = NO;
+    
+    NSMutableArray *caches = [NSMutableArray arrayWithCapacity:entries.count];
+    for (PDFKThumbCacheManifestEntry *entry = oldestEntry; entry != nil; entry = entry.newer) {
+        [caches addObject:@[entry.guid, @(entry.bytes), @(entry.lastAccess)]];
+    }
+    NSDictionary *manifest = @{@"Version": @(MANIFEST_VERSION), @"Caches": caches};
+    
+    NSData *data = [NSPropertyListSerialization dataWithPropertyList:manifest format:NSPropertyListBinaryFormat_v1_0 options:0 error:NULL];
+    NSString *path = manifestPath;
+    [[NSFileManager new] createDirectoryAtPath:[path stringByDeletingLastPathComponent] withIntermediateDirectories:YES attributes:nil error:NULL];
+    [data writeToFile:path atomically:YES];
+}
+
+- (void)synchronize
+{
+    dispatch_sync(manifestQueue, ^{
+        [self write];
+    });
+}
+
+#pragma mark Entries
+
+/**
+ Add an entry at the most recently used end of the list.
+ 
+ @note Must be called on the manifest queue.
+ */
+- (void)appendEntry:(PDFKThumbCacheManifestEntry *)entry
+{
+    entry.older = newestEntry;
+    entry.newer = nil;
+    if (newestEntry != nil) {
+        newestEntry.newer = entry;
+    } else {
+        oldestEntry = entry;
+    }
+    newestEntry = entry;
+}
+
+/**
+ Remove an entry from the list.
+ 
+ @note Must be called on the manifest queue.
+ */
+- (void)unlinkEntry:(PDFKThumbCacheManifestEntry *)entry
+{
+    if (entry.older != nil) {
+        entry.older.newer = entry.newer;
+    } else {
+        oldestEntry = entry.newer;
+    }
+    if (entry.newer != nil) {
+        entry.newer.older = entry.older;
+    } else {
+        newestEntry = entry.older;
+    }
+    entry.older = nil;
+    entry.newer = nil;
+}
+
+/**
+ Get the entry for the GUID, creating it if needed, and move it to the most recently used position.
+ 
+ @note Must be called on the manifest queue.
+ */
+- (PDFKThumbCacheManifestEntry *)touchedEntryForGUID:(NSString *)guid
+{
+    PDFKThumbCacheManifestEntry *entry = entries[guid];
+    if (entry == nil) {
+        entry = [PDFKThumbCacheManifestEntry new];
+        entry.guid = guid;
+        entries[guid] = entry;
+    } else {
+        [self unlinkEntry:entry];
+    }
+    [self appendEntry:entry];
+    entry.lastAccess = [NSDate timeIntervalSinceReferenceDate];
+    return entry;
+}
+
+/**
+ Remove the least recently used cache.
+ 
+ @note Must be called on the manifest queue.
+ */
+- (void)evictCacheWithGUID:(NSString *)guid
+{
+    PDFKThumbCacheManifestEntry *entry = entries[guid];
+    if (entry != nil) {
+        _totalBytes -= MIN(entry.bytes, _totalBytes);
+        [self unlinkEntry:entry];
+        [entries removeObjectForKey:guid];
+    }
+    [[NSFileManager new] removeItemAtPath:[PDFKThumbCache thumbCachePathForGUID:guid] error:NULL];
+    
+    #ifdef DEBUG
+        NSLog(@"%s evicted %@", __FUNCTION__, guid);
+    #endif
+}
+
+- (void)touchCacheWithGUID:(NSString *)guid
+{
+    if (guid == nil) {
+        return;
+    }
+    dispatch_async(manifestQueue, ^{
+        [self touchedEntryForGUID:guid];
+        [self scheduleWrite];
+    });
+}
+
+- (void)addBytes:(unsigned long long)bytes replacingBytes:(unsigned long long)replacedBytes toCacheWithGUID:(NSString *)guid
+{
+    if (guid == nil) {
+        return;
+    }
+    dispatch_async(manifestQueue, ^{
+        //A rewritten file is only counted once. The replaced file may have been counted in a cache that was evicted since.
+        PDFKThumbCacheManifestEntry *entry = [self touchedEntryForGUID:guid];
+        unsigned long long removedBytes = MIN(replacedBytes, entry.bytes);
+        entry.bytes = (entry.bytes - removedBytes) + bytes;
+        _totalBytes = (_totalBytes - MIN(removedBytes, _totalBytes)) + bytes;
+        
+        //Evict the least recently used caches, but never the one being written to.
+        unsigned long long quota = self.byteQuota;
+        while (_totalBytes > quota && oldestEntry != newestEntry) {
+            [self evictCacheWithGUID:oldestEntry.guid];
+        }
+        
+        [self scheduleWrite];
+    });
+}
+
+- (void)removeCacheWithGUID:(NSString *)guid
+{
+    if (guid == nil) {
+        return;
+    }
+    dispatch_async(manifestQueue, ^{
+        [self evictCacheWithGUID:guid];
+        [self scheduleWrite];
+    });
+}
+
+- (void)purgeCachesOlderThan:(NSTimeInterval)age
+{
+    dispatch_async(manifestQueue, ^{
+        //The oldest caches are first, so stop at the first one that is new enough.
+        NSTimeInterval cutoff = ([NSDate timeIntervalSinceReferenceDate] - age);
+        while (oldestEntry != nil && oldestEntry.lastAccess < cutoff) {
+            [self evictCacheWithGUID:oldestEntry.guid];
+        }
+        [self scheduleWrite];
+    });
+}
+
+- (unsigned long long)totalBytes
+{
+    __block unsigned long long bytes = 0;
+    dispatch_sync(manifestQueue, ^{
+        bytes = _totalBytes;
+    });
+    return bytes;
+}
+
+- (NSUInteger)cacheCount
+{
+    __block NSUInteger count = 0;
+    dispatch_sync(manifestQueue, ^{
+        count = entries.count;
+    });
+    return count;
+}
+
+@end
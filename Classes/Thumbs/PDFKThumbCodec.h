@@ -0,0 +1,129 @@
+/*
+ //  PDFKThumbCodec.h
+ //  M13PDFKit
+ //
+ Copyright (c) 2014 Brandon McQuilkin
+ 
+ Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated documentation files (the
+ "Software"), to deal in the Software without restriction, including without limitation the rights to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software, and to permit persons to whom the Software is furnished to do so, subject to
+ the following conditions:
+ 
+ The above copyright notice and this permission notice shall be included in all copies or substantial portions of the Software.
+ 
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#import <Foundation/Foundation.h>
+#import <CoreGraphics/CoreGraphics.h>
+
+/**
+ The path extension of thumb files.
+ */
+extern NSString *const PDFKThumbCodecPathExtension;
+
+/**
+ The bitmap info of the pixels stored in a thumb file. This is the layout of the bitmap contexts the thumbs are rendered into, and the layout the display path draws without converting.
+ */
+#define PDFKThumbCodecBitmapInfo (kCGBitmapByteOrder32Little | kCGImageAlphaNoneSkipFirst)
+
+/**
+ The description of the pixels in a thumb file.
+ */
+typedef struct {
+    /**
+     The width of the thumb in pixels.
+     */
+    size_t width;
+    /**
+     The height of the thumb in pixels.
+     */
+    size_t height;
+    /**
+     The number of bytes in a row of pixels.
+     */
+    size_t bytesPerRow;
+    /**
+     Wether or not the pixels are LZ4 compressed in the file.
+     */
+    BOOL compressed;
+} PDFKThumbCodecInfo;
+
+/**
+ Encode a bitmap in the thumb file format. The pixels must be in the PDFKThumbCodecBitmapInfo layout.
+ 
+ @param pixels      The pixels of the bitmap.
+ @param width       The width of the bitmap in pixels.
+ @param height      The height of the bitmap in pixels.
+ @param bytesPerRow The number of bytes in a row of pixels.
+ @param compress    Wether or not to LZ4 compress the pixels. The pixels are stored uncompressed if compressing does not make them smaller.
+ 
+ @return The thumb file data, or nil if the bitmap could not be encoded.
+ */
+NSData *PDFKThumbCodecEncodeBitmap(const void *pixels, size_t width, size_t height, size_t bytesPerRow, BOOL compress);
+/**
+ Encode an image in the thumb file format. Images in the PDFKThumbCodecBitmapInfo layout are encoded without being redrawn.
+ 
+ @param image    The image to encode.
+ @param compress Wether or not to LZ4 compress the pixels.
+ 
+ @return The thumb file data, or nil if the image could not be encoded.
+ */
+NSData *PDFKThumbCodecEncodeImage(CGImageRef image, BOOL compress);
+/**
+ Read the description of the pixels in thumb file data.
+ 
+ @param data The thumb file data.
+ @param info Set to the description of the pixels.
+ 
+ @return YES if the data is a valid thumb file.
+ */
+BOOL PDFKThumbCodecGetInfo(NSData *data, PDFKThumbCodecInfo *info);
+/**
+ Decode the pixels of thumb file data into a buffer provided by the caller.
+ 
+ @param data         The thumb file data.
+ @param buffer       The buffer to decode into. The pixels are written with the bytesPerRow given by PDFKThumbCodecGetInfo.
+ @param bufferLength The length of the buffer in bytes. Must be at least bytesPerRow * height.
+ 
+ @return YES if the pixels were decoded.
+ */
+BOOL PDFKThumbCodecDecode(NSData *data, void *buffer, size_t bufferLength);
+/**
+ Create an image from thumb file data. The image is ready to draw: uncompressed pixels are used in place, and compressed pixels are decoded once.
+ 
+ @param data The thumb file data. Memory mapped data is not copied if the pixels are uncompressed.
+ 
+ @return A CGImageRef that must be released by the caller, or NULL if the data is not a valid thumb file.
+ */
+CGImageRef PDFKThumbCodecCreateImage(NSData *data) CF_RETURNS_RETAINED;
+/**
+ Create an image from a thumb file.
+ 
+ @param url The URL of the thumb file.
+ 
+ @return A CGImageRef that must be released by the caller, or NULL if the file does not exist or is not a valid thumb file.
+ */
+CGImageRef PDFKThumbCodecCreateImageWithURL(NSURL *url) CF_RETURNS_RETAINED;
+
+/**
+ Compress data in the LZ4 block format.
+ 
+ @param source            The data to compress.
+ @param sourceLength      The length of the data to compress.
+ @param destination       The buffer to write the compressed data to.
+ @param destinationLength The length of the buffer.
+ 
+ @return The length of the compressed data, or 0 if it does not fit in the buffer.
+ */
+size_t PDFKLZ4Compress(const uint8_t *source, size_t sourceLength, uint8_t *destination, size_t destinationLength);
+/**
+ Decompress data in the LZ4 block format. The decompressor never reads or writes outside of the given buffers.
+ 
+ @param source            The compressed data.
+ @param sourceLength      The length of the compressed data.
+ @param destination       The buffer to decompress into.
+ @param destinationLength The exact length of the decompressed data.
+ 
+ @return YES if the data decompressed to exactly destinationLength bytes.
+ */
+BOOL PDFKLZ4Decompress(const uint8_t *source, size_t sourceLength, uint8_t *destination, size_t destinationLength);
@@ -0,0 +1,443 @@
+/*
+ //  PDFKThumbCodec.m
+ //  M13PDFKit
+ //
+ Copyright (c) 2014 Brandon McQuilkin
+ 
+ Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated documentation files (the
+ "Software"), to deal in the Software without restriction, including without limitation the rights to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software, and to permit persons to whom the Software is furnished to do so, subject to
+ the following conditions:
+ 
+ The above copyright notice and this permission notice shall be included in all copies or substantial portions of the Software.
+ 
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#import "PDFKThumbCodec.h"
+#import "PDFKPixelBufferPool.h"
+#import <libkern/OSByteOrder.h>
+
+NSString *const PDFKThumbCodecPathExtension = @"pdfkthumb";
+
+//The first bytes of a thumb file: "PDKT"
+#define THUMB_MAGIC 0x544B4450
+//The version of the file format
+#define THUMB_VERSION 1
+//The pixels are LZ4 compressed
+#define THUMB_FLAG_COMPRESSED 0x0001
+
+//The smallest match LZ4 encodes
+#define LZ4_MIN_MATCH 4
+//The last match must start this many bytes before the end of the data
+#define LZ4_MATCH_FIND_LIMIT 12
+//The last bytes of the data are always literals
+#define LZ4_LAST_LITERALS 5
+//The farthest back a match can be
+#define LZ4_MAX_OFFSET 65535
+//The size of the match finder's hash table, as a power of two
+#define LZ4_HASH_LOG 12
+
+/**
+ The header of a thumb file. All fields are little endian.
+ */
+typedef struct {
+    uint32_t magic;
+    uint16_t version;
+    uint16_t flags;
+    uint32_t width;
+    uint32_t height;
+    uint32_t bytesPerRow;
+    uint32_t bitmapInfo;
+    uint32_t pixelLength;
+    uint32_t payloadLength;
+} PDFKThumbFileHeader;
+
+#pragma mark LZ4
+
+static inline uint32_t LZ4Read32(const uint8_t *pointer)
+{
+    uint32_t value;
+    memcpy(&value, pointer, sizeof(value));
+    return value;
+}
+
+static inline uint32_t LZ4Hash(uint32_t sequence)
+{
+    return (sequence * 2654435761U) >> (32 - LZ4_HASH_LOG);
+}
+
+/**
+ Write the extra bytes of a literal or match length that does not fit in its token nibble.
+ */
+static inline uint8_t *LZ4WriteLength(uint8_t *op, size_t length)
+{
+    while (length >= 255) {
+        *op++ = 255;
+        length -= 255;
+    }
+    *op++ = (uint8_t)length;
+    return op;
+}
+
+/**
+ Write a sequence of literals followed by a match, or only literals if matchLength is 0. Returns NULL if it does not fit.
+ */
+static uint8_t *LZ4WriteSequence(uint8_t *op, uint8_t *oend, const uint8_t *literals, size_t literalLength, size_t offset, size_t matchLength)
+{
+    //Worst case size of the sequence
+    size_t needed = 1 + (literalLength / 255) + 1 + literalLength + (matchLength > 0 ? 2 + (matchLength / 255) + 1 : 0);
+    if (needed > (size_t)(oend - op)) {
+        return NULL;
+    }
+    
+    uint8_t *token = op++;
+    *token = (uint8_t)((literalLength >= 15 ? 15 : literalLength) << 4);
+    if (literalLength >= 15) {
+        op = LZ4WriteLength(op, literalLength - 15);
+    }
+    memcpy(op, literals, literalLength);
+    op += literalLength;
+    
+    if (matchLength > 0) {
+        *op++ = (uint8_t)(offset & 0xFF);
+        *op++ = (uint8_t)(offset >> 8);
+        size_t length = matchLength - LZ4_MIN_MATCH;
+        *token |= (uint8_t)(length >= 15 ? 15 : length);
+        if (length >= 15) {
+            op = LZ4WriteLength(op, length - 15);
+        }
+    }
+    return op;
+}
+
+size_t PDFKLZ4Compress(const uint8_t *source, size_t sourceLength, uint8_t *destination, size_t destinationLength)
+{
+    const uint8_t *ip = source;
+    const uint8_t *anchor = source;
+    const uint8_t *iend = source + sourceLength;
+    uint8_t *op = destination;
+    uint8_t *oend = destination + destinationLength;
+    
+    if (sourceLength > LZ4_MATCH_FIND_LIMIT) {
+        const uint8_t *mflimit = iend - LZ4_MATCH_FIND_LIMIT;
+        const uint8_t *matchlimit = iend - LZ4_LAST_LITERALS;
+        //The position of the last sequence seen with each hash
+        uint32_t table[1 << LZ4_HASH_LOG];
+        memset(table, 0, sizeof(table));
+        
+        ip++;
+        while (ip < mflimit) {
+            uint32_t sequence = LZ4Read32(ip);
+            uint32_t hash = LZ4Hash(sequence);
+            const uint8_t *match = source + table[hash];
+            table[hash] = (uint32_t)(ip - source);
+            
+            if (match >= ip || (size_t)(ip - match) > LZ4_MAX_OFFSET || LZ4Read32(match) != sequence) {
+                //Skip faster through data that does not compress
+                ip += 1 + ((size_t)(ip - anchor) >> 6);
+                continue;
+            }
+            
+            //Extend the match backwards over the literals, then forwards.
+            while (ip > anchor && match > source && ip[-1] == match[-1]) {
+                ip--;
+                match--;
+            }
+            const uint8_t *matchEnd = ip + LZ4_MIN_MATCH;
+            const uint8_t *reference = match + LZ4_MIN_MATCH;
+            while (matchEnd < matchlimit && *matchEnd == *reference) {
+                matchEnd++;
+                reference++;
+            }
+            
+            op = LZ4WriteSequence(op, oend, anchor, (size_t)(ip - anchor), (size_t)(ip - match), (size_t)(matchEnd - ip));
+            if (op == NULL) {
+                return 0;
+            }
+            
+            //Remember a position inside the match, so the next runs are found.
+            if (matchEnd - 2 > source) {
+                table[LZ4Hash(LZ4Read32(matchEnd - 2))] = (uint32_t)(matchEnd - 2 - source);
+            }
+            ip = matchEnd;
+            anchor = ip;
+        }
+    }
+    
+    //The remaining bytes are literals
+    op = LZ4WriteSequence(op, oend, anchor, (size_t)(iend - anchor), 0, 0);
+    if (op == NULL) {
+        return 0;
+    }
+    return (size_t)(op - destination);
+}
+
+/**
+ Read the extra bytes of a literal or match length. Returns NO if the data ends first.
+ */
+static inline BOOL LZ4ReadLength(const uint8_t **ip, const uint8_t *iend, size_t *length)
+{
+    uint8_t byte;
+    do {
+        if (*ip >= iend) {
+            return NO;
+        }
+        byte = *(*ip)++;
+        *length += byte;
+    } while (byte == 255);
+    return YES;
+}
+
+BOOL PDFKLZ4Decompress(const uint8_t *source, size_t sourceLength, uint8_t *destination, size_t destinationLength)
+{
+    const uint8_t *ip = source;
+    const uint8_t *iend = source + sourceLength;
+    uint8_t *op = destination;
+    uint8_t *oend = destination + destinationLength;
+    
+    while (ip < iend) {
+        uint8_t token = *ip++;
+        
+        //Literals
+        size_t length = token >> 4;
+        if (length == 15 && LZ4ReadLength(&ip, iend, &length) == NO) {
+            return NO;
+        }
+        if (length > (size_t)(iend - ip) || length > (size_t)(oend - op)) {
+            return NO;
+        }
+        memcpy(op, ip, length);
+        op += length;
+        ip += length;
+        
+        //The last sequence has no match
+        if (ip == iend) {
+            break;
+        }
+        
+        //Match
+        if (iend - ip < 2) {
+            return NO;
+        }
+        size_t offset = (size_t)ip[0] | ((size_t)ip[1] << 8);
+        ip += 2;
+        if (offset == 0 || offset > (size_t)(op - destination)) {
+            return NO;
+        }
+        length = token & 0x0F;
+        if (length == 15 && LZ4ReadLength(&ip, iend, &length) == NO) {
+            return NO;
+        }
+        length += LZ4_MIN_MATCH;
+        if (length > (size_t)(oend - op)) {
+            return NO;
+        }
+        
+        const uint8_t *match = op - offset;
+        if (offset >= length) {
+            memcpy(op, match, length);
+            op += length;
+        } else {
+            //The match overlaps the output, it repeats the last offset bytes.
+            while (length--) {
+                *op++ = *match++;
+            }
+        }
+    }
+    
+    return (op == oend);
+}
+
+#pragma mark Thumb Files
+
+NSData *PDFKThumbCodecEncodeBitmap(const void *pixels, size_t width, size_t height, size_t bytesPerRow, BOOL compress)
+{
+    if (pixels == NULL || width == 0 || height == 0 || bytesPerRow < width * 4) {
+        return nil;
+    }
+    size_t pixelLength = bytesPerRow * height;
+    if (pixelLength > UINT32_MAX) {
+        return nil;
+    }
+    
+    //Room for the header and the uncompressed pixels. Compressed pixels that do not fit are not worth keeping.
+    NSMutableData *data = [NSMutableData dataWithLength:sizeof(PDFKThumbFileHeader) + pixelLength];
+    uint8_t *payload = (uint8_t *)data.mutableBytes + sizeof(PDFKThumbFileHeader);
+    
+    size_t payloadLength = (compress ? PDFKLZ4Compress(pixels, pixelLength, payload, pixelLength - 1) : 0);
+    uint16_t flags = 0;
+    if (payloadLength > 0) {
+        flags |= THUMB_FLAG_COMPRESSED;
+        data.length = sizeof(PDFKThumbFileHeader) + payloadLength;
+    } else {
+        memcpy(payload, pixels, pixelLength);
+        payloadLength = pixelLength;
+    }
+    
+    PDFKThumbFileHeader header;
+    header.magic = OSSwapHostToLittleInt32(THUMB_MAGIC);
+    header.version = OSSwapHostToLittleInt16(THUMB_VERSION);
+    header.flags = OSSwapHostToLittleInt16(flags);
+    header.width = OSSwapHostToLittleInt32((uint32_t)width);
+    header.height = OSSwapHostToLittleInt32((uint32_t)height);
+    header.bytesPerRow = OSSwapHostToLittleInt32((uint32_t)bytesPerRow);
+    header.bitmapInfo = OSSwapHostToLittleInt32((uint32_t)PDFKThumbCodecBitmapInfo);
+    header.pixelLength = OSSwapHostToLittleInt32((uint32_t)pixelLength);
+    header.payloadLength = OSSwapHostToLittleInt32((uint32_t)payloadLength);
+    memcpy(data.mutableBytes, &header, sizeof(header));
+    
+    return data;
+}
+
+NSData *PDFKThumbCodecEncodeImage(CGImageRef image, BOOL compress)
+{
+    if (image == NULL) {
+        return nil;
+    }
+    size_t width = CGImageGetWidth(image);
+    size_t height = CGImageGetHeight(image);
+    
+    //Already in the right layout, use the pixels as they are.
+    if (CGImageGetBitmapInfo(image) == PDFKThumbCodecBitmapInfo && CGImageGetBitsPerPixel(image) == 32 && CGImageGetBitsPerComponent(image) == 8) {
+        CFDataRef pixels = CGDataProviderCopyData(CGImageGetDataProvider(image));
+        if (pixels != NULL) {
+            NSData *data = nil;
+            if ((size_t)CFDataGetLength(pixels) >= CGImageGetBytesPerRow(image) * height) {
+                data = PDFKThumbCodecEncodeBitmap(CFDataGetBytePtr(pixels), width, height, CGImageGetBytesPerRow(image), compress);
+            }
+            CFRelease(pixels);
+            if (data != nil) {
+                return data;
+            }
+        }
+    }
+    
+    //Redraw in the right layout
+    CGColorSpaceRef rgb = CGColorSpaceCreateDeviceRGB();
+    CGContextRef context = CGBitmapContextCreate(NULL, width, height, 8, 0, rgb, PDFKThumbCodecBitmapInfo);
+    CGColorSpaceRelease(rgb);
+    if (context == NULL) {
+        return nil;
+    }
+    CGContextDrawImage(context, CGRectMake(0.0f, 0.0f, width, height), image);
+    NSData *data = PDFKThumbCodecEncodeBitmap(CGBitmapContextGetData(context), width, height, CGBitmapContextGetBytesPerRow(context), compress);
+    CGContextRelease(context);
+    return data;
+}
+
+/**
+ Read and validate the header of a thumb file.
+ */
+static BOOL PDFKThumbCodecReadHeader(NSData *data, PDFKThumbFileHeader *header)
+{
+    if (data.length < sizeof(PDFKThumbFileHeader)) {
+        return NO;
+    }
+    memcpy(header, data.bytes, sizeof(PDFKThumbFileHeader));
+    header->magic = OSSwapLittleToHostInt32(header->magic);
+    header->version = OSSwapLittleToHostInt16(header->version);
+    header->flags = OSSwapLittleToHostInt16(header->flags);
+    header->width = OSSwapLittleToHostInt32(header->width);
+    header->height = OSSwapLittleToHostInt32(header->height);
+    header->bytesPerRow = OSSwapLittleToHostInt32(header->bytesPerRow);
+    header->bitmapInfo = OSSwapLittleToHostInt32(header->bitmapInfo);
+    header->pixelLength = OSSwapLittleToHostInt32(header->pixelLength);
+    header->payloadLength = OSSwapLittleToHostInt32(header->payloadLength);
+    
+    //Check that the file is complete and consistent
+    if (header->magic != THUMB_MAGIC || header->version != THUMB_VERSION || header->bitmapInfo != PDFKThumbCodecBitmapInfo) {
+        return NO;
+    }
+    if (header->width == 0 || header->height == 0 || header->bytesPerRow < (uint64_t)header->width * 4) {
+        return NO;
+    }
+    if ((uint64_t)header->bytesPerRow * header->height != header->pixelLength) {
+        return NO;
+    }
+    if (data.length - sizeof(PDFKThumbFileHeader) < header->payloadLength) {
+        return NO;
+    }
+    if ((header->flags & THUMB_FLAG_COMPRESSED) == 0 && header->payloadLength != header->pixelLength) {
+        return NO;
+    }
+    return YES;
+}
+
+BOOL PDFKThumbCodecGetInfo(NSData *data, PDFKThumbCodecInfo *info)
+{
+    PDFKThumbFileHeader header;
+    if (PDFKThumbCodecReadHeader(data, &header) == NO) {
+        return NO;
+    }
+    if (info != NULL) {
+        info->width = header.width;
+        info->height = header.height;
+        info->bytesPerRow = header.bytesPerRow;
+        info->compressed = ((header.flags & THUMB_FLAG_COMPRESSED) != 0);
+    }
+    return YES;
+}
+
+BOOL PDFKThumbCodecDecode(NSData *data, void *buffer, size_t bufferLength)
+{
+    PDFKThumbFileHeader header;
+    if (buffer == NULL || PDFKThumbCodecReadHeader(data, &header) == NO || bufferLength < header.pixelLength) {
+        return NO;
+    }
+    const uint8_t *payload = (const uint8_t *)data.bytes + sizeof(PDFKThumbFileHeader);
+    if (header.flags & THUMB_FLAG_COMPRESSED) {
+        return PDFKLZ4Decompress(payload, header.payloadLength, buffer, header.pixelLength);
+    }
+    memcpy(buffer, payload, header.pixelLength);
+    return YES;
+}
+
+static void PDFKThumbCodecReleaseData(void *info, const void *data, size_t size)
+{
+    CFRelease(info);
+}
+
+CGImageRef PDFKThumbCodecCreateImage(NSData *data)
+{
+    PDFKThumbFileHeader header;
+    if (PDFKThumbCodecReadHeader(data, &header) == NO) {
+        return NULL;
+    }
+    
+    if (header.flags & THUMB_FLAG_COMPRESSED) {
+        //Decode once, into a pooled buffer the image keeps.
+        void *pixels = PDFKPixelBufferAllocate(header.pixelLength);
+        if (pixels == NULL) {
+            return NULL;
+        }
+        if (PDFKThumbCodecDecode(data, pixels, header.pixelLength) == NO) {
+            PDFKPixelBufferRelease(pixels);
+            return NULL;
+        }
+        return PDFKPixelBufferCreateImage(pixels, header.width, header.height, header.bytesPerRow, PDFKThumbCodecBitmapInfo);
+    }
+    
+    //Use the pixels in place, the image keeps the data alive.
+    const uint8_t *pixels = (const uint8_t *)data.bytes + sizeof(PDFKThumbFileHeader);
+    CGDataProviderRef provider = CGDataProviderCreateWithData((void *)CFBridgingRetain(data), pixels, header.pixelLength, PDFKThumbCodecReleaseData);
+    if (provider == NULL) {
+        CFRelease((__bridge CFTypeRef)data);
+        return NULL;
+    }
+    
+    CGColorSpaceRef rgb = CGColorSpaceCreateDeviceRGB();
+    CGImageRef image = CGImageCreate(header.width, header.height, 8, 32, header.bytesPerRow, rgb, PDFKThumbCodecBitmapInfo, provider, NULL, false, kCGRenderingIntentDefault);
+    CGColorSpaceRelease(rgb);
+    CGDataProviderRelease(provider);
+    return image;
+}
+
+CGImageRef PDFKThumbCodecCreateImageWithURL(NSURL *url)
+{
+    //Read the file now, so drawing the image never waits on the disk.
+    NSData *data = [NSData dataWithContentsOfURL:url options:0 error:NULL];
+    if (data == nil) {
+        return NULL;
+    }
+    return PDFKThumbCodecCreateImage(data);
+}
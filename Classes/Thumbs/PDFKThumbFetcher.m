@@ -28,7 +28,12 @@
 #import "PDFKThumbCache.h"
 #import "PDFKThumbView.h"
 #import "PDFKThumbRequest.h"
-#import <ImageIO/ImageIO.h>
+#import "PDFKTrace.h"
+#import "PDFKThumbCodec.h"
+#import "PDFKThumbFileIO.h"
+
+//The number of following pages whose thumbs are read ahead
+#define READ_AHEAD_PAGES 8
 
 @implementation PDFKThumbFetcher
 {
@@ -49,35 +54,62 @@
 {
     //Cancel and clean up
 	[super cancel];
+	PDFKTraceCounterAdd(PDFKTraceCounterCancelled, 1);
 	request.thumbView.operation = nil;
 	request.thumbView = nil;
 	[[PDFKThumbCache sharedCache] removeNullForKey:request.cacheKey];
 }
 
-- (NSURL *)thumbFileURL
+- (NSString *)thumbFilePathForRequest:(PDFKThumbRequest *)thumbRequest
 {
-    //Get the path to the png file.
-	NSString *cachePath = [PDFKThumbCache thumbCachePathForGUID:request.guid];
-	NSString *fileName = [NSString stringWithFormat:@"%@.png", request.thumbName];
-	return [NSURL fileURLWithPath:[cachePath stringByAppendingPathComponent:fileName]];
+    //Get the path to the thumb file.
+	NSString *cachePath = [PDFKThumbCache thumbCachePathForGUID:thumbRequest.guid];
+	NSString *fileName = [thumbRequest.thumbName stringByAppendingPathExtension:PDFKThumbCodecPathExtension];
+	return [cachePath stringByAppendingPathComponent:fileName];
 }
 
 - (void)main
 {
+    //The file is read on the I/O threads, the fetch queue moves on to the next thumb.
+    PDFKThumbFileIOPriority priority = (self.queuePriority >= NSOperationQueuePriorityNormal ? PDFKThumbFileIOPriorityVisible : PDFKThumbFileIOPriorityReadAhead);
+    [[PDFKThumbFileIO sharedFileIO] readFileAtPath:[self thumbFilePathForRequest:request] priority:priority completion:^(NSData *data) {
+        [self showThumbWithData:data];
+    }];
+    [self readAhead];
+}
+
+/**
+ Load the thumbs of the next pages into the cache, they are likely to be shown next. Thumbs that are not on disk are not rendered.
+ */
+- (void)readAhead
+{
+    PDFKThumbCache *cache = [PDFKThumbCache sharedCache];
+    for (NSInteger page = request.thumbPage + 1; page <= request.thumbPage + READ_AHEAD_PAGES; page++) {
+        PDFKThumbRequest *nextRequest = [PDFKThumbRequest newForView:nil fileURL:request.fileURL password:request.password guid:request.guid page:page size:request.thumbSize];
+        if ([cache objectForKey:nextRequest.cacheKey] != nil) {
+            continue;
+        }
+        [[PDFKThumbFileIO sharedFileIO] readFileAtPath:[self thumbFilePathForRequest:nextRequest] priority:PDFKThumbFileIOPriorityReadAhead completion:^(NSData *data) {
+            CGImageRef imageRef = (data != nil ? PDFKThumbCodecCreateImage(data) : NULL);
+            if (imageRef != NULL) {
+                //A fetch that started since is waiting on this read, and shows the thumb.
+                if ([cache objectForKey:nextRequest.cacheKey] == nil) {
+                    [cache setObject:[UIImage imageWithCGImage:imageRef scale:[UIScreen mainScreen].scale orientation:UIImageOrientationUp] forKey:nextRequest.cacheKey];
+                }
+                CGImageRelease(imageRef);
+            }
+        }];
+    }
+}
+
+- (void)showThumbWithData:(NSData *)data
+{
+	uint64_t decodeStart = PDFKTraceBegin();
+    //The pixels are stored ready to draw, there is nothing to decompress but LZ4.
+	CGImageRef imageRef = (data != nil ? PDFKThumbCodecCreateImage(data) : NULL);
     
-	CGImageRef imageRef = NULL;
-    
-    //Get the existing thumb image
-    //Get the URL of the file to load.
-    NSURL *thumbURL = [self thumbFileURL];
-	CGImageSourceRef loadRef = CGImageSourceCreateWithURL((__bridge CFURLRef)thumbURL, NULL);
-    
-    //If the image file exists, load it
-	if (loadRef != NULL) {
-		imageRef = CGImageSourceCreateImageAtIndex(loadRef, 0, NULL); // Load it
-		CFRelease(loadRef);
-        
-	} else {
+    //If the image file does not exist, render it
+	if (imageRef == NULL) {
         // Existing thumb image not found - so create and queue up a thumb render operation on the work queue
 		PDFKThumbRenderer *thumbRender = [[PDFKThumbRenderer alloc] initWithRequest:request];
 		[thumbRender setQueuePriority:self.queuePriority];
@@ -96,15 +128,10 @@
     //Create a UIImage from a CGImage and show it
 	if (imageRef != NULL) {
         
-		UIImage *image = [UIImage imageWithCGImage:imageRef scale:[UIScreen mainScreen].scale orientation:UIImageOrientationUp];
+		UIImage *decoded = [UIImage imageWithCGImage:imageRef scale:[UIScreen mainScreen].scale orientation:UIImageOrientationUp];
         // Release the CGImage reference from the above thumb load code
 		CGImageRelease(imageRef);
-        
-        //Decode and draw the image on this background thread, The image is not decoded until it is drawn, Lets get it decoded now.
-		UIGraphicsBeginImageContextWithOptions(image.size, YES, [UIScreen mainScreen].scale);
-		[image drawAtPoint:CGPointZero];
-		UIImage *decoded = UIGraphicsGetImageFromCurrentImageContext();
-		UIGraphicsEndImageContext();
+		PDFKTraceEnd(PDFKTraceStageDecode, decodeStart, request.thumbPage);
         
         //Cache
 		[[PDFKThumbCache sharedCache] setObject:decoded forKey:request.cacheKey];
@@ -0,0 +1,71 @@
+/*
+ //  PDFKThumbFileIO.h
+ //  M13PDFKit
+ //
+ Copyright (c) 2014 Brandon McQuilkin
+ 
+ Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated documentation files (the
+ "Software"), to deal in the Software without restriction, including without limitation the rights to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software, and to permit persons to whom the Software is furnished to do so, subject to
+ the following conditions:
+ 
+ The above copyright notice and this permission notice shall be included in all copies or substantial portions of the Software.
+ 
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+
+#import <Foundation/Foundation.h>
+
+/**
+ How soon a thumb file read is needed.
+ */
+typedef NS_ENUM(NSInteger, PDFKThumbFileIOPriority) {
+    /**
+     A thumb view is waiting for the file.
+     */
+    PDFKThumbFileIOPriorityVisible = 0,
+    /**
+     The file is read ahead, in case its thumb is shown soon.
+     */
+    PDFKThumbFileIOPriorityReadAhead
+};
+
+/**
+ Reads and writes thumb files on a small pool of threads, so the fetch and render queues never wait on the disk.
+ 
+ Reads are taken from the pending requests in batches. The whole batch is opened and the kernel is told to read each file ahead before the first one is read, so the reads of a batch are in flight together instead of one after another. Reads for files that are being read are merged, and reads of files that are being written are answered with the data being written.
+ 
+ The completion blocks are called on the I/O threads, so they can decode the file and put the thumb in the cache directly.
+ */
+@interface PDFKThumbFileIO : NSObject
+
+/**
+ The shared thumb file I/O.
+ 
+ @return The instance of PDFKThumbFileIO.
+ */
++ (PDFKThumbFileIO *)sharedFileIO;
+/**
+ Read a file.
+ 
+ @param path       The path of the file.
+ @param priority   How soon the file is needed. Visible reads are done before read ahead. A visible read of a file that is being read ahead raises the priority of that read.
+ @param completion Called on an I/O thread with the contents of the file, or nil if it could not be read.
+ */
+- (void)readFileAtPath:(NSString *)path priority:(PDFKThumbFileIOPriority)priority completion:(void (^)(NSData *data))completion;
+/**
+ Write a file. The file is replaced once it is completely written.
+ 
+ Writes of the same file are never done at the same time. A write that has not started is replaced by a newer write of the same file, and its completion is called with NO.
+ 
+ @param data       The contents of the file.
+ @param path       The path of the file.
+ @param completion Called on an I/O thread once the file is written, with the size of the file that was replaced, or 0 if there was none. May be nil.
+ */
+- (void)writeData:(NSData *)data toPath:(NSString *)path completion:(void (^)(BOOL written, unsigned long long replacedBytes))completion;
+/**
+ Block until all the pending reads and writes are done.
+ */
+- (void)waitUntilIdle;
+
+@end
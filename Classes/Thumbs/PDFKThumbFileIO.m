@@ -0,0 +1,341 @@
+/*
+ //  PDFKThumbFileIO.m
+ //  M13PDFKit
+ //
+ Copyright (c) 2014 Brandon McQuilkin
+ 
+ Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated documentation files (the
+ "Software"), to deal in the Software without restriction, including without limitation the rights to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software, and to permit persons to whom the Software is furnished to do so, subject to
+ the following conditions:
+ 
+ The above copyright notice and this permission notice shall be included in all copies or substantial portions of the Software.
+ 
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+
+#import "PDFKThumbFileIO.h"
+#import "PDFKTrace.h"
+#import <fcntl.h>
+#import <unistd.h>
+#import <sys/stat.h>
+
+//The number of threads reading and writing files
+#define MAXIMUM_IO_THREADS 4
+//The number of reads a thread takes at a time
+#define READ_BATCH_SIZE 8
+//The largest thumb file that is read
+#define MAXIMUM_THUMB_FILE_SIZE (16 * 1024 * 1024)
+
+/**
+ A pending read or write of a file.
+ */
+@interface PDFKThumbFileIORequest : NSObject
+
+@property (nonatomic, copy) NSString *path;
+@property (nonatomic, assign) PDFKThumbFileIOPriority priority;
+/**
+ The data to write, nil for reads.
+ */
+@property (nonatomic, strong) NSData *data;
+/**
+ The completion blocks of all the reads merged into this request.
+ */
+@property (nonatomic, strong) NSMutableArray *completions;
+
+@end
+
+@implementation PDFKThumbFileIORequest
+
+@end
+
+#pragma mark - Reading
+
+/**
+ Read a file that is open, into a buffer that the returned data owns.
+ */
+static NSData *PDFKReadOpenFile(int fd)
+{
+    struct stat status;
+    if (fstat(fd, &status) != 0 || status.st_size <= 0 || status.st_size > MAXIMUM_THUMB_FILE_SIZE) {
+        return nil;
+    }
+    size_t length = (size_t)status.st_size;
+    uint8_t *bytes = malloc(length);
+    size_t done = 0;
+    while (bytes != NULL && done < length) {
+        ssize_t count = pread(fd, bytes + done, length - done, (off_t)done);
+        if (count < 0 && errno == EINTR) {
+            continue;
+        }
+        if (count <= 0) {
+            break;
+        }
+        done += (size_t)count;
+    }
+    if (bytes == NULL || done != length) {
+        free(bytes);
+        return nil;
+    }
+    return [NSData dataWithBytesNoCopy:bytes length:length freeWhenDone:YES];
+}
+
+/**
+ Read a batch of files. All the files are opened, and the reads are started, before waiting on the first file.
+ */
+static void PDFKReadFiles(NSArray *paths, NSData *__strong *results)
+{
+    int descriptors[READ_BATCH_SIZE];
+    NSUInteger count = MIN(paths.count, (NSUInteger)READ_BATCH_SIZE);
+    for (NSUInteger index = 0; index < count; index++) {
+        descriptors[index] = open([paths[index] fileSystemRepresentation], O_RDONLY);
+        if (descriptors[index] < 0) {
+            continue;
+        }
+#ifdef F_RDADVISE
+        //Start reading the whole file in the background
+        struct stat status;
+        if (fstat(descriptors[index], &status) == 0 && status.st_size > 0 && status.st_size <= MAXIMUM_THUMB_FILE_SIZE) {
+            struct radvisory advisory;
+            advisory.ra_offset = 0;
+            advisory.ra_count = (int)status.st_size;
+            fcntl(descriptors[index], F_RDADVISE, &advisory);
+        }
+#endif
+    }
+    for (NSUInteger index = 0; index < count; index++) {
+        results[index] = nil;
+        if (descriptors[index] >= 0) {
+            results[index] = PDFKReadOpenFile(descriptors[index]);
+            close(descriptors[index]);
+        }
+    }
+}
+
+#pragma mark - File I/O
+
+@implementation PDFKThumbFileIO
+{
+    /**
+     The reads that have not started, visible reads first.
+     */
+    NSMutableArray *pendingReads;
+    /**
+     The writes that have not started.
+     */
+    NSMutableArray *pendingWrites;
+    /**
+     The reads that have not finished, by path.
+     */
+    NSMutableDictionary *reads;
+    /**
+     The writes that have not finished, by path.
+     */
+    NSMutableDictionary *writes;
+    /**
+     The paths of the files that are being written.
+     */
+    NSMutableSet *writingPaths;
+    NSUInteger activeThreads;
+    dispatch_group_t group;
+}
+
++ (PDFKThumbFileIO *)sharedFileIO
+{
+    static dispatch_once_t onceToken;
+    static PDFKThumbFileIO *fileIO;
+    dispatch_once(&onceToken, ^{
+        fileIO = [self new];
+    });
+    return fileIO;
+}
+
+- (id)init
+{
+    if ((self = [super init])) {
+        pendingReads = [NSMutableArray new];
+        pendingWrites = [NSMutableArray new];
+        reads = [NSMutableDictionary new];
+        writes = [NSMutableDictionary new];
+        writingPaths = [NSMutableSet new];
+        group = dispatch_group_create();
+    }
+    return self;
+}
+
+- (void)readFileAtPath:(NSString *)path priority:(PDFKThumbFileIOPriority)priority completion:(void (^)(NSData *data))completion
+{
+    NSData *writing = nil;
+    @synchronized(self) {
+        PDFKThumbFileIORequest *request = reads[path];
+        writing = ((PDFKThumbFileIORequest *)writes[path]).data;
+        if (writing == nil && request != nil) {
+            //Merge with the read of the file
+            [request.completions addObject:[completion copy]];
+            if (priority < request.priority && [pendingReads containsObject:request]) {
+                [pendingReads removeObjectIdenticalTo:request];
+                request.priority = priority;
+                [self insertPendingRead:request];
+            }
+            return;
+        }
+        if (writing == nil) {
+            request = [PDFKThumbFileIORequest new];
+            request.path = path;
+            request.priority = priority;
+            request.completions = [NSMutableArray arrayWithObject:[completion copy]];
+            reads[path] = request;
+            [self insertPendingRead:request];
+            [self startThreadIfNeeded];
+        }
+    }
+    
+    //The file is not on disk yet
+    if (writing != nil) {
+        completion(writing);
+    }
+}
+
+- (void)writeData:(NSData *)data toPath:(NSString *)path completion:(void (^)(BOOL written, unsigned long long replacedBytes))completion
+{
+    NSArray *superseded = nil;
+    @synchronized(self) {
+        //The newer data replaces a write of the file that has not started
+        PDFKThumbFileIORequest *pending = writes[path];
+        if (pending != nil && [pendingWrites indexOfObjectIdenticalTo:pending] != NSNotFound) {
+            [pendingWrites removeObjectIdenticalTo:pending];
+            superseded = pending.completions;
+        }
+        
+        PDFKThumbFileIORequest *request = [PDFKThumbFileIORequest new];
+        request.path = path;
+        request.data = data;
+        request.completions = [NSMutableArray new];
+        if (completion != nil) {
+            [request.completions addObject:[completion copy]];
+        }
+        writes[path] = request;
+        [pendingWrites addObject:request];
+        [self startThreadIfNeeded];
+    }
+    
+    for (void (^supersededCompletion)(BOOL written, unsigned long long replacedBytes) in superseded) {
+        supersededCompletion(NO, 0);
+    }
+}
+
+- (void)waitUntilIdle
+{
+    dispatch_group_wait(group, DISPATCH_TIME_FOREVER);
+}
+
+/**
+ Add a read after the pending reads of the same priority. Must be called in @synchronized(self).
+ */
+- (void)insertPendingRead:(PDFKThumbFileIORequest *)request
+{
+    NSUInteger index = pendingReads.count;
+    while (index > 0 && ((PDFKThumbFileIORequest *)pendingReads[index - 1]).priority > request.priority) {
+        index--;
+    }
+    [pendingReads insertObject:request atIndex:index];
+}
+
+/**
+ Must be called in @synchronized(self).
+ */
+- (void)startThreadIfNeeded
+{
+    if (activeThreads >= MAXIMUM_IO_THREADS) {
+        return;
+    }
+    activeThreads++;
+    dispatch_group_async(group, dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_DEFAULT, 0), ^{
+        [self performPendingRequests];
+    });
+}
+
+- (void)performPendingRequests
+{
+    while (YES) {
+        NSArray *batch = nil;
+        PDFKThumbFileIORequest *write = nil;
+        @synchronized(self) {
+            //A write of a file that is being written waits for that write to finish.
+            NSUInteger writeIndex = [pendingWrites indexOfObjectPassingTest:^BOOL(PDFKThumbFileIORequest *request, NSUInteger index, BOOL *stop) {
+                return ([writingPaths containsObject:request.path] == NO);
+            }];
+            
+            //Visible reads, then writes, then read ahead.
+            PDFKThumbFileIORequest *first = pendingReads.firstObject;
+            if (first != nil && (first.priority == PDFKThumbFileIOPriorityVisible || writeIndex == NSNotFound)) {
+                NSUInteger count = 0;
+                while (count < MIN(pendingReads.count, (NSUInteger)READ_BATCH_SIZE) && ((PDFKThumbFileIORequest *)pendingReads[count]).priority == first.priority) {
+                    count++;
+                }
+                batch = [pendingReads subarrayWithRange:NSMakeRange(0, count)];
+                [pendingReads removeObjectsInRange:NSMakeRange(0, count)];
+            } else if (writeIndex != NSNotFound) {
+                //Later writes of the file wait until this one is done
+                write = pendingWrites[writeIndex];
+                [pendingWrites removeObjectAtIndex:writeIndex];
+                [writingPaths addObject:write.path];
+            } else {
+                activeThreads--;
+                return;
+            }
+        }
+        
+        if (batch != nil) {
+            [self performReads:batch];
+        } else {
+            [self performWrite:write];
+        }
+    }
+}
+
+- (void)performReads:(NSArray *)batch
+{
+    NSData *__strong results[READ_BATCH_SIZE];
+    uint64_t traceStart = PDFKTraceBegin();
+    PDFKReadFiles([batch valueForKey:@"path"], results);
+    PDFKTraceEnd(PDFKTraceStageDiskRead, traceStart, 0);
+    
+    for (NSUInteger index = 0; index < batch.count; index++) {
+        PDFKThumbFileIORequest *request = batch[index];
+        NSArray *completions = nil;
+        @synchronized(self) {
+            //No more reads are merged into this one once it is removed.
+            completions = [request.completions copy];
+            [reads removeObjectForKey:request.path];
+        }
+        for (void (^completion)(NSData *data) in completions) {
+            completion(results[index]);
+        }
+        results[index] = nil;
+    }
+}
+
+- (void)performWrite:(PDFKThumbFileIORequest *)request
+{
+    //The size of the file being replaced, so it is not counted twice
+    struct stat status;
+    unsigned long long replacedBytes = ((stat([request.path fileSystemRepresentation], &status) == 0 && status.st_size > 0) ? (unsigned long long)status.st_size : 0);
+    
+    uint64_t traceStart = PDFKTraceBegin();
+    BOOL written = [request.data writeToFile:request.path atomically:YES];
+    PDFKTraceEnd(PDFKTraceStageDiskWrite, traceStart, 0);
+    
+    @synchronized(self) {
+        [writingPaths removeObject:request.path];
+        //A later write of the same file replaces this one
+        if (writes[request.path] == request) {
+            [writes removeObjectForKey:request.path];
+        }
+    }
+    for (void (^completion)(BOOL written, unsigned long long replacedBytes) in request.completions) {
+        completion(written, (written ? replacedBytes : 0));
+    }
+}
+
+@end
@@ -24,6 +24,8 @@
 //
 
 #import "PDFKThumbQueue.h"
+#import "PDFKTrace.h"
+#import "PDFKRenderGuard.h"
 
 @implementation PDFKThumbQueue
 {
@@ -50,7 +52,8 @@
         
 		workQueue = [NSOperationQueue new];
 		[workQueue setName:@"PDFKThumbWorkQueue"];
-		[workQueue setMaxConcurrentOperationCount:1];
+		//More than one worker, so a page that hangs while drawing does not stop the other thumbs
+		[workQueue setMaxConcurrentOperationCount:[PDFKRenderGuard workerCount]];
 	}
     
 	return self;
@@ -61,6 +64,7 @@
 	if ([operation isKindOfClass:[PDFKThumbOperation class]])
 	{
 		[fetchQueue addOperation:operation];
+		PDFKTraceCounterSet(PDFKTraceCounterFetchQueueDepth, fetchQueue.operationCount);
 	}
 }
 
@@ -69,6 +73,7 @@
 	if ([operation isKindOfClass:[PDFKThumbOperation class]])
 	{
 		[workQueue addOperation:operation];
+		PDFKTraceCounterSet(PDFKTraceCounterWorkQueueDepth, workQueue.operationCount);
 	}
 }
 
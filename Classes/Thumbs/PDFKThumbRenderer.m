@@ -28,7 +28,12 @@
 #import "PDFKThumbCache.h"
 #import "PDFKThumbView.h"
 #import "CGPDFDocument.h"
-#import <ImageIO/ImageIO.h>
+#import "PDFKTrace.h"
+#import "PDFKThumbCacheManifest.h"
+#import "PDFKThumbCodec.h"
+#import "PDFKPixelBufferPool.h"
+#import "PDFKThumbFileIO.h"
+#import "PDFKImageCache.h"
 
 @implementation PDFKThumbRenderer
 {
@@ -49,6 +54,7 @@
 {
     //Cancel and clean up
 	[super cancel];
+	PDFKTraceCounterAdd(PDFKTraceCounterCancelled, 1);
 	_request.thumbView.operation = nil;
 	_request.thumbView = nil;
 	[[PDFKThumbCache sharedCache] removeNullForKey:_request.cacheKey];
@@ -60,7 +66,7 @@
 	NSFileManager *fileManager = [NSFileManager new];
 	NSString *cachePath = [PDFKThumbCache thumbCachePathForGUID:_request.guid];
     [fileManager createDirectoryAtPath:cachePath withIntermediateDirectories:NO attributes:nil error:NULL];
-	NSString *fileName = [NSString stringWithFormat:@"%@.png", _request.thumbName];
+	NSString *fileName = [_request.thumbName stringByAppendingPathExtension:PDFKThumbCodecPathExtension];
     //Assemble the url
 	return [NSURL fileURLWithPath:[cachePath stringByAppendingPathComponent:fileName]];
 }
@@ -72,14 +78,24 @@
     NSString *password = _request.password;
     
 	CGImageRef imageRef = NULL;
+    //The pixels of the image, from the pixel buffer pool
+	const void *pixels = NULL;
+	size_t bytesPerRow = 0;
     
+    //Time spent, in case the work is thrown away
+	uint64_t workNanoseconds = 0;
+    
+	uint64_t traceStart = PDFKTraceBegin();
 	CGPDFDocumentRef thePDFDocRef = CGPDFDocumentCreate(_request.fileURL, password);
+	workNanoseconds += PDFKTraceEnd(PDFKTraceStageOpen, traceStart, page);
     
     // Check for non-NULL CGPDFDocumentRef
 	if (thePDFDocRef != NULL) {
         
         //Get the page
+		traceStart = PDFKTraceBegin();
 		CGPDFPageRef thePDFPageRef = CGPDFDocumentGetPage(thePDFDocRef, page);
+		workNanoseconds += PDFKTraceEnd(PDFKTraceStagePageFetch, traceStart, page);
         
         // Check for non-NULL CGPDFPageRef
 		if (thePDFPageRef != NULL) {
@@ -143,9 +159,12 @@
             target_h *= [UIScreen mainScreen].scale;
             
             //Rendering setup
+			traceStart = PDFKTraceBegin();
 			CGColorSpaceRef rgb = CGColorSpaceCreateDeviceRGB();
-			CGBitmapInfo bmi = (kCGBitmapByteOrder32Little | kCGImageAlphaNoneSkipFirst);
-			CGContextRef context = CGBitmapContextCreate(NULL, target_w, target_h, 8, 0, rgb, bmi);
+			CGBitmapInfo bmi = PDFKThumbCodecBitmapInfo;
+			bytesPerRow = PDFKPixelBufferBytesPerRow(target_w);
+			void *buffer = PDFKPixelBufferAllocate(bytesPerRow * target_h);
+			CGContextRef context = (buffer != NULL ? CGBitmapContextCreate(buffer, target_w, target_h, 8, bytesPerRow, rgb, bmi) : NULL);
             
              // Must have a valid custom CGBitmap context to draw into
 			if (context != NULL) {
@@ -161,22 +180,26 @@
 				CGContextConcatCTM(context, CGPDFPageGetDrawingTransform(thePDFPageRef, kCGPDFCropBox, thumbRect, 0, true));
                 
                 //Render
-				CGContextDrawPDFPage(context, thePDFPageRef);
-                
-                //Get the image
-				imageRef = CGBitmapContextCreateImage(context);
+				PDFKImageCacheDrawPage(context, thePDFPageRef);
                 
                 //Cleanup
 				CGContextRelease(context);
+                
+                //Get the image, it keeps the buffer.
+				imageRef = PDFKPixelBufferCreateImage(buffer, target_w, target_h, bytesPerRow, bmi);
+				pixels = (imageRef != NULL ? buffer : NULL);
+			} else {
+				PDFKPixelBufferRelease(buffer);
 			}
             //More cleaning
 			CGColorSpaceRelease(rgb);
+			workNanoseconds += PDFKTraceEnd(PDFKTraceStageRasterize, traceStart, page);
 		}
         //Even more cleaning
 		CGPDFDocumentRelease(thePDFDocRef);
 	}
     
-    //Create UIImage from CGImage and show it, then save thumb as PNG
+    //Create UIImage from CGImage and show it, then save the thumb
 	if (imageRef != NULL) {
         
 		UIImage *image = [UIImage imageWithCGImage:imageRef scale:[UIScreen mainScreen].scale orientation:UIImageOrientationUp];
@@ -199,17 +222,19 @@
 			
 		}
         
-        //Save the thumb to file.
-		CFURLRef thumbURL = (__bridge CFURLRef)[self thumbFileURL];
-		CGImageDestinationRef thumbRef = CGImageDestinationCreateWithURL(thumbURL, (CFStringRef)@"public.png", 1, NULL);
+        //Encode the thumb
+		traceStart = PDFKTraceBegin();
+		NSData *thumbData = PDFKThumbCodecEncodeBitmap(pixels, CGImageGetWidth(imageRef), CGImageGetHeight(imageRef), bytesPerRow, YES);
+		PDFKTraceEnd(PDFKTraceStageEncode, traceStart, page);
         
-		if (thumbRef != NULL)
-		{
-            //Write to file
-			CGImageDestinationAddImage(thumbRef, imageRef, NULL);
-			CGImageDestinationFinalize(thumbRef);
-            //Cleanup
-			CFRelease(thumbRef);
+        //Save the thumb to file, without holding up the next render.
+		if (thumbData != nil) {
+			NSString *guid = _request.guid;
+			[[PDFKThumbFileIO sharedFileIO] writeData:thumbData toPath:[[self thumbFileURL] path] completion:^(BOOL written, unsigned long long replacedBytes) {
+				if (written) {
+					[[PDFKThumbCacheManifest sharedManifest] addBytes:thumbData.length replacingBytes:replacedBytes toCacheWithGUID:guid];
+				}
+			}];
 		}
         //Cleanup
 		CGImageRelease(imageRef);
@@ -218,6 +243,11 @@
 		[[PDFKThumbCache sharedCache] removeNullForKey:_request.cacheKey];
 	}
     
+    //The thumb is cached, but it was not shown.
+	if (self.isCancelled) {
+		PDFKTraceCounterAdd(PDFKTraceCounterCancelledNanoseconds, workNanoseconds);
+	}
+    
     //Done!
 	_request.thumbView.operation = nil;
 }
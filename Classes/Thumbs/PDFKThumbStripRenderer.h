@@ -0,0 +1,59 @@
+/*
+ //  PDFKThumbStripRenderer.h
+ //  M13PDFKit
+ //
+ Copyright (c) 2014 Brandon McQuilkin
+ 
+ Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated documentation files (the
+ "Software"), to deal in the Software without restriction, including without limitation the rights to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software, and to permit persons to whom the Software is furnished to do so, subject to
+ the following conditions:
+ 
+ The above copyright notice and this permission notice shall be included in all copies or substantial portions of the Software.
+ 
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#import <UIKit/UIKit.h>
+#import "PDFKThumbQueue.h"
+
+/**
+ Returns the page displaied by the thumb at the given position in a strip of evenly spaced thumbs.
+ 
+ @param thumb      The zero based position of the thumb in the strip.
+ @param thumbCount The number of thumbs in the strip.
+ @param pageCount  The number of pages in the document.
+ 
+ @return The page number of the thumb.
+ */
+NSInteger PDFKThumbStripPageForThumb(NSInteger thumb, NSInteger thumbCount, NSInteger pageCount);
+
+/**
+ Composites a strip of small page thumbs into a single image. The strip is cached on disk, so it is only rendered once per document, thumb count and thumb size.
+ */
+@interface PDFKThumbStripRenderer : PDFKThumbOperation
+
+/**
+ Initalize the strip renderer, on the main thread.
+ 
+ @param fileURL    The URL of the PDF file.
+ @param phrase     The password to unlock the PDF file.
+ @param guid       The GUID of the PDF document.
+ @param pageCount  The number of pages in the PDF document.
+ @param thumbCount The number of thumbs in the strip.
+ @param thumbSize  The size of each thumb in the strip.
+ @param gap        The space between each thumb.
+ @param completion The block to call on the main thread with the strip image. The image is nil if the strip could not be created. A strip with thumbs missing, because the document could not be opened, is returned but not cached.
+ 
+ @return A new strip renderer.
+ */
+- (id)initWithFileURL:(NSURL *)fileURL password:(NSString *)phrase guid:(NSString *)guid pageCount:(NSInteger)pageCount thumbCount:(NSInteger)thumbCount thumbSize:(CGSize)thumbSize gap:(CGFloat)gap completion:(void (^)(UIImage *strip))completion;
+/**
+ The number of thumbs in the strip.
+ */
+@property (nonatomic, assign, readonly) NSInteger thumbCount;
+/**
+ The size of the strip in points.
+ */
+@property (nonatomic, assign, readonly) CGSize stripSize;
+
+@end
@@ -0,0 +1,243 @@
+/*
+ //  PDFKThumbStripRenderer.m
+ //  M13PDFKit
+ //
+ Copyright (c) 2014 Brandon McQuilkin
+ 
+ Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated documentation files (the
+ "Software"), to deal in the Software without restriction, including without limitation the rights to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software, and to permit persons to whom the Software is furnished to do so, subject to
+ the following conditions:
+ 
+ The above copyright notice and this permission notice shall be included in all copies or substantial portions of the Software.
+ 
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#import "PDFKThumbStripRenderer.h"
+#import "PDFKThumbCache.h"
+#import "PDFKThumbCacheManifest.h"
+#import "CGPDFDocument.h"
+#import "PDFKThumbCodec.h"
+#import "PDFKPixelBufferPool.h"
+#import "PDFKImageCache.h"
+#import <ImageIO/ImageIO.h>
+
+NSInteger PDFKThumbStripPageForThumb(NSInteger thumb, NSInteger thumbCount, NSInteger pageCount)
+{
+    NSInteger strideThumbs = (thumbCount - 1);
+    if (strideThumbs < 1) strideThumbs = 1;
+    
+    //Page stride
+    CGFloat stride = ((CGFloat)pageCount / (CGFloat)strideThumbs);
+    NSInteger page = ((stride * thumb) + 1);
+    if (page > pageCount) page = pageCount;
+    return page;
+}
+
+static inline CGRect AspectFitRect(CGSize size, CGRect bounds)
+{
+    CGFloat scale = MIN(bounds.size.width / size.width, bounds.size.height / size.height);
+    CGSize fit = CGSizeMake(floor(size.width * scale), floor(size.height * scale));
+    return CGRectMake(bounds.origin.x + floor((bounds.size.width - fit.width) / 2.0f), bounds.origin.y + floor((bounds.size.height - fit.height) / 2.0f), fit.width, fit.height);
+}
+
+@implementation PDFKThumbStripRenderer
+{
+    NSURL *_fileURL;
+    NSString *_password;
+    NSInteger _pageCount;
+    CGSize _thumbSize;
+    CGFloat _gap;
+    /**
+     The screen scale, read on the main thread when the operation is created.
+     */
+    CGFloat _scale;
+    void (^_completion)(UIImage *strip);
+}
+
+- (id)initWithFileURL:(NSURL *)fileURL password:(NSString *)phrase guid:(NSString *)guid pageCount:(NSInteger)pageCount thumbCount:(NSInteger)thumbCount thumbSize:(CGSize)thumbSize gap:(CGFloat)gap completion:(void (^)(UIImage *))completion
+{
+    if ((self = [super initWithGUID:guid])) {
+        _fileURL = [fileURL copy];
+        _password = [phrase copy];
+        _pageCount = pageCount;
+        _thumbCount = thumbCount;
+        _thumbSize = thumbSize;
+        _gap = gap;
+        _scale = [UIScreen mainScreen].scale;
+        _completion = [completion copy];
+        _stripSize = CGSizeMake((thumbCount * (thumbSize.width + gap)) - gap, thumbSize.height);
+    }
+    return self;
+}
+
+- (NSString *)cachePath
+{
+    NSFileManager *fileManager = [NSFileManager new];
+    NSString *cachePath = [PDFKThumbCache thumbCachePathForGUID:self.guid];
+    [fileManager createDirectoryAtPath:cachePath withIntermediateDirectories:NO attributes:nil error:NULL];
+    return cachePath;
+}
+
+- (NSURL *)stripFileURL
+{
+    //One strip per thumb count and thumb size
+    NSString *fileName = [NSString stringWithFormat:@"Strip-%04ld-%04ldx%04ld.png", (long)_thumbCount, (long)_thumbSize.width, (long)_thumbSize.height];
+    return [NSURL fileURLWithPath:[[self cachePath] stringByAppendingPathComponent:fileName]];
+}
+
+- (NSURL *)thumbFileURLForPage:(NSInteger)page
+{
+    //Same name that PDFKThumbRequest uses for the thumb.
+    NSString *fileName = [NSString stringWithFormat:@"%07ld-%04ldx%04ld.%@", (long)page, (long)_thumbSize.width, (long)_thumbSize.height, PDFKThumbCodecPathExtension];
+    return [NSURL fileURLWithPath:[[self cachePath] stringByAppendingPathComponent:fileName]];
+}
+
+- (CGImageRef)newImageAtURL:(NSURL *)url
+{
+    CGImageRef imageRef = NULL;
+    CGImageSourceRef sourceRef = CGImageSourceCreateWithURL((__bridge CFURLRef)url, NULL);
+    if (sourceRef != NULL) {
+        //Decode now, not when it is first drawn.
+        NSDictionary *options = @{(NSString *)kCGImageSourceShouldCacheImmediately: @YES};
+        imageRef = CGImageSourceCreateImageAtIndex(sourceRef, 0, (__bridge CFDictionaryRef)options);
+        CFRelease(sourceRef);
+    }
+    return imageRef;
+}
+
+/**
+ Composite the strip. complete is set to NO if a thumb could not be drawn, because the document could not be opened.
+ */
+- (CGImageRef)newStripImageComplete:(BOOL *)complete
+{
+    *complete = YES;
+    CGFloat scale = _scale;
+    size_t width = (size_t)(_stripSize.width * scale);
+    size_t height = (size_t)(_stripSize.height * scale);
+    if (width == 0 || height == 0) {
+        return NULL;
+    }
+    
+    CGBitmapInfo bitmapInfo = (kCGBitmapByteOrder32Little | kCGImageAlphaPremultipliedFirst);
+    size_t bytesPerRow = PDFKPixelBufferBytesPerRow(width);
+    void *buffer = PDFKPixelBufferAllocate(bytesPerRow * height);
+    if (buffer == NULL) {
+        return NULL;
+    }
+    //Pooled buffers are not cleared
+    memset(buffer, 0, bytesPerRow * height);
+    
+    CGColorSpaceRef rgb = CGColorSpaceCreateDeviceRGB();
+    CGContextRef context = CGBitmapContextCreate(buffer, width, height, 8, bytesPerRow, rgb, bitmapInfo);
+    CGColorSpaceRelease(rgb);
+    if (context == NULL) {
+        PDFKPixelBufferRelease(buffer);
+        return NULL;
+    }
+    
+    //The document is only opened if a thumb is not in the cache.
+    CGPDFDocumentRef documentRef = NULL;
+    
+    CGRect cellRect = CGRectMake(0.0f, 0.0f, _thumbSize.width * scale, _thumbSize.height * scale);
+    for (NSInteger thumb = 0; thumb < _thumbCount; thumb++) {
+        if (self.isCancelled) {
+            break;
+        }
+        NSInteger page = PDFKThumbStripPageForThumb(thumb, _thumbCount, _pageCount);
+        
+        CGImageRef thumbRef = PDFKThumbCodecCreateImageWithURL([self thumbFileURLForPage:page]);
+        if (thumbRef != NULL) {
+            //Use the existing thumb
+            CGRect fitRect = AspectFitRect(CGSizeMake(CGImageGetWidth(thumbRef), CGImageGetHeight(thumbRef)), cellRect);
+            CGContextDrawImage(context, fitRect, thumbRef);
+            CGImageRelease(thumbRef);
+        } else {
+            //Render the page
+            if (documentRef == NULL) {
+                documentRef = CGPDFDocumentCreate(_fileURL, _password);
+                if (documentRef == NULL) {
+                    *complete = NO;
+                    break;
+                }
+            }
+            CGPDFPageRef pageRef = CGPDFDocumentGetPage(documentRef, page);
+            if (pageRef != NULL) {
+                CGRect cropBoxRect = CGPDFPageGetBoxRect(pageRef, kCGPDFCropBox);
+                NSInteger rotation = CGPDFPageGetRotationAngle(pageRef);
+                CGSize pageSize = ((rotation == 90 || rotation == 270) ? CGSizeMake(cropBoxRect.size.height, cropBoxRect.size.width) : cropBoxRect.size);
+                CGRect fitRect = AspectFitRect(pageSize, cellRect);
+                
+                CGContextSaveGState(context);
+                CGContextSetRGBFillColor(context, 1.0f, 1.0f, 1.0f, 1.0f);
+                CGContextFillRect(context, fitRect);
+                CGContextClipToRect(context, fitRect);
+                CGContextConcatCTM(context, CGPDFPageGetDrawingTransform(pageRef, kCGPDFCropBox, fitRect, 0, true));
+                PDFKImageCacheDrawPage(context, pageRef);
+                CGContextRestoreGState(context);
+            }
+        }
+        
+        //Next thumb
+        cellRect.origin.x += (_thumbSize.width + _gap) * scale;
+    }
+    
+    //Cleanup
+    CGPDFDocumentRelease(documentRef);
+    CGContextRelease(context);
+    
+    //The image keeps the buffer
+    CGImageRef imageRef = NULL;
+    if (self.isCancelled) {
+        PDFKPixelBufferRelease(buffer);
+    } else {
+        imageRef = PDFKPixelBufferCreateImage(buffer, width, height, bytesPerRow, bitmapInfo);
+    }
+    
+    return imageRef;
+}
+
+- (void)main
+{
+    NSURL *stripURL = [self stripFileURL];
+    
+    //Load the existing strip, or create it.
+    CGImageRef imageRef = [self newImageAtURL:stripURL];
+    if (imageRef == NULL && self.isCancelled == NO) {
+        BOOL complete = NO;
+        imageRef = [self newStripImageComplete:&complete];
+        
+        //Save the strip for next time. A partial strip is shown, but not kept.
+        if (imageRef != NULL && complete) {
+            //A strip that could not be loaded may still be on disk
+            NSFileManager *fileManager = [NSFileManager new];
+            unsigned long long replacedBytes = [[fileManager attributesOfItemAtPath:stripURL.path error:NULL] fileSize];
+            CGImageDestinationRef destinationRef = CGImageDestinationCreateWithURL((__bridge CFURLRef)stripURL, (CFStringRef)@"public.png", 1, NULL);
+            if (destinationRef != NULL) {
+                CGImageDestinationAddImage(destinationRef, imageRef, NULL);
+                CGImageDestinationFinalize(destinationRef);
+                CFRelease(destinationRef);
+                
+                NSDictionary *attributes = [fileManager attributesOfItemAtPath:stripURL.path error:NULL];
+                [[PDFKThumbCacheManifest sharedManifest] addBytes:[attributes fileSize] replacingBytes:replacedBytes toCacheWithGUID:self.guid];
+            }
+        }
+    }
+    
+    UIImage *image = nil;
+    if (imageRef != NULL) {
+        image = [UIImage imageWithCGImage:imageRef scale:_scale orientation:UIImageOrientationUp];
+        CGImageRelease(imageRef);
+    }
+    
+    //Return the strip
+    if (self.isCancelled == NO && _completion != nil) {
+        void (^completion)(UIImage *strip) = _completion;
+        dispatch_async(dispatch_get_main_queue(), ^{
+            completion(image);
+        });
+    }
+    _completion = nil;
+}
+
+@end
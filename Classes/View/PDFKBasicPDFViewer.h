@@ -14,9 +14,9 @@
 */
 
 #import <UIKit/UIKit.h>
+#import "PDFKBasicPDFViewerSinglePageCollectionView.h"
 @class PDFKDocument;
 @class PDFKPageScrubber;
-@class PDFKBasicPDFViewerSinglePageCollectionView;
 @class PDFKBasicPDFViewerThumbsCollectionView;
 
 typedef void (^PDFKBasicPDFViewerPageChangeBlock)(NSUInteger page);
@@ -83,6 +83,10 @@ typedef void (^PDFKBasicPDFViewerPageChangeBlock)(NSUInteger page);
  If false, a done button is added to the toolbar.
  */
 @property (nonatomic, assign) BOOL standalone;
+/**
+ How the pages are displayed. Set it before the view loads.
+ */
+@property (nonatomic, assign) PDFKPageDisplayMode pageDisplayMode;
 
 /**
  The toolbar displaied at the top of the screen.
@@ -19,6 +19,9 @@
 #import "PDFKPageContentView.h"
 #import "PDFKBasicPDFViewerThumbsCollectionView.h"
 #import "PDFKBasicPDFViewerSinglePageCollectionView.h"
+#import "PDFKPageExporter.h"
+#import "PDFKPageSet.h"
+#import "PDFKSessionRecorder.h"
 #import <TTOpenInAppActivity/TTOpenInAppActivity.h>
 
 
@@ -100,7 +103,7 @@
     _showingSinglePage = YES;
     
     //Create the single page view
-    _pageCollectionView = [[PDFKBasicPDFViewerSinglePageCollectionView alloc] initWithFrame:self.view.bounds andDocument:_document];
+    _pageCollectionView = [[PDFKBasicPDFViewerSinglePageCollectionView alloc] initWithFrame:self.view.bounds document:_document displayMode:_pageDisplayMode];
     _pageCollectionView.translatesAutoresizingMaskIntoConstraints = NO;
     _pageCollectionView.singlePageDelegate = self;
     [self.view addSubview:_pageCollectionView];
@@ -185,7 +188,7 @@
 - (void)didReceiveMemoryWarning
 {
     [super didReceiveMemoryWarning];
-    // Dispose of any resources that can be recreated.
+    // Dispose of any resources that can be recreated. The resource governor sheds its consumers for the same event.
 }
 
 #pragma mark - Layout
@@ -335,14 +338,59 @@
 }
 
 - (void)send
+{
+    if (_document.pageCount <= 1) {
+        [self presentActivityViewControllerWithURL:_document.fileURL];
+        return;
+    }
+    
+    //Choose what to send
+    UIAlertController *alertController = [UIAlertController alertControllerWithTitle:nil message:nil preferredStyle:UIAlertControllerStyleActionSheet];
+    [alertController addAction:[UIAlertAction actionWithTitle:@"Send Document" style:UIAlertActionStyleDefault handler:^(UIAlertAction *action) {
+        [self presentActivityViewControllerWithURL:_document.fileURL];
+    }]];
+    [alertController addAction:[UIAlertAction actionWithTitle:@"Send This Page" style:UIAlertActionStyleDefault handler:^(UIAlertAction *action) {
+        PDFKPageSet *pages = [PDFKPageSet pageSet];
+        [pages addIndex:_document.currentPage];
+        [self sendPages:pages name:[NSString stringWithFormat:@"Page %lu", (unsigned long)_document.currentPage]];
+    }]];
+    if (_document.bookmarks.count > 0) {
+        [alertController addAction:[UIAlertAction actionWithTitle:@"Send Bookmarked Pages" style:UIAlertActionStyleDefault handler:^(UIAlertAction *action) {
+            [self sendPages:[_document.bookmarks copy] name:@"Bookmarks"];
+        }]];
+    }
+    [alertController addAction:[UIAlertAction actionWithTitle:@"Cancel" style:UIAlertActionStyleCancel handler:nil]];
+    alertController.popoverPresentationController.barButtonItem = _shareItem;
+    [self presentViewController:alertController animated:YES completion:NULL];
+}
+
+- (void)sendPages:(PDFKPageSet *)pages name:(NSString *)name
+{
+    //Export the pages off the main thread, large documents take a moment.
+    NSString *fileName = [NSString stringWithFormat:@"%@ (%@).pdf", [_document.fileURL.lastPathComponent stringByDeletingPathExtension], name];
+    NSString *path = [NSTemporaryDirectory() stringByAppendingPathComponent:fileName];
+    NSURL *documentURL = _document.fileURL;
+    _shareItem.enabled = NO;
+    dispatch_async(dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_DEFAULT, 0), ^{
+        PDFKPageExporter *exporter = [[PDFKPageExporter alloc] initWithFilePath:documentURL.path];
+        BOOL exported = [exporter exportPages:pages toPath:path];
+        dispatch_async(dispatch_get_main_queue(), ^{
+            _shareItem.enabled = YES;
+            //Send the whole document if the pages could not be exported
+            [self presentActivityViewControllerWithURL:(exported ? [NSURL fileURLWithPath:path isDirectory:NO] : documentURL)];
+        });
+    });
+}
+
+- (void)presentActivityViewControllerWithURL:(NSURL *)url
 {
     UIActivityViewController *activityViewController;
     TTOpenInAppActivity *openInAppActivity;
     if (_enableOpening) {
         openInAppActivity = [[TTOpenInAppActivity alloc] initWithView:self.view andBarButtonItem:_shareItem];
-        activityViewController = [[UIActivityViewController alloc] initWithActivityItems:@[_document.fileURL] applicationActivities:@[openInAppActivity]];
+        activityViewController = [[UIActivityViewController alloc] initWithActivityItems:@[url] applicationActivities:@[openInAppActivity]];
     } else {
-        activityViewController = [[UIActivityViewController alloc] initWithActivityItems:@[_document.fileURL] applicationActivities:nil];
+        activityViewController = [[UIActivityViewController alloc] initWithActivityItems:@[url] applicationActivities:nil];
     }
     
     if (!_enablePrinting) {
@@ -433,6 +481,8 @@
 
 - (void)singlePageCollectionView:(PDFKBasicPDFViewerSinglePageCollectionView *)collectionView didDisplayPage:(NSUInteger)page
 {
+    [[PDFKSessionRecorder sharedRecorder] recordEvent:PDFKSessionEventPageDisplay page:page count:1];
+    
     if (self.document.currentPage != page) {
         self.document.currentPage = page;
         [self.pageScrubber updateScrubber];
@@ -498,6 +548,18 @@
     //Check to see if the document was clicked.
     if (gestureRecognizer.state == UIGestureRecognizerStateRecognized && _showingSinglePage) {
         if (gestureRecognizer.numberOfTapsRequired == 1) {
+            //Follow a link on the page, if one was tapped
+            for (PDFKBasicPDFViewerSinglePageCollectionViewCell *cell in [_pageCollectionView visibleCells]) {
+                id target = [cell.pageContentView processSingleTap:gestureRecognizer];
+                if ([target isKindOfClass:[NSNumber class]]) {
+                    [self displayPage:[target unsignedIntegerValue]];
+                    return;
+                } else if ([target isKindOfClass:[NSURL class]]) {
+                    [[UIApplication sharedApplication] openURL:target];
+                    return;
+                }
+            }
+
             //Check what side the touch is on
             CGPoint touch = [gestureRecognizer locationInView:self.view];
             
@@ -520,7 +582,11 @@
 - (void)handleDoubleTap:(UITapGestureRecognizer *)gestureRecognizer
 {
     if (gestureRecognizer.state == UIGestureRecognizerStateRecognized) {
-        if (gestureRecognizer.numberOfTouchesRequired == 1) {
+        if (_pageCollectionView.displayMode != PDFKPageDisplayModeSinglePage) {
+            //Zoom the column of pages
+            CGFloat scale = (gestureRecognizer.numberOfTouchesRequired == 1 ? 2.0 : 0.5);
+            _pageCollectionView.pageZoomScale = _pageCollectionView.pageZoomScale * scale;
+        } else if (gestureRecognizer.numberOfTouchesRequired == 1) {
             //Zoom in
             PDFKBasicPDFViewerSinglePageCollectionViewCell *cell = [_pageCollectionView visibleCells][0];
             [cell.pageContentView zoomIncrement];
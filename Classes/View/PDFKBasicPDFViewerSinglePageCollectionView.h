@@ -19,6 +19,24 @@
 @class PDFKDocument;
 @class PDFKBasicPDFViewerSinglePageCollectionView;
 
+/**
+ How the pages are displayed.
+ */
+typedef NS_ENUM(NSInteger, PDFKPageDisplayMode) {
+    /**
+     One page at a time, swiping between pages.
+     */
+    PDFKPageDisplayModeSinglePage = 0,
+    /**
+     The pages in a continuous vertical column.
+     */
+    PDFKPageDisplayModeContinuous,
+    /**
+     Two page spreads in a continuous vertical column. The first page is on its own.
+     */
+    PDFKPageDisplayModeContinuousSpreads
+};
+
 @protocol PDFKBasicPDFViewerSinglePageCollectionViewDelegate <NSObject>
 /**
  Notifies the delegate that the collection view did display a page. This allows the main controller to update bookmarks.
@@ -33,6 +51,24 @@
 @interface PDFKBasicPDFViewerSinglePageCollectionView : UICollectionView
 
 - (id)initWithFrame:(CGRect)frame andDocument:(PDFKDocument *)document;
+/**
+ Create a page collection view.
+ 
+ @param frame       The frame of the view.
+ @param document    The document to display.
+ @param displayMode How to display the pages.
+ 
+ @return A new page collection view.
+ */
+- (id)initWithFrame:(CGRect)frame document:(PDFKDocument *)document displayMode:(PDFKPageDisplayMode)displayMode;
+/**
+ How the pages are displayed.
+ */
+@property (nonatomic, assign, readonly) PDFKPageDisplayMode displayMode;
+/**
+ The width of the pages relative to the width of the view, in the continuous modes. Pinching changes it.
+ */
+@property (nonatomic, assign) CGFloat pageZoomScale;
 /**
  The current page that is being displaied.
  */
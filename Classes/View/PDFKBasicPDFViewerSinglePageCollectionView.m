@@ -16,6 +16,12 @@
 #import "PDFKBasicPDFViewerSinglePageCollectionView.h"
 #import "PDFKDocument.h"
 #import "PDFKPageContentView.h"
+#import "PDFKPageContentViewPool.h"
+#import "PDFKContinuousPageLayout.h"
+
+//The range of the zoom scale in the continuous modes
+#define MINIMUM_CONTINUOUS_ZOOM 1.0
+#define MAXIMUM_CONTINUOUS_ZOOM 4.0
 
 @interface PDFKBasicPDFViewerSinglePageCollectionView () <UICollectionViewDataSource, UICollectionViewDelegate, UICollectionViewDelegateFlowLayout, UIScrollViewDelegate>
 
@@ -23,28 +29,53 @@
 
 @property (nonatomic, strong) NSArray *bookmarkedPages;
 
+@property (nonatomic, strong) PDFKPageContentViewPool *pageViewPool;
+
+@property (nonatomic, strong) PDFKContinuousPageLayout *continuousLayout;
+
 @end
 
 @implementation PDFKBasicPDFViewerSinglePageCollectionView
 
 - (id)initWithFrame:(CGRect)frame andDocument:(PDFKDocument *)document
 {
-    UICollectionViewFlowLayout *layout = [[UICollectionViewFlowLayout alloc] init];
-    layout.scrollDirection = UICollectionViewScrollDirectionHorizontal;
-    layout.sectionInset = UIEdgeInsetsMake(0.0, 0.0, 0.0, 0.0);
-    layout.minimumLineSpacing = 0.0;
-    layout.minimumInteritemSpacing = 0.0;
-    
-    self.pagingEnabled = YES;
+    return [self initWithFrame:frame document:document displayMode:PDFKPageDisplayModeSinglePage];
+}
+
+- (id)initWithFrame:(CGRect)frame document:(PDFKDocument *)document displayMode:(PDFKPageDisplayMode)displayMode
+{
+    UICollectionViewLayout *layout = nil;
+    PDFKContinuousPageLayout *continuousLayout = nil;
+    if (displayMode == PDFKPageDisplayModeSinglePage) {
+        UICollectionViewFlowLayout *flowLayout = [[UICollectionViewFlowLayout alloc] init];
+        flowLayout.scrollDirection = UICollectionViewScrollDirectionHorizontal;
+        flowLayout.sectionInset = UIEdgeInsetsMake(0.0, 0.0, 0.0, 0.0);
+        flowLayout.minimumLineSpacing = 0.0;
+        flowLayout.minimumInteritemSpacing = 0.0;
+        layout = flowLayout;
+    } else {
+        continuousLayout = [[PDFKContinuousPageLayout alloc] initWithDocument:document spreads:(displayMode == PDFKPageDisplayModeContinuousSpreads)];
+        layout = continuousLayout;
+    }
     
     self = [super initWithFrame:frame collectionViewLayout:layout];
     
     if (self) {
+        _displayMode = displayMode;
+        _continuousLayout = continuousLayout;
         self.backgroundColor = [UIColor groupTableViewBackgroundColor];
         self.showsHorizontalScrollIndicator = NO;
+        self.pagingEnabled = (displayMode == PDFKPageDisplayModeSinglePage);
+        
+        //Pinching resizes the pages in the continuous modes
+        if (continuousLayout != nil) {
+            UIPinchGestureRecognizer *pinchGestureRecognizer = [[UIPinchGestureRecognizer alloc] initWithTarget:self action:@selector(handlePinch:)];
+            [self addGestureRecognizer:pinchGestureRecognizer];
+        }
         
         [self registerClass:[PDFKBasicPDFViewerSinglePageCollectionViewCell class] forCellWithReuseIdentifier:@"ContentCell"];
         _document = document;
+        _pageViewPool = [[PDFKPageContentViewPool alloc] initWithDocument:document];
         
         self.dataSource = self;
         self.delegate = self;
@@ -55,10 +86,59 @@
 
 - (void)displayPage:(NSUInteger)page animated:(BOOL)animated
 {
+    if (_continuousLayout != nil) {
+        //Scroll the top of the page to the top of the view
+        CGRect frame = [_continuousLayout.pageLayout frameForPage:page];
+        CGFloat maximumY = MAX(self.contentSize.height - self.bounds.size.height + self.contentInset.bottom, -self.contentInset.top);
+        CGFloat y = MIN(frame.origin.y - _continuousLayout.pageLayout.pageSpacing - self.contentInset.top, maximumY);
+        [self setContentOffset:CGPointMake(self.contentOffset.x, y) animated:animated];
+        return;
+    }
     NSIndexPath *indexPath = [NSIndexPath indexPathForItem:(page - 1) inSection:0];
     [self scrollToItemAtIndexPath:indexPath atScrollPosition:UICollectionViewScrollPositionCenteredHorizontally animated:animated];
 }
 
+- (void)layoutSubviews
+{
+    //The pages are rendered to fit the view, not each cell. Set before the cells are resized, so they render at the new size.
+    CGSize viewportSize = self.bounds.size;
+    viewportSize.height -= self.contentInset.top + self.contentInset.bottom;
+    _pageViewPool.viewportSize = viewportSize;
+    
+    [super layoutSubviews];
+}
+
+- (NSUInteger)currentPage
+{
+    if (_continuousLayout != nil) {
+        //The page in the middle of the view
+        CGFloat middle = self.contentOffset.y + self.contentInset.top + ((self.bounds.size.height - self.contentInset.top - self.contentInset.bottom) / 2.0);
+        return MAX([_continuousLayout.pageLayout pageAtOffset:middle], (NSUInteger)1);
+    }
+    return (self.contentOffset.x + self.frame.size.width) / self.frame.size.width;
+}
+
+#pragma mark Zoom
+
+- (CGFloat)pageZoomScale
+{
+    return (_continuousLayout != nil ? _continuousLayout.zoomScale : 1.0);
+}
+
+- (void)setPageZoomScale:(CGFloat)pageZoomScale
+{
+    _continuousLayout.zoomScale = MIN(MAX(pageZoomScale, MINIMUM_CONTINUOUS_ZOOM), MAXIMUM_CONTINUOUS_ZOOM);
+}
+
+- (void)handlePinch:(UIPinchGestureRecognizer *)gestureRecognizer
+{
+    if (gestureRecognizer.state == UIGestureRecognizerStateChanged) {
+        //Only the visible pages are laid out again, so this can follow the fingers.
+        self.pageZoomScale = self.pageZoomScale * gestureRecognizer.scale;
+        gestureRecognizer.scale = 1.0;
+    }
+}
+
 - (NSInteger)numberOfSectionsInCollectionView:(UICollectionView *)collectionView
 {
     return 1;
@@ -80,38 +160,85 @@
 - (UICollectionViewCell *)collectionView:(UICollectionView *)collectionView cellForItemAtIndexPath:(NSIndexPath *)indexPath
 {
     PDFKBasicPDFViewerSinglePageCollectionViewCell *cell = [self dequeueReusableCellWithReuseIdentifier:@"ContentCell" forIndexPath:indexPath];
-    
+    cell.contentView.autoresizingMask = UIViewAutoresizingFlexibleHeight|UIViewAutoresizingFlexibleWidth;
+    [self bindContentToCell:cell atIndexPath:indexPath];
+    return cell;
+}
+
+- (void)collectionView:(UICollectionView *)collectionView willDisplayCell:(UICollectionViewCell *)cell forItemAtIndexPath:(NSIndexPath *)indexPath
+{
+    //A prefetched cell that scrolled off and back is displayed again without being configured, and its content was returned to the pool.
+    PDFKBasicPDFViewerSinglePageCollectionViewCell *pageCell = (PDFKBasicPDFViewerSinglePageCollectionViewCell *)cell;
+    if (pageCell.pageContentView == nil) {
+        [self bindContentToCell:pageCell atIndexPath:indexPath];
+    }
+}
+
+- (void)bindContentToCell:(PDFKBasicPDFViewerSinglePageCollectionViewCell *)cell atIndexPath:(NSIndexPath *)indexPath
+{
     CGRect contentSize = CGRectZero;
-    contentSize.size = [self collectionView:self layout:self.collectionViewLayout sizeForItemAtIndexPath:indexPath];
+    if (_continuousLayout != nil) {
+        contentSize.size = [_continuousLayout layoutAttributesForItemAtIndexPath:indexPath].size;
+    } else {
+        contentSize.size = [self collectionView:self layout:self.collectionViewLayout sizeForItemAtIndexPath:indexPath];
+    }
     
     //Get the page number
     NSInteger page = indexPath.row + 1;
     
-    cell.contentView.autoresizingMask = UIViewAutoresizingFlexibleHeight|UIViewAutoresizingFlexibleWidth;
+    //Recycle the previous content
+    if (cell.pageContentView != nil) {
+        [_pageViewPool recycleView:cell.pageContentView];
+        cell.pageContentView = nil;
+    }
     
     //Load the content
-    cell.pageContentView = [[PDFKPageContentView alloc] initWithFrame:contentSize fileURL:_document.fileURL page:page password:_document.password];
+    cell.pageContentView = [_pageViewPool viewForPage:page frame:contentSize];
+    
+    //The whole column zooms in the continuous modes, not the pages
+    cell.pageContentView.pinchGestureRecognizer.enabled = (_continuousLayout == nil);
         
     //Show the thumb while rendering
-    [cell.pageContentView showPageThumb:_document.fileURL page:(indexPath.item + 1) password:_document.password guid:_document.guid];
+    [cell.pageContentView showPageThumb:_document.fileURL page:(indexPath.item + 1) password:_document.password guid:_document.fingerprint];
     
-    return cell;
+    //Get the neighbouring pages ready
+    [_pageViewPool prefetchPagesAroundPage:page];
+}
+
+- (void)collectionView:(UICollectionView *)collectionView didEndDisplayingCell:(UICollectionViewCell *)cell forItemAtIndexPath:(NSIndexPath *)indexPath
+{
+    //Return the content view to the pool
+    PDFKBasicPDFViewerSinglePageCollectionViewCell *pageCell = (PDFKBasicPDFViewerSinglePageCollectionViewCell *)cell;
+    [_pageViewPool recycleView:pageCell.pageContentView];
+    pageCell.pageContentView = nil;
+}
+
+- (void)didSettleOnCurrentPage
+{
+    //Notify the delegate first, so the move to the page is recorded before the next pages are predicted
+    NSUInteger page = self.currentPage;
+    [_singlePageDelegate singlePageCollectionView:self didDisplayPage:page];
+    [_pageViewPool preloadPredictedPagesAfterPage:page];
 }
 
 - (void)scrollViewDidEndDecelerating:(UIScrollView *)scrollView
 {
     //Get the current page and notify the delegate
-    NSUInteger page = (scrollView.contentOffset.x + scrollView.frame.size.width) / scrollView.frame.size.width;
-    
-    [_singlePageDelegate singlePageCollectionView:self didDisplayPage:page];
+    [self didSettleOnCurrentPage];
 }
 
 - (void)scrollViewDidEndScrollingAnimation:(UIScrollView *)scrollView
 {
     //Get the current page and notify the delegate
-    NSUInteger page = (scrollView.contentOffset.x + scrollView.frame.size.width) / scrollView.frame.size.width;
-    
-    [_singlePageDelegate singlePageCollectionView:self didDisplayPage:page];
+    [self didSettleOnCurrentPage];
+}
+
+- (void)scrollViewDidEndDragging:(UIScrollView *)scrollView willDecelerate:(BOOL)decelerate
+{
+    //Continuous scrolling can stop anywhere
+    if (decelerate == NO && _continuousLayout != nil) {
+        [self didSettleOnCurrentPage];
+    }
 }
 
 @end
@@ -125,11 +252,11 @@
         [_pageContentView removeFromSuperview];
     }
     
+    _pageContentView = pageContentView;
+    
     if (pageContentView == nil) {
         return;
     }
-    
-    _pageContentView = pageContentView;
 
     [self.contentView addSubview:_pageContentView];
 }
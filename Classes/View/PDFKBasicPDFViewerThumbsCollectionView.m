@@ -19,6 +19,7 @@
 #import "PDFKThumbView.h"
 #import "PDFKThumbRequest.h"
 #import "PDFKThumbCache.h"
+#import "PDFKSessionRecorder.h"
 #import <QuartzCore/QuartzCore.h>
 
 @interface PDFKBasicPDFViewerThumbsCollectionView () <UICollectionViewDataSource, UICollectionViewDelegate, UICollectionViewDelegateFlowLayout>
@@ -27,9 +28,9 @@
  */
 @property (nonatomic, strong) PDFKDocument *document;
 /**
- The array of bookmarked pages to display.
+ The set of bookmarked pages to display. A snapshot of the document's bookmarks when they were shown.
  */
-@property (nonatomic, strong) NSArray *bookmarkedPages;
+@property (nonatomic, strong) PDFKPageSet *bookmarkedPages;
 /**
  Wether or not we are showing bookmarked pages.
  */
@@ -65,13 +66,7 @@
 - (void)showBookmarkedPages:(BOOL)show
 {
     if (show) {
-        NSMutableArray *temp = [NSMutableArray array];
-        
-        [_document.bookmarks enumerateIndexesUsingBlock:^(NSUInteger page, BOOL *stop) {
-             [temp addObject:[NSNumber numberWithInteger:page]];
-         }];
-        
-        _bookmarkedPages = [temp copy];
+        _bookmarkedPages = [_document.bookmarks copy];
         _showBookmarkedPages = YES;
         [self reloadData];
     } else {
@@ -87,9 +82,9 @@
         NSIndexPath *indexPath = [NSIndexPath indexPathForItem:(page - 1) inSection:0];
         [self scrollToItemAtIndexPath:indexPath atScrollPosition:UICollectionViewScrollPositionCenteredHorizontally animated:YES];
     } else {
-        NSInteger location = [_bookmarkedPages indexOfObject:[NSNumber numberWithUnsignedInteger:page]];
-        //If it is a bookmarked page.
-        if (location != NSNotFound) {
+        //If it is a bookmarked page, its position is the number of bookmarks before it.
+        if ([_bookmarkedPages containsIndex:page]) {
+            NSInteger location = [_bookmarkedPages rankOfIndex:page] - 1;
             NSIndexPath *indexPath = [NSIndexPath indexPathForItem:location inSection:0];
             [self scrollToItemAtIndexPath:indexPath atScrollPosition:UICollectionViewScrollPositionCenteredHorizontally animated:YES];
         }
@@ -114,14 +109,14 @@
 - (UICollectionViewCell *)collectionView:(UICollectionView *)collectionView cellForItemAtIndexPath:(NSIndexPath *)indexPath
 {
     PDFKBasicPDFViewerThumbsCollectionViewCell *cell = [self dequeueReusableCellWithReuseIdentifier:@"ThumbCell" forIndexPath:indexPath];
-    NSUInteger pageToDisplay = (_showBookmarkedPages ? ((NSNumber *)_bookmarkedPages[indexPath.row]).unsignedIntegerValue : indexPath.row + 1);
+    NSUInteger pageToDisplay = (_showBookmarkedPages ? [_bookmarkedPages indexAtRank:indexPath.row] : indexPath.row + 1);
     
     //Set the page number
     cell.pageNumberLabel.text = [NSString stringWithFormat:@"%li", (unsigned long)pageToDisplay];
     //Show bookmarked
     [cell showBookmark:[_document.bookmarks containsIndex:pageToDisplay]];
     //Load the thumb
-    PDFKThumbRequest *request = [PDFKThumbRequest newForView:cell.thumbView fileURL:_document.fileURL password:_document.password guid:_document.guid page:pageToDisplay size:[self collectionView:self layout:self.collectionViewLayout sizeForItemAtIndexPath:indexPath]];
+    PDFKThumbRequest *request = [PDFKThumbRequest newForView:cell.thumbView fileURL:_document.fileURL password:_document.password guid:_document.fingerprint page:pageToDisplay size:[self collectionView:self layout:self.collectionViewLayout sizeForItemAtIndexPath:indexPath]];
     UIImage *image = [[PDFKThumbCache sharedCache] thumbRequest:request priority:YES];
     
     //If from cache, will return immediatly, with UIImage object, else it is an NSNull object
@@ -139,12 +134,30 @@
     [pageCell.thumbView.operation cancel];
 }
 
+- (void)scrollViewDidScroll:(UIScrollView *)scrollView
+{
+    //Record the visible pages for session replays. Bookmarked pages are not consecutive, they are not recorded.
+    PDFKSessionRecorder *recorder = [PDFKSessionRecorder sharedRecorder];
+    if (recorder.recording == NO || _showBookmarkedPages) {
+        return;
+    }
+    NSInteger first = NSIntegerMax;
+    NSInteger last = 0;
+    for (NSIndexPath *indexPath in [self indexPathsForVisibleItems]) {
+        first = MIN(first, indexPath.row + 1);
+        last = MAX(last, indexPath.row + 1);
+    }
+    if (last > 0) {
+        [recorder recordEvent:PDFKSessionEventThumbsVisible page:first count:(last - first + 1)];
+    }
+}
+
 - (void)collectionView:(UICollectionView *)collectionView didSelectItemAtIndexPath:(NSIndexPath *)indexPath
 {
     if (!_showBookmarkedPages) {
         [self.pageDelegate thumbCollectionView:self didSelectPage:(indexPath.row + 1)];
     } else {
-        NSInteger page = ((NSNumber *)_bookmarkedPages[indexPath.row]).integerValue;\
+        NSInteger page = [_bookmarkedPages indexAtRank:indexPath.row];
         [self.pageDelegate thumbCollectionView:self didSelectPage:page];
     }
 }
@@ -0,0 +1,44 @@
+/*
+ //  PDFKContinuousPageLayout.h
+ //  M13PDFKit
+ //
+ Copyright (c) 2014 Brandon McQuilkin
+ 
+ Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated documentation files (the
+ "Software"), to deal in the Software without restriction, including without limitation the rights to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software, and to permit persons to whom the Software is furnished to do so, subject to
+ the following conditions:
+ 
+ The above copyright notice and this permission notice shall be included in all copies or substantial portions of the Software.
+ 
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#import <UIKit/UIKit.h>
+#import "PDFKPageLayout.h"
+
+@class PDFKDocument;
+
+/**
+ A collection view layout that shows the pages of a document in a continuous vertical column, or in two page spreads. Each item is a page, sized to its aspect ratio. The pages start with the size of the first page, and their actual sizes are read in the background.
+ */
+@interface PDFKContinuousPageLayout : UICollectionViewLayout
+
+/**
+ Create a layout for a document.
+ 
+ @param document The document to lay out.
+ @param spreads  Wether or not to lay out the pages in two page spreads.
+ 
+ @return A new layout.
+ */
+- (id)initWithDocument:(PDFKDocument *)document spreads:(BOOL)spreads;
+/**
+ The page positions.
+ */
+@property (nonatomic, strong, readonly) PDFKPageLayout *pageLayout;
+/**
+ The width of the pages relative to the width of the collection view. Changing it keeps the page at the top of the collection view in place.
+ */
+@property (nonatomic, assign) CGFloat zoomScale;
+
+@end
@@ -0,0 +1,204 @@
+/*
+ //  PDFKContinuousPageLayout.m
+ //  M13PDFKit
+ //
+ Copyright (c) 2014 Brandon McQuilkin
+ 
+ Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated documentation files (the
+ "Software"), to deal in the Software without restriction, including without limitation the rights to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software, and to permit persons to whom the Software is furnished to do so, subject to
+ the following conditions:
+ 
+ The above copyright notice and this permission notice shall be included in all copies or substantial portions of the Software.
+ 
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#import "PDFKContinuousPageLayout.h"
+#import "PDFKDocument.h"
+#import "PDFKPage.h"
+#import "CGPDFDocument.h"
+
+//The number of page sizes read before they are applied
+#define PAGE_SIZE_BATCH 256
+
+@implementation PDFKContinuousPageLayout
+{
+    /**
+     Reads the page sizes.
+     */
+    NSOperationQueue *sizeQueue;
+    /**
+     The page at the top of the collection view before the width changed, and how far into the page the top was, as a fraction of its height.
+     */
+    NSUInteger anchorPage;
+    CGFloat anchorFraction;
+}
+
+- (id)initWithDocument:(PDFKDocument *)document spreads:(BOOL)spreads
+{
+    if ((self = [super init])) {
+        _zoomScale = 1.0;
+        
+        //Estimate with the first page
+        CGSize estimatedSize = CGSizeMake(612.0, 792.0);
+        CGPDFDocumentRef documentRef = CGPDFDocumentCreate(document.fileURL, document.password);
+        if (documentRef != NULL && CGPDFDocumentGetNumberOfPages(documentRef) > 0) {
+            estimatedSize = [PDFKPage viewSizeForPageRef:CGPDFDocumentGetPage(documentRef, 1)];
+        }
+        CGPDFDocumentRelease(documentRef);
+        
+        _pageLayout = [[PDFKPageLayout alloc] initWithPageCount:document.pageCount estimatedPageSize:estimatedSize];
+        _pageLayout.spreads = spreads;
+        
+        sizeQueue = [NSOperationQueue new];
+        [sizeQueue setName:@"PDFKPageSizeQueue"];
+        [sizeQueue setMaxConcurrentOperationCount:1];
+        [self loadPageSizesForDocument:document];
+    }
+    return self;
+}
+
+- (void)dealloc
+{
+    [sizeQueue cancelAllOperations];
+}
+
+#pragma mark Page Sizes
+
+- (void)loadPageSizesForDocument:(PDFKDocument *)document
+{
+    NSURL *fileURL = document.fileURL;
+    NSString *password = document.password;
+    __weak PDFKContinuousPageLayout *weakSelf = self;
+    NSBlockOperation *operation = [NSBlockOperation new];
+    __weak NSBlockOperation *weakOperation = operation;
+    [operation addExecutionBlock:^{
+        CGPDFDocumentRef documentRef = CGPDFDocumentCreate(fileURL, password);
+        if (documentRef == NULL) {
+            return;
+        }
+        size_t pageCount = CGPDFDocumentGetNumberOfPages(documentRef);
+        for (size_t first = 2; first <= pageCount && weakOperation.isCancelled == NO; first += PAGE_SIZE_BATCH) {
+            size_t count = MIN((size_t)PAGE_SIZE_BATCH, (pageCount - first) + 1);
+            NSMutableData *sizes = [NSMutableData dataWithLength:(count * sizeof(CGSize))];
+            CGSize *values = sizes.mutableBytes;
+            for (size_t index = 0; index < count; index++) {
+                values[index] = [PDFKPage viewSizeForPageRef:CGPDFDocumentGetPage(documentRef, first + index)];
+            }
+            dispatch_async(dispatch_get_main_queue(), ^{
+                [weakSelf applyPageSizes:sizes firstPage:first];
+            });
+        }
+        CGPDFDocumentRelease(documentRef);
+    }];
+    [sizeQueue addOperation:operation];
+}
+
+- (void)applyPageSizes:(NSData *)sizes firstPage:(NSUInteger)first
+{
+    //Keep the page at the top of the view in place while the pages above it change size
+    UICollectionView *collectionView = self.collectionView;
+    CGFloat top = collectionView.contentOffset.y + collectionView.contentInset.top;
+    NSUInteger topPage = [_pageLayout pageAtOffset:top];
+    CGFloat topOffset = top - [_pageLayout frameForPage:topPage].origin.y;
+    
+    const CGSize *values = sizes.bytes;
+    NSUInteger count = sizes.length / sizeof(CGSize);
+    for (NSUInteger index = 0; index < count; index++) {
+        [_pageLayout setSize:values[index] forPage:(first + index)];
+    }
+    [self invalidateLayout];
+    
+    if (collectionView != nil && topPage > 0 && first <= topPage) {
+        CGFloat y = [_pageLayout frameForPage:topPage].origin.y + topOffset - collectionView.contentInset.top;
+        collectionView.contentOffset = CGPointMake(collectionView.contentOffset.x, y);
+    }
+}
+
+#pragma mark Zoom
+
+- (void)setZoomScale:(CGFloat)zoomScale
+{
+    if (zoomScale == _zoomScale) {
+        return;
+    }
+    _zoomScale = zoomScale;
+    
+    UICollectionView *collectionView = self.collectionView;
+    if (collectionView == nil) {
+        return;
+    }
+    [self anchorTopPage];
+    _pageLayout.width = collectionView.bounds.size.width * _zoomScale;
+    [self invalidateLayout];
+    collectionView.contentOffset = [self targetContentOffsetForProposedContentOffset:collectionView.contentOffset];
+}
+
+/**
+ Remember the page at the top of the collection view, to keep it there when the width changes.
+ */
+- (void)anchorTopPage
+{
+    UICollectionView *collectionView = self.collectionView;
+    if (_pageLayout.width <= 0.0 || collectionView == nil) {
+        return;
+    }
+    CGFloat top = collectionView.contentOffset.y + collectionView.contentInset.top;
+    anchorPage = [_pageLayout pageAtOffset:top];
+    CGRect frame = [_pageLayout frameForPage:anchorPage];
+    anchorFraction = (frame.size.height > 0.0 ? (top - frame.origin.y) / frame.size.height : 0.0);
+}
+
+#pragma mark Layout
+
+- (void)prepareLayout
+{
+    [super prepareLayout];
+    
+    //Changing the width scales every page, without visiting them.
+    CGFloat width = self.collectionView.bounds.size.width * _zoomScale;
+    if (width != _pageLayout.width) {
+        [self anchorTopPage];
+        _pageLayout.width = width;
+    }
+}
+
+- (CGSize)collectionViewContentSize
+{
+    return _pageLayout.contentSize;
+}
+
+- (NSArray *)layoutAttributesForElementsInRect:(CGRect)rect
+{
+    NSRange pages = [_pageLayout pagesInRect:rect];
+    NSMutableArray *attributes = [NSMutableArray arrayWithCapacity:pages.length];
+    for (NSUInteger page = pages.location; page < NSMaxRange(pages); page++) {
+        [attributes addObject:[self layoutAttributesForItemAtIndexPath:[NSIndexPath indexPathForItem:(page - 1) inSection:0]]];
+    }
+    return attributes;
+}
+
+- (UICollectionViewLayoutAttributes *)layoutAttributesForItemAtIndexPath:(NSIndexPath *)indexPath
+{
+    UICollectionViewLayoutAttributes *attributes = [UICollectionViewLayoutAttributes layoutAttributesForCellWithIndexPath:indexPath];
+    attributes.frame = [_pageLayout frameForPage:(indexPath.item + 1)];
+    return attributes;
+}
+
+- (BOOL)shouldInvalidateLayoutForBoundsChange:(CGRect)newBounds
+{
+    return (newBounds.size.width * _zoomScale != _pageLayout.width);
+}
+
+- (CGPoint)targetContentOffsetForProposedContentOffset:(CGPoint)proposedContentOffset
+{
+    if (anchorPage == 0 || anchorPage > _pageLayout.pageCount) {
+        return proposedContentOffset;
+    }
+    CGRect frame = [_pageLayout frameForPage:anchorPage];
+    anchorPage = 0;
+    proposedContentOffset.y = frame.origin.y + (frame.size.height * anchorFraction) - self.collectionView.contentInset.top;
+    return proposedContentOffset;
+}
+
+@end
@@ -0,0 +1,70 @@
+/*
+ //  PDFKHighlightOverlay.h
+ //  M13PDFKit
+ //
+ Copyright (c) 2014 Brandon McQuilkin
+ 
+ Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated documentation files (the
+ "Software"), to deal in the Software without restriction, including without limitation the rights to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software, and to permit persons to whom the Software is furnished to do so, subject to
+ the following conditions:
+ 
+ The above copyright notice and this permission notice shall be included in all copies or substantial portions of the Software.
+ 
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+
+#import <UIKit/UIKit.h>
+
+/**
+ The kinds of highlights, drawn in this order.
+ */
+typedef NS_ENUM(NSUInteger, PDFKHighlightKind) {
+    /**
+     The links of the page.
+     */
+    PDFKHighlightKindLink = 0,
+    /**
+     Matches of a search.
+     */
+    PDFKHighlightKindSearchHit,
+    /**
+     The selection.
+     */
+    PDFKHighlightKindSelection,
+    PDFKHighlightKindCount
+};
+
+/**
+ Draws the highlights of a page in one view, instead of a view for each highlighted rect. The rects of each kind are filled as one path in the colour of the kind, overlapping rects are filled once. Only the rects in the area being drawn are found, through a spatial index, and changing the rects of a kind only redraws the area of the rects that changed.
+ */
+@interface PDFKHighlightOverlay : UIView
+
+/**
+ Set the highlighted rects of a kind.
+ 
+ @param rects The rects in the view's coordinates, NSValues of CGRects. nil or an empty array removes the highlights of the kind.
+ @param kind  The kind of highlight.
+ */
+- (void)setRects:(NSArray *)rects forKind:(PDFKHighlightKind)kind;
+/**
+ Get the highlighted rects of a kind.
+ 
+ @param kind The kind of highlight.
+ 
+ @return The rects, NSValues of CGRects.
+ */
+- (NSArray *)rectsForKind:(PDFKHighlightKind)kind;
+/**
+ Set the colour of a kind of highlight. The colours should be translucent. By default links are the tint colour, search hits are yellow, and the selection is blue.
+ 
+ @param color The colour.
+ @param kind  The kind of highlight.
+ */
+- (void)setColor:(UIColor *)color forKind:(PDFKHighlightKind)kind;
+/**
+ Statistics for the overlay. The keys are "Draws", "DrawnRects" (the rects drawn by all the draws) and "Rects" (the rects highlighted now).
+ */
+@property (nonatomic, readonly) NSDictionary *statistics;
+
+@end
@@ -0,0 +1,160 @@
+/*
+ //  PDFKHighlightOverlay.m
+ //  M13PDFKit
+ //
+ Copyright (c) 2014 Brandon McQuilkin
+ 
+ Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated documentation files (the
+ "Software"), to deal in the Software without restriction, including without limitation the rights to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software, and to permit persons to whom the Software is furnished to do so, subject to
+ the following conditions:
+ 
+ The above copyright notice and this permission notice shall be included in all copies or substantial portions of the Software.
+ 
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+
+#import "PDFKHighlightOverlay.h"
+#import "PDFKRectIndex.h"
+
+//The most changed rects that are redrawn one by one, more redraw the area around all of them
+#define MAXIMUM_DIRTY_RECTS 32
+//The space around a rect that is redrawn with it, for antialiasing
+#define DIRTY_RECT_OUTSET 1.0f
+
+@implementation PDFKHighlightOverlay
+{
+    NSArray *kindRects[PDFKHighlightKindCount];
+    PDFKRectIndex *kindIndexes[PDFKHighlightKindCount];
+    UIColor *kindColors[PDFKHighlightKindCount];
+    
+    //Statistics
+    NSUInteger drawCount;
+    NSUInteger drawnRectCount;
+}
+
+- (id)initWithFrame:(CGRect)frame
+{
+    if ((self = [super initWithFrame:frame])) {
+        self.opaque = NO;
+        self.backgroundColor = [UIColor clearColor];
+        self.userInteractionEnabled = NO;
+        self.autoresizesSubviews = NO;
+        self.autoresizingMask = (UIViewAutoresizingFlexibleWidth | UIViewAutoresizingFlexibleHeight);
+        self.contentMode = UIViewContentModeRedraw;
+        
+        kindColors[PDFKHighlightKindSearchHit] = [UIColor colorWithRed:1.0f green:0.85f blue:0.0f alpha:0.4f];
+        kindColors[PDFKHighlightKindSelection] = [UIColor colorWithRed:0.11f green:0.5f blue:0.95f alpha:0.3f];
+    }
+    return self;
+}
+
+- (UIColor *)colorForKind:(PDFKHighlightKind)kind
+{
+    if (kindColors[kind] != nil) {
+        return kindColors[kind];
+    }
+    UIColor *tint = self.tintColor ?: [UIColor colorWithRed:0.11f green:0.5f blue:0.95f alpha:1.0f];
+    return [tint colorWithAlphaComponent:0.25f];
+}
+
+- (void)tintColorDidChange
+{
+    [super tintColorDidChange];
+    if (kindColors[PDFKHighlightKindLink] == nil && kindRects[PDFKHighlightKindLink].count > 0) {
+        [self setNeedsDisplayInRect:kindIndexes[PDFKHighlightKindLink].bounds];
+    }
+}
+
+- (void)setColor:(UIColor *)color forKind:(PDFKHighlightKind)kind
+{
+    if (kind >= PDFKHighlightKindCount) {
+        return;
+    }
+    kindColors[kind] = color;
+    if (kindRects[kind].count > 0) {
+        [self setNeedsDisplayInRect:kindIndexes[kind].bounds];
+    }
+}
+
+- (NSArray *)rectsForKind:(PDFKHighlightKind)kind
+{
+    return (kind < PDFKHighlightKindCount ? (kindRects[kind] ?: @[]) : @[]);
+}
+
+- (void)setRects:(NSArray *)rects forKind:(PDFKHighlightKind)kind
+{
+    if (kind >= PDFKHighlightKindCount) {
+        return;
+    }
+    rects = [rects copy] ?: @[];
+    
+    //Only the rects that were added or removed are redrawn
+    NSSet *oldRects = [NSSet setWithArray:(kindRects[kind] ?: @[])];
+    NSSet *newRects = [NSSet setWithArray:rects];
+    NSMutableSet *changed = [oldRects mutableCopy];
+    [changed minusSet:newRects];
+    NSMutableSet *added = [newRects mutableCopy];
+    [added minusSet:oldRects];
+    [changed unionSet:added];
+    
+    kindRects[kind] = rects;
+    CGRect *indexRects = malloc(MAX(rects.count, 1) * sizeof(CGRect));
+    if (indexRects != NULL) {
+        for (NSUInteger index = 0; index < rects.count; index++) {
+            indexRects[index] = [rects[index] CGRectValue];
+        }
+        kindIndexes[kind] = [[PDFKRectIndex alloc] initWithRects:indexRects count:rects.count];
+        free(indexRects);
+    }
+    
+    if (changed.count > MAXIMUM_DIRTY_RECTS) {
+        CGRect dirty = CGRectNull;
+        for (NSValue *value in changed) {
+            dirty = CGRectUnion(dirty, [value CGRectValue]);
+        }
+        [self setNeedsDisplayInRect:CGRectInset(dirty, -DIRTY_RECT_OUTSET, -DIRTY_RECT_OUTSET)];
+    } else {
+        for (NSValue *value in changed) {
+            [self setNeedsDisplayInRect:CGRectInset([value CGRectValue], -DIRTY_RECT_OUTSET, -DIRTY_RECT_OUTSET)];
+        }
+    }
+}
+
+- (void)drawRect:(CGRect)rect
+{
+    CGContextRef context = UIGraphicsGetCurrentContext();
+    drawCount++;
+    
+    //One path for each kind, with the rects in the area being drawn.
+    for (NSUInteger kind = 0; kind < PDFKHighlightKindCount; kind++) {
+        PDFKRectIndex *index = kindIndexes[kind];
+        if (index.count == 0 || CGRectIntersectsRect(index.bounds, rect) == NO) {
+            continue;
+        }
+        CGMutablePathRef path = CGPathCreateMutable();
+        __block NSUInteger pathRects = 0;
+        [index enumerateRectsIntersectingRect:rect usingBlock:^(NSUInteger rectIndex, CGRect indexedRect, BOOL *stop) {
+            CGPathAddRect(path, NULL, CGRectIntersection(indexedRect, rect));
+            pathRects++;
+        }];
+        if (pathRects > 0) {
+            CGContextSetFillColorWithColor(context, [self colorForKind:kind].CGColor);
+            CGContextAddPath(context, path);
+            CGContextFillPath(context);
+            drawnRectCount += pathRects;
+        }
+        CGPathRelease(path);
+    }
+}
+
+- (NSDictionary *)statistics
+{
+    NSUInteger rectCount = 0;
+    for (NSUInteger kind = 0; kind < PDFKHighlightKindCount; kind++) {
+        rectCount += kindRects[kind].count;
+    }
+    return @{@"Draws": @(drawCount), @"DrawnRects": @(drawnRectCount), @"Rects": @(rectCount)};
+}
+
+@end
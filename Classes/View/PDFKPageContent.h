@@ -24,11 +24,15 @@
 //
 
 #import <UIKit/UIKit.h>
+#import "PDFKResourceGovernor.h"
+#import "PDFKPage.h"
+
+@class PDFKHighlightOverlay;
 
 /**
  The view that displays the PDF page. It is backed by a CATiledLayer
  */
-@interface PDFKPageContent : UIView
+@interface PDFKPageContent : UIView <PDFKResourceConsumer>
 
 /**
  Initalize the page view.
@@ -41,46 +45,33 @@
  */
 - (id)initWithURL:(NSURL *)fileURL page:(NSInteger)page password:(NSString *)phrase;
 /**
- Process a single tap on the view.
+ Initalize the page view with a page that has already been loaded.
  
- @param recognizer The gesture recognizer that detected the single tap, for anotated links.
+ @param page The page to display.
  
- @return The PDFKDocumentLink that was tapped.
+ @return A new view containing the content for the given PDF page.
  */
-- (id)processSingleTap:(UITapGestureRecognizer *)recognizer;
-
-@end
-
+- (id)initWithPage:(PDFKPage *)page;
 /**
- A object representation of a link on a PDF page.
+ The page that the view displays.
  */
-@interface PDFKDocumentLink : NSObject
-
+@property (nonatomic, strong, readonly) PDFKPage *page;
 /**
- The rect of the link in the page.
+ Process a single tap on the view.
+ 
+ @param recognizer The gesture recognizer that detected the single tap, for anotated links.
+ 
+ @return The PDFKDocumentLink that was tapped.
  */
-@property (nonatomic, assign, readonly) CGRect rect;
+- (id)processSingleTap:(UITapGestureRecognizer *)recognizer;
 /**
- The link's information.
+ The view that draws the link, search hit and selection highlights over the page. It is created when it is first used.
  */
-@property (nonatomic, assign, readonly) CGPDFDictionaryRef dictionary;
+@property (nonatomic, strong, readonly) PDFKHighlightOverlay *highlightOverlay;
 /**
- Create a new document link.
- 
- @param linkRect       The rect of the link on the page.
- @param linkDictionary The link's information.
- 
- @return A new document link.
+ Highlight all the links of the page.
  */
-+ (id)newWithRect:(CGRect)linkRect dictionary:(CGPDFDictionaryRef)linkDictionary;
-/**
- Create a new document link.
-
-@param linkRect       The rect of the link on the page.
-@param linkDictionary The link's information.
-
-@return A new document link.
-*/
-- (id)initWithRect:(CGRect)linkRect dictionary:(CGPDFDictionaryRef)linkDictionary;
+- (void)highlightPageLinks;
 
 @end
+
@@ -26,37 +26,33 @@
 #import "PDFKPageContent.h"
 #import "PDFKPageContentLayer.h"
 #import "CGPDFDocument.h"
+#import "PDFKTrace.h"
+#import "PDFKImageCache.h"
+#import "PDFKHighlightOverlay.h"
+#import <libkern/OSAtomic.h>
+
+//The number of tile levels accounted for, the layer's levels of detail at each screen scale
+#define TILE_LEVELS 20
+
+/**
+ Add the bytes of a tile to a level. A level holds at most the whole page, tiles drawn again replace the old ones.
+ */
+static void PDFKPageContentAddTileBytes(volatile int64_t *levelBytes, int64_t tileBytes, int64_t pageBytes)
+{
+    int64_t current = 0;
+    int64_t updated = 0;
+    do {
+        current = *levelBytes;
+        updated = MIN(current + tileBytes, MAX(pageBytes, current));
+    } while (OSAtomicCompareAndSwap64Barrier(current, updated, levelBytes) == false);
+}
 
 @implementation PDFKPageContent
 {
-	/**
-	 The document links in the page.
-	 */
-	NSMutableArray *_links;
-	/**
-	 The refrence to the document.
-	 */
-	CGPDFDocumentRef _PDFDocRef;
-	/**
-	 The refrence to the document page.
-	 */
-	CGPDFPageRef _PDFPageRef;
-	/**
-	 The angle of the page (0, 90, 180, 270)
-	 */
-	NSInteger _pageAngle;
-	/**
-	 The size of the page.
-	 */
-	CGFloat _pageWidth;
-	CGFloat _pageHeight;
-	/**
-	 The page offset.
-	 */
-	CGFloat _pageOffsetX;
-	CGFloat _pageOffsetY;
-    
-    NSInteger _page;
+    /**
+     An estimate of the bytes of tiles drawn at each level of detail since the tiles were last released.
+     */
+    volatile int64_t _tileBytes[TILE_LEVELS];
 }
 
 + (Class)layerClass
@@ -65,353 +61,24 @@
 	return [PDFKPageContentLayer class];
 }
 
-- (void)highlightPageLinks
-{
-	if (_links.count > 0) // Add highlight views over all links
-	{
-		UIColor *hilite = [self tintColor];
-        if (!hilite) {
-            hilite = [UIColor colorWithRed:0.11 green:0.5 blue:0.95 alpha:1];
-        }
-        
-		for (PDFKDocumentLink *link in _links) {
-            
-			UIView *highlight = [[UIView alloc] initWithFrame:link.rect];
-            
-			highlight.autoresizesSubviews = NO;
-			highlight.userInteractionEnabled = NO;
-			highlight.contentMode = UIViewContentModeRedraw;
-			highlight.autoresizingMask = UIViewAutoresizingNone;
-			highlight.backgroundColor = hilite; // Color
-            
-			[self addSubview:highlight];
-		}
-	}
-}
-
-- (PDFKDocumentLink *)linkFromAnnotation:(CGPDFDictionaryRef)annotationDictionary
-{
-	PDFKDocumentLink *documentLink = nil;
-    // Annotation co-ordinates array
-	CGPDFArrayRef annotationRectArray = NULL;
-    
-    //If we can get the annotation's location and size, we need to convert that from PDF coordinates to view coordinates
-	if (CGPDFDictionaryGetArray(annotationDictionary, "Rect", &annotationRectArray)) {
-        //PDFRect lower-left X and Y
-		CGPDFReal ll_x = 0.0f;
-        CGPDFReal ll_y = 0.0f;
-        //PDFRect upper-right X and Y
-		CGPDFReal ur_x = 0.0f;
-        CGPDFReal ur_y = 0.0f;
-        
-        //Lower-left
-		CGPDFArrayGetNumber(annotationRectArray, 0, &ll_x);
-		CGPDFArrayGetNumber(annotationRectArray, 1, &ll_y);
-        //Upper-right
-		CGPDFArrayGetNumber(annotationRectArray, 2, &ur_x);
-		CGPDFArrayGetNumber(annotationRectArray, 3, &ur_y);
-        
-        //Normalize
-		if (ll_x > ur_x) {
-            CGPDFReal t = ll_x;
-            ll_x = ur_x;
-            ur_x = t;
-        }
-		if (ll_y > ur_y) {
-            CGPDFReal t = ll_y;
-            ll_y = ur_y;
-            ur_y = t;
-        }
-        
-        //Offset
-		ll_x -= _pageOffsetX;
-        ll_y -= _pageOffsetY;
-		ur_x -= _pageOffsetX;
-        ur_y -= _pageOffsetY;
-        
-        //Page rotation angle (in degrees)
-		switch (_pageAngle) {
-			case 90: {
-				CGPDFReal swap;
-				swap = ll_y;
-                ll_y = ll_x;
-                ll_x = swap;
-				swap = ur_y;
-                ur_y = ur_x;
-                ur_x = swap;
-				break;
-			}
-			case 270: {
-				CGPDFReal swap;
-				swap = ll_y;
-                ll_y = ll_x;
-                ll_x = swap;
-				swap = ur_y;
-                ur_y = ur_x;
-                ur_x = swap;
-				ll_x = ((0.0f - ll_x) + _pageWidth);
-				ur_x = ((0.0f - ur_x) + _pageWidth);
-				break;
-			}
-			case 0: {
-				ll_y = ((0.0f - ll_y) + _pageHeight);
-				ur_y = ((0.0f - ur_y) + _pageHeight);
-				break;
-			}
-		}
-        
-        //Integer X and width
-		NSInteger vr_x = ll_x;
-        NSInteger vr_w = (ur_x - ll_x);
-        
-        //Integer Y and height
-		NSInteger vr_y = ll_y;
-        NSInteger vr_h = (ur_y - ll_y);
-        
-        //View CGRect from PDFRect
-		CGRect viewRect = CGRectMake(vr_x, vr_y, vr_w, vr_h);
-        
-		documentLink = [PDFKDocumentLink newWithRect:viewRect dictionary:annotationDictionary];
-	}
-    
-	return documentLink;
-}
-
-- (void)buildAnnotationLinksList
-{
-	_links = [NSMutableArray new];
-	CGPDFArrayRef pageAnnotations = NULL;
-    
-    //Get the dictionary of the page.
-	CGPDFDictionaryRef pageDictionary = CGPDFPageGetDictionary(_PDFPageRef);
-    //Get the annotations of the page.
-	if (CGPDFDictionaryGetArray(pageDictionary, "Annots", &pageAnnotations) == true) {
-        
-        //Number of annotations
-		NSInteger count = CGPDFArrayGetCount(pageAnnotations);
-        
-        
-		for (NSInteger index = 0; index < count; index++) {
-            
-            CGPDFDictionaryRef annotationDictionary = NULL;
-			if (CGPDFArrayGetDictionary(pageAnnotations, index, &annotationDictionary) == true) {
-                
-                //PDF annotation subtype string
-				const char *annotationSubtype = NULL;
-                
-				if (CGPDFDictionaryGetName(annotationDictionary, "Subtype", &annotationSubtype) == true) {
-                    //Found annotation subtype of 'Link'
-					if (strcmp(annotationSubtype, "Link") == 0) {
-                        //Create and add the link to the list.
-						PDFKDocumentLink *documentLink = [self linkFromAnnotation:annotationDictionary];
-						if (documentLink != nil) {
-                            [_links insertObject:documentLink atIndex:0];
-                        }
-					}
-				}
-			}
-		}
-        
-        #if DEBUG
-		//[self highlightPageLinks]; // Link support debugging
-        #endif
-	}
-}
-
-- (CGPDFArrayRef)destinationWithName:(const char *)destinationName inDestsTree:(CGPDFDictionaryRef)node
+- (PDFKHighlightOverlay *)highlightOverlay
 {
-	CGPDFArrayRef destinationArray = NULL;
-	CGPDFArrayRef limitsArray = NULL;
-    
-    //Check to see if we are outside the node's limits
-	if (CGPDFDictionaryGetArray(node, "Limits", &limitsArray) == true) {
-        
-		CGPDFStringRef lowerLimit = NULL;
-        CGPDFStringRef upperLimit = NULL;
-        
-        //Get the lower and upper limits
-		if (CGPDFArrayGetString(limitsArray, 0, &lowerLimit) == true) {
-			if (CGPDFArrayGetString(limitsArray, 1, &upperLimit) == true) {
-                
-				const char *ll = (const char *)CGPDFStringGetBytePtr(lowerLimit);
-				const char *ul = (const char *)CGPDFStringGetBytePtr(upperLimit);
-                
-				if ((strcmp(destinationName, ll) < 0) || (strcmp(destinationName, ul) > 0)) {
-					return NULL; // Destination name is outside this node's limits
-				}
-			}
-		}
-	}
-    
-    //Check to see if we have a name's array.
-	CGPDFArrayRef namesArray = NULL;
-	if (CGPDFDictionaryGetArray(node, "Names", &namesArray) == true) {
-        
-		NSInteger namesCount = CGPDFArrayGetCount(namesArray);
-        
-		for (NSInteger index = 0; index < namesCount; index += 2) {
-            
-            //Destination name string
-			CGPDFStringRef destName;
-            
-			if (CGPDFArrayGetString(namesArray, index, &destName) == true) {
-                
-				const char *dn = (const char *)CGPDFStringGetBytePtr(destName);
-                
-                //Found the destination name
-				if (strcmp(dn, destinationName) == 0) {
-					if (CGPDFArrayGetArray(namesArray, (index + 1), &destinationArray) == false) {
-                        
-						CGPDFDictionaryRef destinationDictionary = NULL;
-                        
-						if (CGPDFArrayGetDictionary(namesArray, (index + 1), &destinationDictionary) == true) {
-							CGPDFDictionaryGetArray(destinationDictionary, "D", &destinationArray);
-						}
-					}
-                    //We have a destination array
-					return destinationArray;
-				}
-			}
-		}
-	}
-    
-    //Check to see if we have a kids array
-	CGPDFArrayRef kidsArray = NULL;
-	if (CGPDFDictionaryGetArray(node, "Kids", &kidsArray) == true) {
-        
-		NSInteger kidsCount = CGPDFArrayGetCount(kidsArray);
-        
-		for (NSInteger index = 0; index < kidsCount; index++) {
-            
-			CGPDFDictionaryRef kidNode = NULL;
-            //Recurse into node
-			if (CGPDFArrayGetDictionary(kidsArray, index, &kidNode) == true) {
-				destinationArray = [self destinationWithName:destinationName inDestsTree:kidNode];
-				if (destinationArray != NULL) {
-                    return destinationArray; // Return destination array
-                }
-			}
-		}
-	}
-    
-    //We got nothing.
-	return NULL;
+    //One view draws all the highlights
+    if (_highlightOverlay == nil) {
+        _highlightOverlay = [[PDFKHighlightOverlay alloc] initWithFrame:self.bounds];
+        [self addSubview:_highlightOverlay];
+    }
+    return _highlightOverlay;
 }
 
-- (id)annotationLinkTarget:(CGPDFDictionaryRef)annotationDictionary
+- (void)highlightPageLinks
 {
-	id linkTarget = nil;
-	CGPDFStringRef destName = NULL;
-    const char *destString = NULL;
-	CGPDFDictionaryRef actionDictionary = NULL;
-    CGPDFArrayRef destArray = NULL;
-    
-	if (CGPDFDictionaryGetDictionary(annotationDictionary, "A", &actionDictionary) == true) {
-        
-        //Annotation action type string
-		const char *actionType = NULL;
-        
-		if (CGPDFDictionaryGetName(actionDictionary, "S", &actionType) == true) {
-            
-            //GoTo action type
-			if (strcmp(actionType, "GoTo") == 0) {
-				if (CGPDFDictionaryGetArray(actionDictionary, "D", &destArray) == false) {
-					CGPDFDictionaryGetString(actionDictionary, "D", &destName);
-				}
-                
-			} else  {
-                //Handle other link action type possibility
-                
-                //URI action type
-				if (strcmp(actionType, "URI") == 0) {
-                    
-					CGPDFStringRef uriString = NULL;
-					if (CGPDFDictionaryGetString(actionDictionary, "URI", &uriString) == true) {
-                        //Destination URI string
-						const char *uri = (const char *)CGPDFStringGetBytePtr(uriString);
-                        NSString *target = [NSString stringWithCString:uri encoding:NSUTF8StringEncoding];
-                        linkTarget = [NSURL URLWithString:[target stringByAddingPercentEscapesUsingEncoding:NSUTF8StringEncoding]];
-                        //Debug check
-                        #if DEBUG
-						if (linkTarget == nil) NSLog(@"%s Bad URI '%@'", __FUNCTION__, target);
-                        #endif
-					}
-				}
-			}
-		}
-	} else {
-        // Handle other link target possibilities
-		if (CGPDFDictionaryGetArray(annotationDictionary, "Dest", &destArray) == false) {
-			if (CGPDFDictionaryGetString(annotationDictionary, "Dest", &destName) == false) {
-				CGPDFDictionaryGetName(annotationDictionary, "Dest", &destString);
-			}
-		}
-	}
-    
-    //Handle a destination name
-	if (destName != NULL) {
-		CGPDFDictionaryRef catalogDictionary = CGPDFDocumentGetCatalog(_PDFDocRef);
-		CGPDFDictionaryRef namesDictionary = NULL;
-        
-		if (CGPDFDictionaryGetDictionary(catalogDictionary, "Names", &namesDictionary) == true) {
-            
-			CGPDFDictionaryRef destsDictionary = NULL;
-            
-			if (CGPDFDictionaryGetDictionary(namesDictionary, "Dests", &destsDictionary) == true) {
-				const char *destinationName = (const char *)CGPDFStringGetBytePtr(destName);
-				destArray = [self destinationWithName:destinationName inDestsTree:destsDictionary];
-			}
-		}
-	}
-    
-    //Handle a destination string
-	if (destString != NULL) {
-		CGPDFDictionaryRef catalogDictionary = CGPDFDocumentGetCatalog(_PDFDocRef);
-		CGPDFDictionaryRef destsDictionary = NULL;
-        
-		if (CGPDFDictionaryGetDictionary(catalogDictionary, "Dests", &destsDictionary) == true) {
-            
-			CGPDFDictionaryRef targetDictionary = NULL;
-			if (CGPDFDictionaryGetDictionary(destsDictionary, destString, &targetDictionary) == true) {
-				CGPDFDictionaryGetArray(targetDictionary, "D", &destArray);
-			}
-		}
-	}
-    
-    //Handle a destination array
-	if (destArray != NULL) {
-		NSInteger targetPageNumber = 0;
-		CGPDFDictionaryRef pageDictionaryFromDestArray = NULL;
-        
-		if (CGPDFArrayGetDictionary(destArray, 0, &pageDictionaryFromDestArray) == true) {
-            
-			NSInteger pageCount = CGPDFDocumentGetNumberOfPages(_PDFDocRef);
-			for (NSInteger pageNumber = 1; pageNumber <= pageCount; pageNumber++) {
-                
-				CGPDFPageRef pageRef = CGPDFDocumentGetPage(_PDFDocRef, pageNumber);
-				CGPDFDictionaryRef pageDictionaryFromPage = CGPDFPageGetDictionary(pageRef);
-                
-                //Found it!
-				if (pageDictionaryFromPage == pageDictionaryFromDestArray) {
-					targetPageNumber = pageNumber; break;
-				}
-			}
-		} else {
-            //Try page number from array possibility
-			CGPDFInteger pageNumber = 0;
-            
-			if (CGPDFArrayGetInteger(destArray, 0, &pageNumber) == true) {
-				targetPageNumber = (pageNumber + 1); // 1-based
-			}
-		}
-        
-        //We have a target page number
-		if (targetPageNumber > 0) {
-			linkTarget = [NSNumber numberWithInteger:targetPageNumber];
-		}
+	NSArray *links = _page.links;
+	NSMutableArray *rects = [NSMutableArray arrayWithCapacity:links.count];
+	for (PDFKDocumentLink *link in links) {
+		[rects addObject:[NSValue valueWithCGRect:link.rect]];
 	}
-    
-	return linkTarget;
+	[self.highlightOverlay setRects:rects forKind:PDFKHighlightKindLink];
 }
 
 - (id)processSingleTap:(UITapGestureRecognizer *)recognizer
@@ -419,17 +86,9 @@
 	id result = nil; // Tap result object
     
 	if (recognizer.state == UIGestureRecognizerStateRecognized) {
-		if (_links.count > 0) {
-            
+		if (_page.links.count > 0) {
 			CGPoint point = [recognizer locationInView:self];
-            
-            //Search for a link at that point
-			for (PDFKDocumentLink *link in _links) {
-				if (CGRectContainsPoint(link.rect, point) == true) {
-					result = [self annotationLinkTarget:link.dictionary];
-                    break;
-				}
-			}
+			result = [_page linkTargetAtPoint:point];
 		}
 	}
     
@@ -461,67 +120,15 @@
 
 - (id)initWithURL:(NSURL *)fileURL page:(NSInteger)page password:(NSString *)phrase
 {
-	CGRect viewRect = CGRectZero;
+	PDFKPage *pageModel = nil;
     
 	if (fileURL != nil) {
+		CGPDFDocumentRef documentRef = CGPDFDocumentCreate(fileURL, phrase);
         
-		_PDFDocRef = CGPDFDocumentCreate(fileURL, phrase);
-        
-		if (_PDFDocRef != NULL) {
-			if (page < 1) page = 1; // Check the lower page bounds
-            
-			NSInteger pages = CGPDFDocumentGetNumberOfPages(_PDFDocRef);
-            
-			if (page > pages) page = pages; // Check the upper page bounds
-            
-			_PDFPageRef = CGPDFDocumentGetPage(_PDFDocRef, page); // Get page
-            
-			if (_PDFPageRef != NULL) {
-                
-                _page = page;
-                
-				CGPDFPageRetain(_PDFPageRef); // Retain the PDF page
-                
-				CGRect cropBoxRect = CGPDFPageGetBoxRect(_PDFPageRef, kCGPDFCropBox);
-				CGRect mediaBoxRect = CGPDFPageGetBoxRect(_PDFPageRef, kCGPDFMediaBox);
-				CGRect effectiveRect = CGRectIntersection(cropBoxRect, mediaBoxRect);
-                
-				_pageAngle = CGPDFPageGetRotationAngle(_PDFPageRef);
-                
-				switch (_pageAngle)
-				{
-					default:
-					case 0: case 180: {
-						_pageWidth = effectiveRect.size.width;
-						_pageHeight = effectiveRect.size.height;
-						_pageOffsetX = effectiveRect.origin.x;
-						_pageOffsetY = effectiveRect.origin.y;
-						break;
-					}
-                        
-					case 90: case 270: {
-						_pageWidth = effectiveRect.size.height;
-						_pageHeight = effectiveRect.size.width;
-						_pageOffsetX = effectiveRect.origin.y;
-						_pageOffsetY = effectiveRect.origin.x;
-						break;
-					}
-				}
-                
-				NSInteger page_w = _pageWidth;
-				NSInteger page_h = _pageHeight;
-                
-                //Make even?
-				if (page_w % 2) page_w--;
-                if (page_h % 2) page_h--;
-                
-                //View size
-				viewRect.size = CGSizeMake(page_w, page_h);
-			} else {
-				CGPDFDocumentRelease(_PDFDocRef);
-                _PDFDocRef = NULL;
-				NSAssert(NO, @"CGPDFPageRef == NULL");
-			}
+		if (documentRef != NULL) {
+			pageModel = [[PDFKPage alloc] initWithDocumentRef:documentRef page:page];
+			CGPDFDocumentRelease(documentRef);
+			NSAssert(pageModel != nil, @"CGPDFPageRef == NULL");
 		} else {
 			NSAssert(NO, @"CGPDFDocumentRef == NULL");
 		}
@@ -529,8 +136,19 @@
 		NSAssert(NO, @"fileURL == nil");
 	}
     
+	return [self initWithPage:pageModel];
+}
+
+- (id)initWithPage:(PDFKPage *)page
+{
+	CGRect viewRect = CGRectZero;
+	viewRect.size = page.viewSize;
+    
 	id view = [self initWithFrame:viewRect]; // UIView setup
-	if (view != nil) [self buildAnnotationLinksList]; // Links
+	if (view != nil) {
+        _page = page;
+        [[PDFKResourceGovernor sharedGovernor] registerConsumer:self category:PDFKResourceCategoryTiles priority:PDFKResourcePriorityNormal];
+    }
     
 	return view;
 }
@@ -541,18 +159,21 @@
 	[super removeFromSuperview];
 }
 
-- (void)dealloc
-{
-	CGPDFPageRelease(_PDFPageRef), _PDFPageRef = NULL;
-	CGPDFDocumentRelease(_PDFDocRef), _PDFDocRef = NULL;
-}
-
 #pragma mark CATiledLayer delegate methods
 
 - (void)drawLayer:(CATiledLayer *)layer inContext:(CGContextRef)context
 {
     //Retain self?
 	PDFKPageContent *readerContentPage = self;
+	uint64_t traceStart = PDFKTraceBegin();
+    
+    //Account for the tile, in device pixels, at the level of detail of the zoom scale
+    CGRect tileRect = CGContextGetClipBoundingBox(context);
+    CGAffineTransform deviceTransform = CGContextGetCTM(context);
+    CGFloat deviceScale = fabs((deviceTransform.a * deviceTransform.d) - (deviceTransform.b * deviceTransform.c));
+    NSInteger level = MIN(MAX((NSInteger)lround(log2(MAX(deviceScale, 1.0f)) / 2.0), 0), TILE_LEVELS - 1);
+    CGRect pageRect = layer.bounds;
+    PDFKPageContentAddTileBytes(&_tileBytes[level], (int64_t)(tileRect.size.width * tileRect.size.height * deviceScale * 4.0f), (int64_t)(pageRect.size.width * pageRect.size.height * deviceScale * 4.0f));
     
     //Fill self
 	CGContextSetRGBFillColor(context, 1.0f, 1.0f, 1.0f, 1.0f);
@@ -560,33 +181,49 @@
     
     //Translate for Page
 	CGContextTranslateCTM(context, 0.0f, self.bounds.size.height); CGContextScaleCTM(context, 1.0f, -1.0f);
-	CGContextConcatCTM(context, CGPDFPageGetDrawingTransform(_PDFPageRef, kCGPDFCropBox, self.bounds, 0, true));
+	CGContextConcatCTM(context, CGPDFPageGetDrawingTransform(_page.pageRef, kCGPDFCropBox, self.bounds, 0, true));
     
-    //Render the PDF page into the context
-	CGContextDrawPDFPage(context, _PDFPageRef);
+    //Render the PDF page into the context, scanned pages from their decoded image
+	PDFKImageCacheDrawPage(context, _page.pageRef);
+	PDFKTraceEnd(PDFKTraceStageTileDraw, traceStart, _page.pageNumber);
     
     //Release self
 	if (readerContentPage != nil) readerContentPage = nil;
 }
 
-@end
-
-@implementation PDFKDocumentLink
+#pragma mark PDFKResourceConsumer
 
-+ (id)newWithRect:(CGRect)linkRect dictionary:(CGPDFDictionaryRef)linkDictionary
+- (NSUInteger)resourceBytes
 {
-	return [[PDFKDocumentLink alloc] initWithRect:linkRect dictionary:linkDictionary];
+    int64_t bytes = 0;
+    for (NSInteger level = 0; level < TILE_LEVELS; level++) {
+        bytes += OSAtomicAdd64Barrier(0, &_tileBytes[level]);
+    }
+    return (bytes > 0 ? (NSUInteger)bytes : 0);
 }
 
-#pragma mark ReaderDocumentLink instance methods
-
-- (id)initWithRect:(CGRect)linkRect dictionary:(CGPDFDictionaryRef)linkDictionary
+- (NSUInteger)shedResourcesForPressure:(PDFKResourcePressure)pressure
 {
-	if ((self = [super init])) {
-		_dictionary = linkDictionary;
-		_rect = linkRect;
-	}
-    return self;
+    //Keep the tiles of the visible page, unless the pressure is critical
+    if (self.window != nil && pressure < PDFKResourcePressureCritical) {
+        return 0;
+    }
+    
+    //Take the bytes of each level, tiles may be drawn on other threads meanwhile
+    int64_t bytes = 0;
+    for (NSInteger level = 0; level < TILE_LEVELS; level++) {
+        int64_t levelBytes = 0;
+        do {
+            levelBytes = _tileBytes[level];
+        } while (OSAtomicCompareAndSwap64Barrier(levelBytes, 0, &_tileBytes[level]) == false);
+        bytes += levelBytes;
+    }
+    
+    //Drop the tiles, they are redrawn when the page is displayed.
+    self.layer.contents = nil;
+    [self.layer setNeedsDisplay];
+    
+    return (bytes > 0 ? (NSUInteger)bytes : 0);
 }
 
 @end
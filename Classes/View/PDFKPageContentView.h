@@ -29,6 +29,8 @@
 @class PDFKPageContentView;
 @class PDFKPageContent;
 @class PDFKPageContentThumb;
+@class PDFKPage;
+@class PDFKPageRenderCache;
 
 /**
  The delegate for PDFKPageContentView.
@@ -66,6 +68,29 @@
  @return A PDFPageContentView.
  */
 - (id)initWithFrame:(CGRect)frame fileURL:(NSURL *)fileURL page:(NSUInteger)page password:(NSString *)phrase;
+/**
+ Create a PDFPageContentView for a page that has already been loaded.
+ 
+ @param frame The frame of the view.
+ @param page  The page to display.
+ 
+ @return A PDFPageContentView.
+ */
+- (id)initWithFrame:(CGRect)frame page:(PDFKPage *)page;
+/**
+ Display a different page in the view, reusing the scroll view, container and thumb view. The zoom is reset to fit the new page.
+ 
+ @param page The page to display.
+ */
+- (void)bindPage:(PDFKPage *)page;
+/**
+ The page that the view displays.
+ */
+@property (nonatomic, readonly) PDFKPage *page;
+/**
+ The cache of screen resolution page images. If set, the page is shown from the cache when it was rendered before, and tiles are only drawn when zoomed in. The owner of the cache sets its viewport size, so views of different sizes share the images.
+ */
+@property (nonatomic, weak) PDFKPageRenderCache *renderCache;
 /**
  Shows a preview of the page derived from the thumbnail while the full page is loaded and rendered.
  
@@ -27,6 +27,8 @@
 #import "PDFKPageContent.h"
 #import "PDFKThumbCache.h"
 #import "PDFKThumbRequest.h"
+#import "CGPDFDocument.h"
+#import "PDFKPageRenderCache.h"
 #import <QuartzCore/QuartzCore.h>
 
 #define CONTENT_INSET 2.0f
@@ -43,6 +45,7 @@
 {
 	PDFKPageContent *theContentView;
 	PDFKPageContentThumb *theThumbView;
+	UIImageView *thePageImageView;
 	UIView *theContainerView;
 }
 
@@ -65,6 +68,24 @@ static inline CGFloat ZoomScaleThatFits(CGSize target, CGSize source)
 }
 
 - (id)initWithFrame:(CGRect)frame fileURL:(NSURL *)fileURL page:(NSUInteger)page password:(NSString *)phrase
+{
+	PDFKPage *pageModel = nil;
+    
+	CGPDFDocumentRef documentRef = CGPDFDocumentCreate(fileURL, phrase);
+	if (documentRef != NULL) {
+		pageModel = [[PDFKPage alloc] initWithDocumentRef:documentRef page:page];
+		CGPDFDocumentRelease(documentRef);
+	}
+    
+	self = [self initWithFrame:frame page:pageModel];
+    
+    //Tag the view with the page number, even if it failed to load
+	self.tag = page;
+    
+	return self;
+}
+
+- (id)initWithFrame:(CGRect)frame page:(PDFKPage *)page
 {
 	if ((self = [super initWithFrame:frame]))
 	{
@@ -81,54 +102,126 @@ static inline CGFloat ZoomScaleThatFits(CGSize target, CGSize source)
 		self.delegate = self;
         self.scrollEnabled = YES;
         self.clipsToBounds = YES;
+        self.autoresizingMask = UIViewAutoresizingFlexibleHeight|UIViewAutoresizingFlexibleWidth;
         
-		theContentView = [[PDFKPageContent alloc] initWithURL:fileURL page:page password:phrase];
+        theContainerView = [[UIView alloc] initWithFrame:CGRectZero];
+        theContainerView.userInteractionEnabled = NO;
+        theContainerView.contentMode = UIViewContentModeRedraw;
+        theContainerView.backgroundColor = [UIColor whiteColor];
+        theContainerView.autoresizesSubviews = YES;
+        theContainerView.autoresizingMask = UIViewAutoresizingFlexibleHeight|UIViewAutoresizingFlexibleWidth;
         
-		if (theContentView != nil)
-        {
-			theContainerView = [[UIView alloc] initWithFrame:theContentView.bounds];
-            theContainerView.backgroundColor = [UIColor blueColor];
-			theContainerView.userInteractionEnabled = NO;
-			theContainerView.contentMode = UIViewContentModeRedraw;
-			theContainerView.backgroundColor = [UIColor whiteColor];
-            theContainerView.autoresizesSubviews = YES;
-            theContainerView.autoresizingMask = UIViewAutoresizingFlexibleHeight|UIViewAutoresizingFlexibleWidth;
-            
-            self.autoresizingMask = UIViewAutoresizingFlexibleHeight|UIViewAutoresizingFlexibleWidth;
-            
-            //Remove autoresizing constraints.
-            theContentView.translatesAutoresizingMaskIntoConstraints = NO;
-            theThumbView.translatesAutoresizingMaskIntoConstraints = NO;
-            
-            //Content size same as view size
-			self.contentSize = theContentView.bounds.size;
-            
-            //Add the thumb view to the container view
-			theThumbView = [[PDFKPageContentThumb alloc] initWithFrame:theContentView.bounds]; // Page thumb view
-			[theContainerView addSubview:theThumbView];
-            
-            //Add the content view to the container view
-			[theContainerView addSubview:theContentView];
-            
-            //Add the container view to the scroll view
-			[self addSubview:theContainerView];
-            
-            //Update the minimum and maximum zoom scales
-			[self updateMinimumMaximumZoom];
-            
-            //Set zoom to fit page content
-			self.zoomScale = self.minimumZoomScale;
-		}
+        //Add the thumb view to the container view
+        theThumbView = [[PDFKPageContentThumb alloc] initWithFrame:CGRectZero]; // Page thumb view
+        theThumbView.translatesAutoresizingMaskIntoConstraints = NO;
+        [theContainerView addSubview:theThumbView];
         
-		[self addObserver:self forKeyPath:@"frame" options:0 context:PDFKPageContentViewContext];
+        //Add the screen resolution page image over the thumb
+        thePageImageView = [[UIImageView alloc] initWithFrame:CGRectZero];
+        thePageImageView.contentMode = UIViewContentModeScaleToFill;
+        [theContainerView addSubview:thePageImageView];
         
-        //Tag the view with the page number
-		self.tag = page;
+        //Add the container view to the scroll view
+        [self addSubview:theContainerView];
+        
+		[self addObserver:self forKeyPath:@"frame" options:NSKeyValueObservingOptionOld context:PDFKPageContentViewContext];
+        
+        [self bindPage:page];
 	}
     
 	return self;
 }
 
+- (void)bindPage:(PDFKPage *)page
+{
+    //Reset the zoom before the container changes size
+    self.minimumZoomScale = 1.0f;
+    self.maximumZoomScale = 1.0f;
+    self.zoomScale = 1.0f;
+    
+    //Replace the content
+    [theContentView removeFromSuperview];
+    [theThumbView clearForReuse];
+    thePageImageView.image = nil;
+    theContentView = (page != nil ? [[PDFKPageContent alloc] initWithPage:page] : nil);
+    
+	if (theContentView != nil)
+    {
+        //Remove autoresizing constraints.
+        theContentView.translatesAutoresizingMaskIntoConstraints = NO;
+        
+        theContainerView.frame = theContentView.bounds;
+        theThumbView.frame = theContentView.bounds;
+        theContainerView.hidden = NO;
+        
+        //Add the content view to the container view
+        [theContainerView addSubview:theContentView];
+        
+        //Content size same as view size
+        self.contentSize = theContentView.bounds.size;
+        self.contentOffset = CGPointZero;
+        
+        //Update the minimum and maximum zoom scales
+        [self updateMinimumMaximumZoom];
+        
+        //Set zoom to fit page content
+        self.zoomScale = self.minimumZoomScale;
+    } else {
+        theContainerView.hidden = YES;
+    }
+    
+    //Tag the view with the page number
+	self.tag = page.pageNumber;
+    
+    [self updateRenderedPage];
+    [self setNeedsLayout];
+}
+
+- (PDFKPage *)page
+{
+    return theContentView.page;
+}
+
+- (void)setRenderCache:(PDFKPageRenderCache *)renderCache
+{
+    _renderCache = renderCache;
+    [self updateRenderedPage];
+}
+
+- (void)updateRenderedPage
+{
+    PDFKPage *page = self.page;
+    
+    //Show the page at once if it was rendered before, otherwise render it while the tiles draw.
+    UIImage *image = (page != nil ? [_renderCache imageForPage:page] : nil);
+    thePageImageView.image = image;
+    [self updateTileVisibility];
+    
+    if (image == nil && page != nil) {
+        __weak PDFKPageContentView *weakSelf = self;
+        [_renderCache renderPage:page completion:^(UIImage *rendered) {
+            [weakSelf showRenderedImage:rendered forPage:page];
+        }];
+    }
+}
+
+- (void)showRenderedImage:(UIImage *)image forPage:(PDFKPage *)page
+{
+    //The view may have been bound to another page meanwhile
+    if (self.page != page) {
+        return;
+    }
+    thePageImageView.image = image;
+    [self updateTileVisibility];
+}
+
+- (void)updateTileVisibility
+{
+    //The rendered page is sharp up to the zoom that fits the page, tiles are only needed beyond that.
+    BOOL zoomed = (self.zoomScale > (self.minimumZoomScale * 1.01f));
+    theContentView.hidden = (thePageImageView.image != nil && zoomed == NO);
+}
+
 - (void)dealloc
 {
 	[self removeObserver:self forKeyPath:@"frame" context:PDFKPageContentViewContext];
@@ -157,6 +250,7 @@ static inline CGFloat ZoomScaleThatFits(CGSize target, CGSize source)
         
 		if ((object == self) && [keyPath isEqualToString:@"frame"]) {
 			CGFloat oldMinimumZoomScale = self.minimumZoomScale;
+            CGSize oldSize = [change[NSKeyValueChangeOldKey] CGRectValue].size;
             //Update zoom scale limits
 			[self updateMinimumMaximumZoom];
             
@@ -174,6 +268,11 @@ static inline CGFloat ZoomScaleThatFits(CGSize target, CGSize source)
 					}
 				}
 			}
+            
+            //The page may need to be rendered again, if the viewport changed with the size of the view
+            if (_renderCache != nil && CGSizeEqualToSize(oldSize, self.frame.size) == NO) {
+                [self updateRenderedPage];
+            }
 		}
 	}
 }
@@ -198,6 +297,7 @@ static inline CGFloat ZoomScaleThatFits(CGSize target, CGSize source)
     
 	theContainerView.frame = viewFrame;
     theThumbView.frame = theContainerView.bounds;
+    thePageImageView.frame = theContainerView.bounds;
     theContentView.frame = theContainerView.bounds;
 }
 
@@ -250,6 +350,11 @@ static inline CGFloat ZoomScaleThatFits(CGSize target, CGSize source)
 	return theContainerView;
 }
 
+- (void)scrollViewDidZoom:(UIScrollView *)scrollView
+{
+    [self updateTileVisibility];
+}
+
 #pragma mark UIResponder instance methods
 
 - (void)touchesBegan:(NSSet *)touches withEvent:(UIEvent *)event
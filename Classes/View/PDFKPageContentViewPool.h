@@ -0,0 +1,79 @@
+/*
+ //  PDFKPageContentViewPool.h
+ //  M13PDFKit
+ //
+ Copyright (c) 2014 Brandon McQuilkin
+ 
+ Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated documentation files (the
+ "Software"), to deal in the Software without restriction, including without limitation the rights to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software, and to permit persons to whom the Software is furnished to do so, subject to
+ the following conditions:
+ 
+ The above copyright notice and this permission notice shall be included in all copies or substantial portions of the Software.
+ 
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#import <UIKit/UIKit.h>
+
+@class PDFKDocument;
+@class PDFKPage;
+@class PDFKPageContentView;
+
+/**
+ Recycles PDFKPageContentViews for a document. The document is opened once and shared by every page, and the pages next to the current page are loaded and rendered in the background so they are ready before they are swiped to.
+ */
+@interface PDFKPageContentViewPool : NSObject
+
+/**
+ Create a pool for the given document.
+ 
+ @param document The document to display pages from.
+ 
+ @return A new pool.
+ */
+- (id)initWithDocument:(PDFKDocument *)document;
+/**
+ The size of the view the pages are displayed in. Set it when the view is resized or rotated, before the page views are resized. Pages are rendered to fit this size, changing it removes the rendered pages.
+ */
+@property (nonatomic, assign) CGSize viewportSize;
+/**
+ Get a view displaying the given page. A recycled view is used if one is available.
+ 
+ @param page  The page to display.
+ @param frame The frame of the view.
+ 
+ @return A view displaying the page.
+ */
+- (PDFKPageContentView *)viewForPage:(NSInteger)page frame:(CGRect)frame;
+/**
+ Return a view to the pool once it is no longer displayed.
+ 
+ @param view The view to recycle.
+ */
+- (void)recycleView:(PDFKPageContentView *)view;
+/**
+ Get the loaded page for the given page number, loading it now if it has not been prefetched.
+ 
+ @param page The page number.
+ 
+ @return The loaded page, or nil if it could not be loaded.
+ */
+- (PDFKPage *)pageForPageNumber:(NSInteger)page;
+/**
+ Load the pages on either side of the given page in the background. Pages further away are released.
+ 
+ @param page The page being displayed.
+ */
+- (void)prefetchPagesAroundPage:(NSInteger)page;
+/**
+ Load and render in the background the pages the reader is likely to go to from the given page, other than the pages next to it: the pages the reader went to from it before, and the pages its links go to. The predicted pages are kept until the reader settles on another page.
+ 
+ @param page The page the reader settled on.
+ */
+- (void)preloadPredictedPagesAfterPage:(NSInteger)page;
+/**
+ Statistics for the pages bound to views. The keys are "Binds", "PrefetchHits" (pages that had been prefetched), "PrefetchMisses" (pages loaded while binding), "ReusedViews", "CreatedViews", "MeanHitLatency", "MeanMissLatency" (in seconds, from asking for a view to it displaying the page), "PredictedLoads" (predicted pages loaded), "PredictedBinds" (views bound to a page that was loaded because it was predicted), and "RenderCache" (the statistics of the page image cache). The miss latency matches the cost of loading a page without the pool.
+ */
+@property (nonatomic, readonly) NSDictionary *statistics;
+
+@end
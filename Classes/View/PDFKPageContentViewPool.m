@@ -0,0 +1,380 @@
+/*
+ //  PDFKPageContentViewPool.m
+ //  M13PDFKit
+ //
+ Copyright (c) 2014 Brandon McQuilkin
+ 
+ Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated documentation files (the
+ "Software"), to deal in the Software without restriction, including without limitation the rights to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software, and to permit persons to whom the Software is furnished to do so, subject to
+ the following conditions:
+ 
+ The above copyright notice and this permission notice shall be included in all copies or substantial portions of the Software.
+ 
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#import "PDFKPageContentViewPool.h"
+#import "PDFKPageContentView.h"
+#import "PDFKDocument.h"
+#import "PDFKPage.h"
+#import "CGPDFDocument.h"
+#import "PDFKPageRenderCache.h"
+#import <QuartzCore/QuartzCore.h>
+
+//The number of pages to load on each side of the current page
+#define PREFETCH_DISTANCE 1
+//The most pages, other than the pages next to the current page, to load because they are likely to be displayed next
+#define MAXIMUM_PREDICTED_PAGES 2
+//The number of unused views to keep
+#define MAXIMUM_RECYCLED_VIEWS 3
+
+@implementation PDFKPageContentViewPool
+{
+    PDFKDocument *document;
+    /**
+     The document shared by all the pages.
+     */
+    CGPDFDocumentRef documentRef;
+    /**
+     The loaded pages, keyed by page number.
+     */
+    NSMutableDictionary *pages;
+    /**
+     The page numbers being loaded in the background.
+     */
+    NSMutableIndexSet *loadingPages;
+    /**
+     The pages loaded because they are likely to be displayed after the page the reader settled on.
+     */
+    NSIndexSet *predictedPages;
+    /**
+     The page the latest prediction is for. Only used on the main thread.
+     */
+    NSInteger predictionPage;
+    /**
+     Views that are no longer displayed.
+     */
+    NSMutableArray *recycledViews;
+    /**
+     Loads the pages in the background.
+     */
+    NSOperationQueue *prefetchQueue;
+    /**
+     Screen resolution images of the recent and neighbouring pages.
+     */
+    PDFKPageRenderCache *renderCache;
+    
+    //Statistics
+    NSUInteger bindCount;
+    NSUInteger hitCount;
+    NSUInteger missCount;
+    NSUInteger reuseCount;
+    NSUInteger createCount;
+    CFTimeInterval totalHitLatency;
+    CFTimeInterval totalMissLatency;
+    NSUInteger predictedLoadCount;
+    NSUInteger predictedBindCount;
+}
+
+- (id)initWithDocument:(PDFKDocument *)object
+{
+    if ((self = [super init])) {
+        document = object;
+        pages = [NSMutableDictionary new];
+        loadingPages = [NSMutableIndexSet new];
+        predictedPages = [NSIndexSet indexSet];
+        recycledViews = [NSMutableArray new];
+        
+        prefetchQueue = [NSOperationQueue new];
+        [prefetchQueue setName:@"PDFKPagePrefetchQueue"];
+        [prefetchQueue setMaxConcurrentOperationCount:1];
+        
+        renderCache = [PDFKPageRenderCache new];
+    }
+    return self;
+}
+
+- (void)dealloc
+{
+    [prefetchQueue cancelAllOperations];
+    CGPDFDocumentRelease(documentRef), documentRef = NULL;
+}
+
+#pragma mark Pages
+
+- (CGPDFDocumentRef)documentRef
+{
+    @synchronized(pages) {
+        //Open the document once
+        if (documentRef == NULL) {
+            documentRef = CGPDFDocumentCreate(document.fileURL, document.password);
+        }
+        return documentRef;
+    }
+}
+
+- (PDFKPage *)cachedPageForPageNumber:(NSInteger)page
+{
+    @synchronized(pages) {
+        return pages[@(page)];
+    }
+}
+
+- (PDFKPage *)loadPageForPageNumber:(NSInteger)page
+{
+    PDFKPage *pageModel = [[PDFKPage alloc] initWithDocumentRef:[self documentRef] page:page];
+    if (pageModel != nil) {
+        @synchronized(pages) {
+            pages[@(page)] = pageModel;
+        }
+    }
+    return pageModel;
+}
+
+- (PDFKPage *)pageForPageNumber:(NSInteger)page
+{
+    PDFKPage *pageModel = [self cachedPageForPageNumber:page];
+    if (pageModel == nil) {
+        pageModel = [self loadPageForPageNumber:page];
+    }
+    return pageModel;
+}
+
+- (void)prefetchPagesAroundPage:(NSInteger)page
+{
+    NSInteger pageCount = document.pageCount;
+    NSInteger first = MAX(1, page - PREFETCH_DISTANCE);
+    NSInteger last = MIN(pageCount, page + PREFETCH_DISTANCE);
+    
+    @synchronized(pages) {
+        //Release the pages that are no longer near the current page or predicted. Views that display them keep them alive.
+        for (NSNumber *key in [pages allKeys]) {
+            NSInteger pageNumber = key.integerValue;
+            if ((pageNumber < first || pageNumber > last) && [predictedPages containsIndex:pageNumber] == NO) {
+                [pages removeObjectForKey:key];
+            }
+        }
+    }
+    
+    //Keep the neighbouring page images
+    renderCache.currentPage = page;
+    
+    for (NSInteger pageNumber = first; pageNumber <= last; pageNumber++) {
+        @synchronized(pages) {
+            //Already loaded, render it if needed.
+            PDFKPage *pageModel = pages[@(pageNumber)];
+            if (pageModel != nil) {
+                [renderCache renderPage:pageModel completion:nil];
+                continue;
+            }
+            //Loading
+            if ([loadingPages containsIndex:pageNumber]) {
+                continue;
+            }
+            [loadingPages addIndex:pageNumber];
+        }
+        
+        __weak PDFKPageContentViewPool *weakSelf = self;
+        NSBlockOperation *operation = [NSBlockOperation blockOperationWithBlock:^{
+            PDFKPageContentViewPool *strongSelf = weakSelf;
+            [strongSelf prefetchPageNumber:pageNumber];
+        }];
+        operation.qualityOfService = NSQualityOfServiceUtility;
+        [prefetchQueue addOperation:operation];
+    }
+}
+
+- (void)prefetchPageNumber:(NSInteger)page
+{
+    PDFKPage *pageModel = [self cachedPageForPageNumber:page];
+    if (pageModel == nil) {
+        pageModel = [self loadPageForPageNumber:page];
+    }
+    @synchronized(pages) {
+        [loadingPages removeIndex:page];
+    }
+    
+    //Render the page image, if the page is still next to the current page.
+    if (pageModel != nil) {
+        __weak PDFKPageContentViewPool *weakSelf = self;
+        dispatch_async(dispatch_get_main_queue(), ^{
+            [weakSelf renderPrefetchedPage:pageModel];
+        });
+    }
+}
+
+- (void)renderPrefetchedPage:(PDFKPage *)page
+{
+    if (labs(page.pageNumber - renderCache.currentPage) <= PREFETCH_DISTANCE) {
+        [renderCache renderPage:page completion:nil];
+    }
+}
+
+#pragma mark Predicted Pages
+
+- (void)preloadPredictedPagesAfterPage:(NSInteger)page
+{
+    predictionPage = page;
+    
+    __weak PDFKPageContentViewPool *weakSelf = self;
+    NSBlockOperation *operation = [NSBlockOperation blockOperationWithBlock:^{
+        PDFKPageContentViewPool *strongSelf = weakSelf;
+        [strongSelf loadPredictedPagesAfterPage:page];
+    }];
+    operation.qualityOfService = NSQualityOfServiceUtility;
+    [prefetchQueue addOperation:operation];
+}
+
+- (void)loadPredictedPagesAfterPage:(NSInteger)page
+{
+    //Resolving the link targets can scan the document, so it is done here, once per page.
+    PDFKPage *pageModel = [self pageForPageNumber:page];
+    NSArray *linkTargets = pageModel.linkTargetPages;
+    
+    //The pages next to the current page are prefetched anyway
+    NSInteger pageCount = document.pageCount;
+    NSArray *ranked = [document.navigationModel predictedPagesAfterPage:page linkTargets:linkTargets count:(MAXIMUM_PREDICTED_PAGES + (PREFETCH_DISTANCE * 2))];
+    NSMutableIndexSet *predicted = [NSMutableIndexSet indexSet];
+    NSMutableArray *predictedModels = [NSMutableArray array];
+    for (NSNumber *number in ranked) {
+        NSInteger pageNumber = number.integerValue;
+        if (labs(pageNumber - page) <= PREFETCH_DISTANCE || pageNumber < 1 || pageNumber > pageCount) {
+            continue;
+        }
+        PDFKPage *predictedModel = [self cachedPageForPageNumber:pageNumber];
+        if (predictedModel == nil) {
+            predictedModel = [self loadPageForPageNumber:pageNumber];
+            if (predictedModel != nil) {
+                @synchronized(pages) {
+                    predictedLoadCount++;
+                }
+            }
+        }
+        if (predictedModel != nil) {
+            [predicted addIndex:pageNumber];
+            [predictedModels addObject:predictedModel];
+        }
+        if (predicted.count >= MAXIMUM_PREDICTED_PAGES) {
+            break;
+        }
+    }
+    
+    __weak PDFKPageContentViewPool *weakSelf = self;
+    dispatch_async(dispatch_get_main_queue(), ^{
+        [weakSelf renderPredictedPages:predictedModels indexes:predicted afterPage:page];
+    });
+}
+
+- (void)renderPredictedPages:(NSArray *)predictedModels indexes:(NSIndexSet *)indexes afterPage:(NSInteger)page
+{
+    //The reader has moved on
+    if (page != predictionPage) {
+        return;
+    }
+    
+    @synchronized(pages) {
+        //Release the pages that were predicted before, unless they are near the current page
+        for (NSNumber *key in [pages allKeys]) {
+            NSInteger pageNumber = key.integerValue;
+            if ([predictedPages containsIndex:pageNumber] && [indexes containsIndex:pageNumber] == NO && labs(pageNumber - page) > PREFETCH_DISTANCE) {
+                [pages removeObjectForKey:key];
+            }
+        }
+        predictedPages = [indexes copy];
+    }
+    
+    //Keep the predicted page images with the neighbouring ones
+    renderCache.currentPage = page;
+    renderCache.predictedPages = indexes;
+    for (PDFKPage *predictedModel in predictedModels) {
+        [renderCache renderPage:predictedModel completion:nil];
+    }
+}
+
+#pragma mark Views
+
+- (CGSize)viewportSize
+{
+    return renderCache.viewportSize;
+}
+
+- (void)setViewportSize:(CGSize)viewportSize
+{
+    renderCache.viewportSize = viewportSize;
+}
+
+- (PDFKPageContentView *)viewForPage:(NSInteger)page frame:(CGRect)frame
+{
+    CFTimeInterval startTime = CACurrentMediaTime();
+    
+    PDFKPage *pageModel = [self cachedPageForPageNumber:page];
+    BOOL hit = (pageModel != nil);
+    if (hit == NO) {
+        pageModel = [self loadPageForPageNumber:page];
+    }
+    BOOL predicted = NO;
+    @synchronized(pages) {
+        predicted = (hit && [predictedPages containsIndex:page]);
+    }
+    
+    //Reuse a view if possible
+    PDFKPageContentView *view = [recycledViews lastObject];
+    if (view != nil) {
+        [recycledViews removeLastObject];
+        view.frame = frame;
+        [view bindPage:pageModel];
+        reuseCount++;
+    } else {
+        view = [[PDFKPageContentView alloc] initWithFrame:frame page:pageModel];
+        createCount++;
+    }
+    view.renderCache = renderCache;
+    
+    //Statistics
+    CFTimeInterval latency = (CACurrentMediaTime() - startTime);
+    bindCount++;
+    if (predicted) {
+        predictedBindCount++;
+    }
+    if (hit) {
+        hitCount++;
+        totalHitLatency += latency;
+    } else {
+        missCount++;
+        totalMissLatency += latency;
+    }
+    
+    return view;
+}
+
+- (void)recycleView:(PDFKPageContentView *)view
+{
+    if (view == nil) {
+        return;
+    }
+    
+    [view removeFromSuperview];
+    if (recycledViews.count < MAXIMUM_RECYCLED_VIEWS && [recycledViews containsObject:view] == NO) {
+        [recycledViews addObject:view];
+    }
+}
+
+- (NSDictionary *)statistics
+{
+    NSUInteger predictedLoads = 0;
+    @synchronized(pages) {
+        predictedLoads = predictedLoadCount;
+    }
+    return @{@"Binds": @(bindCount),
+             @"PrefetchHits": @(hitCount),
+             @"PrefetchMisses": @(missCount),
+             @"ReusedViews": @(reuseCount),
+             @"CreatedViews": @(createCount),
+             @"MeanHitLatency": @(hitCount > 0 ? (totalHitLatency / hitCount) : 0.0),
+             @"MeanMissLatency": @(missCount > 0 ? (totalMissLatency / missCount) : 0.0),
+             @"PredictedLoads": @(predictedLoads),
+             @"PredictedBinds": @(predictedBindCount),
+             @"RenderCache": renderCache.statistics};
+}
+
+@end
@@ -0,0 +1,91 @@
+/*
+ //  PDFKPageLayout.h
+ //  M13PDFKit
+ //
+ Copyright (c) 2014 Brandon McQuilkin
+ 
+ Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated documentation files (the
+ "Software"), to deal in the Software without restriction, including without limitation the rights to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software, and to permit persons to whom the Software is furnished to do so, subject to
+ the following conditions:
+ 
+ The above copyright notice and this permission notice shall be included in all copies or substantial portions of the Software.
+ 
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#import <UIKit/UIKit.h>
+
+/**
+ Lays out the pages of a document in a continuous vertical column, or in rows of two page spreads. Every page is scaled to the width of its column.
+ 
+ The height of each row is stored as an aspect ratio in a Fenwick tree, so finding the frame of a page or the page at an offset takes O(log n) time, a page's size can be updated in O(log n) time, and changing the width, which happens when zooming or rotating, does not touch the pages at all.
+ */
+@interface PDFKPageLayout : NSObject
+
+/**
+ Create a layout.
+ 
+ @param pageCount         The number of pages.
+ @param estimatedPageSize The size of the pages until their actual sizes are set.
+ 
+ @return A new layout.
+ */
+- (id)initWithPageCount:(NSUInteger)pageCount estimatedPageSize:(CGSize)estimatedPageSize;
+/**
+ The number of pages.
+ */
+@property (nonatomic, readonly) NSUInteger pageCount;
+/**
+ The width to lay the pages out in.
+ */
+@property (nonatomic, assign) CGFloat width;
+/**
+ The space around and between the pages.
+ */
+@property (nonatomic, assign) CGFloat pageSpacing;
+/**
+ Wether or not pages are laid out in rows of two.
+ */
+@property (nonatomic, assign) BOOL spreads;
+/**
+ Wether or not the first page is alone in its row, like the cover of a book. Only used with spreads.
+ */
+@property (nonatomic, assign) BOOL firstPageAlone;
+/**
+ The size of the laid out pages.
+ */
+@property (nonatomic, readonly) CGSize contentSize;
+
+/**
+ Set the size of a page. Only the ratio of the width to the height is used.
+ 
+ @param size The size of the page.
+ @param page The page number.
+ */
+- (void)setSize:(CGSize)size forPage:(NSUInteger)page;
+/**
+ Get the frame of a page.
+ 
+ @param page The page number.
+ 
+ @return The frame of the page.
+ */
+- (CGRect)frameForPage:(NSUInteger)page;
+/**
+ Get the page at the given vertical offset. The space above a row belongs to the row.
+ 
+ @param offset The vertical offset.
+ 
+ @return The number of the first page in the row at the offset, or 0 if there are no pages.
+ */
+- (NSUInteger)pageAtOffset:(CGFloat)offset;
+/**
+ Get the pages that intersect the given rect vertically.
+ 
+ @param rect The rect.
+ 
+ @return The range of page numbers.
+ */
+- (NSRange)pagesInRect:(CGRect)rect;
+
+@end
@@ -0,0 +1,284 @@
+/*
+ //  PDFKPageLayout.m
+ //  M13PDFKit
+ //
+ Copyright (c) 2014 Brandon McQuilkin
+ 
+ Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated documentation files (the
+ "Software"), to deal in the Software without restriction, including without limitation the rights to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software, and to permit persons to whom the Software is furnished to do so, subject to
+ the following conditions:
+ 
+ The above copyright notice and this permission notice shall be included in all copies or substantial portions of the Software.
+ 
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#import "PDFKPageLayout.h"
+
+//The space around and between the pages
+#define DEFAULT_PAGE_SPACING 8.0
+
+#pragma mark Fenwick Tree
+
+/**
+ Build a Fenwick tree of the given values in O(n) time. The tree is indexed from 1.
+ */
+static void PDFKFenwickBuild(double *tree, const double *values, size_t count)
+{
+    tree[0] = 0.0;
+    for (size_t index = 1; index <= count; index++) {
+        tree[index] = values[index - 1];
+    }
+    for (size_t index = 1; index <= count; index++) {
+        size_t parent = index + (index & (~index + 1));
+        if (parent <= count) {
+            tree[parent] += tree[index];
+        }
+    }
+}
+
+/**
+ Add to the value at the given index, from 0.
+ */
+static void PDFKFenwickAdd(double *tree, size_t count, size_t index, double delta)
+{
+    for (size_t node = index + 1; node <= count; node += (node & (~node + 1))) {
+        tree[node] += delta;
+    }
+}
+
+/**
+ The sum of the first given number of values.
+ */
+static double PDFKFenwickPrefix(const double *tree, size_t length)
+{
+    double sum = 0.0;
+    for (size_t node = length; node > 0; node -= (node & (~node + 1))) {
+        sum += tree[node];
+    }
+    return sum;
+}
+
+/**
+ The largest length for which (length * spacing) + (scale * prefix(length)) <= target. The values and spacing can't be negative.
+ */
+static size_t PDFKFenwickSearch(const double *tree, size_t count, double spacing, double scale, double target)
+{
+    size_t step = 1;
+    while ((step << 1) <= count) {
+        step <<= 1;
+    }
+    size_t position = 0;
+    double sum = 0.0;
+    for (; step > 0; step >>= 1) {
+        size_t next = position + step;
+        if (next <= count && ((next * spacing) + (scale * (sum + tree[next]))) <= target) {
+            position = next;
+            sum += tree[next];
+        }
+    }
+    return position;
+}
+
+#pragma mark Layout
+
+@implementation PDFKPageLayout
+{
+    /**
+     The height of each page divided by its width.
+     */
+    float *pageAspects;
+    /**
+     The largest page aspect in each row.
+     */
+    double *rowAspects;
+    /**
+     The Fenwick tree of the row aspects.
+     */
+    double *rowTree;
+    size_t rowCount;
+}
+
+- (id)initWithPageCount:(NSUInteger)pageCount estimatedPageSize:(CGSize)estimatedPageSize
+{
+    if ((self = [super init])) {
+        _pageCount = pageCount;
+        _pageSpacing = DEFAULT_PAGE_SPACING;
+        _firstPageAlone = YES;
+        
+        float aspect = (estimatedPageSize.width > 0.0 ? (float)(estimatedPageSize.height / estimatedPageSize.width) : 1.0f);
+        pageAspects = malloc(MAX(pageCount, (NSUInteger)1) * sizeof(float));
+        for (NSUInteger index = 0; index < pageCount; index++) {
+            pageAspects[index] = aspect;
+        }
+        [self buildRows];
+    }
+    return self;
+}
+
+- (void)dealloc
+{
+    free(pageAspects);
+    free(rowAspects);
+    free(rowTree);
+}
+
+#pragma mark Rows
+
+- (void)buildRows
+{
+    free(rowAspects);
+    free(rowTree);
+    
+    rowCount = [self rowForPage:_pageCount] + (_pageCount > 0 ? 1 : 0);
+    rowAspects = malloc(MAX(rowCount, (size_t)1) * sizeof(double));
+    rowTree = malloc((rowCount + 1) * sizeof(double));
+    for (size_t row = 0; row < rowCount; row++) {
+        rowAspects[row] = [self aspectOfRow:row];
+    }
+    PDFKFenwickBuild(rowTree, rowAspects, rowCount);
+}
+
+- (size_t)rowForPage:(NSUInteger)page
+{
+    if (page == 0) {
+        return 0;
+    }
+    if (_spreads == NO) {
+        return page - 1;
+    }
+    return (_firstPageAlone ? page / 2 : (page - 1) / 2);
+}
+
+- (NSUInteger)firstPageInRow:(size_t)row
+{
+    if (_spreads == NO) {
+        return row + 1;
+    }
+    if (_firstPageAlone) {
+        return (row == 0 ? 1 : row * 2);
+    }
+    return (row * 2) + 1;
+}
+
+- (NSUInteger)lastPageInRow:(size_t)row
+{
+    if (_spreads == NO) {
+        return row + 1;
+    }
+    if (_firstPageAlone) {
+        return (row == 0 ? 1 : MIN((row * 2) + 1, _pageCount));
+    }
+    return MIN((row * 2) + 2, _pageCount);
+}
+
+- (double)aspectOfRow:(size_t)row
+{
+    double aspect = 0.0;
+    NSUInteger last = [self lastPageInRow:row];
+    for (NSUInteger page = [self firstPageInRow:row]; page <= last; page++) {
+        aspect = MAX(aspect, pageAspects[page - 1]);
+    }
+    return aspect;
+}
+
+/**
+ The width of the pages.
+ */
+- (double)columnWidth
+{
+    double width = (_spreads ? (_width - (_pageSpacing * 3.0)) / 2.0 : _width - (_pageSpacing * 2.0));
+    return MAX(width, 0.0);
+}
+
+#pragma mark Properties
+
+- (void)setSpreads:(BOOL)spreads
+{
+    if (spreads != _spreads) {
+        _spreads = spreads;
+        [self buildRows];
+    }
+}
+
+- (void)setFirstPageAlone:(BOOL)firstPageAlone
+{
+    if (firstPageAlone != _firstPageAlone) {
+        _firstPageAlone = firstPageAlone;
+        if (_spreads) {
+            [self buildRows];
+        }
+    }
+}
+
+- (CGSize)contentSize
+{
+    double height = (rowCount * _pageSpacing) + ([self columnWidth] * PDFKFenwickPrefix(rowTree, rowCount)) + _pageSpacing;
+    return CGSizeMake(_width, (CGFloat)height);
+}
+
+#pragma mark Pages
+
+- (void)setSize:(CGSize)size forPage:(NSUInteger)page
+{
+    if (page < 1 || page > _pageCount || size.width <= 0.0 || size.height <= 0.0) {
+        return;
+    }
+    float aspect = (float)(size.height / size.width);
+    if (aspect == pageAspects[page - 1]) {
+        return;
+    }
+    pageAspects[page - 1] = aspect;
+    
+    size_t row = [self rowForPage:page];
+    double rowAspect = [self aspectOfRow:row];
+    if (rowAspect != rowAspects[row]) {
+        PDFKFenwickAdd(rowTree, rowCount, row, rowAspect - rowAspects[row]);
+        rowAspects[row] = rowAspect;
+    }
+}
+
+- (CGRect)frameForPage:(NSUInteger)page
+{
+    if (page < 1 || page > _pageCount) {
+        return CGRectZero;
+    }
+    size_t row = [self rowForPage:page];
+    double columnWidth = [self columnWidth];
+    double rowTop = ((row + 1) * _pageSpacing) + (columnWidth * PDFKFenwickPrefix(rowTree, row));
+    double rowHeight = columnWidth * rowAspects[row];
+    double height = columnWidth * pageAspects[page - 1];
+    
+    //Center the page in its column, and vertically in its row
+    double x = _pageSpacing;
+    if (_spreads) {
+        NSUInteger first = [self firstPageInRow:row];
+        if (first == [self lastPageInRow:row]) {
+            x = (_width - columnWidth) / 2.0;
+        } else if (page != first) {
+            x = (_pageSpacing * 2.0) + columnWidth;
+        }
+    }
+    return CGRectMake((CGFloat)x, (CGFloat)(rowTop + ((rowHeight - height) / 2.0)), (CGFloat)columnWidth, (CGFloat)height);
+}
+
+- (NSUInteger)pageAtOffset:(CGFloat)offset
+{
+    if (rowCount == 0) {
+        return 0;
+    }
+    size_t row = PDFKFenwickSearch(rowTree, rowCount, _pageSpacing, [self columnWidth], offset);
+    return [self firstPageInRow:MIN(row, rowCount - 1)];
+}
+
+- (NSRange)pagesInRect:(CGRect)rect
+{
+    if (rowCount == 0 || CGRectIsEmpty(rect)) {
+        return NSMakeRange(0, 0);
+    }
+    NSUInteger first = [self pageAtOffset:CGRectGetMinY(rect)];
+    NSUInteger last = [self lastPageInRow:[self rowForPage:[self pageAtOffset:CGRectGetMaxY(rect)]]];
+    return NSMakeRange(first, (last - first) + 1);
+}
+
+@end
@@ -0,0 +1,74 @@
+/*
+ //  PDFKPageRenderCache.h
+ //  M13PDFKit
+ //
+ Copyright (c) 2014 Brandon McQuilkin
+ 
+ Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated documentation files (the
+ "Software"), to deal in the Software without restriction, including without limitation the rights to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software, and to permit persons to whom the Software is furnished to do so, subject to
+ the following conditions:
+ 
+ The above copyright notice and this permission notice shall be included in all copies or substantial portions of the Software.
+ 
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#import <UIKit/UIKit.h>
+#import "PDFKResourceGovernor.h"
+
+@class PDFKPage;
+
+/**
+ Keeps screen resolution bitmaps of the recently viewed pages and of the pages next to the current page, so a page that is swiped back to, or swiped to next, is shown sharp at once instead of from its thumb while tiles render. The cache is used from the main thread, the pages are rendered in the background.
+ */
+@interface PDFKPageRenderCache : NSObject <PDFKResourceConsumer>
+
+/**
+ The size of the view that displays a page. Pages are rendered to fit this size at the screen scale. Changing the size, for example on rotation, removes all the bitmaps and cancels the renders in progress.
+ */
+@property (nonatomic, assign) CGSize viewportSize;
+/**
+ The page being displayed. The pages next to it are kept before other pages when the cache is over its budget.
+ */
+@property (nonatomic, assign) NSInteger currentPage;
+/**
+ The pages likely to be displayed after the current page, other than the pages next to it. They are kept and rendered like the pages next to the current page. Set after the current page, as setting the current page does not clear them.
+ */
+@property (nonatomic, copy) NSIndexSet *predictedPages;
+/**
+ The maximum number of bytes of bitmaps to keep. Defaults to 40MB.
+ */
+@property (nonatomic, assign) NSUInteger byteBudget;
+/**
+ The size in pixels of the bitmap of a page at the current viewport size.
+ 
+ @param page The page.
+ 
+ @return The size of the bitmap, or CGSizeZero if there is no viewport.
+ */
+- (CGSize)pixelSizeForPage:(PDFKPage *)page;
+/**
+ Get the bitmap of a page, if it has been rendered at the current viewport size.
+ 
+ @param page The page.
+ 
+ @return The bitmap, or nil if it is not cached.
+ */
+- (UIImage *)imageForPage:(PDFKPage *)page;
+/**
+ Render a page at the current viewport size in the background, if it is not cached or already rendering.
+ 
+ @param page       The page to render.
+ @param completion Called on the main thread with the bitmap, unless the render is cancelled. May be nil. If the page hangs while drawing, it is called with the page's placeholder once the render guard gives up on the page.
+ */
+- (void)renderPage:(PDFKPage *)page completion:(void (^)(UIImage *image))completion;
+/**
+ Remove all the bitmaps and cancel the renders in progress.
+ */
+- (void)removeAllImages;
+/**
+ Statistics for the cache. The keys are "Requests", "Hits", "Renders", "Evictions", "Bytes" and "MeanRenderTime" (in seconds).
+ */
+@property (nonatomic, readonly) NSDictionary *statistics;
+
+@end
@@ -0,0 +1,435 @@
+/*
+ //  PDFKPageRenderCache.m
+ //  M13PDFKit
+ //
+ Copyright (c) 2014 Brandon McQuilkin
+ 
+ Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated documentation files (the
+ "Software"), to deal in the Software without restriction, including without limitation the rights to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software, and to permit persons to whom the Software is furnished to do so, subject to
+ the following conditions:
+ 
+ The above copyright notice and this permission notice shall be included in all copies or substantial portions of the Software.
+ 
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#import "PDFKPageRenderCache.h"
+#import "PDFKPage.h"
+#import "PDFKPixelBufferPool.h"
+#import "PDFKTrace.h"
+#import "PDFKImageCache.h"
+#import "PDFKRenderGuard.h"
+#import <QuartzCore/QuartzCore.h>
+
+//The pages on each side of the current page that are kept before others
+#define ADJACENT_DISTANCE 1
+//The default maximum bytes of bitmaps
+#define DEFAULT_BYTE_BUDGET (40 * 1024 * 1024)
+
+/**
+ A rendered page.
+ */
+@interface PDFKPageRenderCacheEntry : NSObject
+
+@property (nonatomic, strong) UIImage *image;
+@property (nonatomic, assign) CGSize pixelSize;
+@property (nonatomic, assign) NSUInteger bytes;
+
+@end
+
+@implementation PDFKPageRenderCacheEntry
+
+@end
+
+@implementation PDFKPageRenderCache
+{
+    /**
+     The rendered pages, keyed by page number.
+     */
+    NSMutableDictionary *entries;
+    /**
+     The page numbers of the rendered pages, least recently used first.
+     */
+    NSMutableArray *accessOrder;
+    /**
+     The render operations in progress, keyed by page number.
+     */
+    NSMutableDictionary *renders;
+    /**
+     The pages being rendered, keyed by page number, to render them again if a render hangs.
+     */
+    NSMutableDictionary *renderingPages;
+    /**
+     The blocks waiting for each render, keyed by page number.
+     */
+    NSMutableDictionary *completions;
+    /**
+     Renders the pages in the background.
+     */
+    NSOperationQueue *renderQueue;
+    /**
+     Incremented when the viewport changes, so renders for the old size are thrown away.
+     */
+    NSUInteger generation;
+    NSUInteger totalBytes;
+    
+    //Statistics
+    NSUInteger requestCount;
+    NSUInteger hitCount;
+    NSUInteger renderCount;
+    NSUInteger evictionCount;
+    CFTimeInterval totalRenderTime;
+}
+
+- (id)init
+{
+    if ((self = [super init])) {
+        entries = [NSMutableDictionary new];
+        accessOrder = [NSMutableArray new];
+        renders = [NSMutableDictionary new];
+        renderingPages = [NSMutableDictionary new];
+        completions = [NSMutableDictionary new];
+        _byteBudget = DEFAULT_BYTE_BUDGET;
+        
+        renderQueue = [NSOperationQueue new];
+        [renderQueue setName:@"PDFKPageRenderQueue"];
+        [renderQueue setMaxConcurrentOperationCount:[PDFKRenderGuard workerCount]];
+        
+        //A page that hangs keeps its worker, the other pages render on the other workers.
+        [[NSNotificationCenter defaultCenter] addObserver:self selector:@selector(pageTimedOut:) name:PDFKRenderGuardPageTimedOutNotification object:nil];
+        
+        //Pages can be rendered again, and tiles are drawn meanwhile.
+        [[PDFKResourceGovernor sharedGovernor] registerConsumer:self category:PDFKResourceCategoryTiles priority:PDFKResourcePriorityNormal];
+    }
+    return self;
+}
+
+- (void)dealloc
+{
+    [[NSNotificationCenter defaultCenter] removeObserver:self];
+    [renderQueue cancelAllOperations];
+}
+
+#pragma mark Properties
+
+- (void)setViewportSize:(CGSize)viewportSize
+{
+    if (CGSizeEqualToSize(viewportSize, _viewportSize)) {
+        return;
+    }
+    //Every page needs to be rendered at the new size
+    _viewportSize = viewportSize;
+    [self removeAllImages];
+}
+
+- (void)setCurrentPage:(NSInteger)currentPage
+{
+    _currentPage = currentPage;
+    
+    //Stop rendering pages that are no longer next to the current page
+    for (NSNumber *key in [renders allKeys]) {
+        if ([self isNearCurrentPage:key] == NO) {
+            [self cancelRenderForPageNumber:key];
+        }
+    }
+    [self evictToBudget];
+}
+
+- (void)setPredictedPages:(NSIndexSet *)predictedPages
+{
+    _predictedPages = [predictedPages copy];
+    
+    //Stop rendering pages that are no longer predicted
+    for (NSNumber *key in [renders allKeys]) {
+        if ([self isNearCurrentPage:key] == NO) {
+            [self cancelRenderForPageNumber:key];
+        }
+    }
+}
+
+/**
+ Wether a page is next to the current page, or predicted to be displayed after it.
+ */
+- (BOOL)isNearCurrentPage:(NSNumber *)key
+{
+    return (labs(key.integerValue - _currentPage) <= ADJACENT_DISTANCE || (key.integerValue > 0 && [_predictedPages containsIndex:key.unsignedIntegerValue]));
+}
+
+- (void)setByteBudget:(NSUInteger)byteBudget
+{
+    _byteBudget = byteBudget;
+    [self evictToBudget];
+}
+
+#pragma mark Images
+
+- (CGSize)pixelSizeForPage:(PDFKPage *)page
+{
+    CGSize viewSize = page.viewSize;
+    if (viewSize.width <= 0.0f || viewSize.height <= 0.0f || _viewportSize.width <= 0.0f || _viewportSize.height <= 0.0f) {
+        return CGSizeZero;
+    }
+    //The size the page is shown at when zoomed to fit
+    CGFloat scale = MIN(_viewportSize.width / viewSize.width, _viewportSize.height / viewSize.height) * [UIScreen mainScreen].scale;
+    return CGSizeMake(round(viewSize.width * scale), round(viewSize.height * scale));
+}
+
+- (UIImage *)imageForPage:(PDFKPage *)page
+{
+    NSNumber *key = @(page.pageNumber);
+    PDFKPageRenderCacheEntry *entry = entries[key];
+    requestCount++;
+    
+    if (entry == nil || CGSizeEqualToSize(entry.pixelSize, [self pixelSizeForPage:page]) == NO) {
+        return nil;
+    }
+    
+    hitCount++;
+    [accessOrder removeObject:key];
+    [accessOrder addObject:key];
+    return entry.image;
+}
+
+- (void)renderPage:(PDFKPage *)page completion:(void (^)(UIImage *image))completion
+{
+    NSNumber *key = @(page.pageNumber);
+    CGSize pixelSize = [self pixelSizeForPage:page];
+    if (page == nil || CGSizeEqualToSize(pixelSize, CGSizeZero)) {
+        return;
+    }
+    
+    //Already rendered
+    PDFKPageRenderCacheEntry *entry = entries[key];
+    if (entry != nil && CGSizeEqualToSize(entry.pixelSize, pixelSize)) {
+        if (completion != nil) {
+            completion(entry.image);
+        }
+        return;
+    }
+    
+    if (completion != nil) {
+        NSMutableArray *waiting = completions[key];
+        if (waiting == nil) {
+            waiting = [NSMutableArray new];
+            completions[key] = waiting;
+        }
+        [waiting addObject:[completion copy]];
+    }
+    
+    //Already rendering, make sure it is rendered before prefetched pages if it is waited on.
+    NSOperation *operation = renders[key];
+    if (operation != nil) {
+        if (completion != nil) {
+            operation.queuePriority = NSOperationQueuePriorityHigh;
+        }
+        return;
+    }
+    
+    __weak PDFKPageRenderCache *weakSelf = self;
+    NSUInteger renderGeneration = generation;
+    NSBlockOperation *renderOperation = [NSBlockOperation new];
+    __weak NSBlockOperation *weakOperation = renderOperation;
+    [renderOperation addExecutionBlock:^{
+        NSBlockOperation *operation = weakOperation;
+        if (operation == nil || operation.isCancelled) {
+            return;
+        }
+        CFTimeInterval startTime = CACurrentMediaTime();
+        UIImage *image = [PDFKPageRenderCache newImageOfPage:page pixelSize:pixelSize];
+        CFTimeInterval renderTime = CACurrentMediaTime() - startTime;
+        
+        dispatch_async(dispatch_get_main_queue(), ^{
+            [weakSelf finishRenderOfPageNumber:key image:image pixelSize:pixelSize renderTime:renderTime generation:renderGeneration operation:operation];
+        });
+    }];
+    renderOperation.queuePriority = (completion != nil ? NSOperationQueuePriorityHigh : NSOperationQueuePriorityNormal);
+    renderOperation.qualityOfService = NSQualityOfServiceUserInitiated;
+    renders[key] = renderOperation;
+    renderingPages[key] = page;
+    [renderQueue addOperation:renderOperation];
+}
+
+- (void)finishRenderOfPageNumber:(NSNumber *)key image:(UIImage *)image pixelSize:(CGSize)pixelSize renderTime:(CFTimeInterval)renderTime generation:(NSUInteger)renderGeneration operation:(NSOperation *)operation
+{
+    //Cancelled, or superseded by a new viewport
+    if (renders[key] != operation || renderGeneration != generation) {
+        return;
+    }
+    [renders removeObjectForKey:key];
+    [renderingPages removeObjectForKey:key];
+    NSArray *waiting = completions[key];
+    [completions removeObjectForKey:key];
+    
+    renderCount++;
+    totalRenderTime += renderTime;
+    
+    if (image != nil) {
+        [self removeImageForPageNumber:key];
+        
+        PDFKPageRenderCacheEntry *entry = [PDFKPageRenderCacheEntry new];
+        entry.image = image;
+        entry.pixelSize = pixelSize;
+        entry.bytes = CGImageGetBytesPerRow(image.CGImage) * CGImageGetHeight(image.CGImage);
+        entries[key] = entry;
+        [accessOrder addObject:key];
+        totalBytes += entry.bytes;
+        
+        [self evictToBudget];
+        
+        for (void (^completion)(UIImage *image) in waiting) {
+            completion(image);
+        }
+    }
+}
+
++ (UIImage *)newImageOfPage:(PDFKPage *)page pixelSize:(CGSize)pixelSize
+{
+    uint64_t traceStart = PDFKTraceBegin();
+    size_t width = (size_t)pixelSize.width;
+    size_t height = (size_t)pixelSize.height;
+    CGBitmapInfo bitmapInfo = (kCGBitmapByteOrder32Little | kCGImageAlphaNoneSkipFirst);
+    size_t bytesPerRow = PDFKPixelBufferBytesPerRow(width);
+    void *buffer = PDFKPixelBufferAllocate(bytesPerRow * height);
+    if (buffer == NULL) {
+        return nil;
+    }
+    
+    CGColorSpaceRef rgb = CGColorSpaceCreateDeviceRGB();
+    CGContextRef context = CGBitmapContextCreate(buffer, width, height, 8, bytesPerRow, rgb, bitmapInfo);
+    CGColorSpaceRelease(rgb);
+    if (context == NULL) {
+        PDFKPixelBufferRelease(buffer);
+        return nil;
+    }
+    
+    //Draw the page the same way the tiles are drawn, scaled to the bitmap.
+    CGRect pageRect = CGRectMake(0.0f, 0.0f, page.viewSize.width, page.viewSize.height);
+    CGContextSetRGBFillColor(context, 1.0f, 1.0f, 1.0f, 1.0f);
+    CGContextFillRect(context, CGRectMake(0.0f, 0.0f, width, height));
+    CGContextScaleCTM(context, width / pageRect.size.width, height / pageRect.size.height);
+    CGContextConcatCTM(context, CGPDFPageGetDrawingTransform(page.pageRef, kCGPDFCropBox, pageRect, 0, true));
+    PDFKImageCacheDrawPage(context, page.pageRef);
+    CGContextRelease(context);
+    
+    CGImageRef imageRef = PDFKPixelBufferCreateImage(buffer, width, height, bytesPerRow, bitmapInfo);
+    PDFKTraceEnd(PDFKTraceStageRasterize, traceStart, page.pageNumber);
+    if (imageRef == NULL) {
+        return nil;
+    }
+    UIImage *image = [UIImage imageWithCGImage:imageRef scale:[UIScreen mainScreen].scale orientation:UIImageOrientationUp];
+    CGImageRelease(imageRef);
+    return image;
+}
+
+- (void)pageTimedOut:(NSNotification *)notification
+{
+    NSNumber *key = notification.userInfo[@"Page"];
+    PDFKPage *page = renderingPages[key];
+    if (page == nil || PDFKRenderGuardDocumentKey(page.documentRef) != [notification.userInfo[@"DocumentKey"] unsignedLongLongValue]) {
+        return;
+    }
+    
+    //The render is stuck drawing the page. Render it again, it draws the placeholder now, and the waiting completions get it.
+    [renders removeObjectForKey:key];
+    [renderingPages removeObjectForKey:key];
+    [self renderPage:page completion:nil];
+}
+
+#pragma mark Eviction
+
+- (void)cancelRenderForPageNumber:(NSNumber *)key
+{
+    [renders[key] cancel];
+    [renders removeObjectForKey:key];
+    [renderingPages removeObjectForKey:key];
+    [completions removeObjectForKey:key];
+}
+
+- (void)removeImageForPageNumber:(NSNumber *)key
+{
+    PDFKPageRenderCacheEntry *entry = entries[key];
+    if (entry != nil) {
+        totalBytes -= entry.bytes;
+        [entries removeObjectForKey:key];
+        [accessOrder removeObject:key];
+    }
+}
+
+/**
+ The least recently used page to evict: pages away from the current page first, then the pages next to it or predicted. The current page is never evicted to meet the budget.
+ */
+- (NSNumber *)pageNumberToEvict
+{
+    for (NSNumber *key in accessOrder) {
+        if ([self isNearCurrentPage:key] == NO) {
+            return key;
+        }
+    }
+    for (NSNumber *key in accessOrder) {
+        if (key.integerValue != _currentPage) {
+            return key;
+        }
+    }
+    return nil;
+}
+
+- (void)evictToBudget
+{
+    while (totalBytes > _byteBudget) {
+        NSNumber *key = [self pageNumberToEvict];
+        if (key == nil) {
+            break;
+        }
+        [self removeImageForPageNumber:key];
+        evictionCount++;
+    }
+}
+
+- (void)removeAllImages
+{
+    generation++;
+    [renderQueue cancelAllOperations];
+    [renders removeAllObjects];
+    [renderingPages removeAllObjects];
+    [completions removeAllObjects];
+    [entries removeAllObjects];
+    [accessOrder removeAllObjects];
+    totalBytes = 0;
+}
+
+#pragma mark Statistics
+
+- (NSDictionary *)statistics
+{
+    return @{@"Requests": @(requestCount),
+             @"Hits": @(hitCount),
+             @"Renders": @(renderCount),
+             @"Evictions": @(evictionCount),
+             @"Bytes": @(totalBytes),
+             @"MeanRenderTime": @(renderCount > 0 ? totalRenderTime / renderCount : 0.0)};
+}
+
+#pragma mark PDFKResourceConsumer
+
+- (NSUInteger)resourceBytes
+{
+    return totalBytes;
+}
+
+- (NSUInteger)shedResourcesForPressure:(PDFKResourcePressure)pressure
+{
+    NSUInteger bytes = totalBytes;
+    if (pressure >= PDFKResourcePressureCritical) {
+        [self removeAllImages];
+    } else {
+        //Keep the page on screen
+        for (NSNumber *key in [accessOrder copy]) {
+            if (key.integerValue != _currentPage) {
+                [self removeImageForPageNumber:key];
+            }
+        }
+    }
+    return bytes - totalBytes;
+}
+
+@end
@@ -81,6 +81,10 @@
  Update the scrubber to display the current page (If not selected through the scrubber.
  */
 - (void)updateScrubber;
+/**
+ Statistics for the previews shown while scrubbing, since the scrubber was created. The keys are "Previews" (the number of previews shown), "ExactHits" (previews that used the cached large thumb), "StripHits" (previews taken from the thumb strip), "Upgrades" (large thumbs requested after the touch paused), "Superseded" (large thumb requests cancelled by a newer page), "MeanPreviewLatency" and "MaxPreviewLatency" (in seconds, from the track value changing to the preview being set).
+ */
+@property (nonatomic, readonly) NSDictionary *scrubbingStatistics;
 
 @end
 
@@ -27,6 +27,9 @@
 #import "PDFKDocument.h"
 #import "PDFKThumbRequest.h"
 #import "PDFKThumbCache.h"
+#import "PDFKThumbStripRenderer.h"
+#import "PDFKSessionRecorder.h"
+#import <QuartzCore/QuartzCore.h>
 
 #define THUMB_SMALL_GAP 2
 #define THUMB_SMALL_WIDTH 22
@@ -34,6 +37,8 @@
 #define THUMB_LARGE_WIDTH 32
 #define THUMB_LARGE_HEIGHT 42
 
+#define PREVIEW_UPGRADE_DELAY 0.12
+
 #define PAGE_NUMBER_WIDTH 96.0f
 #define PAGE_NUMBER_HEIGHT 30.0f
 #define PAGE_NUMBER_SPACE 20.0f
@@ -53,7 +58,22 @@
      */
     UIView *containerView;
         
-    NSMutableDictionary *miniThumbViews;
+    /**
+     The view that displays the strip of small thumbs. All the small thumbs are composited into one image, so the strip is a single view.
+     */
+    UIImageView *stripView;
+    /**
+     The operation that is creating the strip.
+     */
+    PDFKThumbStripRenderer *stripOperation;
+    /**
+     The number of thumbs in the current strip.
+     */
+    NSInteger stripThumbCount;
+    /**
+     The finished strip image, used to preview pages while scrubbing.
+     */
+    UIImage *stripImage;
         
     PDFKPageScrubberThumb *pageThumbView;
     
@@ -63,6 +83,17 @@
     
     NSTimer *enableTimer;
     NSTimer *trackTimer;
+    //Requests the large thumb once the touch pauses while scrubbing.
+    NSTimer *previewTimer;
+    
+    //Scrubbing statistics
+    NSUInteger previewCount;
+    NSUInteger exactHitCount;
+    NSUInteger stripHitCount;
+    NSUInteger upgradeCount;
+    NSUInteger supersededCount;
+    CFTimeInterval totalPreviewLatency;
+    CFTimeInterval maxPreviewLatency;
 }
 
 @synthesize pageNumberLabel = pageNumberLabel;
@@ -139,8 +170,6 @@
 		document = object; // Retain the document object for our use
         
 		[self updatePageNumberText:document.currentPage];
-        
-		miniThumbViews = [NSMutableDictionary new]; // Small thumbs
 	}
     
 	return self;
@@ -158,11 +187,16 @@
     //Invalidate timers
 	[trackTimer invalidate];
     [enableTimer invalidate];
+    [previewTimer invalidate];
+    
+    //Stop creating the strip
+    [stripOperation cancel];
+    stripOperation = nil;
     
 	[super removeFromSuperview];
 }
 
-- (void)updatePageThumbView:(NSInteger)page
+- (void)positionPageThumbView:(NSInteger)page
 {
 	NSInteger pages = document.pageCount;
     
@@ -184,6 +218,18 @@
 			pageThumbView.frame = pageThumbRect;
 		}
 	}
+}
+
+- (PDFKThumbRequest *)pageThumbRequestForPage:(NSInteger)page
+{
+    //Maximum thumb size
+    CGSize size = CGSizeMake(THUMB_LARGE_WIDTH, THUMB_LARGE_HEIGHT);
+    return [PDFKThumbRequest newForView:pageThumbView fileURL:document.fileURL password:document.password guid:document.fingerprint page:page size:size];
+}
+
+- (void)updatePageThumbView:(NSInteger)page
+{
+    [self positionPageThumbView:page];
     
     //Only if page number changed
 	if (page != pageThumbView.tag) {
@@ -191,15 +237,8 @@
 		pageThumbView.tag = page;
         [pageThumbView clearForReuse];
         
-        //Maximum thumb size
-		CGSize size = CGSizeMake(THUMB_LARGE_WIDTH, THUMB_LARGE_HEIGHT);
-        
         //Get the thumb for the page.
-		NSURL *fileURL = document.fileURL;
-        NSString *guid = document.guid;
-        NSString *phrase = document.password;
-        
-		PDFKThumbRequest *request = [PDFKThumbRequest newForView:pageThumbView fileURL:fileURL password:phrase guid:guid page:page size:size];
+		PDFKThumbRequest *request = [self pageThumbRequestForPage:page];
         
         //Request the thumb
 		UIImage *image = [[PDFKThumbCache sharedCache] thumbRequest:request priority:YES];
@@ -210,6 +249,113 @@
 	}
 }
 
+#pragma mark Scrubbing previews
+
+- (UIImage *)stripPreviewForPage:(NSInteger)page
+{
+    if (stripImage == nil || stripThumbCount < 1) {
+        return nil;
+    }
+    
+    //Find the thumb in the strip closest to the page
+    NSInteger strideThumbs = (stripThumbCount - 1);
+    if (strideThumbs < 1) strideThumbs = 1;
+    CGFloat stride = ((CGFloat)document.pageCount / (CGFloat)strideThumbs);
+    NSInteger thumb = (NSInteger)round((page - 1) / stride);
+    if (thumb < 0) thumb = 0;
+    if (thumb >= stripThumbCount) thumb = (stripThumbCount - 1);
+    
+    //Crop the thumb out of the strip, the image view scales it up.
+    CGFloat scale = stripImage.scale;
+    CGRect cropRect = CGRectMake((thumb * (THUMB_SMALL_WIDTH + THUMB_SMALL_GAP) * scale), 0.0f, (THUMB_SMALL_WIDTH * scale), (THUMB_SMALL_HEIGHT * scale));
+    CGImageRef imageRef = CGImageCreateWithImageInRect(stripImage.CGImage, cropRect);
+    if (imageRef == NULL) {
+        return nil;
+    }
+    UIImage *image = [UIImage imageWithCGImage:imageRef scale:scale orientation:UIImageOrientationUp];
+    CGImageRelease(imageRef);
+    return image;
+}
+
+- (void)showScrubbingPreviewForPage:(NSInteger)page
+{
+    CFTimeInterval startTime = CACurrentMediaTime();
+    
+    [self positionPageThumbView:page];
+    
+	if (page == pageThumbView.tag) {
+        return;
+    }
+    [[PDFKSessionRecorder sharedRecorder] recordEvent:PDFKSessionEventScrub page:page count:1];
+    
+    //Cancel the large thumb request for the previous page, it is no longer needed.
+    if (pageThumbView.operation != nil) {
+        supersededCount++;
+    }
+    pageThumbView.tag = page;
+    [pageThumbView clearForReuse];
+    
+    //Use the large thumb if it is already in memory, otherwise the nearest thumb in the strip.
+    PDFKThumbRequest *request = [self pageThumbRequestForPage:page];
+    id object = [[PDFKThumbCache sharedCache] objectForKey:request.cacheKey];
+    UIImage *image = nil;
+    if ([object isKindOfClass:[UIImage class]]) {
+        image = object;
+        exactHitCount++;
+    } else {
+        image = [self stripPreviewForPage:page];
+        if (image != nil) {
+            stripHitCount++;
+        }
+        //Request the large thumb when the touch pauses
+        [self restartPreviewTimer];
+    }
+    [pageThumbView showImage:image];
+    
+    //Latency
+    CFTimeInterval latency = (CACurrentMediaTime() - startTime);
+    previewCount++;
+    totalPreviewLatency += latency;
+    if (latency > maxPreviewLatency) maxPreviewLatency = latency;
+}
+
+- (void)previewTimerFired:(NSTimer *)timer
+{
+	[previewTimer invalidate];
+    previewTimer = nil;
+    
+    NSInteger page = pageThumbView.tag;
+    if (page < 1) {
+        return;
+    }
+    
+    //Upgrade the preview to the large thumb
+    PDFKThumbRequest *request = [self pageThumbRequestForPage:page];
+    UIImage *image = [[PDFKThumbCache sharedCache] thumbRequest:request priority:YES];
+    if ([image isKindOfClass:[UIImage class]]) {
+        [pageThumbView showImage:image];
+    }
+    upgradeCount++;
+}
+
+- (void)restartPreviewTimer
+{
+	[previewTimer invalidate];
+	previewTimer = [NSTimer scheduledTimerWithTimeInterval:PREVIEW_UPGRADE_DELAY target:self selector:@selector(previewTimerFired:) userInfo:nil repeats:NO];
+}
+
+- (NSDictionary *)scrubbingStatistics
+{
+    CFTimeInterval meanLatency = (previewCount > 0 ? (totalPreviewLatency / previewCount) : 0.0);
+    return @{@"Previews": @(previewCount),
+             @"ExactHits": @(exactHitCount),
+             @"StripHits": @(stripHitCount),
+             @"Upgrades": @(upgradeCount),
+             @"Superseded": @(supersededCount),
+             @"MeanPreviewLatency": @(meanLatency),
+             @"MaxPreviewLatency": @(maxPreviewLatency)};
+}
+
 - (void)layoutSubviews
 {
     //Update the containerview frame for the current bounds.
@@ -259,75 +405,89 @@
     //Update page thumb view
 	[self updatePageThumbView:document.currentPage];
     
-	NSInteger strideThumbs = (thumbs - 1);
-    if (strideThumbs < 1) strideThumbs = 1;
+	CGFloat heightDelta = (controlRect.size.height - THUMB_SMALL_HEIGHT);
     
-    //Page stride
-	CGFloat stride = ((CGFloat)pages / (CGFloat)strideThumbs);
+    //Strip X, Y
+	NSInteger stripY = (heightDelta / 2.0f);
+	CGRect stripRect = CGRectMake(0.0f, stripY, controlWidth, THUMB_SMALL_HEIGHT);
+    
+    //Create the strip view when needed
+    if (stripView == nil) {
+        stripView = [[UIImageView alloc] initWithFrame:stripRect];
+        stripView.userInteractionEnabled = NO;
+        stripView.contentMode = UIViewContentModeScaleToFill;
+        //Add below the page thumb view
+        [trackControl insertSubview:stripView belowSubview:pageThumbView];
+    } else if (CGRectEqualToRect(stripView.frame, stripRect) == false) {
+        stripView.frame = stripRect;
+    }
     
-	CGFloat heightDelta = (controlRect.size.height - THUMB_SMALL_HEIGHT);
+    //Only request a new strip if the number of thumbs changed
+    if (thumbs != stripThumbCount) {
+        stripThumbCount = thumbs;
+        [self requestStripWithThumbCount:thumbs];
+    }
+}
+
+- (UIImage *)placeholderStripWithThumbCount:(NSInteger)thumbs
+{
+    CGFloat thumbWidth = (THUMB_SMALL_WIDTH + THUMB_SMALL_GAP);
+    CGSize size = CGSizeMake(((thumbs * thumbWidth) - THUMB_SMALL_GAP), THUMB_SMALL_HEIGHT);
+    if (size.width <= 0.0f) {
+        return nil;
+    }
     
-    //Initial X, Y
-	NSInteger thumbY = (heightDelta / 2.0f);
-    NSInteger thumbX = 0;
-    
-	CGRect thumbRect = CGRectMake(thumbX, thumbY, THUMB_SMALL_WIDTH, THUMB_SMALL_HEIGHT);
-    
-	NSMutableDictionary *thumbsToHide = [miniThumbViews mutableCopy];
-    
-    //Iterate through needed thumbs
-	for (NSInteger thumb = 0; thumb < thumbs; thumb++) {
-        
-        // Page
-		NSInteger page = ((stride * thumb) + 1);
-        if (page > pages) page = pages;
-        
-        //Page number key for thumb view
-		NSNumber *key = [NSNumber numberWithInteger:page];
-        
-		PDFKPageScrubberThumb *smallThumbView = [miniThumbViews objectForKey:key];
-        
-        //We need to create a new small thumb view for the page number
-		if (smallThumbView == nil) {
-            //Maximum thumb size
-			CGSize size = CGSizeMake(THUMB_SMALL_WIDTH, THUMB_SMALL_HEIGHT);
-            
-			NSURL *fileURL = document.fileURL;
-            NSString *guid = document.guid;
-            NSString *phrase = document.password;
-            
-            //Create a small thumb view
-			smallThumbView = [[PDFKPageScrubberThumb alloc] initWithFrame:thumbRect small:YES andColor:self.thumbBackgroundColor];
-			PDFKThumbRequest *thumbRequest = [PDFKThumbRequest newForView:smallThumbView fileURL:fileURL password:phrase guid:guid page:page size:size];
-            
-            //Request the thumb
-			UIImage *image = [[PDFKThumbCache sharedCache] thumbRequest:thumbRequest priority:NO];
-            
-            //Use thumb image from cache, and show it
-			if ([image isKindOfClass:[UIImage class]]) [smallThumbView showImage:image];
-            
-			[trackControl addSubview:smallThumbView];
-            [miniThumbViews setObject:smallThumbView forKey:key];
-            
-		} else {
-            // Resue existing small thumb view for the page number
-			smallThumbView.hidden = NO;
-            [thumbsToHide removeObjectForKey:key];
-            
-			if (CGRectEqualToRect(smallThumbView.frame, thumbRect) == false) {
-				smallThumbView.frame = thumbRect;
-			}
-		}
-        
-        //Next thumb X position
-		thumbRect.origin.x += thumbWidth;
-	}
+    UIGraphicsBeginImageContextWithOptions(size, NO, 0.0f);
+    
+    //Fill a cell for each thumb
+    [[self.thumbBackgroundColor colorWithAlphaComponent:0.6f] setFill];
+    CGRect cellRect = CGRectMake(0.0f, 0.0f, THUMB_SMALL_WIDTH, THUMB_SMALL_HEIGHT);
+    for (NSInteger thumb = 0; thumb < thumbs; thumb++) {
+        UIRectFill(cellRect);
+        cellRect.origin.x += thumbWidth;
+    }
     
-    //Hide unused thumbs
-	[thumbsToHide enumerateKeysAndObjectsUsingBlock:^(id key, id object, BOOL *stop) {
-        PDFKPageScrubberThumb *thumb = object;
-        thumb.hidden = YES;
-     }];
+    UIImage *image = UIGraphicsGetImageFromCurrentImageContext();
+    UIGraphicsEndImageContext();
+    return image;
+}
+
+- (void)requestStripWithThumbCount:(NSInteger)thumbs
+{
+    //Cancel the previous strip
+    [stripOperation cancel];
+    stripOperation = nil;
+    
+    //Show the placeholder until the strip is ready
+    stripImage = nil;
+    stripView.image = [self placeholderStripWithThumbCount:thumbs];
+    
+    if (thumbs < 1) {
+        return;
+    }
+    
+    CGSize size = CGSizeMake(THUMB_SMALL_WIDTH, THUMB_SMALL_HEIGHT);
+    
+    __weak PDFKPageScrubber *weakSelf = self;
+    stripOperation = [[PDFKThumbStripRenderer alloc] initWithFileURL:document.fileURL password:document.password guid:document.fingerprint pageCount:document.pageCount thumbCount:thumbs thumbSize:size gap:THUMB_SMALL_GAP completion:^(UIImage *strip) {
+        [weakSelf showStrip:strip thumbCount:thumbs];
+    }];
+    
+    [[PDFKThumbQueue sharedQueue] addWorkOperation:stripOperation];
+}
+
+- (void)showStrip:(UIImage *)strip thumbCount:(NSInteger)thumbs
+{
+    //Ignore strips that have been replaced
+    if (thumbs != stripThumbCount) {
+        return;
+    }
+    stripOperation = nil;
+    
+    if (strip != nil) {
+        stripView.image = strip;
+        stripImage = strip;
+    }
 }
 
 - (void)updateScrubber
@@ -417,9 +577,9 @@
 	NSInteger page = [self trackViewPageNumber:trackView];
     
 	if (page != document.currentPage) {
-        //Update
+        //Update, with the instant preview
 		[self updatePageNumberText:page];
-		[self updatePageThumbView:page];
+		[self showScrubbingPreviewForPage:page];
         //Start tracking.
 		[self restartTrackTimer];
 	}
@@ -433,9 +593,9 @@
     
     //Only if the page number has changed
 	if (page != trackView.tag) {
-        //Update
+        //Update, with the instant preview
 		[self updatePageNumberText:page];
-		[self updatePageThumbView:page];
+		[self showScrubbingPreviewForPage:page];
         //Update the page tracking tag
 		trackView.tag = page;
         
@@ -450,6 +610,11 @@
 	[trackTimer invalidate];
     trackTimer = nil;
     
+    //Upgrade the preview now, rather than when the timer fires
+    if (previewTimer != nil) {
+        [self previewTimerFired:previewTimer];
+    }
+    
     //Only if the page number has changed.
 	if (trackView.tag != document.currentPage)
 	{
@@ -467,7 +632,6 @@
 	trackView.tag = 0;
 }
 
-
 @end
 
 @implementation PDFKPageScrubberTrackControl
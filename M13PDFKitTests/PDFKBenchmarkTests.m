@@ -0,0 +1,1915 @@
+//
+//  PDFKBenchmarkTests.m
+//  M13PDFKitTests
+//
+//  Created by Brandon McQuilkin on 11/19/14.
+//  Copyright (c) 2014 BrandonMcQuilkin. All rights reserved.
+//
+//  Benchmarks for the document and thumb pipeline.
+//
+//  Environment variables:
+//  PDFK_BENCHMARK_CORPUS   A directory of PDF files to benchmark. A generated document is used if not set.
+//  PDFK_BENCHMARK_OUTPUT   The file to write the JSON results to. Defaults to PDFKBenchmarks.json in the temporary directory.
+//  PDFK_BENCHMARK_BASELINE A JSON results file from a previous run. Benchmarks that are slower than the baseline fail.
+//
+
+#import <UIKit/UIKit.h>
+#import <XCTest/XCTest.h>
+#import <ImageIO/ImageIO.h>
+#import <QuartzCore/QuartzCore.h>
+#import "PDFKDocument.h"
+#import "PDFKPage.h"
+#import "PDFKThumbCache.h"
+#import "CGPDFDocument.h"
+#import "PDFKThumbCodec.h"
+#import "PDFKPixelBufferPool.h"
+#import "PDFKDocumentImporter.h"
+#import "PDFKDocumentMetadata.h"
+#import "PDFKPageLayout.h"
+#import "PDFKIncrementalWriter.h"
+#import "PDFKFileReader.h"
+#import "PDFKPageSet.h"
+#import "PDFKPageExporter.h"
+#import "PDFKThumbFileIO.h"
+#import "PDFKImageCache.h"
+#import "PDFKFontCache.h"
+#import "PDFKTextExtractor.h"
+#import "PDFKSessionRecorder.h"
+#import "PDFKSessionReplayer.h"
+#import "PDFKRectIndex.h"
+#import "PDFKHighlightOverlay.h"
+#import "PDFKNavigationModel.h"
+#import "PDFKRenderGuard.h"
+#import "PDFKPageScrubber.h"
+#import "PDFKResourceGovernor.h"
+#import "PDFKThumbCacheManifest.h"
+#import "PDFKTrace.h"
+#import <mach/mach.h>
+#import <libkern/OSAtomic.h>
+#import <fcntl.h>
+#import <unistd.h>
+
+//The number of timed samples for each benchmark
+#define BENCHMARK_SAMPLES 15
+//The pages in the generated document
+#define GENERATED_PAGES 48
+//The number of pages in the generated scanned document
+#define GENERATED_SCAN_PAGES 12
+//A benchmark regresses if its median is this much slower than the baseline...
+#define REGRESSION_TOLERANCE 0.10
+//...and the difference is larger than this many median absolute deviations.
+#define REGRESSION_DEVIATIONS 3.0
+//The pages in the generated page sets are smaller than this, so the sets have three chunks
+#define PAGE_SET_UNIVERSE 180000
+//The number of document caches in the manifest benchmark
+#define MANIFEST_ENTRIES 100000
+//The number of stages each thread times in the trace benchmark
+#define TRACE_EVENTS 100000
+
+@interface PDFKDocument (Benchmarks)
+
++ (BOOL)isPDF:(NSString *)filePath;
+
+@end
+
+@interface PDFKPageScrubber (Benchmarks)
+
+- (void)trackViewTouchDown:(PDFKPageScrubberTrackControl *)trackView;
+- (void)trackViewValueChanged:(PDFKPageScrubberTrackControl *)trackView;
+- (void)trackViewTouchUp:(PDFKPageScrubberTrackControl *)trackView;
+
+@end
+
+/**
+ A consumer for the resource governor tests.
+ */
+@interface PDFKBenchmarkConsumer : NSObject <PDFKResourceConsumer>
+{
+@public
+    volatile int64_t bytes;
+}
+
+/**
+ Called when the consumer is asked to release its resources.
+ */
+@property (nonatomic, copy) void (^shedBlock)(PDFKBenchmarkConsumer *consumer);
+
+@end
+
+@implementation PDFKBenchmarkConsumer
+
+- (NSUInteger)resourceBytes
+{
+    int64_t value = OSAtomicAdd64Barrier(0, &bytes);
+    return (value > 0 ? (NSUInteger)value : 0);
+}
+
+- (NSUInteger)shedResourcesForPressure:(PDFKResourcePressure)pressure
+{
+    if (_shedBlock != nil) {
+        _shedBlock(self);
+    }
+    int64_t value = 0;
+    do {
+        value = bytes;
+    } while (OSAtomicCompareAndSwap64Barrier(value, 0, &bytes) == false);
+    return (value > 0 ? (NSUInteger)value : 0);
+}
+
+@end
+
+@interface PDFKBenchmarkTests : XCTestCase
+
+@end
+
+@implementation PDFKBenchmarkTests
+
+static NSMutableDictionary *benchmarkResults = nil;
+
+#pragma mark Corpus
+
++ (NSString *)generatedDocumentPath
+{
+    NSString *path = [NSTemporaryDirectory() stringByAppendingPathComponent:@"PDFKBenchmark.pdf"];
+    if ([[NSFileManager defaultManager] fileExistsAtPath:path]) {
+        return path;
+    }
+    
+    //A document with text, a named destination on each page, and links to the next page and to a URL.
+    CGRect pageRect = CGRectMake(0.0f, 0.0f, 612.0f, 792.0f);
+    UIGraphicsBeginPDFContextToFile(path, pageRect, @{(NSString *)kCGPDFContextTitle: @"PDFKit Benchmark", (NSString *)kCGPDFContextAuthor: @"M13PDFKit"});
+    NSDictionary *attributes = @{NSFontAttributeName: [UIFont systemFontOfSize:12.0f]};
+    for (NSInteger page = 1; page <= GENERATED_PAGES; page++) {
+        UIGraphicsBeginPDFPage();
+        
+        NSString *name = [NSString stringWithFormat:@"page-%ld", (long)page];
+        UIGraphicsAddPDFContextDestinationAtPoint(name, CGPointZero);
+        
+        for (NSInteger line = 0; line < 40; line++) {
+            NSString *text = [NSString stringWithFormat:@"Page %ld line %ld. The quick brown fox jumps over the lazy dog.", (long)page, (long)line];
+            [text drawAtPoint:CGPointMake(36.0f, 36.0f + (line * 16.0f)) withAttributes:attributes];
+        }
+        
+        NSString *next = [NSString stringWithFormat:@"page-%ld", (long)((page % GENERATED_PAGES) + 1)];
+        UIGraphicsSetPDFContextDestinationForRect(next, CGRectMake(36.0f, 700.0f, 200.0f, 24.0f));
+        UIGraphicsSetPDFContextURLForRect([NSURL URLWithString:@"http://www.example.com"], CGRectMake(376.0f, 700.0f, 200.0f, 24.0f));
+    }
+    UIGraphicsEndPDFContext();
+    
+    return path;
+}
+
++ (NSString *)generatedScanPath
+{
+    NSString *path = [NSTemporaryDirectory() stringByAppendingPathComponent:@"PDFKBenchmarkScan.pdf"];
+    if ([[NSFileManager defaultManager] fileExistsAtPath:path]) {
+        return path;
+    }
+    
+    //A scanned document: every page only draws the same large JPEG image.
+    CGSize scanSize = CGSizeMake(1700.0f, 2200.0f);
+    UIGraphicsBeginImageContextWithOptions(scanSize, YES, 1.0f);
+    CGContextRef context = UIGraphicsGetCurrentContext();
+    for (NSInteger band = 0; band < 110; band++) {
+        CGContextSetRGBFillColor(context, (band % 7) / 7.0f, (band % 11) / 11.0f, (band % 13) / 13.0f, 1.0f);
+        CGContextFillRect(context, CGRectMake((band * 37) % 1700, band * 20.0f, 900.0f, 20.0f));
+    }
+    UIImage *scan = [UIImage imageWithData:UIImageJPEGRepresentation(UIGraphicsGetImageFromCurrentImageContext(), 0.8f)];
+    UIGraphicsEndImageContext();
+    
+    CGRect pageRect = CGRectMake(0.0f, 0.0f, 612.0f, 792.0f);
+    UIGraphicsBeginPDFContextToFile(path, pageRect, nil);
+    for (NSInteger page = 1; page <= GENERATED_SCAN_PAGES; page++) {
+        UIGraphicsBeginPDFPage();
+        [scan drawInRect:pageRect];
+    }
+    UIGraphicsEndPDFContext();
+    
+    return path;
+}
+
++ (NSArray *)corpusPaths
+{
+    static NSArray *paths = nil;
+    static dispatch_once_t predicate = 0;
+    dispatch_once(&predicate, ^{
+        NSString *corpus = [[NSProcessInfo processInfo] environment][@"PDFK_BENCHMARK_CORPUS"];
+        NSMutableArray *found = [NSMutableArray new];
+        if (corpus.length > 0) {
+            for (NSString *file in [[NSFileManager defaultManager] contentsOfDirectoryAtPath:corpus error:NULL]) {
+                if ([[file pathExtension] caseInsensitiveCompare:@"pdf"] == NSOrderedSame) {
+                    [found addObject:[corpus stringByAppendingPathComponent:file]];
+                }
+            }
+        }
+        if (found.count == 0) {
+            [found addObject:[self generatedDocumentPath]];
+        }
+        paths = found;
+    });
+    return paths;
+}
+
++ (NSArray *)corpusPagesWithLinks
+{
+    NSMutableArray *pages = [NSMutableArray new];
+    for (NSString *path in [self corpusPaths]) {
+        CGPDFDocumentRef documentRef = CGPDFDocumentCreate([NSURL fileURLWithPath:path], nil);
+        if (documentRef == NULL) {
+            continue;
+        }
+        size_t pageCount = CGPDFDocumentGetNumberOfPages(documentRef);
+        for (size_t page = 1; page <= pageCount; page++) {
+            PDFKPage *pageModel = [[PDFKPage alloc] initWithDocumentRef:documentRef page:page];
+            if (pageModel.links.count > 0) {
+                [pages addObject:pageModel];
+            }
+        }
+        CGPDFDocumentRelease(documentRef);
+    }
+    return pages;
+}
+
+#pragma mark Statistics
+
++ (void)setUp
+{
+    [super setUp];
+    benchmarkResults = [NSMutableDictionary new];
+}
+
++ (void)tearDown
+{
+    NSMutableDictionary *output = [NSMutableDictionary new];
+    output[@"device"] = [UIDevice currentDevice].model;
+    output[@"system"] = [UIDevice currentDevice].systemVersion;
+    output[@"corpus"] = @([self corpusPaths].count);
+    output[@"benchmarks"] = benchmarkResults;
+    
+    NSString *outputPath = [[NSProcessInfo processInfo] environment][@"PDFK_BENCHMARK_OUTPUT"];
+    if (outputPath.length == 0) {
+        outputPath = [NSTemporaryDirectory() stringByAppendingPathComponent:@"PDFKBenchmarks.json"];
+    }
+    NSData *data = [NSJSONSerialization dataWithJSONObject:output options:NSJSONWritingPrettyPrinted error:NULL];
+    [data writeToFile:outputPath atomically:YES];
+    NSLog(@"Benchmark results written to %@", outputPath);
+    
+    [super tearDown];
+}
+
+static double Median(NSArray *sortedValues)
+{
+    NSUInteger count = sortedValues.count;
+    if (count == 0) {
+        return 0.0;
+    }
+    if (count % 2) {
+        return [sortedValues[count / 2] doubleValue];
+    }
+    return ([sortedValues[(count / 2) - 1] doubleValue] + [sortedValues[count / 2] doubleValue]) / 2.0;
+}
+
+- (NSDictionary *)baselineForBenchmark:(NSString *)name
+{
+    static NSDictionary *baseline = nil;
+    static dispatch_once_t predicate = 0;
+    dispatch_once(&predicate, ^{
+        NSString *path = [[NSProcessInfo processInfo] environment][@"PDFK_BENCHMARK_BASELINE"];
+        NSData *data = (path.length > 0 ? [NSData dataWithContentsOfFile:path] : nil);
+        NSDictionary *results = (data != nil ? [NSJSONSerialization JSONObjectWithData:data options:0 error:NULL] : nil);
+        baseline = results[@"benchmarks"];
+    });
+    return baseline[name];
+}
+
+/**
+ Time the block, record the results, and compare them to the baseline.
+ */
+- (void)benchmark:(NSString *)name block:(void (^)(void))block
+{
+    //Warm up
+    block();
+    
+    NSMutableArray *samples = [NSMutableArray new];
+    for (NSInteger sample = 0; sample < BENCHMARK_SAMPLES; sample++) {
+        CFTimeInterval start = CACurrentMediaTime();
+        @autoreleasepool {
+            block();
+        }
+        [samples addObject:@(CACurrentMediaTime() - start)];
+    }
+    
+    NSArray *sorted = [samples sortedArrayUsingSelector:@selector(compare:)];
+    double median = Median(sorted);
+    NSMutableArray *deviations = [NSMutableArray new];
+    for (NSNumber *value in sorted) {
+        [deviations addObject:@(fabs(value.doubleValue - median))];
+    }
+    double deviation = Median([deviations sortedArrayUsingSelector:@selector(compare:)]);
+    double mean = [[samples valueForKeyPath:@"@avg.self"] doubleValue];
+    
+    NSDictionary *result = @{@"samples": @(samples.count),
+                             @"median": @(median),
+                             @"mad": @(deviation),
+                             @"mean": @(mean),
+                             @"min": sorted.firstObject,
+                             @"max": sorted.lastObject};
+    benchmarkResults[name] = result;
+    
+    //Compare to the baseline
+    NSDictionary *baseline = [self baselineForBenchmark:name];
+    if (baseline != nil) {
+        double baselineMedian = [baseline[@"median"] doubleValue];
+        double noise = MAX([baseline[@"mad"] doubleValue], deviation);
+        double difference = median - baselineMedian;
+        if (median > (baselineMedian * (1.0 + REGRESSION_TOLERANCE)) && difference > (REGRESSION_DEVIATIONS * noise)) {
+            XCTFail(@"%@ regressed: median %.6fs, baseline %.6fs", name, median, baselineMedian);
+        }
+    }
+}
+
+#pragma mark Benchmarks
+
+- (void)testDocumentOpen
+{
+    NSArray *paths = [PDFKBenchmarkTests corpusPaths];
+    [self benchmark:@"DocumentOpen" block:^{
+        for (NSString *path in paths) {
+            PDFKDocument *document = [[PDFKDocument alloc] initWithContentsOfFile:path password:nil];
+            XCTAssertNotNil(document);
+            XCTAssertTrue(document.pageCount > 0);
+        }
+    }];
+}
+
+- (void)testDocumentImport
+{
+    //The corpus, and every file in it a second time to exercise the duplicate check.
+    NSArray *paths = [PDFKBenchmarkTests corpusPaths];
+    paths = [paths arrayByAddingObjectsFromArray:paths];
+    __block NSDictionary *statistics = nil;
+    [self benchmark:@"DocumentImport" block:^{
+        XCTestExpectation *expectation = [self expectationWithDescription:@"Import"];
+        PDFKDocumentImporter *importer = [[PDFKDocumentImporter alloc] initWithFilePaths:paths password:nil];
+        [importer importWithProgress:nil completion:^(NSArray *documents, NSDictionary *importStatistics) {
+            statistics = importStatistics;
+            [expectation fulfill];
+        }];
+        [self waitForExpectationsWithTimeout:600.0 handler:nil];
+    }];
+    
+    XCTAssertEqual([statistics[@"Imported"] unsignedIntegerValue] + [statistics[@"Duplicates"] unsignedIntegerValue], paths.count);
+    XCTAssertTrue([statistics[@"Duplicates"] unsignedIntegerValue] >= paths.count / 2);
+    NSLog(@"DocumentImport: %@ documents per second", statistics[@"DocumentsPerSecond"]);
+}
+
+- (void)testDocumentMetadata
+{
+    //The encodings and date formats found in Info dictionaries and XMP
+    const uint8_t utf16[] = {0xFE, 0xFF, 0x00, 'P', 0x00, 'D', 0x00, 'F', 0x00, 0x1B, 'e', 'n', 0x00, 0x1B, 0x20, 0xAC};
+    XCTAssertEqualObjects([PDFKDocumentMetadata stringWithPDFTextBytes:utf16 length:sizeof(utf16)], @"PDF\u20AC");
+    const uint8_t docEncoding[] = {'A', 0x84, 0xA0, 0xE9};
+    XCTAssertEqualObjects([PDFKDocumentMetadata stringWithPDFTextBytes:docEncoding length:sizeof(docEncoding)], @"A\u2014\u20AC\u00E9");
+    XCTAssertEqual([[PDFKDocumentMetadata dateWithPDFDateString:@"D:20240315123045+02'00'"] timeIntervalSince1970], 1710498645.0);
+    XCTAssertEqual([[PDFKDocumentMetadata dateWithPDFDateString:@"2024-03-15T12:30:45.5-05:00"] timeIntervalSince1970], 1710523845.5);
+    XCTAssertEqual([[PDFKDocumentMetadata dateWithPDFDateString:@"D:2024"] timeIntervalSince1970], 1704067200.0);
+    XCTAssertNil([PDFKDocumentMetadata dateWithPDFDateString:@"D:20241315"]);
+    NSString *xmp = @"<x:xmpmeta xmlns:x='adobe:ns:meta/'><rdf:RDF xmlns:rdf='http://www.w3.org/1999/02/22-rdf-syntax-ns#'>"
+    "<rdf:Description xmlns:dc='http://purl.org/dc/elements/1.1/' xmlns:pdf='http://ns.adobe.com/pdf/1.3/' pdf:Producer='Producer'>"
+    "<dc:title><rdf:Alt><rdf:li xml:lang='x-default'>Title</rdf:li><rdf:li xml:lang='fr'>Titre</rdf:li></rdf:Alt></dc:title>"
+    "</rdf:Description></rdf:RDF></x:xmpmeta>";
+    NSDictionary *entries = [PDFKDocumentMetadata entriesWithXMPData:[xmp dataUsingEncoding:NSUTF8StringEncoding]];
+    XCTAssertEqualObjects(entries[@"Title"], @"Title");
+    XCTAssertEqualObjects(entries[@"Producer"], @"Producer");
+    
+    //Archive the corpus, then time reopening it from the archives, which should not need to open the documents.
+    NSArray *paths = [PDFKBenchmarkTests corpusPaths];
+    for (NSString *path in paths) {
+        XCTAssertNotNil([[PDFKDocument alloc] initWithContentsOfFile:path password:nil]);
+    }
+    [self benchmark:@"DocumentUnarchive" block:^{
+        for (NSInteger iteration = 0; iteration < 10; iteration++) {
+            for (NSString *path in paths) {
+                PDFKDocument *document = [PDFKDocument unarchiveDocumentForContentsOfFile:path password:nil];
+                XCTAssertTrue(document.pageCount > 0);
+            }
+        }
+    }];
+    
+    PDFKDocument *document = [PDFKDocument unarchiveDocumentForContentsOfFile:[PDFKBenchmarkTests generatedDocumentPath] password:nil];
+    XCTAssertEqualObjects(document.title, @"PDFKit Benchmark");
+    XCTAssertEqualObjects(document.author, @"M13PDFKit");
+}
+
+- (void)testIncrementalSave
+{
+    //Work on copies of the corpus
+    NSFileManager *fileManager = [NSFileManager defaultManager];
+    NSMutableArray *paths = [NSMutableArray new];
+    for (NSString *path in [PDFKBenchmarkTests corpusPaths]) {
+        NSString *copyPath = [NSTemporaryDirectory() stringByAppendingPathComponent:[@"PDFKBenchmarkSave-" stringByAppendingString:path.lastPathComponent]];
+        [fileManager removeItemAtPath:copyPath error:NULL];
+        XCTAssertTrue([fileManager copyItemAtPath:path toPath:copyPath error:NULL]);
+        [paths addObject:copyPath];
+    }
+    
+    //Saving again replaces the previous bookmarks and highlights, and only appends the changes.
+    NSString *generatedPath = [NSTemporaryDirectory() stringByAppendingPathComponent:@"PDFKBenchmarkSave.pdf"];
+    [fileManager removeItemAtPath:generatedPath error:NULL];
+    XCTAssertTrue([fileManager copyItemAtPath:[PDFKBenchmarkTests generatedDocumentPath] toPath:generatedPath error:NULL]);
+    PDFKPageSet *bookmarks = [PDFKPageSet pageSet];
+    PDFKPageSet *highlightedPages = [PDFKPageSet pageSet];
+    [bookmarks addIndex:1];
+    [bookmarks addIndex:GENERATED_PAGES];
+    [highlightedPages addIndex:1];
+    PDFKIncrementalWriter *writer = [[PDFKIncrementalWriter alloc] initWithFilePath:generatedPath];
+    XCTAssertTrue([writer writeBookmarks:bookmarks highlightedPages:highlightedPages]);
+    XCTAssertTrue([writer writeBookmarks:bookmarks highlightedPages:highlightedPages]);
+    XCTAssertTrue([writer.statistics[@"AppendedBytes"] unsignedIntegerValue] < 4096);
+    
+    //The updated file reopens with the outline, the annotation, and the same pages.
+    CGPDFDocumentRef documentRef = CGPDFDocumentCreateUnshared([NSURL fileURLWithPath:generatedPath], nil);
+    XCTAssertTrue(documentRef != NULL);
+    CGPDFDictionaryRef outlines = NULL;
+    CGPDFArrayRef annotations = NULL;
+    XCTAssertTrue(CGPDFDictionaryGetDictionary(CGPDFDocumentGetCatalog(documentRef), "Outlines", &outlines));
+    XCTAssertTrue(CGPDFDictionaryGetArray(CGPDFPageGetDictionary(CGPDFDocumentGetPage(documentRef, 1)), "Annots", &annotations));
+    NSUInteger highlightCount = 0;
+    for (size_t index = 0; annotations != NULL && index < CGPDFArrayGetCount(annotations); index++) {
+        CGPDFDictionaryRef annotation = NULL;
+        const char *subtype = NULL;
+        if (CGPDFArrayGetDictionary(annotations, index, &annotation) && CGPDFDictionaryGetName(annotation, "Subtype", &subtype) && strcmp(subtype, "Highlight") == 0) {
+            highlightCount++;
+        }
+    }
+    XCTAssertEqual(highlightCount, (NSUInteger)1);
+    XCTAssertEqual(CGPDFDocumentGetNumberOfPages(documentRef), (size_t)GENERATED_PAGES);
+    CGPDFDocumentRelease(documentRef);
+    
+    //A partial update is removed
+    unsigned long long savedSize = [[fileManager attributesOfItemAtPath:generatedPath error:NULL] fileSize];
+    [[NSString stringWithFormat:@"%llu\n", savedSize] writeToFile:[generatedPath stringByAppendingString:@".pdfkjournal"] atomically:YES encoding:NSUTF8StringEncoding error:NULL];
+    NSFileHandle *handle = [NSFileHandle fileHandleForWritingAtPath:generatedPath];
+    [handle seekToEndOfFile];
+    [handle writeData:[NSMutableData dataWithLength:4096]];
+    [handle closeFile];
+    XCTAssertTrue([PDFKIncrementalWriter recoverFileAtPath:generatedPath]);
+    XCTAssertEqual([[fileManager attributesOfItemAtPath:generatedPath error:NULL] fileSize], savedSize);
+    
+    //Compare saving the changes to rewriting the whole file
+    __block NSUInteger iteration = 0;
+    [self benchmark:@"IncrementalSave" block:^{
+        iteration++;
+        for (NSString *path in paths) {
+            //Encrypted files, and files with fewer pages, are not changed
+            PDFKPageSet *pages = [PDFKPageSet pageSet];
+            if (iteration % 2) {
+                [pages addIndex:1];
+            }
+            [[[PDFKIncrementalWriter alloc] initWithFilePath:path] writeBookmarks:bookmarks highlightedPages:pages];
+        }
+    }];
+    [self benchmark:@"FileRewrite" block:^{
+        for (NSString *path in paths) {
+            NSData *data = [NSData dataWithContentsOfFile:path];
+            XCTAssertTrue([data writeToFile:path options:NSDataWritingAtomic error:NULL]);
+        }
+    }];
+    
+    for (NSString *path in paths) {
+        [fileManager removeItemAtPath:path error:NULL];
+    }
+    [fileManager removeItemAtPath:generatedPath error:NULL];
+}
+
+- (void)testCrossReferenceTable
+{
+    //Entries of 19 bytes, ending in a bare line feed, then an update that deletes the second object.
+    NSMutableString *text = [NSMutableString stringWithString:@"%PDF-1.4\n"];
+    NSUInteger catalogOffset = text.length;
+    [text appendString:@"1 0 obj\n<< /Type /Catalog >>\nendobj\n"];
+    NSUInteger stringOffset = text.length;
+    [text appendString:@"2 0 obj\n(Deleted)\nendobj\n"];
+    NSUInteger firstSection = text.length;
+    [text appendFormat:@"xref\n0 3\n0000000000 65535 f\n%010lu 00000 n\n%010lu 00000 n\ntrailer\n<< /Size 3 /Root 1 0 R >>\n", (unsigned long)catalogOffset, (unsigned long)stringOffset];
+    NSUInteger secondSection = text.length;
+    [text appendFormat:@"xref\n0 1\n0000000000 65535 f\r\n2 1\n0000000000 00001 f\r\ntrailer\n<< /Size 3 /Root 1 0 R /Prev %lu >>\nstartxref\n%lu\n%%%%EOF\n", (unsigned long)firstSection, (unsigned long)secondSection];
+    NSString *path = [NSTemporaryDirectory() stringByAppendingPathComponent:@"PDFKBenchmarkCrossReference.pdf"];
+    XCTAssertTrue([[text dataUsingEncoding:NSASCIIStringEncoding] writeToFile:path atomically:YES]);
+    
+    int fd = open([path fileSystemRepresentation], O_RDONLY);
+    PDFKFile file;
+    XCTAssertTrue(PDFKFileOpen(&file, fd));
+    XCTAssertEqual(file.entryCount, (size_t)3);
+    if (file.entryCount == 3) {
+        XCTAssertEqual(file.entries[1].type, (uint8_t)1);
+        XCTAssertEqual(file.entries[1].offset, (uint64_t)catalogOffset);
+        XCTAssertEqual(file.entries[2].type, (uint8_t)0);
+    }
+    PDFKBuffer object = {0};
+    XCTAssertTrue(PDFKFileCopyObject(&file, 1, &object));
+    XCTAssertFalse(PDFKFileCopyObject(&file, 2, &object));
+    PDFKBufferFree(&object);
+    PDFKFileClose(&file);
+    close(fd);
+    
+    //A hybrid update, its table lists the third object as free and its cross reference stream has it.
+    NSMutableData *data = [[[text substringToIndex:secondSection] dataUsingEncoding:NSASCIIStringEncoding] mutableCopy];
+    NSUInteger hybridOffset = data.length;
+    [data appendData:[@"3 0 obj\n(Hybrid)\nendobj\n" dataUsingEncoding:NSASCIIStringEncoding]];
+    NSUInteger streamOffset = data.length;
+    [data appendData:[@"4 0 obj\n<< /Type /XRef /Size 5 /W [1 2 1] /Index [3 1] /Length 4 >>\nstream\n" dataUsingEncoding:NSASCIIStringEncoding]];
+    uint8_t row[4] = {1, (uint8_t)(hybridOffset >> 8), (uint8_t)hybridOffset, 0};
+    [data appendBytes:row length:sizeof(row)];
+    [data appendData:[@"\nendstream\nendobj\n" dataUsingEncoding:NSASCIIStringEncoding]];
+    NSUInteger hybridSection = data.length;
+    [data appendData:[[NSString stringWithFormat:@"xref\n0 1\n0000000000 65535 f \n2 2\n0000000000 00001 f \n0000000000 00000 f \ntrailer\n<< /Size 5 /Root 1 0 R /Prev %lu /XRefStm %lu >>\nstartxref\n%lu\n%%%%EOF\n", (unsigned long)firstSection, (unsigned long)streamOffset, (unsigned long)hybridSection] dataUsingEncoding:NSASCIIStringEncoding]];
+    XCTAssertTrue([data writeToFile:path atomically:YES]);
+    
+    fd = open([path fileSystemRepresentation], O_RDONLY);
+    XCTAssertTrue(PDFKFileOpen(&file, fd));
+    XCTAssertEqual(file.entryCount, (size_t)5);
+    if (file.entryCount == 5) {
+        XCTAssertEqual(file.entries[2].type, (uint8_t)0);
+        XCTAssertEqual(file.entries[3].type, (uint8_t)1);
+        XCTAssertEqual(file.entries[3].offset, (uint64_t)hybridOffset);
+    }
+    XCTAssertTrue(PDFKFileCopyObject(&file, 3, &object));
+    XCTAssertFalse(PDFKFileCopyObject(&file, 2, &object));
+    PDFKBufferFree(&object);
+    PDFKFileClose(&file);
+    close(fd);
+    [[NSFileManager defaultManager] removeItemAtPath:path error:NULL];
+}
+
+static uint64_t ResidentBytes(void)
+{
+    struct mach_task_basic_info info;
+    mach_msg_type_number_t count = MACH_TASK_BASIC_INFO_COUNT;
+    if (task_info(mach_task_self(), MACH_TASK_BASIC_INFO, (task_info_t)&info, &count) != KERN_SUCCESS) {
+        return 0;
+    }
+    return info.resident_size;
+}
+
+- (void)testPageExport
+{
+    NSString *outputPath = [NSTemporaryDirectory() stringByAppendingPathComponent:@"PDFKBenchmarkExport.pdf"];
+    NSURL *outputURL = [NSURL fileURLWithPath:outputPath isDirectory:NO];
+    
+    //The exported file has only the selected pages, and is smaller than the document.
+    PDFKPageSet *pages = [PDFKPageSet pageSet];
+    [pages addIndex:2];
+    [pages addIndexesInRange:NSMakeRange(10, 5)];
+    NSString *generatedPath = [PDFKBenchmarkTests generatedDocumentPath];
+    PDFKPageExporter *exporter = [[PDFKPageExporter alloc] initWithFilePath:generatedPath];
+    XCTAssertTrue([exporter exportPages:pages toPath:outputPath]);
+    CGPDFDocumentRef documentRef = CGPDFDocumentCreateUnshared(outputURL, nil);
+    XCTAssertTrue(documentRef != NULL);
+    XCTAssertEqual(CGPDFDocumentGetNumberOfPages(documentRef), (size_t)pages.count);
+    CGPDFDocumentRelease(documentRef);
+    XCTAssertTrue([exporter.statistics[@"WrittenBytes"] unsignedLongLongValue] < [[[NSFileManager defaultManager] attributesOfItemAtPath:generatedPath error:NULL] fileSize]);
+    
+    //Pages outside the document are rejected
+    PDFKPageSet *missingPages = [PDFKPageSet pageSet];
+    [missingPages addIndex:GENERATED_PAGES + 1];
+    XCTAssertFalse([exporter exportPages:missingPages toPath:outputPath]);
+    
+    //Export the first page, and every third page, of each document. Encrypted files are not exported.
+    __block uint64_t writtenBytes = 0;
+    __block uint64_t residentGrowth = 0;
+    [self benchmark:@"PageExport" block:^{
+        writtenBytes = 0;
+        for (NSString *path in [PDFKBenchmarkTests corpusPaths]) {
+            CGPDFDocumentRef corpusRef = CGPDFDocumentCreateUnshared([NSURL fileURLWithPath:path isDirectory:NO], nil);
+            size_t pageCount = (corpusRef != NULL ? CGPDFDocumentGetNumberOfPages(corpusRef) : 0);
+            CGPDFDocumentRelease(corpusRef);
+            
+            PDFKPageSet *corpusPages = [PDFKPageSet pageSet];
+            for (size_t page = 1; page <= pageCount; page += 3) {
+                [corpusPages addIndex:page];
+            }
+            for (PDFKPageSet *selection in @[[PDFKPageSet pageSetWithIndexSet:[NSIndexSet indexSetWithIndex:1]], corpusPages]) {
+                uint64_t residentBefore = ResidentBytes();
+                PDFKPageExporter *corpusExporter = [[PDFKPageExporter alloc] initWithFilePath:path];
+                if (pageCount > 0 && [corpusExporter exportPages:selection toPath:outputPath]) {
+                    writtenBytes += [corpusExporter.statistics[@"WrittenBytes"] unsignedLongLongValue];
+                    uint64_t residentAfter = ResidentBytes();
+                    residentGrowth = MAX(residentGrowth, (residentAfter > residentBefore ? residentAfter - residentBefore : 0));
+                }
+            }
+        }
+    }];
+    NSMutableDictionary *result = [benchmarkResults[@"PageExport"] mutableCopy];
+    result[@"writtenBytes"] = @(writtenBytes);
+    result[@"bytesPerSecond"] = @(writtenBytes / MAX([result[@"median"] doubleValue], 0.000001));
+    result[@"maximumResidentGrowth"] = @(residentGrowth);
+    benchmarkResults[@"PageExport"] = result;
+    
+    [[NSFileManager defaultManager] removeItemAtPath:outputPath error:NULL];
+}
+
+- (void)testPageLayout
+{
+    //Mixed portrait and landscape pages, checked against laying them out one by one.
+    PDFKPageLayout *small = [[PDFKPageLayout alloc] initWithPageCount:101 estimatedPageSize:CGSizeMake(612.0, 792.0)];
+    small.width = 320.0;
+    small.spreads = YES;
+    for (NSUInteger page = 1; page <= 101; page++) {
+        [small setSize:((page % 7) == 0 ? CGSizeMake(792.0, 612.0) : CGSizeMake(612.0, 792.0)) forPage:page];
+    }
+    CGFloat column = (320.0 - (small.pageSpacing * 3.0)) / 2.0;
+    CGFloat y = small.pageSpacing;
+    for (NSUInteger page = 1; page <= 101; page = (page == 1 ? 2 : page + 2)) {
+        NSUInteger last = (page == 1 ? 1 : MIN(page + 1, (NSUInteger)101));
+        CGFloat rowHeight = 0.0;
+        for (NSUInteger index = page; index <= last; index++) {
+            CGRect frame = [small frameForPage:index];
+            rowHeight = MAX(rowHeight, frame.size.height);
+            XCTAssertEqualWithAccuracy(frame.size.width, column, 0.01);
+        }
+        XCTAssertEqualWithAccuracy(CGRectGetMidY([small frameForPage:page]), y + (rowHeight / 2.0), 0.01);
+        XCTAssertEqual([small pageAtOffset:y + 1.0], page);
+        y += rowHeight + small.pageSpacing;
+    }
+    XCTAssertEqualWithAccuracy(small.contentSize.height, y, 0.01);
+    
+    //A very long document
+    NSUInteger pageCount = 100000;
+    PDFKPageLayout *layout = [[PDFKPageLayout alloc] initWithPageCount:pageCount estimatedPageSize:CGSizeMake(612.0, 792.0)];
+    layout.width = 768.0;
+    [self benchmark:@"PageLayoutSizes" block:^{
+        for (NSUInteger page = 1; page <= pageCount; page++) {
+            [layout setSize:((page % 3) == 0 ? CGSizeMake(792.0, 612.0 + (page % 5)) : CGSizeMake(612.0, 792.0 + (page % 5))) forPage:page];
+        }
+    }];
+    [self benchmark:@"PageLayoutQueries" block:^{
+        CGFloat height = layout.contentSize.height;
+        for (NSUInteger query = 0; query < 100000; query++) {
+            NSUInteger page = [layout pageAtOffset:(height * (query % 997)) / 997.0];
+            CGRect frame = [layout frameForPage:page];
+            XCTAssertTrue(frame.size.height > 0.0);
+        }
+    }];
+    [self benchmark:@"PageLayoutZoom" block:^{
+        for (NSUInteger step = 0; step < 1000; step++) {
+            layout.width = 768.0 * (1.0 + ((step % 30) / 10.0));
+            NSRange visible = [layout pagesInRect:CGRectMake(0.0, layout.contentSize.height / 2.0, layout.width, 1024.0)];
+            XCTAssertTrue(visible.length > 0);
+        }
+    }];
+}
+
+- (void)testPDFSniffing
+{
+    NSArray *paths = [PDFKBenchmarkTests corpusPaths];
+    [self benchmark:@"IsPDF" block:^{
+        for (NSInteger iteration = 0; iteration < 100; iteration++) {
+            for (NSString *path in paths) {
+                XCTAssertTrue([PDFKDocument isPDF:path]);
+            }
+        }
+    }];
+}
+
+- (void)testNameTreeLookup
+{
+    NSArray *pages = [PDFKBenchmarkTests corpusPagesWithLinks];
+    XCTAssertTrue(pages.count > 0);
+    [self benchmark:@"LinkTargetLookup" block:^{
+        for (PDFKPage *page in pages) {
+            for (PDFKDocumentLink *link in page.links) {
+                CGPoint center = CGPointMake(CGRectGetMidX(link.rect), CGRectGetMidY(link.rect));
+                [page linkTargetAtPoint:center];
+            }
+        }
+    }];
+}
+
+- (void)testLinkHitTest
+{
+    NSArray *pages = [PDFKBenchmarkTests corpusPagesWithLinks];
+    XCTAssertTrue(pages.count > 0);
+    [self benchmark:@"LinkHitTest" block:^{
+        //Points that mostly miss the links
+        for (PDFKPage *page in pages) {
+            CGSize size = page.viewSize;
+            for (CGFloat y = 0.0f; y < size.height; y += 32.0f) {
+                for (CGFloat x = 0.0f; x < size.width; x += 32.0f) {
+                    for (PDFKDocumentLink *link in page.links) {
+                        if (CGRectContainsPoint(link.rect, CGPointMake(x, y))) {
+                            break;
+                        }
+                    }
+                }
+            }
+        }
+    }];
+}
+
+- (void)testHighlightOverlay
+{
+    //An index page: a grid of small links
+    CGSize pageSize = CGSizeMake(612.0f, 792.0f);
+    NSMutableArray *rects = [NSMutableArray new];
+    CGRect *indexRects = malloc(5000 * sizeof(CGRect));
+    for (NSInteger index = 0; index < 5000; index++) {
+        CGRect rect = CGRectMake(20.0f + ((index % 50) * 11.5f), 20.0f + ((index / 50) * 7.5f), 10.0f, 6.0f);
+        indexRects[index] = rect;
+        [rects addObject:[NSValue valueWithCGRect:rect]];
+    }
+    
+    //The index finds the same rects as testing every rect
+    PDFKRectIndex *rectIndex = [[PDFKRectIndex alloc] initWithRects:indexRects count:rects.count];
+    CGRect area = CGRectMake(100.0f, 100.0f, 64.0f, 48.0f);
+    NSMutableIndexSet *expected = [NSMutableIndexSet new];
+    for (NSUInteger index = 0; index < rects.count; index++) {
+        if (CGRectIntersectsRect(indexRects[index], area)) {
+            [expected addIndex:index];
+        }
+    }
+    XCTAssertEqualObjects([rectIndex indexesOfRectsIntersectingRect:area], expected);
+    XCTAssertEqual([rectIndex indexOfRectContainingPoint:CGPointMake(25.0f, 23.0f)], (NSUInteger)0);
+    XCTAssertEqual([rectIndex indexOfRectContainingPoint:CGPointMake(5.0f, 5.0f)], (NSUInteger)NSNotFound);
+    
+    [self benchmark:@"LinkHitTestIndexed" block:^{
+        for (CGFloat y = 0.0f; y < pageSize.height; y += 4.0f) {
+            for (CGFloat x = 0.0f; x < pageSize.width; x += 4.0f) {
+                [rectIndex indexOfRectContainingPoint:CGPointMake(x, y)];
+            }
+        }
+    }];
+    free(indexRects);
+    
+    //Building and drawing a view for each link, against one overlay
+    CGColorSpaceRef rgb = CGColorSpaceCreateDeviceRGB();
+    CGContextRef context = CGBitmapContextCreate(NULL, pageSize.width, pageSize.height, 8, 0, rgb, PDFKThumbCodecBitmapInfo);
+    CGColorSpaceRelease(rgb);
+    [self benchmark:@"HighlightViews" block:^{
+        UIView *container = [[UIView alloc] initWithFrame:CGRectMake(0.0f, 0.0f, pageSize.width, pageSize.height)];
+        for (NSValue *value in rects) {
+            UIView *highlight = [[UIView alloc] initWithFrame:[value CGRectValue]];
+            highlight.userInteractionEnabled = NO;
+            highlight.backgroundColor = [UIColor colorWithRed:0.11f green:0.5f blue:0.95f alpha:0.25f];
+            [container addSubview:highlight];
+        }
+        [container layoutIfNeeded];
+        [container.layer renderInContext:context];
+    }];
+    __block PDFKHighlightOverlay *overlay = nil;
+    [self benchmark:@"HighlightOverlay" block:^{
+        overlay = [[PDFKHighlightOverlay alloc] initWithFrame:CGRectMake(0.0f, 0.0f, pageSize.width, pageSize.height)];
+        [overlay setRects:rects forKind:PDFKHighlightKindLink];
+        [overlay.layer displayIfNeeded];
+        [overlay.layer renderInContext:context];
+    }];
+    XCTAssertEqual([overlay.statistics[@"Rects"] unsignedIntegerValue], rects.count);
+    XCTAssertEqual([overlay.statistics[@"DrawnRects"] unsignedIntegerValue], rects.count);
+    CGContextRelease(context);
+}
+
+- (void)testThumbCache
+{
+    UIGraphicsBeginImageContextWithOptions(CGSizeMake(144.0f, 144.0f), YES, 1.0f);
+    UIImage *image = UIGraphicsGetImageFromCurrentImageContext();
+    UIGraphicsEndImageContext();
+    
+    PDFKThumbCache *cache = [PDFKThumbCache sharedCache];
+    [self benchmark:@"ThumbCache" block:^{
+        for (NSInteger index = 0; index < 1000; index++) {
+            NSString *key = [NSString stringWithFormat:@"PDFKBenchmark-%ld", (long)(index % 200)];
+            if ([cache objectForKey:key] == nil) {
+                [cache setObject:image forKey:key];
+            }
+        }
+    }];
+    [cache removeAllObjects];
+}
+
+- (void)testThumbCacheManifest
+{
+    //A manifest of its own, so the thumb caches are not touched. It starts empty, instead of being rebuilt from the cache directories.
+    NSString *path = [NSTemporaryDirectory() stringByAppendingPathComponent:@"PDFKBenchmarkManifest.plist"];
+    NSData *empty = [NSPropertyListSerialization dataWithPropertyList:@{@"Version": @1, @"Caches": @[]} format:NSPropertyListBinaryFormat_v1_0 options:0 error:NULL];
+    XCTAssertTrue([empty writeToFile:path atomically:YES]);
+    PDFKThumbCacheManifest *manifest = [[PDFKThumbCacheManifest alloc] initWithPath:path];
+    manifest.byteQuota = ULLONG_MAX;
+    
+    NSMutableArray *guids = [NSMutableArray arrayWithCapacity:MANIFEST_ENTRIES];
+    for (NSInteger index = 0; index < MANIFEST_ENTRIES; index++) {
+        [guids addObject:[NSString stringWithFormat:@"PDFKBenchmarkCache-%06ld", (long)index]];
+    }
+    
+    //One file in each cache
+    CFTimeInterval fillStart = CACurrentMediaTime();
+    for (NSString *guid in guids) {
+        [manifest addBytes:1000 replacingBytes:0 toCacheWithGUID:guid];
+    }
+    XCTAssertEqual(manifest.cacheCount, (NSUInteger)MANIFEST_ENTRIES);
+    XCTAssertEqual(manifest.totalBytes, 1000ULL * MANIFEST_ENTRIES);
+    CFTimeInterval fillTime = CACurrentMediaTime() - fillStart;
+    
+    //Rewriting the files moves each cache to the most recently used end, and does not change the total.
+    [self benchmark:@"ThumbCacheManifestRewrite" block:^{
+        for (NSString *guid in guids.reverseObjectEnumerator) {
+            [manifest addBytes:1000 replacingBytes:1000 toCacheWithGUID:guid];
+        }
+        [manifest totalBytes];
+    }];
+    XCTAssertEqual(manifest.cacheCount, (NSUInteger)MANIFEST_ENTRIES);
+    XCTAssertEqual(manifest.totalBytes, 1000ULL * MANIFEST_ENTRIES);
+    
+    //Over the quota the least recently used caches are evicted, which are the last caches after rewriting in reverse.
+    manifest.byteQuota = 1000ULL * (MANIFEST_ENTRIES - 1000);
+    [manifest addBytes:1000 replacingBytes:1000 toCacheWithGUID:guids[0]];
+    XCTAssertEqual(manifest.cacheCount, (NSUInteger)(MANIFEST_ENTRIES - 1000));
+    XCTAssertEqual(manifest.totalBytes, manifest.byteQuota);
+    
+    //The manifest is written in least recently used order, and loads again
+    [self benchmark:@"ThumbCacheManifestWrite" block:^{
+        [manifest synchronize];
+    }];
+    NSArray *caches = [NSPropertyListSerialization propertyListWithData:[NSData dataWithContentsOfFile:path] options:NSPropertyListImmutable format:NULL error:NULL][@"Caches"];
+    XCTAssertEqual(caches.count, (NSUInteger)(MANIFEST_ENTRIES - 1000));
+    XCTAssertEqualObjects(caches.firstObject[0], guids[MANIFEST_ENTRIES - 1001]);
+    XCTAssertEqualObjects(caches.lastObject[0], guids[0]);
+    PDFKThumbCacheManifest *loaded = [[PDFKThumbCacheManifest alloc] initWithPath:path];
+    XCTAssertEqual(loaded.cacheCount, (NSUInteger)(MANIFEST_ENTRIES - 1000));
+    XCTAssertEqual(loaded.totalBytes, 1000ULL * (MANIFEST_ENTRIES - 1000));
+    
+    NSMutableDictionary *result = [benchmarkResults[@"ThumbCacheManifestRewrite"] mutableCopy];
+    result[@"Entries"] = @(MANIFEST_ENTRIES);
+    result[@"FillSeconds"] = @(fillTime);
+    benchmarkResults[@"ThumbCacheManifestRewrite"] = result;
+    [[NSFileManager defaultManager] removeItemAtPath:path error:NULL];
+}
+
+/**
+ Render the first page of the corpus as a thumb.
+ */
+- (CGImageRef)newBenchmarkThumb CF_RETURNS_RETAINED
+{
+    NSString *path = [PDFKBenchmarkTests corpusPaths].firstObject;
+    CGPDFDocumentRef documentRef = CGPDFDocumentCreate([NSURL fileURLWithPath:path], nil);
+    XCTAssertTrue(documentRef != NULL);
+    CGPDFPageRef pageRef = CGPDFDocumentGetPage(documentRef, 1);
+    
+    CGRect thumbRect = CGRectMake(0.0f, 0.0f, 288.0f, 288.0f);
+    CGColorSpaceRef rgb = CGColorSpaceCreateDeviceRGB();
+    CGContextRef context = CGBitmapContextCreate(NULL, thumbRect.size.width, thumbRect.size.height, 8, 0, rgb, PDFKThumbCodecBitmapInfo);
+    CGColorSpaceRelease(rgb);
+    CGContextSetRGBFillColor(context, 1.0f, 1.0f, 1.0f, 1.0f);
+    CGContextFillRect(context, thumbRect);
+    CGContextConcatCTM(context, CGPDFPageGetDrawingTransform(pageRef, kCGPDFCropBox, thumbRect, 0, true));
+    CGContextDrawPDFPage(context, pageRef);
+    CGImageRef imageRef = CGBitmapContextCreateImage(context);
+    CGContextRelease(context);
+    CGPDFDocumentRelease(documentRef);
+    return imageRef;
+}
+
+- (void)testImagePageDraw
+{
+    CGPDFDocumentRef documentRef = CGPDFDocumentCreateUnshared([NSURL fileURLWithPath:[PDFKBenchmarkTests generatedScanPath]], nil);
+    XCTAssertTrue(documentRef != NULL);
+    PDFKImageCache *imageCache = [PDFKImageCache cacheForDocument:documentRef];
+    
+    //Thumbs, and screen sized pages
+    CGColorSpaceRef rgb = CGColorSpaceCreateDeviceRGB();
+    CGRect thumbRect = CGRectMake(0.0f, 0.0f, 180.0f, 240.0f);
+    CGRect screenRect = CGRectMake(0.0f, 0.0f, 768.0f, 1024.0f);
+    CGContextRef thumbContext = CGBitmapContextCreate(NULL, thumbRect.size.width, thumbRect.size.height, 8, 0, rgb, PDFKThumbCodecBitmapInfo);
+    CGContextRef screenContext = CGBitmapContextCreate(NULL, screenRect.size.width, screenRect.size.height, 8, 0, rgb, PDFKThumbCodecBitmapInfo);
+    CGColorSpaceRelease(rgb);
+    void (^drawPages)(BOOL cached) = ^(BOOL cached) {
+        for (size_t page = 1; page <= GENERATED_SCAN_PAGES; page++) {
+            CGPDFPageRef pageRef = CGPDFDocumentGetPage(documentRef, page);
+            for (NSInteger index = 0; index < 2; index++) {
+                CGContextRef context = (index == 0 ? thumbContext : screenContext);
+                CGRect rect = (index == 0 ? thumbRect : screenRect);
+                CGContextSaveGState(context);
+                CGContextConcatCTM(context, CGPDFPageGetDrawingTransform(pageRef, kCGPDFCropBox, rect, 0, true));
+                if (cached) {
+                    PDFKImageCacheDrawPage(context, pageRef);
+                } else {
+                    CGContextDrawPDFPage(context, pageRef);
+                }
+                CGContextRestoreGState(context);
+            }
+        }
+    };
+    
+    //Both ways draw the same thumb
+    drawPages(NO);
+    CGImageRef drawnRef = CGBitmapContextCreateImage(thumbContext);
+    drawPages(YES);
+    const uint8_t *drawn = CFDataGetBytePtr(CFAutorelease(CGDataProviderCopyData(CGImageGetDataProvider(drawnRef))));
+    const uint8_t *cached = CGBitmapContextGetData(thumbContext);
+    double difference = 0.0;
+    size_t length = CGBitmapContextGetBytesPerRow(thumbContext) * CGBitmapContextGetHeight(thumbContext);
+    for (size_t index = 0; index < length; index++) {
+        difference += abs((int)drawn[index] - (int)cached[index]);
+    }
+    CGImageRelease(drawnRef);
+    XCTAssertTrue((difference / length) < 8.0);
+    
+    //The image is shared by all the pages
+    NSDictionary *statistics = imageCache.statistics;
+    XCTAssertEqual([statistics[@"ImagePages"] unsignedIntegerValue], (NSUInteger)GENERATED_SCAN_PAGES);
+    XCTAssertTrue([statistics[@"Decodes"] unsignedIntegerValue] <= 2);
+    XCTAssertTrue([statistics[@"DownsampledDecodes"] unsignedIntegerValue] >= 1);
+    
+    [self benchmark:@"ImagePageDraw" block:^{
+        drawPages(NO);
+    }];
+    [self benchmark:@"ImagePageDrawCached" block:^{
+        drawPages(YES);
+    }];
+    NSMutableDictionary *result = [benchmarkResults[@"ImagePageDrawCached"] mutableCopy];
+    [result addEntriesFromDictionary:imageCache.statistics];
+    benchmarkResults[@"ImagePageDrawCached"] = result;
+    
+    CGContextRelease(thumbContext);
+    CGContextRelease(screenContext);
+    CGPDFDocumentRelease(documentRef);
+    [PDFKImageCache removeAllCaches];
+}
+
+- (void)testRenderGuard
+{
+    CGPDFDocumentRef documentRef = CGPDFDocumentCreateUnshared([NSURL fileURLWithPath:[PDFKBenchmarkTests generatedDocumentPath]], nil);
+    XCTAssertTrue(documentRef != NULL);
+    XCTAssertNotNil(CGPDFDocumentGetFingerprint(documentRef));
+    uint64_t documentKey = PDFKRenderGuardDocumentKey(documentRef);
+    NSString *directory = [NSTemporaryDirectory() stringByAppendingPathComponent:@"PDFKRenderGuardTest"];
+    [[NSFileManager new] removeItemAtPath:directory error:nil];
+    
+    //A draw left in the journal counts a strike when the next guard starts, the second strike blacklists the page.
+    CGPDFPageRef crashingPage = CGPDFDocumentGetPage(documentRef, 3);
+    for (NSUInteger crash = 1; crash <= 2; crash++) {
+        @autoreleasepool {
+            PDFKRenderGuard *guard = [[PDFKRenderGuard alloc] initWithDirectory:directory];
+            guard.timeout = 600.0;
+            XCTAssertEqual([guard.statistics[@"RecoveredCrashes"] unsignedIntegerValue], (NSUInteger)(crash - 1));
+            XCTAssertNotEqual([guard beginPage:crashingPage], NSNotFound);
+        }
+    }
+    PDFKRenderGuard *guard = [[PDFKRenderGuard alloc] initWithDirectory:directory];
+    XCTAssertEqual([guard.statistics[@"RecoveredCrashes"] unsignedIntegerValue], (NSUInteger)1);
+    XCTAssertTrue([guard isPageBlacklisted:3 documentKey:documentKey]);
+    XCTAssertEqual([guard beginPage:crashingPage], NSNotFound);
+    [guard removeAllStrikes];
+    NSInteger job = [guard beginPage:crashingPage];
+    XCTAssertNotEqual(job, NSNotFound);
+    [guard endJob:job];
+    
+    //A draw that hangs is given up on, and the page is not drawn again
+    guard.timeout = 0.2;
+    [self expectationForNotification:PDFKRenderGuardPageTimedOutNotification object:guard handler:^BOOL(NSNotification *notification) {
+        return ([notification.userInfo[@"Page"] unsignedIntegerValue] == 5 && [notification.userInfo[@"DocumentKey"] unsignedLongLongValue] == documentKey);
+    }];
+    NSInteger hungJob = [guard beginPage:CGPDFDocumentGetPage(documentRef, 5)];
+    [self waitForExpectationsWithTimeout:5.0 handler:nil];
+    XCTAssertEqual([guard.statistics[@"TimedOut"] unsignedIntegerValue], (NSUInteger)1);
+    XCTAssertEqual([guard beginPage:CGPDFDocumentGetPage(documentRef, 5)], NSNotFound);
+    
+    //Draws from many threads claim the journal slots without losing any
+    guard.timeout = 600.0;
+    dispatch_apply(8, dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_DEFAULT, 0), ^(size_t thread) {
+        for (NSUInteger iteration = 0; iteration < 5000; iteration++) {
+            NSInteger stressJob = [guard beginPage:CGPDFDocumentGetPage(documentRef, 6 + ((thread + iteration) % 8))];
+            [guard endJob:stressJob];
+        }
+    });
+    NSDictionary *statistics = guard.statistics;
+    XCTAssertEqual([statistics[@"ActiveJobs"] unsignedIntegerValue], (NSUInteger)1);
+    XCTAssertEqual([statistics[@"Unjournaled"] unsignedIntegerValue], (NSUInteger)0);
+    [guard endJob:hungJob];
+    XCTAssertEqual([guard.statistics[@"ActiveJobs"] unsignedIntegerValue], (NSUInteger)0);
+    XCTAssertTrue([guard isPageBlacklisted:5 documentKey:documentKey]);
+    
+    //A draw that finishes forgets the strikes against its page, so a page drawn between two crashes is still drawn.
+    NSString *strikesDirectory = [NSTemporaryDirectory() stringByAppendingPathComponent:@"PDFKRenderGuardStrikesTest"];
+    [[NSFileManager new] removeItemAtPath:strikesDirectory error:nil];
+    for (NSUInteger crash = 1; crash <= 2; crash++) {
+        @autoreleasepool {
+            PDFKRenderGuard *crashGuard = [[PDFKRenderGuard alloc] initWithDirectory:strikesDirectory];
+            crashGuard.timeout = 600.0;
+            if (crash == 2) {
+                [crashGuard endJob:[crashGuard beginPage:crashingPage]];
+            }
+            XCTAssertNotEqual([crashGuard beginPage:crashingPage], NSNotFound);
+        }
+    }
+    @autoreleasepool {
+        PDFKRenderGuard *strikesGuard = [[PDFKRenderGuard alloc] initWithDirectory:strikesDirectory];
+        XCTAssertEqual([strikesGuard.statistics[@"RecoveredCrashes"] unsignedIntegerValue], (NSUInteger)1);
+        XCTAssertFalse([strikesGuard isPageBlacklisted:3 documentKey:documentKey]);
+    }
+    [[NSFileManager new] removeItemAtPath:strikesDirectory error:nil];
+    
+    //The cost of guarding the draws of thumbs
+    CGColorSpaceRef rgb = CGColorSpaceCreateDeviceRGB();
+    CGRect thumbRect = CGRectMake(0.0f, 0.0f, 180.0f, 240.0f);
+    CGContextRef context = CGBitmapContextCreate(NULL, thumbRect.size.width, thumbRect.size.height, 8, 0, rgb, PDFKThumbCodecBitmapInfo);
+    CGColorSpaceRelease(rgb);
+    void (^drawPages)(BOOL guarded) = ^(BOOL guarded) {
+        for (size_t page = 1; page <= GENERATED_PAGES; page++) {
+            CGPDFPageRef pageRef = CGPDFDocumentGetPage(documentRef, page);
+            CGContextSaveGState(context);
+            CGContextConcatCTM(context, CGPDFPageGetDrawingTransform(pageRef, kCGPDFCropBox, thumbRect, 0, true));
+            if (guarded) {
+                NSInteger drawJob = [guard beginPage:pageRef];
+                CGContextDrawPDFPage(context, pageRef);
+                [guard endJob:drawJob];
+            } else {
+                CGContextDrawPDFPage(context, pageRef);
+            }
+            CGContextRestoreGState(context);
+        }
+    };
+    [self benchmark:@"PageDraw" block:^{
+        drawPages(NO);
+    }];
+    [self benchmark:@"PageDrawGuarded" block:^{
+        drawPages(YES);
+    }];
+    NSMutableDictionary *result = [benchmarkResults[@"PageDrawGuarded"] mutableCopy];
+    [result addEntriesFromDictionary:guard.statistics];
+    benchmarkResults[@"PageDrawGuarded"] = result;
+    
+    CGContextRelease(context);
+    CGPDFDocumentRelease(documentRef);
+    [guard removeAllStrikes];
+    [[NSFileManager new] removeItemAtPath:directory error:nil];
+}
+
+- (void)testTextExtraction
+{
+    //Searching finds the text of the generated pages
+    PDFKDocument *document = [[PDFKDocument alloc] initWithContentsOfFile:[PDFKBenchmarkTests generatedDocumentPath] password:nil];
+    for (NSString *text in @[@"page 7 line", @"line 39"]) {
+        XCTestExpectation *expectation = [self expectationWithDescription:@"Search"];
+        __block PDFKPageSet *found = nil;
+        [document searchForText:text completion:^(PDFKPageSet *pages) {
+            found = pages;
+            [expectation fulfill];
+        }];
+        [self waitForExpectationsWithTimeout:60.0 handler:nil];
+        NSUInteger expectedCount = ([text isEqualToString:@"line 39"] ? GENERATED_PAGES : 1);
+        XCTAssertEqual(found.count, expectedCount);
+        XCTAssertEqual(document.searchResultPages.count, expectedCount);
+        XCTAssertTrue([found containsIndex:7]);
+    }
+    
+    //The fonts parsed once for a document, and again for every page
+    NSMutableArray *documentRefs = [NSMutableArray new];
+    for (NSString *path in [PDFKBenchmarkTests corpusPaths]) {
+        CGPDFDocumentRef documentRef = CGPDFDocumentCreateUnshared([NSURL fileURLWithPath:path], nil);
+        if (documentRef != NULL) {
+            [documentRefs addObject:CFBridgingRelease(documentRef)];
+        }
+    }
+    __block NSUInteger glyphCount = 0;
+    __block NSTimeInterval elapsed = 0.0;
+    NSDictionary *(^extractText)(BOOL cached) = ^(BOOL cached) {
+        NSMutableDictionary *fontStatistics = [NSMutableDictionary dictionaryWithDictionary:@{@"Hits": @0, @"Misses": @0}];
+        glyphCount = 0;
+        elapsed = 0.0;
+        void (^addFontStatistics)(CGPDFDocumentRef documentRef) = ^(CGPDFDocumentRef documentRef) {
+            NSDictionary *statistics = [PDFKFontCache cacheForDocument:documentRef].statistics;
+            for (NSString *key in @[@"Hits", @"Misses"]) {
+                fontStatistics[key] = @([fontStatistics[key] unsignedIntegerValue] + [statistics[key] unsignedIntegerValue]);
+            }
+        };
+        for (id document in documentRefs) {
+            CGPDFDocumentRef documentRef = (__bridge CGPDFDocumentRef)document;
+            PDFKTextExtractor *extractor = [[PDFKTextExtractor alloc] initWithDocument:documentRef];
+            for (size_t page = 1; page <= CGPDFDocumentGetNumberOfPages(documentRef); page++) {
+                [extractor textOfPage:page];
+                if (cached == NO) {
+                    addFontStatistics(documentRef);
+                    [PDFKFontCache removeAllCaches];
+                }
+            }
+            if (cached) {
+                addFontStatistics(documentRef);
+            }
+            glyphCount += [extractor.statistics[@"Glyphs"] unsignedIntegerValue];
+            elapsed += [extractor.statistics[@"Elapsed"] doubleValue];
+            [PDFKFontCache removeAllCaches];
+        }
+        return fontStatistics;
+    };
+    
+    __block NSDictionary *uncachedStatistics = nil;
+    __block NSDictionary *cachedStatistics = nil;
+    [self benchmark:@"TextExtractionUncached" block:^{
+        uncachedStatistics = extractText(NO);
+    }];
+    NSMutableDictionary *result = [benchmarkResults[@"TextExtractionUncached"] mutableCopy];
+    result[@"glyphsPerSecond"] = @(elapsed > 0.0 ? glyphCount / elapsed : 0.0);
+    benchmarkResults[@"TextExtractionUncached"] = result;
+    
+    [self benchmark:@"TextExtraction" block:^{
+        cachedStatistics = extractText(YES);
+    }];
+    result = [benchmarkResults[@"TextExtraction"] mutableCopy];
+    NSUInteger lookups = [cachedStatistics[@"Hits"] unsignedIntegerValue] + [cachedStatistics[@"Misses"] unsignedIntegerValue];
+    result[@"glyphsPerSecond"] = @(elapsed > 0.0 ? glyphCount / elapsed : 0.0);
+    result[@"fontHitRate"] = @(lookups > 0 ? [cachedStatistics[@"Hits"] doubleValue] / lookups : 0.0);
+    benchmarkResults[@"TextExtraction"] = result;
+    
+    //Each font is parsed once per document
+    XCTAssertTrue([cachedStatistics[@"Misses"] unsignedIntegerValue] <= [uncachedStatistics[@"Misses"] unsignedIntegerValue]);
+}
+
+- (void)testThumbFileIO
+{
+    //Render a thumb to write and read back
+    CGImageRef imageRef = [self newBenchmarkThumb];
+    
+    NSURL *thumbURL = [NSURL fileURLWithPath:[NSTemporaryDirectory() stringByAppendingPathComponent:@"PDFKBenchmarkThumb.png"]];
+    [self benchmark:@"ThumbFileIO" block:^{
+        for (NSInteger iteration = 0; iteration < 20; iteration++) {
+            //Write
+            CGImageDestinationRef destinationRef = CGImageDestinationCreateWithURL((__bridge CFURLRef)thumbURL, (CFStringRef)@"public.png", 1, NULL);
+            CGImageDestinationAddImage(destinationRef, imageRef, NULL);
+            CGImageDestinationFinalize(destinationRef);
+            CFRelease(destinationRef);
+            
+            //Read and decode
+            CGImageSourceRef sourceRef = CGImageSourceCreateWithURL((__bridge CFURLRef)thumbURL, NULL);
+            NSDictionary *options = @{(NSString *)kCGImageSourceShouldCacheImmediately: @YES};
+            CGImageRef loadedRef = CGImageSourceCreateImageAtIndex(sourceRef, 0, (__bridge CFDictionaryRef)options);
+            XCTAssertTrue(loadedRef != NULL);
+            CGImageRelease(loadedRef);
+            CFRelease(sourceRef);
+        }
+    }];
+    
+    CGImageRelease(imageRef);
+    [[NSFileManager defaultManager] removeItemAtURL:thumbURL error:NULL];
+}
+
+- (void)testThumbFileIOWriteOrder
+{
+    //Many versions of a few files, written faster than the disk keeps up
+    NSString *directory = [NSTemporaryDirectory() stringByAppendingPathComponent:@"PDFKBenchmarkWrites"];
+    [[NSFileManager defaultManager] removeItemAtPath:directory error:NULL];
+    [[NSFileManager defaultManager] createDirectoryAtPath:directory withIntermediateDirectories:YES attributes:nil error:NULL];
+    PDFKThumbFileIO *fileIO = [PDFKThumbFileIO sharedFileIO];
+    NSInteger fileCount = 8;
+    NSInteger versionCount = 50;
+    __block volatile int32_t written = 0;
+    __block volatile int32_t superseded = 0;
+    __block volatile int64_t growth = 0;
+    for (NSInteger version = 0; version < versionCount; version++) {
+        for (NSInteger file = 0; file < fileCount; file++) {
+            NSMutableData *data = [NSMutableData dataWithLength:(NSUInteger)(4096 + (version * 97) + file)];
+            memset(data.mutableBytes, (int)version, data.length);
+            NSString *path = [directory stringByAppendingPathComponent:[NSString stringWithFormat:@"%ld.thumb", (long)file]];
+            [fileIO writeData:data toPath:path completion:^(BOOL didWrite, unsigned long long replacedBytes) {
+                if (didWrite) {
+                    OSAtomicIncrement32Barrier(&written);
+                    OSAtomicAdd64Barrier((int64_t)data.length - (int64_t)replacedBytes, &growth);
+                } else {
+                    OSAtomicIncrement32Barrier(&superseded);
+                }
+            }];
+        }
+    }
+    [fileIO waitUntilIdle];
+    
+    //Every write was either done or replaced, each file has its last version, and the reported sizes add up to the files on disk.
+    int32_t writtenCount = written;
+    int32_t supersededCount = superseded;
+    int64_t reportedGrowth = growth;
+    XCTAssertEqual(writtenCount + supersededCount, (int32_t)(fileCount * versionCount));
+    XCTAssertTrue(writtenCount >= fileCount);
+    int64_t onDisk = 0;
+    for (NSInteger file = 0; file < fileCount; file++) {
+        NSData *data = [NSData dataWithContentsOfFile:[directory stringByAppendingPathComponent:[NSString stringWithFormat:@"%ld.thumb", (long)file]]];
+        XCTAssertEqual(data.length, (NSUInteger)(4096 + ((versionCount - 1) * 97) + file));
+        XCTAssertEqual(((const uint8_t *)data.bytes)[data.length - 1], (uint8_t)(versionCount - 1));
+        onDisk += (int64_t)data.length;
+    }
+    XCTAssertEqual(reportedGrowth, onDisk);
+    
+    [[NSFileManager defaultManager] removeItemAtPath:directory error:NULL];
+}
+
+- (void)testThumbCodec
+{
+    CGImageRef imageRef = [self newBenchmarkThumb];
+    CFDataRef pixels = CGDataProviderCopyData(CGImageGetDataProvider(imageRef));
+    size_t pixelLength = CGImageGetBytesPerRow(imageRef) * CGImageGetHeight(imageRef);
+    
+    //Decode into the same buffer every time, like the display path.
+    void *buffer = malloc(pixelLength);
+    [self benchmark:@"ThumbCodec" block:^{
+        for (NSInteger iteration = 0; iteration < 20; iteration++) {
+            NSData *thumbData = PDFKThumbCodecEncodeImage(imageRef, YES);
+            XCTAssertNotNil(thumbData);
+            XCTAssertTrue(PDFKThumbCodecDecode(thumbData, buffer, pixelLength));
+        }
+    }];
+    
+    //The pixels survive the round trip, and are smaller on disk.
+    NSData *thumbData = PDFKThumbCodecEncodeImage(imageRef, YES);
+    PDFKThumbCodecInfo info;
+    XCTAssertTrue(PDFKThumbCodecGetInfo(thumbData, &info));
+    XCTAssertEqual(info.width, CGImageGetWidth(imageRef));
+    XCTAssertEqual(info.height, CGImageGetHeight(imageRef));
+    XCTAssertTrue(info.compressed);
+    XCTAssertTrue(thumbData.length < pixelLength);
+    XCTAssertTrue(PDFKThumbCodecDecode(thumbData, buffer, pixelLength));
+    XCTAssertEqual(memcmp(buffer, CFDataGetBytePtr(pixels), pixelLength), 0);
+    
+    //Damaged files are rejected, not decoded out of bounds.
+    NSData *truncated = [thumbData subdataWithRange:NSMakeRange(0, thumbData.length - 1)];
+    XCTAssertFalse(PDFKThumbCodecDecode(truncated, buffer, pixelLength));
+    XCTAssertTrue(PDFKThumbCodecCreateImage(truncated) == NULL);
+    
+    free(buffer);
+    CFRelease(pixels);
+    CGImageRelease(imageRef);
+}
+
+- (void)testThumbCodecFileIO
+{
+    CGImageRef imageRef = [self newBenchmarkThumb];
+    
+    //The same work as testThumbFileIO, in the thumb file format.
+    NSURL *thumbURL = [NSURL fileURLWithPath:[NSTemporaryDirectory() stringByAppendingPathComponent:[@"PDFKBenchmarkThumb" stringByAppendingPathExtension:PDFKThumbCodecPathExtension]]];
+    [self benchmark:@"ThumbCodecFileIO" block:^{
+        for (NSInteger iteration = 0; iteration < 20; iteration++) {
+            XCTAssertTrue([PDFKThumbCodecEncodeImage(imageRef, YES) writeToURL:thumbURL atomically:NO]);
+            CGImageRef loadedRef = PDFKThumbCodecCreateImageWithURL(thumbURL);
+            XCTAssertTrue(loadedRef != NULL);
+            CGImageRelease(loadedRef);
+        }
+    }];
+    
+    CGImageRelease(imageRef);
+    [[NSFileManager defaultManager] removeItemAtURL:thumbURL error:NULL];
+}
+
+- (void)testThumbGridFill
+{
+    //A thumb file for each page of the grid
+    CGImageRef imageRef = [self newBenchmarkThumb];
+    NSData *thumbData = PDFKThumbCodecEncodeImage(imageRef, YES);
+    CGImageRelease(imageRef);
+    NSString *directory = [NSTemporaryDirectory() stringByAppendingPathComponent:@"PDFKBenchmarkGrid"];
+    [[NSFileManager defaultManager] createDirectoryAtPath:directory withIntermediateDirectories:YES attributes:nil error:NULL];
+    NSMutableArray *paths = [NSMutableArray new];
+    for (NSInteger page = 1; page <= GENERATED_PAGES; page++) {
+        NSString *path = [directory stringByAppendingPathComponent:[[NSString stringWithFormat:@"%07ld", (long)page] stringByAppendingPathExtension:PDFKThumbCodecPathExtension]];
+        XCTAssertTrue([thumbData writeToFile:path atomically:NO]);
+        [paths addObject:path];
+    }
+    
+    //Filling the grid one file after another, as the fetch queue did
+    [self benchmark:@"ThumbGridFillSerial" block:^{
+        for (NSString *path in paths) {
+            CGImageRef loadedRef = PDFKThumbCodecCreateImageWithURL([NSURL fileURLWithPath:path isDirectory:NO]);
+            XCTAssertTrue(loadedRef != NULL);
+            CGImageRelease(loadedRef);
+        }
+    }];
+    
+    //Filling the grid with batched reads, decoding on the I/O threads
+    PDFKThumbFileIO *fileIO = [PDFKThumbFileIO sharedFileIO];
+    __block volatile int32_t loaded = 0;
+    [self benchmark:@"ThumbGridFillBatched" block:^{
+        for (NSString *path in paths) {
+            [fileIO readFileAtPath:path priority:PDFKThumbFileIOPriorityVisible completion:^(NSData *data) {
+                CGImageRef loadedRef = (data != nil ? PDFKThumbCodecCreateImage(data) : NULL);
+                if (loadedRef != NULL) {
+                    OSAtomicIncrement32(&loaded);
+                }
+                CGImageRelease(loadedRef);
+            }];
+        }
+        [fileIO waitUntilIdle];
+    }];
+    XCTAssertEqual(loaded, (int32_t)((BENCHMARK_SAMPLES + 1) * paths.count));
+    
+    [[NSFileManager defaultManager] removeItemAtPath:directory error:NULL];
+}
+
++ (NSArray *)generatedSessionEvents
+{
+    //A fling down the thumbs grid and back, a scrubber drag across the document, and fast page swipes.
+    NSMutableArray *events = [NSMutableArray new];
+    NSTimeInterval time = 0.0;
+    for (NSInteger row = 0; row < (GENERATED_PAGES / 4); row++, time += 0.016) {
+        [events addObject:[[PDFKSessionEvent alloc] initWithType:PDFKSessionEventThumbsVisible time:time page:(row * 4) + 1 count:20]];
+    }
+    for (NSInteger row = (GENERATED_PAGES / 4) - 1; row >= 0; row -= 2, time += 0.05) {
+        [events addObject:[[PDFKSessionEvent alloc] initWithType:PDFKSessionEventThumbsVisible time:time page:(row * 4) + 1 count:20]];
+    }
+    time += 0.5;
+    for (NSInteger page = 1; page <= GENERATED_PAGES; page++, time += 0.03) {
+        [events addObject:[[PDFKSessionEvent alloc] initWithType:PDFKSessionEventScrub time:time page:page count:1]];
+    }
+    time += 0.5;
+    for (NSInteger page = 1; page <= 20; page++, time += (page % 5 == 0 ? 0.6 : 0.15)) {
+        [events addObject:[[PDFKSessionEvent alloc] initWithType:PDFKSessionEventPageDisplay time:time page:page count:1]];
+    }
+    return events;
+}
+
+- (void)testSessionReplay
+{
+    //A recorded session if one is given, otherwise a generated one. Sessions are replayed as they were recorded, once.
+    NSString *sessionPath = [[NSProcessInfo processInfo] environment][@"PDFK_BENCHMARK_SESSION"];
+    NSString *documentPath = [[NSProcessInfo processInfo] environment][@"PDFK_BENCHMARK_SESSION_DOCUMENT"];
+    NSArray *events = (sessionPath.length > 0 ? [PDFKSessionRecorder eventsWithSessionData:[NSData dataWithContentsOfFile:sessionPath]] : nil);
+    if (events == nil || documentPath.length == 0) {
+        events = [PDFKBenchmarkTests generatedSessionEvents];
+        documentPath = [PDFKBenchmarkTests generatedDocumentPath];
+    }
+    
+    //Sessions survive being written and read
+    NSArray *decoded = [PDFKSessionRecorder eventsWithSessionData:[PDFKSessionRecorder sessionDataWithEvents:events]];
+    XCTAssertEqual(decoded.count, events.count);
+    XCTAssertEqual(((PDFKSessionEvent *)decoded.lastObject).page, ((PDFKSessionEvent *)events.lastObject).page);
+    
+    //Start with no thumbs
+    PDFKDocument *document = [[PDFKDocument alloc] initWithContentsOfFile:documentPath password:nil];
+    [[PDFKThumbCache sharedCache] removeAllObjects];
+    [PDFKThumbCache removeThumbCacheWithGUID:document.fingerprint];
+    
+    XCTestExpectation *expectation = [self expectationWithDescription:@"Replay"];
+    __block NSDictionary *report = nil;
+    PDFKSessionReplayer *replayer = [[PDFKSessionReplayer alloc] initWithDocument:document events:decoded];
+    [replayer replayWithCompletion:^(NSDictionary *replayReport) {
+        report = replayReport;
+        [expectation fulfill];
+    }];
+    [self waitForExpectationsWithTimeout:120.0 handler:nil];
+    
+    XCTAssertEqual([report[@"Events"] unsignedIntegerValue], events.count);
+    XCTAssertTrue([report[@"TimeToFirstThumb"][@"Count"] unsignedIntegerValue] > 0);
+    XCTAssertTrue([report[@"TimeToSharpPage"][@"Count"] unsignedIntegerValue] > 0);
+    benchmarkResults[@"SessionReplay"] = report;
+    NSLog(@"SessionReplay: %@", report);
+}
+
+- (void)testScrubbingPreview
+{
+    //Start with no thumbs, so the previews come from the strip until the large thumbs are rendered
+    PDFKDocument *document = [[PDFKDocument alloc] initWithContentsOfFile:[PDFKBenchmarkTests generatedDocumentPath] password:nil];
+    [[PDFKThumbCache sharedCache] removeAllObjects];
+    [PDFKThumbCache removeThumbCacheWithGUID:document.fingerprint];
+    
+    PDFKPageScrubber *scrubber = [[PDFKPageScrubber alloc] initWithFrame:CGRectMake(0.0f, 0.0f, 320.0f, 44.0f) document:document];
+    [scrubber setNeedsLayout];
+    [scrubber layoutIfNeeded];
+    PDFKPageScrubberTrackControl *trackControl = [scrubber valueForKey:@"trackControl"];
+    XCTAssertNotNil(trackControl);
+    
+    //Wait for the strip
+    NSDate *deadline = [NSDate dateWithTimeIntervalSinceNow:10.0];
+    while ([scrubber valueForKey:@"stripImage"] == nil && [deadline timeIntervalSinceNow] > 0.0) {
+        [[NSRunLoop currentRunLoop] runUntilDate:[NSDate dateWithTimeIntervalSinceNow:0.01]];
+    }
+    XCTAssertNotNil([scrubber valueForKey:@"stripImage"]);
+    
+    //A drag across the track: a fast sweep to the middle, a pause, then a fast sweep to the end.
+    CGFloat width = trackControl.bounds.size.width;
+    NSInteger steps = 96;
+    [trackControl setValue:@(0.0f) forKey:@"value"];
+    [scrubber trackViewTouchDown:trackControl];
+    for (NSInteger step = 1; step <= steps; step++) {
+        [trackControl setValue:@(MIN(width - 1.0f, (width * step) / steps)) forKey:@"value"];
+        [scrubber trackViewValueChanged:trackControl];
+        NSTimeInterval interval = (step == (steps / 2) ? 0.5 : 0.008);
+        [[NSRunLoop currentRunLoop] runUntilDate:[NSDate dateWithTimeIntervalSinceNow:interval]];
+    }
+    [scrubber trackViewTouchUp:trackControl];
+    
+    //Every page change showed a preview at once, the pause and the end of the touch upgraded it.
+    NSDictionary *statistics = scrubber.scrubbingStatistics;
+    XCTAssertTrue([statistics[@"Previews"] unsignedIntegerValue] >= (NSUInteger)(GENERATED_PAGES / 2));
+    XCTAssertTrue([statistics[@"StripHits"] unsignedIntegerValue] > 0);
+    XCTAssertTrue([statistics[@"Upgrades"] unsignedIntegerValue] >= 2);
+    benchmarkResults[@"ScrubbingPreview"] = statistics;
+    NSLog(@"ScrubbingPreview: %@", statistics);
+    
+    [scrubber removeFromSuperview];
+}
+
++ (NSArray *)generatedReadingTrace
+{
+    //Three readings of the generated document: mostly page by page, looking up the glossary at the end every few pages and going back, and returning to the contents between chapters.
+    NSMutableArray *trace = [NSMutableArray array];
+    for (NSInteger reading = 0; reading < 3; reading++) {
+        for (NSInteger page = 3; page <= 40; page++) {
+            [trace addObject:@(page)];
+            if (page % 6 == 0) {
+                [trace addObject:@(GENERATED_PAGES - 2)];
+                [trace addObject:@(page)];
+            }
+            if (page % 10 == 0) {
+                [trace addObject:@(2)];
+            }
+        }
+    }
+    return trace;
+}
+
+- (void)testNavigationPrediction
+{
+    //The pages displayed in a recorded session if one is given, otherwise a generated reading
+    NSString *sessionPath = [[NSProcessInfo processInfo] environment][@"PDFK_BENCHMARK_SESSION"];
+    NSArray *events = (sessionPath.length > 0 ? [PDFKSessionRecorder eventsWithSessionData:[NSData dataWithContentsOfFile:sessionPath]] : nil);
+    NSMutableArray *trace = [NSMutableArray array];
+    for (PDFKSessionEvent *event in events) {
+        if (event.type == PDFKSessionEventPageDisplay && [trace.lastObject integerValue] != event.page) {
+            [trace addObject:@(event.page)];
+        }
+    }
+    if (trace.count < 2) {
+        trace = [[PDFKBenchmarkTests generatedReadingTrace] mutableCopy];
+    }
+    
+    //A move is ready if it goes to a page next to the current page, which are always loaded, or to one of the two predicted pages.
+    __block NSUInteger moves = 0;
+    __block NSUInteger neighbourHits = 0;
+    __block NSUInteger predictedHits = 0;
+    __block PDFKNavigationModel *model = nil;
+    [self benchmark:@"NavigationPrediction" block:^{
+        model = [PDFKNavigationModel new];
+        moves = 0;
+        neighbourHits = 0;
+        predictedHits = 0;
+        for (NSUInteger index = 1; index < trace.count; index++) {
+            NSUInteger fromPage = [trace[index - 1] unsignedIntegerValue];
+            NSUInteger toPage = [trace[index] unsignedIntegerValue];
+            BOOL neighbour = (toPage + 1 == fromPage || toPage == fromPage + 1);
+            BOOL predicted = neighbour;
+            NSUInteger predictedCount = 0;
+            for (NSNumber *page in [model predictedPagesAfterPage:fromPage linkTargets:nil count:4]) {
+                if (labs((long)page.unsignedIntegerValue - (long)fromPage) > 1 && predictedCount < 2) {
+                    predicted = (predicted || page.unsignedIntegerValue == toPage);
+                    predictedCount++;
+                }
+            }
+            moves++;
+            neighbourHits += (neighbour ? 1 : 0);
+            predictedHits += (predicted ? 1 : 0);
+            [model recordTransitionFromPage:fromPage toPage:toPage];
+        }
+    }];
+    XCTAssertTrue(moves > 0);
+    XCTAssertTrue(predictedHits >= neighbourHits);
+    
+    //The model survives being written and read
+    PDFKNavigationModel *decoded = [[PDFKNavigationModel alloc] initWithSerializedData:[model serializedData]];
+    XCTAssertNotNil(decoded);
+    XCTAssertEqualObjects([decoded serializedData], [model serializedData]);
+    XCTAssertEqualObjects([decoded predictedPagesAfterPage:[trace[1] unsignedIntegerValue] linkTargets:nil count:4], [model predictedPagesAfterPage:[trace[1] unsignedIntegerValue] linkTargets:nil count:4]);
+    XCTAssertNil([[PDFKNavigationModel alloc] initWithSerializedData:[NSData dataWithBytes:"PNM0" length:4]]);
+    
+    NSMutableDictionary *result = [benchmarkResults[@"NavigationPrediction"] mutableCopy];
+    result[@"Moves"] = @(moves);
+    result[@"NeighbourHitRate"] = @((double)neighbourHits / moves);
+    result[@"PredictedHitRate"] = @((double)predictedHits / moves);
+    result[@"SerializedBytes"] = @([model serializedData].length);
+    benchmarkResults[@"NavigationPrediction"] = result;
+    NSLog(@"NavigationPrediction: %@", result);
+}
+
+#pragma mark Page Sets
+
+/**
+ Change both the page set and the membership of each page in the same way. Single pages are added and removed, and ranges of pages are added so that chunks become bitmaps and runs.
+ */
+static void ChangePages(PDFKPageSet *pageSet, uint8_t *membership, unsigned int *seed)
+{
+    for (NSInteger operation = 0; operation < 400; operation++) {
+        NSUInteger page = 1 + (rand_r(seed) % (PAGE_SET_UNIVERSE - 1));
+        if (operation % 8 == 0) {
+            NSUInteger length = MIN((NSUInteger)(1 + (rand_r(seed) % 6000)), PAGE_SET_UNIVERSE - page);
+            [pageSet addIndexesInRange:NSMakeRange(page, length)];
+            memset(membership + page, 1, length);
+        } else if (operation % 5 == 0) {
+            [pageSet removeIndex:page];
+            membership[page] = 0;
+        } else {
+            [pageSet addIndex:page];
+            membership[page] = 1;
+        }
+    }
+}
+
+static NSUInteger SortedPages(const uint8_t *membership, NSUInteger *pages)
+{
+    NSUInteger count = 0;
+    for (NSUInteger page = 0; page < PAGE_SET_UNIVERSE; page++) {
+        if (membership[page]) {
+            pages[count++] = page;
+        }
+    }
+    return count;
+}
+
+static NSUInteger SortedUnion(const NSUInteger *a, NSUInteger countA, const NSUInteger *b, NSUInteger countB, NSUInteger *pages)
+{
+    NSUInteger i = 0, j = 0, count = 0;
+    while (i < countA || j < countB) {
+        if (j == countB || (i < countA && a[i] < b[j])) {
+            pages[count++] = a[i++];
+        } else if (i == countA || b[j] < a[i]) {
+            pages[count++] = b[j++];
+        } else {
+            pages[count++] = a[i++];
+            j++;
+        }
+    }
+    return count;
+}
+
+static NSUInteger SortedIntersection(const NSUInteger *a, NSUInteger countA, const NSUInteger *b, NSUInteger countB, NSUInteger *pages)
+{
+    NSUInteger i = 0, j = 0, count = 0;
+    while (i < countA && j < countB) {
+        if (a[i] < b[j]) {
+            i++;
+        } else if (b[j] < a[i]) {
+            j++;
+        } else {
+            pages[count++] = a[i++];
+            j++;
+        }
+    }
+    return count;
+}
+
+/**
+ Wether the pages of a decoded set are in ascending order and match its count.
+ */
+static BOOL PageSetIsConsistent(PDFKPageSet *pageSet)
+{
+    __block NSUInteger count = 0;
+    __block NSUInteger previous = NSNotFound;
+    __block BOOL ordered = YES;
+    [pageSet enumerateIndexesUsingBlock:^(NSUInteger idx, BOOL *stop) {
+        if (previous != NSNotFound && idx <= previous) {
+            ordered = NO;
+            *stop = YES;
+        }
+        previous = idx;
+        count++;
+    }];
+    return (ordered && count == pageSet.count);
+}
+
+/**
+ Check a page set against the sorted array of the pages it should contain.
+ */
+- (void)verifyPageSet:(PDFKPageSet *)pageSet pages:(const NSUInteger *)pages count:(NSUInteger)count
+{
+    XCTAssertEqual(pageSet.count, count);
+    XCTAssertEqual(pageSet.firstIndex, (count > 0 ? pages[0] : (NSUInteger)NSNotFound));
+    XCTAssertEqual(pageSet.lastIndex, (count > 0 ? pages[count - 1] : (NSUInteger)NSNotFound));
+    
+    __block NSUInteger position = 0;
+    __block BOOL matches = YES;
+    [pageSet enumerateIndexesUsingBlock:^(NSUInteger idx, BOOL *stop) {
+        if (position >= count || pages[position] != idx) {
+            matches = NO;
+            *stop = YES;
+        }
+        position++;
+    }];
+    XCTAssertTrue(matches && position == count);
+    
+    //Rank and select at the pages, and at the gaps before them
+    for (NSUInteger rank = 0; rank < count; rank += MAX(count / 512, (NSUInteger)1)) {
+        XCTAssertEqual([pageSet indexAtRank:rank], pages[rank]);
+        XCTAssertEqual([pageSet rankOfIndex:pages[rank]], rank + 1);
+        XCTAssertTrue([pageSet containsIndex:pages[rank]]);
+        if (pages[rank] > 0 && (rank == 0 || pages[rank - 1] + 1 < pages[rank])) {
+            XCTAssertFalse([pageSet containsIndex:pages[rank] - 1]);
+            XCTAssertEqual([pageSet rankOfIndex:pages[rank] - 1], rank);
+        }
+    }
+    XCTAssertEqual([pageSet indexAtRank:count], (NSUInteger)NSNotFound);
+    XCTAssertEqual([pageSet rankOfIndex:PAGE_SET_UNIVERSE], count);
+}
+
+- (void)testPageSet
+{
+    uint8_t *membershipA = malloc(PAGE_SET_UNIVERSE);
+    uint8_t *membershipB = malloc(PAGE_SET_UNIVERSE);
+    NSUInteger *pagesA = malloc(PAGE_SET_UNIVERSE * sizeof(NSUInteger));
+    NSUInteger *pagesB = malloc(PAGE_SET_UNIVERSE * sizeof(NSUInteger));
+    NSUInteger *expected = malloc(PAGE_SET_UNIVERSE * sizeof(NSUInteger));
+    unsigned int seed = 26;
+    
+    PDFKPageSet *a = nil;
+    PDFKPageSet *b = nil;
+    for (NSInteger round = 0; round < 8; round++) {
+        @autoreleasepool {
+            memset(membershipA, 0, PAGE_SET_UNIVERSE);
+            memset(membershipB, 0, PAGE_SET_UNIVERSE);
+            a = [PDFKPageSet pageSet];
+            b = [PDFKPageSet pageSet];
+            ChangePages(a, membershipA, &seed);
+            ChangePages(b, membershipB, &seed);
+            NSUInteger countA = SortedPages(membershipA, pagesA);
+            NSUInteger countB = SortedPages(membershipB, pagesB);
+            [self verifyPageSet:a pages:pagesA count:countA];
+            [self verifyPageSet:b pages:pagesB count:countB];
+            
+            //Union
+            PDFKPageSet *unionSet = [a copy];
+            [unionSet unionPageSet:b];
+            [self verifyPageSet:unionSet pages:expected count:SortedUnion(pagesA, countA, pagesB, countB, expected)];
+            
+            //Intersection, in place and into a new set
+            NSUInteger intersectionCount = SortedIntersection(pagesA, countA, pagesB, countB, expected);
+            PDFKPageSet *intersection = [a copy];
+            [intersection intersectPageSet:b];
+            [self verifyPageSet:intersection pages:expected count:intersectionCount];
+            [self verifyPageSet:[a pageSetByIntersectingWithPageSet:b] pages:expected count:intersectionCount];
+            
+            //The operands are not changed
+            [self verifyPageSet:a pages:pagesA count:countA];
+            [self verifyPageSet:b pages:pagesB count:countB];
+            
+            //Serialization round trip, directly and through an archive
+            for (PDFKPageSet *pageSet in @[a, b, unionSet, intersection, [PDFKPageSet pageSet]]) {
+                NSData *data = [pageSet serializedData];
+                PDFKPageSet *decoded = [[PDFKPageSet alloc] initWithSerializedData:data];
+                XCTAssertEqualObjects(decoded, pageSet);
+                XCTAssertEqualObjects([decoded serializedData], data);
+                XCTAssertEqualObjects([NSKeyedUnarchiver unarchiveObjectWithData:[NSKeyedArchiver archivedDataWithRootObject:pageSet]], pageSet);
+            }
+        }
+    }
+    
+    //Removing every page empties the set
+    PDFKPageSet *emptied = [a copy];
+    NSUInteger countA = SortedPages(membershipA, pagesA);
+    for (NSUInteger index = 0; index < countA; index++) {
+        [emptied removeIndex:pagesA[index]];
+    }
+    [self verifyPageSet:emptied pages:pagesA count:0];
+    XCTAssertEqualObjects(emptied, [PDFKPageSet pageSet]);
+    
+    [self benchmark:@"PageSetOperations" block:^{
+        for (NSInteger iteration = 0; iteration < 50; iteration++) {
+            PDFKPageSet *unionSet = [a copy];
+            [unionSet unionPageSet:b];
+            [unionSet intersectPageSet:a];
+            for (NSUInteger rank = 0; rank < unionSet.count; rank += 97) {
+                [unionSet rankOfIndex:[unionSet indexAtRank:rank]];
+            }
+        }
+    }];
+    
+    free(membershipA);
+    free(membershipB);
+    free(pagesA);
+    free(pagesB);
+    free(expected);
+}
+
+- (void)testPageSetCorruptData
+{
+    //An array chunk, a chunk of runs, and a bitmap chunk
+    PDFKPageSet *pageSet = [PDFKPageSet pageSet];
+    [pageSet addIndex:5];
+    [pageSet addIndexesInRange:NSMakeRange(70000, 6000)];
+    for (NSUInteger page = 131072; page < 146072; page += 3) {
+        [pageSet addIndex:page];
+    }
+    NSData *data = [pageSet serializedData];
+    XCTAssertEqualObjects([[PDFKPageSet alloc] initWithSerializedData:data], pageSet);
+    
+    //Every truncation is refused
+    NSUInteger acceptedTruncations = 0;
+    for (NSUInteger length = 0; length < data.length; length++) {
+        @autoreleasepool {
+            if ([[PDFKPageSet alloc] initWithSerializedData:[data subdataWithRange:NSMakeRange(0, length)]] != nil) {
+                acceptedTruncations++;
+            }
+        }
+    }
+    XCTAssertEqual(acceptedTruncations, (NSUInteger)0);
+    
+    //The header is 12 bytes, then the array chunk (8 byte header, one page), the chunk of runs (8 byte header, run count, one run), and the bitmap chunk.
+    NSDictionary *corruptions = @{@"Magic": @[@0, @0x00],
+                                  @"Version": @[@4, @2],
+                                  @"ChunkType": @[@14, @7],
+                                  @"EmptyChunk": @[@16, @0],
+                                  @"RepeatedKey": @[@22, @0],
+                                  @"RunsCardinality": @[@26, @0xFF],
+                                  @"BitmapCardinality": @[@42, @0x00]};
+    for (NSString *name in corruptions) {
+        NSMutableData *corrupt = [data mutableCopy];
+        ((uint8_t *)corrupt.mutableBytes)[[corruptions[name][0] unsignedIntegerValue]] = [corruptions[name][1] unsignedCharValue];
+        XCTAssertNil([[PDFKPageSet alloc] initWithSerializedData:corrupt], @"%@", name);
+    }
+    
+    //Random damage either is refused, or decodes to a well formed set
+    unsigned int seed = 26;
+    NSUInteger refused = 0;
+    NSUInteger malformed = 0;
+    for (NSInteger iteration = 0; iteration < 2000; iteration++) {
+        @autoreleasepool {
+            NSMutableData *corrupt = [data mutableCopy];
+            for (NSInteger flip = 0; flip < 1 + (iteration % 4); flip++) {
+                ((uint8_t *)corrupt.mutableBytes)[rand_r(&seed) % corrupt.length] ^= (uint8_t)(1 << (rand_r(&seed) % 8));
+            }
+            PDFKPageSet *decoded = [[PDFKPageSet alloc] initWithSerializedData:corrupt];
+            if (decoded == nil) {
+                refused++;
+            } else if (PageSetIsConsistent(decoded) == NO) {
+                malformed++;
+            }
+        }
+    }
+    XCTAssertEqual(malformed, (NSUInteger)0);
+    XCTAssertTrue(refused > 0);
+}
+
+- (void)testResourceGovernorStress
+{
+    PDFKResourceGovernor *governor = [PDFKResourceGovernor sharedGovernor];
+    NSArray *priorities = @[@(PDFKResourcePriorityHigh), @(PDFKResourcePriorityNormal), @(PDFKResourcePriorityLow)];
+    
+    //Consumers are asked in priority order, and the visible resources are kept until the pressure is critical
+    NSMutableArray *shedOrder = [NSMutableArray array];
+    NSMutableArray *ordered = [NSMutableArray array];
+    for (NSNumber *priority in priorities) {
+        PDFKBenchmarkConsumer *consumer = [PDFKBenchmarkConsumer new];
+        consumer->bytes = 1048576;
+        consumer.shedBlock = ^(PDFKBenchmarkConsumer *shedConsumer) {
+            [shedOrder addObject:shedConsumer];
+        };
+        [governor registerConsumer:consumer category:PDFKResourceCategoryDisplayLists priority:priority.integerValue];
+        [ordered addObject:consumer];
+    }
+    [governor shedResourcesForPressure:PDFKResourcePressureWarning];
+    XCTAssertEqualObjects(shedOrder, (@[ordered[2], ordered[1]]));
+    XCTAssertEqual([ordered[0] resourceBytes], (NSUInteger)1048576);
+    [governor shedResourcesForPressure:PDFKResourcePressureCritical];
+    XCTAssertEqual(shedOrder.lastObject, ordered[0]);
+    XCTAssertEqual([ordered[0] resourceBytes], (NSUInteger)0);
+    for (PDFKBenchmarkConsumer *consumer in ordered) {
+        [governor unregisterConsumer:consumer];
+        consumer.shedBlock = nil;
+    }
+    
+    //Consumers are registered, unregistered, deallocated and grow on several threads, while the main thread sheds and reads the breakdown.
+    NSMutableArray *survivors = [NSMutableArray array];
+    dispatch_group_t group = dispatch_group_create();
+    for (NSInteger thread = 0; thread < 8; thread++) {
+        dispatch_group_async(group, dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_DEFAULT, 0), ^{
+            unsigned int seed = (unsigned int)thread + 1;
+            NSMutableArray *live = [NSMutableArray array];
+            for (NSInteger iteration = 0; iteration < 5000; iteration++) {
+                @autoreleasepool {
+                    NSUInteger action = rand_r(&seed) % 4;
+                    NSUInteger index = (live.count > 0 ? rand_r(&seed) % live.count : 0);
+                    if (action == 0 || live.count == 0) {
+                        PDFKBenchmarkConsumer *consumer = [PDFKBenchmarkConsumer new];
+                        consumer->bytes = 1 + (rand_r(&seed) % 65536);
+                        PDFKResourceCategory category = ((rand_r(&seed) % 2) ? PDFKResourceCategoryDisplayLists : PDFKResourceCategoryImages);
+                        [governor registerConsumer:consumer category:category priority:[priorities[rand_r(&seed) % priorities.count] integerValue]];
+                        [live addObject:consumer];
+                    } else if (action == 1) {
+                        [governor unregisterConsumer:live[index]];
+                        [live removeObjectAtIndex:index];
+                    } else if (action == 2) {
+                        //Deallocated while it is registered
+                        [live removeObjectAtIndex:index];
+                    } else {
+                        OSAtomicAdd64Barrier(4096, &((PDFKBenchmarkConsumer *)live[index])->bytes);
+                    }
+                }
+            }
+            @synchronized(survivors) {
+                [survivors addObjectsFromArray:live];
+            }
+        });
+    }
+    NSUInteger sheds = 0;
+    while (dispatch_group_wait(group, DISPATCH_TIME_NOW) != 0) {
+        @autoreleasepool {
+            [governor shedResourcesForPressure:((sheds % 2) ? PDFKResourcePressureCritical : PDFKResourcePressureWarning)];
+            [governor memoryBreakdown];
+            sheds++;
+        }
+    }
+    
+    //The survivors are still tracked. Their bytes are in the breakdown, and a critical shed releases them all.
+    unsigned long long survivorBytes = 0;
+    for (PDFKBenchmarkConsumer *consumer in survivors) {
+        survivorBytes += [consumer resourceBytes];
+    }
+    NSDictionary *breakdown = [governor memoryBreakdown];
+    XCTAssertTrue([breakdown[@"DisplayLists"] unsignedLongLongValue] + [breakdown[@"Images"] unsignedLongLongValue] >= survivorBytes);
+    [self benchmark:@"ResourceGovernorBreakdown" block:^{
+        for (NSInteger iteration = 0; iteration < 100; iteration++) {
+            [governor memoryBreakdown];
+        }
+    }];
+    [governor shedResourcesForPressure:PDFKResourcePressureCritical];
+    NSUInteger unreleased = 0;
+    for (PDFKBenchmarkConsumer *consumer in survivors) {
+        unreleased += ([consumer resourceBytes] > 0 ? 1 : 0);
+        [governor unregisterConsumer:consumer];
+    }
+    XCTAssertEqual(unreleased, (NSUInteger)0);
+    [governor shedResourcesForPressure:PDFKResourcePressureNormal];
+    
+    NSMutableDictionary *result = [benchmarkResults[@"ResourceGovernorBreakdown"] mutableCopy];
+    result[@"Sheds"] = @(sheds);
+    result[@"Survivors"] = @(survivors.count);
+    benchmarkResults[@"ResourceGovernorBreakdown"] = result;
+    NSLog(@"ResourceGovernorStress: %@", result);
+}
+
+- (void)testTraceOverhead
+{
+    BOOL wasEnabled = PDFKTraceIsEnabled();
+    
+    //Time a stage on several threads, as the queues do. The work between the calls is trivial, so the calls are what is measured.
+    void (^timeStages)(void) = ^{
+        dispatch_apply(4, dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_DEFAULT, 0), ^(size_t thread) {
+            volatile uint64_t sink = 0;
+            for (NSInteger index = 0; index < TRACE_EVENTS; index++) {
+                uint64_t traceStart = PDFKTraceBegin();
+                sink += ((uint64_t)index * thread);
+                PDFKTraceEnd(PDFKTraceStageDecode, traceStart, index);
+            }
+        });
+    };
+    
+    [PDFKTrace reset];
+    PDFKTraceSetEnabled(NO);
+    [self benchmark:@"TraceDisabled" block:timeStages];
+    XCTAssertEqual([[PDFKTrace countersSnapshot][@"Stages"][@"Decode"][@"Count"] unsignedLongLongValue], 0ULL);
+    
+    PDFKTraceSetEnabled(YES);
+    [self benchmark:@"TraceEnabled" block:timeStages];
+    XCTAssertTrue([[PDFKTrace countersSnapshot][@"Stages"][@"Decode"][@"Count"] unsignedLongLongValue] >= (unsigned long long)(BENCHMARK_SAMPLES + 1) * 4 * TRACE_EVENTS);
+    PDFKTraceSetEnabled(wasEnabled);
+    [PDFKTrace reset];
+    
+    //The cost of each timed stage
+    double events = 4.0 * TRACE_EVENTS;
+    double disabled = [benchmarkResults[@"TraceDisabled"][@"median"] doubleValue];
+    double enabled = [benchmarkResults[@"TraceEnabled"][@"median"] doubleValue];
+    XCTAssertTrue(disabled <= enabled);
+    NSMutableDictionary *result = [benchmarkResults[@"TraceEnabled"] mutableCopy];
+    result[@"DisabledNanosecondsPerStage"] = @(disabled * 1.0e9 / events);
+    result[@"EnabledNanosecondsPerStage"] = @(enabled * 1.0e9 / events);
+    result[@"OverheadNanosecondsPerStage"] = @((enabled - disabled) * 1.0e9 / events);
+    benchmarkResults[@"TraceEnabled"] = result;
+    NSLog(@"TraceOverhead: %@", result);
+}
+
+- (void)testPixelBufferPool
+{
+    PDFKPixelBufferPool *pool = [PDFKPixelBufferPool sharedPool];
+    [pool resetStatistics];
+    NSInteger outstanding = [[pool statistics][@"OutstandingBuffers"] integerValue];
+    
+    //Thumb and strip sized buffers, allocated on the worker threads and released elsewhere, as the images are.
+    NSArray *lengths = @[@(576 * 744 * 4), @(864 * 1116 * 4), @(1536 * 96 * 4)];
+    [self benchmark:@"PixelBufferAllocation" block:^{
+        dispatch_apply(4, dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_DEFAULT, 0), ^(size_t thread) {
+            for (NSInteger iteration = 0; iteration < 250; iteration++) {
+                size_t length = [lengths[(thread + iteration) % lengths.count] unsignedIntegerValue];
+                void *buffer = PDFKPixelBufferAllocate(length);
+                XCTAssertTrue(buffer != NULL);
+                XCTAssertEqual((uintptr_t)buffer % 64, (uintptr_t)0);
+                //Touch each page, like drawing would
+                for (size_t offset = 0; offset < length; offset += 4096) {
+                    ((uint8_t *)buffer)[offset] = 1;
+                }
+                PDFKPixelBufferRelease(buffer);
+            }
+        });
+    }];
+    
+    //Every buffer was returned, and buffers were reused.
+    NSDictionary *statistics = [pool statistics];
+    XCTAssertEqual([statistics[@"OutstandingBuffers"] integerValue], outstanding);
+    XCTAssertTrue([statistics[@"Reuses"] integerValue] > 0);
+    XCTAssertTrue([statistics[@"SystemAllocations"] integerValue] < [statistics[@"Allocations"] integerValue]);
+    
+    //The buffers kept by the idle worker threads are freed too
+    [pool removeAllCachedBuffers];
+    XCTAssertEqual([[pool statistics][@"CachedBytes"] integerValue], (NSInteger)0);
+}
+
+@end